@@ -16,6 +16,24 @@ Dir::~Dir() {}
 
 IOClient::~IOClient() {}
 
+Status IOClient::NewFiles(const std::string& dir,
+                          const std::vector<std::string>& names) {
+  Status s;
+  for (size_t i = 0; s.ok() && i < names.size(); i++) {
+    s = NewFile(dir + "/" + names[i]);
+  }
+  return s;
+}
+
+Status IOClient::GetAttrs(const std::string& dir,
+                          const std::vector<std::string>& names) {
+  Status s;
+  for (size_t i = 0; s.ok() && i < names.size(); i++) {
+    s = GetAttr(dir + "/" + names[i]);
+  }
+  return s;
+}
+
 IOClient* IOClient::Factory(const IOClientOptions& raw_options) {
   IOClientOptions options = raw_options;
   if (options.argc >= 3) {
@@ -11,6 +11,9 @@
 
 #include "pdlfs-common/status.h"
 
+#include <string>
+#include <vector>
+
 namespace pdlfs {
 namespace ioclient {
 
@@ -58,6 +61,13 @@ class IOClient {
   virtual Status CloseDir(Dir* dir) = 0;
   virtual Status MakeDir(const std::string& path) = 0;
 
+  // Bulk FS operations against files under a common parent directory.
+  // The default implementation issues one operation per file.
+  virtual Status NewFiles(const std::string& dir,
+                          const std::vector<std::string>& names);
+  virtual Status GetAttrs(const std::string& dir,
+                          const std::vector<std::string>& names);
+
  private:
   // No copying allowed
   void operator=(const IOClient&);
@@ -75,6 +75,10 @@ class DeltafsClient : public IOClient {
   virtual Status DelFile(const std::string& path);
   virtual Status MakeDir(const std::string& path);
   virtual Status GetAttr(const std::string& path);
+  virtual Status NewFiles(const std::string& dir,
+                          const std::vector<std::string>& names);
+  virtual Status GetAttrs(const std::string& dir,
+                          const std::vector<std::string>& names);
   virtual Status OpenDir(const std::string& path, Dir**);
   virtual Status FlushEpoch(Dir* dir);
   virtual Status CloseDir(Dir* dir);
@@ -179,6 +183,65 @@ Status DeltafsClient::GetAttr(const std::string& path) {
   return s;
 }
 
+// Return an error if any of the files failed.
+static Status BulkError(const std::string& dir,
+                        const std::vector<std::string>& names,
+                        const std::vector<int>& errs, int r) {
+  if (r == -1) {
+    return IOError(dir);
+  } else if (static_cast<size_t>(r) != names.size()) {
+    for (size_t i = 0; i < errs.size(); i++) {
+      if (errs[i] != 0) {
+        errno = errs[i];
+        return IOError(dir + "/" + names[i]);
+      }
+    }
+  }
+  return Status::OK();
+}
+
+Status DeltafsClient::NewFiles(const std::string& dir,
+                               const std::vector<std::string>& names) {
+  const char* p = dir.c_str();
+#if VERBOSE >= 10
+  if (kVVerbose) printf("deltafs_mkfiles %s (%zu)...\n", p, names.size());
+#endif
+  std::vector<const char*> n(names.size());
+  for (size_t i = 0; i < names.size(); i++) {
+    n[i] = names[i].c_str();
+  }
+  std::vector<int> errs(names.size(), 0);
+  int r = deltafs_mkfiles(p, n.empty() ? NULL : &n[0], n.size(), IO_FILEPERMS,
+                          errs.empty() ? NULL : &errs[0]);
+  Status s = BulkError(dir, names, errs, r);
+#if VERBOSE >= 10
+  if (kVVerbose) print(s);
+#endif
+  return s;
+}
+
+Status DeltafsClient::GetAttrs(const std::string& dir,
+                               const std::vector<std::string>& names) {
+  const char* p = dir.c_str();
+#if VERBOSE >= 10
+  if (kVVerbose) printf("deltafs_getattrs %s (%zu)...\n", p, names.size());
+#endif
+  std::vector<const char*> n(names.size());
+  for (size_t i = 0; i < names.size(); i++) {
+    n[i] = names[i].c_str();
+  }
+  std::vector<struct stat> statbufs(names.size());
+  std::vector<int> errs(names.size(), 0);
+  int r = deltafs_getattrs(p, n.empty() ? NULL : &n[0], n.size(),
+                           statbufs.empty() ? NULL : &statbufs[0],
+                           errs.empty() ? NULL : &errs[0]);
+  Status s = BulkError(dir, names, errs, r);
+#if VERBOSE >= 10
+  if (kVVerbose) print(s);
+#endif
+  return s;
+}
+
 Status DeltafsClient::OpenDir(const std::string& path, Dir** dirptr) {
   const char* p = path.c_str();
 #if VERBOSE >= 10
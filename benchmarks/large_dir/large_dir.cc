@@ -11,6 +11,8 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <map>
+#include <string>
 #include <vector>
 
 #include "pdlfs-common/coding.h"
@@ -27,6 +29,9 @@ struct LDbenchOptions : public ioclient::IOClientOptions {
   int num_dirs;
   // Total number of empty files to create (among all clients)
   int num_files;
+  // Number of files under a same directory to create or check with
+  // a single bulk operation. Bulk operations are not used if set to 1.
+  int batch_size;
   // True if clients are running in relaxed consistency mode (deltafs only)
   bool relaxed_consistency;
   // Continue running even if we get errors.
@@ -108,6 +113,68 @@ class LDbench {  // LD stands for large directory
     }
   }
 
+  // Files pending bulk insertion or checking, grouped by parent directory
+  typedef std::map<int, std::vector<std::string> > Batches;
+
+  static void AddToBatch(Batches* batches, int dir_no, int f) {
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "f_%d", f);
+    (*batches)[dir_no].push_back(tmp);
+  }
+
+  // Send all files of a directory with a single bulk operation and update
+  // the report accordingly.
+  void FlushBatch(Batches::iterator it, bool insert, LDbenchReport* report) {
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "/d_%d", it->first);
+    std::vector<std::string>* const names = &it->second;
+    Status s =
+        insert ? io_->NewFiles(tmp, *names) : io_->GetAttrs(tmp, *names);
+    if (s.ok() || options_.ignore_errors) {
+      report->ops += names->size();
+    } else {
+      report->errors++;
+    }
+    names->clear();
+  }
+
+  // Flush all non-empty batches until an error occurs.
+  void FlushAll(Batches* batches, bool insert, LDbenchReport* report) {
+    Batches::iterator it = batches->begin();
+    for (; it != batches->end() && report->errors == 0; ++it) {
+      if (!it->second.empty()) {
+        FlushBatch(it, insert, report);
+      }
+    }
+  }
+
+  // Insert or check files using bulk operations.
+  LDbenchReport RunBatches(bool insert) {
+    double start = MPI_Wtime();
+    LDbenchReport report;
+    report.errors = 0;
+    report.ops = 0;
+    Batches batches;
+    for (int f = options_.rank; f < options_.num_files;) {
+      int dir_no = Dir(f) % options_.num_dirs;
+      AddToBatch(&batches, dir_no, f);
+      f += options_.comm_sz;
+      Batches::iterator it = batches.find(dir_no);
+      if (it->second.size() >= static_cast<size_t>(options_.batch_size)) {
+        FlushBatch(it, insert, &report);
+        if (report.errors != 0) {
+          break;
+        }
+      }
+    }
+    if (report.errors == 0) {
+      FlushAll(&batches, insert, &report);
+    }
+
+    report.duration = MPI_Wtime() - start;
+    return report;
+  }
+
   static uint32_t Dir(uint32_t file_no) {
     char tmp[4];
     EncodeFixed32(tmp, file_no);
@@ -153,6 +220,9 @@ class LDbench {  // LD stands for large directory
   // Collectively create files under parent directories.
   // Return a status report with local timing and error counts.
   LDbenchReport BulkCreates() {
+    if (!options_.skip_inserts && options_.batch_size > 1) {
+      return RunBatches(true);
+    }
     double start = MPI_Wtime();
     LDbenchReport report;
     report.errors = 0;
@@ -179,6 +249,9 @@ class LDbench {  // LD stands for large directory
   // Collectively touch all created files.
   // Return a status report with local timing and error counts.
   LDbenchReport Touch() {
+    if (!options_.skip_reads && options_.batch_size > 1) {
+      return RunBatches(false);
+    }
     double start = MPI_Wtime();
     LDbenchReport report;
     report.errors = 0;
@@ -274,7 +347,9 @@ static void Help(const char* prog, FILE* out) {
           "  --num-files=n          :  "
           "Total number of files to create\n"
           "  --num-dirs=n           :  "
-          "Total number of dirs to create\n\n"
+          "Total number of dirs to create\n"
+          "  --batch-size=n         :  "
+          "Create and check files in batches of n\n\n"
           "Deltafs benchmark\n",
           prog);
 }
@@ -290,6 +365,7 @@ static pdlfs::LDbenchOptions ParseOptions(int argc, char** argv) {
   result.skip_deletes = false;
   result.num_files = 16;
   result.num_dirs = 1;
+  result.batch_size = 1;
   result.argv = NULL;
   result.argc = 0;
 
@@ -302,6 +378,7 @@ static pdlfs::LDbenchOptions ParseOptions(int argc, char** argv) {
     optinfo.push_back({"skip-deletes", 0, NULL, 'd'});
     optinfo.push_back({"num-files", 1, NULL, 'n'});
     optinfo.push_back({"num-dirs", 1, NULL, 'm'});
+    optinfo.push_back({"batch-size", 1, NULL, 'b'});
     optinfo.push_back({"help", 0, NULL, 'H'});
     optinfo.push_back({NULL, 0, NULL, 0});
 
@@ -331,6 +408,9 @@ static pdlfs::LDbenchOptions ParseOptions(int argc, char** argv) {
           case 'm':
             result.num_dirs = atoi(optarg);
             break;
+          case 'b':
+            result.batch_size = atoi(optarg);
+            break;
           case 'H':
           case 'h':
             Help(argv[0], stdout);
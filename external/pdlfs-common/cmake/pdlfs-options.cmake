@@ -31,6 +31,7 @@ include (xpkg-import)
 #   -DPDLFS_RADOS=ON                       -- compile in RADOS env
 #     - RADOS_INCLUDE_DIR: optional hint for finding rado/librados.h
 #     - RADOS_LIBRARY_DIR: optional hint for finding rados lib
+#   -DPDLFS_SOCKET_RPC=ON                  -- compile in socket rpc (linux only)
 #   -DPDLFS_SNAPPY=ON                      -- compile in snappy compression
 #     - SNAPPY_INCLUDE_DIR: optional hint for finding snappy.h
 #     - SNAPPY_LIBRARY_DIR: optional hint for finding snappy lib
@@ -110,6 +111,14 @@ set (PDLFS_RADOS "OFF" CACHE
      BOOL "Include RADOS object store")
 set (PDLFS_SNAPPY "OFF" CACHE
      BOOL "Include (libsnappy-dev) for compression")
+# the socket rpc needs epoll so it defaults to ON only on linux
+if (${PDLFS_TARGET_OS} STREQUAL "Linux")
+    set (PDLFS_SOCKET_RPC_DEFAULT "ON")
+else ()
+    set (PDLFS_SOCKET_RPC_DEFAULT "OFF")
+endif ()
+set (PDLFS_SOCKET_RPC ${PDLFS_SOCKET_RPC_DEFAULT} CACHE
+     BOOL "Include built-in TCP/UDP socket RPC interface")
 
 #
 # now start pulling the parts in.  currently we set find_package to
@@ -150,6 +159,10 @@ if (PDLFS_RADOS)
     message (STATUS "Enabled RADOS - PDLFS_RADOS=ON")
 endif ()
 
+if (PDLFS_SOCKET_RPC)
+    message (STATUS "Enabled socket rpc - PDLFS_SOCKET_RPC=ON")
+endif ()
+
 if (PDLFS_SNAPPY)
     find_package(Snappy MODULE REQUIRED)
     list (APPEND PDLFS_COMPONENT_CFG "Snappy")
@@ -12,23 +12,42 @@
 #include "pdlfs-common/env.h"
 #include "pdlfs-common/fio.h"
 #include "pdlfs-common/leveldb/db/db.h"
+#include "pdlfs-common/leveldb/db/write_batch.h"
+#include "pdlfs-common/port.h"
 #include "pdlfs-common/status.h"
 
 namespace pdlfs {
 
 // Each file is regarded as a stream of variable-size data blocks with
 // each block having an offset, a size, and an extent of file data.
+// Block writes are buffered in memory and committed to the db as a single
+// write batch, along with an updated stream header when the stream is
+// flushed. Different streams never contend with each other.
 struct Stream : public Fio::Handle {
-  Stream() {}
+  Stream()
+      : iter(NULL),
+        nwrites(0),
+        ncommits(0),
+        nflus(0),
+        batch(&batches[0]),
+        buffered(0) {}
+  port::Mutex mu;         // Protects all states below
+  port::Mutex commit_mu;  // Serializes commits to the db
   uint64_t mtime;
   uint64_t size;
   uint64_t off;  // Current read/write position
 
-  Iterator* iter;   // Cursor to the current data block
-  int32_t nwrites;  // Number of block writes
-  int32_t nflus;    // Number of writes committed to the header
-};
+  Iterator* iter;    // Cursor to the current data block
+  int32_t nwrites;   // Number of block writes
+  int32_t ncommits;  // Number of block writes committed to the db
+  int32_t nflus;     // Number of writes committed to the header
 
+  // Block writes not yet committed. One of the two batches is being
+  // filled while the other one may be being committed.
+  WriteBatch batches[2];
+  WriteBatch* batch;
+  size_t buffered;  // Total size of the blocks in *batch
+};
 struct StreamHeader {
   StreamHeader() {}
   bool DecodeFrom(Slice* input);
@@ -42,6 +61,12 @@ struct BlkDBOptions {
   int uniquefier;
   bool sync;
   bool verify_checksum;
+  // Commit the block writes of a stream to the db once they amount to this
+  // many bytes, even if the stream has not been flushed. Set to "0" to
+  // commit each write immediately. Ignored when "sync" is true, in which
+  // case each write is committed and synced before it returns.
+  // Default: 128KB
+  size_t write_buffer_size;
   bool owns_db;
   DB* db;
 };
@@ -53,6 +78,9 @@ class BlkDB : public Fio {
   Status ReadFrom(Stream*, const Fentry& fentry, Slice* result, uint64_t off,
                   uint64_t size, char* scratch);
 
+  Status Commit(Stream*, const Fentry& fentry, bool update_header,
+                bool force_sync);
+
   static const KeyType kHeaderType = kDataDesType;
 
  public:
@@ -84,12 +112,12 @@ class BlkDB : public Fio {
   // No copying allowed
   void operator=(const BlkDB&);
   BlkDB(const BlkDB&);
-  port::Mutex mutex_;
 
   // Constant after construction
   int uniquefier_;
   bool sync_;
   bool verify_checksum_;
+  size_t write_buffer_size_;
   bool owns_db_;
   DB* db_;
 };
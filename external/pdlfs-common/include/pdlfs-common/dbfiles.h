@@ -27,10 +27,11 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kValueLogFile
 };
 
-static const int kMaxFileType = kInfoLogFile;
+static const int kMaxFileType = kValueLogFile;
 
 // Return the string name of file type.
 extern const char* NameOfType(FileType type);
@@ -50,6 +51,12 @@ extern std::string TableFileName(const std::string& dbname, uint64_t number);
 // "dbname".
 extern std::string SSTTableFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the value log with the specified number
+// in the db named by "dbname".  The result will be prefixed with
+// "dbname".
+extern std::string ValueLogFileName(const std::string& dbname,
+                                    uint64_t number);
+
 // Return the name of the descriptor file for the db named by
 // "dbname" and the specified incarnation number.  The result will be
 // prefixed with "dbname".
@@ -15,6 +15,8 @@
 #include "pdlfs-common/mdb.h"
 #include "pdlfs-common/port.h"
 
+#include <deque>
+
 namespace pdlfs {
 
 class DirTable;
@@ -38,8 +40,15 @@ struct Dir {
 
 #if defined(DELTAFS)
   uint64_t seq;  // Incremented whenever a sub-directory's lookup state changes
+  mutable uint64_t neg_due;  // Latest due of the negative leases issued below
+  int split_size;  // No split is attempted while size is at or below this
+  // Odd while a split is moving entries out. Incremented again when that
+  // split ends. No lease is issued by reads that overlap with a split.
+  uint64_t split_seq;
   port::AtomicPointer tx;  // Either NULL or an on-going write transaction
   class Tx;
+  struct Writer;
+  std::deque<Writer*> writers;  // Mutations waiting to be group committed
 #endif
   port::CondVar cv;
   DirIndex index;  // GIGA+ index
@@ -216,6 +216,17 @@ class SequentialFile {
   void operator=(const SequentialFile&);
 };
 
+// A single read request issued as part of a batch.
+struct ReadRequest {
+  ReadRequest() : offset(0), n(0), scratch(NULL) {}
+  uint64_t offset;
+  size_t n;
+  char* scratch;  // Must hold at least "n" bytes
+  // Set by the implementation
+  Slice result;
+  Status status;
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class RandomAccessFile {
  public:
@@ -234,6 +245,14 @@ class RandomAccessFile {
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
 
+  // Perform a batch of "n" reads. The result and the status of each read are
+  // stored in the corresponding request. Implementations able to keep
+  // multiple reads in flight should override this method. The default
+  // implementation issues the reads one after another.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void MultiRead(ReadRequest* reqs, size_t n) const;
+
  private:
   // No copying allowed
   RandomAccessFile(const RandomAccessFile&);
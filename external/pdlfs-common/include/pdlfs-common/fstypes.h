@@ -96,6 +96,12 @@ class Stat {
   bool DecodeFrom(const Slice& encoding);
   bool DecodeFrom(Slice* input);
 
+  // A fixed-width encoding that copies the in-memory representation as is.
+  // Cheaper to produce and parse than the varint-based encoding above.
+  enum { kFixedEncodedLength = 64 };
+  void EncodeFixedTo(char* dst) const;
+  void DecodeFixedFrom(const char* src);
+
   Stat() {
 #ifndef NDEBUG
     memset(this, 0, sizeof(*this));
@@ -235,6 +241,11 @@ class LookupStat {
   bool DecodeFrom(const Slice& encoding);
   bool DecodeFrom(Slice* input);
 
+  // A fixed-width encoding that copies the in-memory representation as is.
+  enum { kFixedEncodedLength = 48 };
+  void EncodeFixedTo(char* dst) const;
+  void DecodeFixedFrom(const char* src);
+
   LookupStat() {
 #ifndef NDEBUG
     memset(this, 0, sizeof(*this));
@@ -10,6 +10,7 @@
  */
 
 #include <stdint.h>
+#include <string>
 #include <utility>
 
 #include "pdlfs-common/slice.h"
@@ -101,6 +102,12 @@ class DirIndex {
   // Return the next child partition for the given parent partition.
   int NewIndexForSplitting(int index) const;
 
+  // Store in [*lower, *upper) the range of hashes that includes all files of
+  // the given partition until its next split. Files of other partitions may
+  // also fall in this range. *upper is cleared when the range extends to
+  // the end of the hash space. The partition must be splittable.
+  void GetSplitRange(int index, std::string* lower, std::string* upper) const;
+
   // Return the zeroth server of the directory being indexed.
   int ZerothServer() const;
 
@@ -35,10 +35,19 @@ class IndexCache {
   Handle* Insert(const DirId& id, DirIndex* index);
   void Erase(const DirId& id);
 
+  // Cache-wide counters.
+  struct Stats {
+    Stats() : hits(0), misses(0) {}
+    uint64_t hits;
+    uint64_t misses;
+  };
+  void GetStats(Stats* stats);
+
  private:
   static Slice LRUKey(const DirId&, char* scratch);
   LRUCache<IndexEntry> lru_;
   port::Mutex* mu_;
+  Stats stats_;
 
   // No copying allowed
   void operator=(const IndexCache&);
@@ -78,6 +78,13 @@ struct DBOptions {
   // Default: NULL
   ThreadPool* compaction_pool;
 
+  // Maximum number of disjoint key ranges a compaction may be split into.
+  // Each range is merged into its own set of output tables, and ranges
+  // other than the first may be merged concurrently by threads of
+  // compaction_pool. Outputs of all ranges are installed together.
+  // Default: 1
+  int max_subcompactions;
+
   // -------------------
   // Parameters that affect performance
 
@@ -119,7 +126,14 @@ struct DBOptions {
   // Default: 4K
   size_t block_size;
 
-  // Type of index to use for each generated SSTable.
+  // Type of index to use for each generated SSTable. kCompact indexes
+  // blocks by the first 8 bytes of their keys and can take much less
+  // memory than kMultiwaySearchTree when keys are hashes or otherwise
+  // spread evenly across the key space. kCompact requires the bytewise
+  // comparator and user keys that are at least 8 bytes long; it is
+  // ignored for other comparators, and tables holding shorter keys are
+  // written with kMultiwaySearchTree instead. Tables written with one type
+  // of index remain readable after switching to the other.
   //
   // Default: kMultiwaySearchTree
   IndexType index_type;
@@ -162,6 +176,20 @@ struct DBOptions {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // Values at least this large are moved out of the LSM and into an
+  // append-only value log by columns of kLSMKeyStyle.  Only keys and
+  // pointers to these values are then rewritten by compactions.
+  // Ignored by all other types of db.
+  // Default: 64
+  size_t value_log_min_value_size;
+
+  // A value log is rewritten by garbage collection once the fraction of its
+  // bytes still referenced by the LSM drops below this ratio.  Logs with no
+  // references left are always deleted.  Set to 0 to never rewrite logs.
+  // Ignored by all other types of db.
+  // Default: 0.5
+  double value_log_gc_ratio;
+
   // -------------------
   // Dangerous zone - parameters for experts
 
@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include "pdlfs-common/leveldb/db/options.h"
 #include "pdlfs-common/slice.h"
 #include "pdlfs-common/status.h"
 
@@ -53,7 +54,7 @@ class BlockHandle {
 // end of every table file.
 class Footer {
  public:
-  Footer() {}
+  Footer() : index_type_(kMultiwaySearchTree) {}
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -63,17 +64,24 @@ class Footer {
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // The type of the index block of the table
+  IndexType index_type() const { return index_type_; }
+  void set_index_type(IndexType t) { index_type_ = t; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
   // Encoded length of a Footer.  Note that the serialization of a
   // Footer will always occupy exactly this many bytes.  It consists
-  // of two block handles and a magic number.
+  // of two block handles and a magic number.  The index type is stored
+  // in the last byte of the padding after the two handles, which is
+  // zero (kMultiwaySearchTree) in tables written before it existed.
   enum { kEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8 };
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  IndexType index_type_;
 };
 
 // kTableMagicNumber was picked by running
@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include "pdlfs-common/leveldb/db/options.h"
 #include "pdlfs-common/slice.h"
 #include "pdlfs-common/status.h"
 
@@ -21,7 +22,6 @@
 namespace pdlfs {
 
 struct BlockContents;
-struct DBOptions;
 
 class BlockHandle;
 class Iterator;
@@ -55,6 +55,10 @@ class IndexBuilder {
   // block we are building.
   virtual size_t CurrentSizeEstimate() const = 0;
 
+  // Return the type of the index block being built. This may differ from
+  // options->index_type when keys cannot be indexed by the requested type.
+  virtual IndexType type() const = 0;
+
   // Finish building the block and return a slice that refers to the
   // block contents.
   virtual Slice Finish() = 0;
@@ -68,8 +72,10 @@ class IndexReader {
 
   typedef DBOptions Options;
 
-  // Create an index reader according to the specified options.
-  static IndexReader* Create(const BlockContents& contents,
+  // Create an index reader for an index block of the specified type.
+  // The type of an index block is recorded in the footer of the table
+  // holding it and may differ from options->index_type.
+  static IndexReader* Create(IndexType type, const BlockContents& contents,
                              const Options* options);
 
   // Return the amount of memory used to hold the index.
@@ -65,6 +65,9 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Return the amount of memory used to hold the index of the table.
+  size_t ApproximateIndexMemoryUsage() const;
+
   // Return the properties associated with the table or NULL
   // if no valid properties can be found.
   const TableProperties* GetProperties() const;
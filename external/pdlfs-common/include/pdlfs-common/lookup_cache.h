@@ -16,7 +16,9 @@
 
 namespace pdlfs {
 
-// An LRU-cache of pathname lookup leases.
+// An LRU-cache of pathname lookup leases. Besides the lookup states of
+// existing directories, the cache may also hold negative entries that
+// record the absence of a name until their leases expire.
 class LookupCache {
   typedef LRUEntry<LookupStat> LookupEntry;
 
@@ -31,14 +33,35 @@ class LookupCache {
   void Release(Handle* handle);
   LookupStat* Value(Handle* handle);
 
-  Handle* Lookup(const DirId& pid, const Slice& nhash);
+  // Return NULL if there is no entry for the given name, or if the lease of
+  // the entry is due before min_due.
+  Handle* Lookup(const DirId& pid, const Slice& nhash, uint64_t min_due = 0);
   Handle* Insert(const DirId& pid, const Slice& nhash, LookupStat* stat);
+  // Insert an entry recording that the given name does not exist.
+  Handle* InsertNegative(const DirId& pid, const Slice& nhash,
+                         uint64_t lease_due);
   void Erase(const DirId& pid, const Slice& nhash);
 
+  static bool IsNegative(const LookupStat* stat) {
+    return stat->DirMode() == 0;
+  }
+
+  // Cache-wide counters.
+  struct Stats {
+    Stats();
+    uint64_t hits;           // Lookups answered by a positive entry
+    uint64_t negative_hits;  // Lookups answered by a negative entry
+    uint64_t misses;         // Lookups finding no entry or an expired one
+    uint64_t renewals;       // Leases renewed ahead of their expiration
+  };
+  void RecordRenewal();
+  void GetStats(Stats* stats);
+
  private:
   static Slice LRUKey(const DirId&, const Slice&, char* scratch);
   LRUCache<LookupEntry> lru_;
   port::Mutex* mu_;
+  Stats stats_;
 
   // No copying allowed
   void operator=(const LookupCache&);
@@ -127,6 +127,23 @@ class MDB {
   typedef std::vector<Stat> StatList;
   size_t List(const DirId& id, StatList* stats, NameList* names, Tx* tx,
               size_t limit);
+  // List entries in the order of their name hashes, starting after the entry
+  // whose hash is "start_hash", or from the first entry if "start_hash" is
+  // empty. Stop after "limit" entries or once the listed names and stats
+  // take at least "byte_limit" bytes. The hash of the last entry visited is
+  // stored in *last_hash so a later call can resume from there. Set *has_more
+  // to true iff the directory has more entries to list. Entries that cannot
+  // be decoded are skipped. Return a non-OK status on read errors.
+  Status List(const DirId& id, const Slice& start_hash, StatList* stats,
+              NameList* names, std::string* last_hash, bool* has_more,
+              Tx* tx, size_t limit, size_t byte_limit);
+  // List all entries whose name hashes are at least "lower_hash" and below
+  // "upper_hash", or with no upper bound if "upper_hash" is empty. The hash
+  // of each listed entry is stored in *hashes. Return a non-OK status on read
+  // errors or when an entry cannot be decoded.
+  Status ListRange(const DirId& id, const Slice& lower_hash,
+                   const Slice& upper_hash, StatList* stats, NameList* names,
+                   NameList* hashes, Tx* tx);
   bool Exists(const DirId& id, const Slice& hash, Tx* tx);
 
   Status Commit(Tx* tx) {
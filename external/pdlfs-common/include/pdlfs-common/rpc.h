@@ -34,13 +34,17 @@ namespace rpc {
 class If;
 }
 
-enum RPCImpl { kMargoRPC, kMercuryRPC, kThriftRPC };
+// kSocketRPC is a built-in implementation on top of plain TCP or UDP
+// sockets. kAutoRPC selects kSocketRPC when it is compiled in and the uri
+// is of the form "tcp://..." or "udp://...", or is simply "tcp" or "udp".
+// Otherwise, kAutoRPC selects kMercuryRPC.
+enum RPCImpl { kMargoRPC, kMercuryRPC, kThriftRPC, kSocketRPC, kAutoRPC };
 
 enum RPCMode { kServerClient, kClientOnly };
 
 struct RPCOptions {
   RPCOptions();
-  RPCImpl impl;  // Default: kMercuryRPC
+  RPCImpl impl;  // Default: kAutoRPC
   RPCMode mode;  // Default: kServerClient
   std::string uri;
   uint64_t rpc_timeout;  // In microseconds, Default: 5 secs
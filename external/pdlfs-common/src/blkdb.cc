@@ -46,6 +46,7 @@ BlkDBOptions::BlkDBOptions()
     : uniquefier(0),
       sync(false),
       verify_checksum(false),
+      write_buffer_size(128 << 10),
       owns_db(false),
       db(NULL) {}
 
@@ -53,6 +54,8 @@ BlkDB::BlkDB(const BlkDBOptions& options)
     : uniquefier_(options.uniquefier),
       sync_(options.sync),
       verify_checksum_(options.verify_checksum),
+      // Synchronous writes must be durable when they return
+      write_buffer_size_(options.sync ? 0 : options.write_buffer_size),
       owns_db_(options.owns_db),
       db_(options.db) {
   assert(db_ != NULL);
@@ -68,8 +71,8 @@ Status BlkDB::Fstat(const Fentry& fentry, Handle* fh, uint64_t* mtime,
                     uint64_t* size, bool skip_cache) {
   Status s;
   assert(fh != NULL);
-  const Stream* stream = reinterpret_cast<Stream*>(fh);
-  MutexLock ml(&mutex_);
+  Stream* stream = reinterpret_cast<Stream*>(fh);
+  MutexLock ml(&stream->mu);
   if (stream->nflus < 0 || stream->nwrites < 0) {
     s = NoMoreUpdates();
   } else {
@@ -98,11 +101,8 @@ Status BlkDB::Creat(const Fentry& fentry, bool append_only, Handle** fh) {
 
   if (s.ok()) {
     Stream* stream = new Stream;
-    stream->iter = NULL;
     stream->mtime = header.mtime;
     stream->size = header.size;
-    stream->nwrites = 0;
-    stream->nflus = 0;
     stream->off = 0;
 
     *fh = stream;
@@ -177,11 +177,8 @@ Status BlkDB::Open(const Fentry& fentry, bool create_if_missing,
 
   if (s.ok()) {
     Stream* stream = new Stream;
-    stream->iter = NULL;
     stream->mtime = header.mtime;
     stream->size = header.size;
-    stream->nwrites = 0;
-    stream->nflus = 0;
     stream->off = 0;
 
     if (found) {
@@ -215,46 +212,73 @@ Status BlkDB::Ftrunc(const Fentry& fentry, Handle* fh, uint64_t size) {
   return Status::NotSupported(Slice());
 }
 
-// Write an updated header record to the db
-// but not necessarily to the underlying storage, unless "force_sync" is true.
-// Return OK on success. If the stream has not changed since its last
-// flush, no action is taken, unless "force_sync" is true.
+// Commit buffered block writes together with an updated header record
+// to the db but not necessarily to the underlying storage, unless
+// "force_sync" is true. Return OK on success. If the stream has not changed
+// since its last flush, no action is taken, unless "force_sync" is true.
 Status BlkDB::Flush(const Fentry& fentry, Handle* fh, bool force_sync) {
-  Status s;
   assert(fh != NULL);
   Stream* stream = reinterpret_cast<Stream*>(fh);
-  MutexLock ml(&mutex_);
+  return Commit(stream, fentry, true, force_sync);
+}
+
+// Commit the block writes buffered by a stream to the db as a single write
+// batch. If "update_header" is true, an updated header record is added to
+// the same batch if the stream has changed since its last flush. Commits
+// of a stream are serialized so that blocks and headers reach the db in
+// the order they are written. New writes may be buffered while a commit
+// is in progress.
+Status BlkDB::Commit(Stream* stream, const Fentry& fentry, bool update_header,
+                     bool force_sync) {
+  Status s;
+  MutexLock cl(&stream->commit_mu);
+  MutexLock ml(&stream->mu);
   if (stream->nflus < 0 || stream->nwrites < 0) {
-    s = NoMoreUpdates();
-  } else if (force_sync || stream->nflus < stream->nwrites) {
-    int32_t nwrites = stream->nwrites;
-    int32_t nflus = stream->nflus;
+    return NoMoreUpdates();
+  }
+  const int32_t nwrites = stream->nwrites;
+  const bool write_header = update_header && stream->nflus < nwrites;
+  const bool has_updates = write_header || stream->ncommits < nwrites;
+  if (!has_updates && !force_sync) {
+    return s;
+  }
+  WriteBatch* const batch = stream->batch;
+  if (batch == &stream->batches[0]) {
+    stream->batch = &stream->batches[1];
+  } else {
+    stream->batch = &stream->batches[0];
+  }
+  stream->buffered = 0;
+  if (write_header) {
     StreamHeader header;
     header.mtime = stream->mtime;
     header.size = stream->size;
-    mutex_.Unlock();
-    if (nflus < nwrites) {
-      char tmp[20];
-      Slice header_encoding = header.EncodeTo(tmp);
-      Key key(UntypedKeyPrefix(fentry));
-      key.SetType(kHeaderType);
-      WriteOptions options;
-      options.sync = (force_sync || sync_);
-      key.SetOffset(uniquefier_);
-      s = db_->Put(options, key.Encode(), header_encoding);
-    } else {
-      s = db_->SyncWAL();
-    }
-    mutex_.Lock();
-    if (s.ok()) {
-      if (nwrites > stream->nflus) {
-        stream->nflus = nwrites;
-      }
-    } else {
-      Error(__LOG_ARGS__, s);
-      stream->nwrites = -1;
-      stream->nflus = -1;
+    char tmp[20];
+    Slice header_encoding = header.EncodeTo(tmp);
+    Key key(UntypedKeyPrefix(fentry));
+    key.SetType(kHeaderType);
+    key.SetOffset(uniquefier_);
+    batch->Put(key.Encode(), header_encoding);
+  }
+  stream->mu.Unlock();
+  if (has_updates) {
+    WriteOptions options;
+    options.sync = (force_sync || sync_);
+    s = db_->Write(options, batch);
+  } else {
+    s = db_->SyncWAL();
+  }
+  batch->Clear();
+  stream->mu.Lock();
+  if (s.ok()) {
+    stream->ncommits = nwrites;
+    if (write_header) {
+      stream->nflus = nwrites;
     }
+  } else {
+    Error(__LOG_ARGS__, s);
+    stream->nwrites = -1;
+    stream->nflus = -1;
   }
   return s;
 }
@@ -262,51 +286,42 @@ Status BlkDB::Flush(const Fentry& fentry, Handle* fh, bool force_sync) {
 Status BlkDB::Close(const Fentry& fentry, Handle* fh) {
   assert(fh != NULL);
   Stream* stream = reinterpret_cast<Stream*>(fh);
-  MutexLock ml(&mutex_);
-  while (stream->nflus < stream->nwrites) {
-    mutex_.Unlock();
-    Status s = Flush(fentry, fh);
-    mutex_.Lock();
-    if (!s.ok()) {
-      break;
-    }
-  }
+  Status s = Commit(stream, fentry, true, false);
   if (stream->iter != NULL) {
     delete stream->iter;
   }
   delete stream;
-  return Status::OK();
+  return s;
 }
 
-// REQUIRES: mutex_ has been locked.
+// Buffer a block write and commit buffered writes once they fill up the
+// write buffer.
+// REQUIRES: stream->mu has been locked.
 Status BlkDB::WriteTo(Stream* stream, const Fentry& fentry, const Slice& data,
                       uint64_t off) {
+  Status s;
   uint64_t end = off + data.size();
-  mutex_.Unlock();
   Key key(UntypedKeyPrefix(fentry));
   key.SetType(kDataBlockType);
   key.SetOffset(end - 1);
-  WriteOptions options;
-  options.sync = sync_;
-  Status s = db_->Put(options, key.Encode(), data);
-  mutex_.Lock();
-  if (s.ok()) {
-    stream->nwrites++;
-    if (stream->iter != NULL) {
-      delete stream->iter;
-      stream->iter = NULL;
-    }
-    uint64_t mtime = Env::Default()->NowMicros();
-    if (mtime > stream->mtime) {
-      stream->mtime = mtime;
-    }
-    if (end > stream->size) {
-      stream->size = end;
-    }
-  } else {
-    Error(__LOG_ARGS__, s);
-    stream->nwrites = -1;
-    stream->nflus = -1;
+  stream->batch->Put(key.Encode(), data);
+  stream->buffered += data.size();
+  stream->nwrites++;
+  if (stream->iter != NULL) {
+    delete stream->iter;
+    stream->iter = NULL;
+  }
+  uint64_t mtime = Env::Default()->NowMicros();
+  if (mtime > stream->mtime) {
+    stream->mtime = mtime;
+  }
+  if (end > stream->size) {
+    stream->size = end;
+  }
+  if (stream->buffered >= write_buffer_size_) {
+    stream->mu.Unlock();
+    s = Commit(stream, fentry, false, false);
+    stream->mu.Lock();
   }
   return s;
 }
@@ -315,15 +330,13 @@ Status BlkDB::Write(const Fentry& fentry, Handle* fh, const Slice& data) {
   Status s;
   assert(fh != NULL);
   Stream* stream = reinterpret_cast<Stream*>(fh);
-  MutexLock ml(&mutex_);
+  MutexLock ml(&stream->mu);
   if (stream->nflus < 0 || stream->nwrites < 0) {
     s = NoMoreUpdates();
   } else {
     uint64_t off = stream->off;
+    stream->off = off + data.size();
     s = WriteTo(stream, fentry, data, off);
-    if (s.ok()) {
-      stream->off = off + data.size();
-    }
   }
   return s;
 }
@@ -333,7 +346,7 @@ Status BlkDB::Pwrite(const Fentry& fentry, Handle* fh, const Slice& data,
   Status s;
   assert(fh != NULL);
   Stream* stream = reinterpret_cast<Stream*>(fh);
-  MutexLock ml(&mutex_);
+  MutexLock ml(&stream->mu);
   if (stream->nflus < 0 || stream->nwrites < 0) {
     s = NoMoreUpdates();
   } else {
@@ -372,15 +385,27 @@ bool BlkInfo::ParseFrom(const Slice& k, const Slice& v) {
 }
 }
 
-// REQUIRES: mutex_ has been locked.
+// Read from the db without holding any lock. Each read goes through a
+// single db iterator, which pins a snapshot of the db taken when it was
+// created, so that a read never sees a partially committed batch. Buffered
+// writes are committed first so that a stream always reads its own writes.
+// REQUIRES: stream->mu has been locked.
 Status BlkDB::ReadFrom(Stream* stream, const Fentry& fentry, Slice* result,
                        uint64_t off, uint64_t size, char* scratch) {
   Status s;
+  if (stream->ncommits < stream->nwrites) {
+    stream->mu.Unlock();
+    s = Commit(stream, fentry, false, false);
+    stream->mu.Lock();
+    if (!s.ok()) {
+      return s;
+    }
+  }
   uint64_t flen = stream->size;
   int32_t nwrites = stream->nwrites;
   Iterator* iter = stream->iter;
   stream->iter = NULL;
-  mutex_.Unlock();
+  stream->mu.Unlock();
 
   if (iter == NULL) {
     ReadOptions options;
@@ -466,7 +491,7 @@ Status BlkDB::ReadFrom(Stream* stream, const Fentry& fentry, Slice* result,
       s = iter->status();
     }
   }
-  mutex_.Lock();
+  stream->mu.Lock();
   if (s.ok()) {
     if (stream->iter == NULL) {
       stream->iter = iter;
@@ -491,7 +516,7 @@ Status BlkDB::Read(const Fentry& fentry, Handle* fh, Slice* result,
   Status s;
   assert(fh != NULL);
   Stream* stream = reinterpret_cast<Stream*>(fh);
-  MutexLock ml(&mutex_);
+  MutexLock ml(&stream->mu);
   uint64_t off = stream->off;
   s = ReadFrom(stream, fentry, result, off, size, scratch);
   if (s.ok()) {
@@ -505,7 +530,7 @@ Status BlkDB::Pread(const Fentry& fentry, Handle* fh, Slice* result,
   Status s;
   assert(fh != NULL);
   Stream* stream = reinterpret_cast<Stream*>(fh);
-  MutexLock ml(&mutex_);
+  MutexLock ml(&stream->mu);
   s = ReadFrom(stream, fentry, result, off, size, scratch);
   return s;
 }
@@ -9,11 +9,57 @@
 
 #include "pdlfs-common/blkdb.h"
 #include "pdlfs-common/gigaplus.h"
+#include "pdlfs-common/histogram.h"
+#include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+
 namespace pdlfs {
 
+namespace {
+// An env whose writable files fail all appends once asked to.
+class WriteErrorEnv : public EnvWrapper {
+ public:
+  WriteErrorEnv() : EnvWrapper(Env::Default()), write_error_(false) {}
+  bool write_error_;
+
+  virtual Status NewWritableFile(const char* fname, WritableFile** result) {
+    Status s = target()->NewWritableFile(fname, result);
+    if (s.ok()) {
+      *result = new ErrorFile(this, *result);
+    }
+    return s;
+  }
+
+ private:
+  class ErrorFile : public WritableFile {
+   public:
+    ErrorFile(WriteErrorEnv* env, WritableFile* base)
+        : env_(env), base_(base) {}
+    virtual ~ErrorFile() { delete base_; }
+
+    virtual Status Append(const Slice& data) {
+      if (env_->write_error_) {
+        return Status::IOError("simulated write error");
+      } else {
+        return base_->Append(data);
+      }
+    }
+
+    virtual Status Close() { return base_->Close(); }
+    virtual Status Flush() { return base_->Flush(); }
+    virtual Status Sync() { return base_->Sync(); }
+
+   private:
+    WriteErrorEnv* env_;
+    WritableFile* base_;
+  };
+};
+}  // namespace
+
 class BlkDBTest {
  public:
   struct File {
@@ -22,14 +68,23 @@ class BlkDBTest {
   };
 
   BlkDBTest() {
-    env_ = Env::Default();
+    env_ = &error_env_;
     dbname_ = test::PrepareTmpDir("blkdb_test", env_);
     DBOptions dbopts;
     dbopts.env = env_;
     DestroyDB(dbname_, dbopts);
     dbopts.create_if_missing = true;
     ASSERT_OK(DB::Open(dbopts, dbname_, &db_));
+    blk_ = NULL;
+    Reopen();
+  }
+
+  void Reopen(size_t write_buffer_size = BlkDBOptions().write_buffer_size,
+              bool sync = false) {
+    delete blk_;
     BlkDBOptions blkopts;
+    blkopts.write_buffer_size = write_buffer_size;
+    blkopts.sync = sync;
     blkopts.owns_db = false;
     blkopts.db = db_;
     blk_ = new BlkDB(blkopts);
@@ -46,7 +101,7 @@ class BlkDBTest {
     return tmp;
   }
 
-  File* Open(int id, bool ocreat = false) {
+  static Fentry MakeFentry(int id) {
     Fentry fentry;
     fentry.pid = DirId(0, 0, 0);
     DirIndex::PutHash(&fentry.nhash, Name(id));
@@ -54,6 +109,11 @@ class BlkDBTest {
     fentry.stat.SetRegId(0);
     fentry.stat.SetSnapId(0);
     fentry.stat.SetInodeNo(id);
+    return fentry;
+  }
+
+  File* Open(int id, bool ocreat = false) {
+    Fentry fentry = MakeFentry(id);
     uint64_t ignored_mtime;
     uint64_t ignored_size;
     Fio::Handle* fh;
@@ -92,10 +152,20 @@ class BlkDBTest {
 
   void Close(File* f) {
     ASSERT_OK(blk_->Flush(f->fentry, f->fh));
-    blk_->Close(f->fentry, f->fh);
+    ASSERT_OK(blk_->Close(f->fentry, f->fh));
     delete f;
   }
 
+  // Return the number of keys committed to the db.
+  int NumKeys() {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int n = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) n++;
+    delete iter;
+    return n;
+  }
+
+  WriteErrorEnv error_env_;
   Env* env_;
   std::string dbname_;
   BlkDB* blk_;
@@ -194,8 +264,285 @@ TEST(BlkDBTest, FileWithHoles) {
   Close(f);
 }
 
+TEST(BlkDBTest, ReadOwnWrites) {
+  File* f = Creat(1);
+  Write(f, "1234", 0);
+  Write(f, "56", 4);
+  // Buffered writes are visible to reads before the stream is flushed
+  ASSERT_EQ(Read(f, 0, 10), "123456");
+  Write(f, "78", 6);
+  ASSERT_EQ(Read(f, 4, 10), "5678");
+  uint64_t mtime;
+  uint64_t size;
+  ASSERT_OK(blk_->Fstat(f->fentry, f->fh, &mtime, &size));
+  ASSERT_EQ(size, 8);
+  Close(f);
+
+  f = Open(1);
+  ASSERT_TRUE(f != NULL);
+  ASSERT_EQ(Read(f, 0, 10), "12345678");
+  Close(f);
+}
+
+TEST(BlkDBTest, UnbufferedWrites) {
+  Reopen(0);
+  File* f = Creat(1);
+  Write(f, "12", 0);
+  Write(f, "5", 4);
+  // Blocks are committed as they are written
+  ASSERT_EQ(NumKeys(), 3);  // Including the stream header
+  Close(f);
+
+  f = Open(1);
+  ASSERT_TRUE(f != NULL);
+  ASSERT_EQ(Read(f, 0, 10), "12xx5");
+  Close(f);
+}
+
+TEST(BlkDBTest, SyncWrites) {
+  Reopen(BlkDBOptions().write_buffer_size, true);
+  File* f = Creat(1);
+  Write(f, "12", 0);
+  Write(f, "5", 4);
+  // Synchronous writes are never buffered
+  ASSERT_EQ(NumKeys(), 3);
+  Close(f);
+}
+
+TEST(BlkDBTest, LargeWrites) {
+  Reopen(1000);
+  File* f = Creat(1);
+  std::string expected;
+  Random rnd(301);
+  for (int i = 0; i < 100; i++) {
+    std::string block;
+    test::RandomString(&rnd, 1 + rnd.Uniform(100), &block);
+    Write(f, block, expected.size());
+    expected += block;
+  }
+  ASSERT_EQ(Read(f, 0, expected.size()), expected);
+  Close(f);
+
+  f = Open(1);
+  ASSERT_TRUE(f != NULL);
+  ASSERT_EQ(Read(f, 0, expected.size()), expected);
+  Close(f);
+}
+
+TEST(BlkDBTest, CloseReportsCommitErrors) {
+  File* f = Creat(1);
+  ASSERT_TRUE(f != NULL);
+  Write(f, "12", 0);
+  // Buffered writes are committed by Close, which must not hide failures
+  error_env_.write_error_ = true;
+  Status s = blk_->Close(f->fentry, f->fh);
+  ASSERT_TRUE(s.IsIOError()) << s.ToString();
+  delete f;
+  error_env_.write_error_ = false;
+}
+
+namespace {
+struct ConcurrentState {
+  explicit ConcurrentState(BlkDBTest* t)
+      : t(t), cv(&mu), next_id(1), num_running(0) {}
+  BlkDBTest* t;
+  port::Mutex mu;
+  port::CondVar cv;
+  int next_id;
+  int num_running;
+};
+
+void ConcurrentWriter(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  state->mu.Lock();
+  const int id = state->next_id++;
+  state->mu.Unlock();
+  BlkDBTest* t = state->t;
+  BlkDBTest::File* f = t->Creat(id);
+  ASSERT_TRUE(f != NULL);
+  for (int i = 0; i < 100; i++) {
+    t->Write(f, BlkDBTest::Name(id), i * 10);
+    ASSERT_EQ(t->Read(f, i * 10, 10), BlkDBTest::Name(id));
+  }
+  t->Close(f);
+  MutexLock ml(&state->mu);
+  state->num_running--;
+  state->cv.SignalAll();
+}
+}  // namespace
+
+TEST(BlkDBTest, ConcurrentStreams) {
+  Reopen(64);
+  const int kNumThreads = 4;
+  ConcurrentState state(this);
+  state.num_running = kNumThreads;
+  for (int i = 0; i < kNumThreads; i++) {
+    env_->StartThread(ConcurrentWriter, &state);
+  }
+  state.mu.Lock();
+  while (state.num_running != 0) {
+    state.cv.Wait();
+  }
+  state.mu.Unlock();
+  for (int id = 1; id <= kNumThreads; id++) {
+    File* f = Open(id);
+    ASSERT_TRUE(f != NULL);
+    ASSERT_EQ(Read(f, 990, 10), Name(id));
+    Close(f);
+  }
+}
+
+// Measure the throughput of many threads each writing and then reading
+// their own files through a shared BlkDB.
+class BlkDBBench {
+ public:
+  static int GetOption(const char* key, int def) {
+    const char* env = getenv(key);
+    if (env == NULL || env[0] == 0) {
+      return def;
+    } else {
+      return atoi(env);
+    }
+  }
+
+  BlkDBBench()
+      : max_threads_(GetOption("BLK_THREADS", 8)),
+        num_files_(GetOption("BLK_FILES", 100)),
+        num_blocks_(GetOption("BLK_BLOCKS", 64)),
+        block_size_(GetOption("BLK_SIZE", 4096)),
+        write_buffer_(GetOption("BLK_BUFFER", 128 << 10)),
+        cv_(&mu_) {}
+
+  void Run() {
+    fprintf(stderr, "%d files/thread, %d blocks/file, %d bytes/block\n",
+            num_files_, num_blocks_, block_size_);
+    for (int n = 1; n <= max_threads_; n *= 2) {
+      RunWith(n);
+    }
+  }
+
+ private:
+  void RunWith(int num_threads) {
+    BlkDBTest t;
+    t.Reopen(write_buffer_);
+    t_ = &t;
+    write_hist_.Clear();
+    read_hist_.Clear();
+    next_thread_ = 0;
+    num_running_ = num_threads;
+    const uint64_t start = Env::Default()->NowMicros();
+    for (int i = 0; i < num_threads; i++) {
+      Env::Default()->StartThread(BGWork, this);
+    }
+    mu_.Lock();
+    while (num_running_ != 0) {
+      cv_.Wait();
+    }
+    mu_.Unlock();
+    const uint64_t dura = Env::Default()->NowMicros() - start;
+    const double ops = double(num_threads) * num_files_ * num_blocks_;
+    fprintf(stderr, "%d threads: %.0f blocks/s, %.3f MB/s (write+read)\n",
+            num_threads, 2e6 * ops / dura,
+            2e6 * ops * block_size_ / dura / 1048576.0);
+    fprintf(stderr, "  Write latency: %.3f us/op\n", write_hist_.Average());
+    fprintf(stderr, "  Read latency:  %.3f us/op\n", read_hist_.Average());
+  }
+
+  static void BGWork(void* arg) {
+    BlkDBBench* bench = reinterpret_cast<BlkDBBench*>(arg);
+    bench->DoWork();
+  }
+
+  void DoWork() {
+    mu_.Lock();
+    const int base = 1 + num_files_ * next_thread_++;
+    mu_.Unlock();
+    Histogram write_hist;
+    Histogram read_hist;
+    write_hist.Clear();
+    read_hist.Clear();
+    std::string block(block_size_, 'x');
+    char* scratch = new char[block_size_];
+    for (int i = 0; i < num_files_; i++) {
+      BlkDBTest::File* f = t_->Creat(base + i);
+      for (int j = 0; j < num_blocks_; j++) {
+        const uint64_t start = Env::Default()->NowMicros();
+        t_->Write(f, block, uint64_t(j) * block_size_);
+        write_hist.Add(Env::Default()->NowMicros() - start);
+      }
+      t_->Close(f);
+    }
+    for (int i = 0; i < num_files_; i++) {
+      BlkDBTest::File* f = t_->Open(base + i);
+      ASSERT_TRUE(f != NULL);
+      for (int j = 0; j < num_blocks_; j++) {
+        Slice result;
+        const uint64_t start = Env::Default()->NowMicros();
+        ASSERT_OK(t_->blk_->Pread(f->fentry, f->fh, &result,
+                                  uint64_t(j) * block_size_, block_size_,
+                                  scratch));
+        read_hist.Add(Env::Default()->NowMicros() - start);
+        ASSERT_EQ(result.size(), block_size_);
+      }
+      t_->Close(f);
+    }
+    delete[] scratch;
+    MutexLock ml(&mu_);
+    write_hist_.Merge(write_hist);
+    read_hist_.Merge(read_hist);
+    num_running_--;
+    cv_.SignalAll();
+  }
+
+  int max_threads_;
+  int num_files_;  // Per thread
+  int num_blocks_;
+  int block_size_;
+  int write_buffer_;
+  BlkDBTest* t_;
+  port::Mutex mu_;
+  port::CondVar cv_;
+  int next_thread_;
+  int num_running_;
+  Histogram write_hist_;
+  Histogram read_hist_;
+};
+
 }  // namespace pdlfs
 
+static void BM_Usage() {
+  fprintf(stderr, "Use --bench=blkdb to run benchmark.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options (via env vars):\n");
+  fprintf(stderr, "  BLK_THREADS  max threads, doubling from 1 (8)\n");
+  fprintf(stderr, "  BLK_FILES    files written and read per thread (100)\n");
+  fprintf(stderr, "  BLK_BLOCKS   blocks per file (64)\n");
+  fprintf(stderr, "  BLK_SIZE     block size in bytes (4096)\n");
+  fprintf(stderr, "  BLK_BUFFER   write buffer size of each stream (131072)\n");
+}
+
+static void BM_Main(int* argc, char*** argv) {
+  pdlfs::Slice bench_name;
+  if (*argc > 1) {
+    bench_name = pdlfs::Slice((*argv)[*argc - 1]);
+  }
+  if (bench_name == "--bench=blkdb") {
+    pdlfs::BlkDBBench bench;
+    bench.Run();
+  } else {
+    BM_Usage();
+  }
+}
+
 int main(int argc, char* argv[]) {
-  return ::pdlfs::test::RunAllTests(&argc, &argv);
+  pdlfs::Slice token;
+  if (argc > 1) {
+    token = pdlfs::Slice(argv[argc - 1]);
+  }
+  if (!token.starts_with("--bench")) {
+    return ::pdlfs::test::RunAllTests(&argc, &argv);
+  } else {
+    BM_Main(&argc, &argv);
+    return 0;
+  }
 }
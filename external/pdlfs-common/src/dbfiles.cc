@@ -41,6 +41,11 @@ std::string SSTTableFileName(const std::string& name, uint64_t number) {
   return MakeFileName(name, number, "sst");
 }
 
+std::string ValueLogFileName(const std::string& name, uint64_t number) {
+  assert(number > 0);
+  return MakeFileName(name, number, "vlog");
+}
+
 std::string DescriptorFileName(const std::string& dbname, uint64_t number) {
   assert(number > 0);
   char buf[100];
@@ -82,7 +87,7 @@ std::string OldInfoLogFileName(const std::string& dbname) {
 //    dbname/LOG
 //    dbname/LOG.old
 //    dbname/MANIFEST-[0-9]+
-//    dbname/[0-9]+.(log|sst|ldb)
+//    dbname/[0-9]+.(log|sst|ldb|vlog)
 bool ParseFileName(const Slice& fname, uint64_t* number, FileType* type) {
   Slice rest(fname);
   if (rest == "CURRENT") {
@@ -119,6 +124,8 @@ bool ParseFileName(const Slice& fname, uint64_t* number, FileType* type) {
       *type = kTableFile;
     } else if (suffix == Slice(".dbtmp")) {
       *type = kTempFile;
+    } else if (suffix == Slice(".vlog")) {
+      *type = kValueLogFile;
     } else {
       return false;
     }
@@ -216,6 +216,22 @@ bool Stat::DecodeFrom(Slice* input) {
   }
 }
 
+void Stat::EncodeFixedTo(char* dst) const {
+  // All fields are byte arrays so they are laid out without padding
+  assert(reg_id_ + sizeof(reg_id_) - modify_time_ == kFixedEncodedLength);
+  memcpy(dst, modify_time_, kFixedEncodedLength);
+}
+
+void Stat::DecodeFixedFrom(const char* src) {
+  memcpy(modify_time_, src, kFixedEncodedLength);
+#ifndef NDEBUG
+  is_reg_id_set_ = is_snap_id_set_ = true;
+  is_file_ino_set_ = is_file_size_set_ = is_file_mode_set_ = true;
+  is_zeroth_server_set_ = is_user_id_set_ = is_group_id_set_ = true;
+  is_modify_time_set_ = is_change_time_set_ = true;
+#endif
+}
+
 Slice LookupStat::EncodeTo(char* scratch) const {
   char* p = scratch;
 #if defined(DELTAFS)
@@ -272,6 +288,20 @@ bool LookupStat::DecodeFrom(Slice* input) {
   }
 }
 
+void LookupStat::EncodeFixedTo(char* dst) const {
+  assert(reg_id_ + sizeof(reg_id_) - lease_due_ == kFixedEncodedLength);
+  memcpy(dst, lease_due_, kFixedEncodedLength);
+}
+
+void LookupStat::DecodeFixedFrom(const char* src) {
+  memcpy(lease_due_, src, kFixedEncodedLength);
+#ifndef NDEBUG
+  is_reg_id_set_ = is_snap_id_set_ = is_dir_ino_set_ = true;
+  is_dir_mode_set_ = is_zeroth_server_set_ = true;
+  is_user_id_set_ = is_group_id_set_ = is_lease_due_set_ = true;
+#endif
+}
+
 void LookupStat::CopyFrom(const Stat& stat) {
 #if defined(DELTAFS)
   SetRegId(stat.RegId());
@@ -100,6 +100,35 @@ TEST(StatTest, StatEncoding) {
   ASSERT_EQ(encoding, encoding2);
 }
 
+TEST(StatTest, StatFixedEncoding) {
+  Stat stat;
+  stat.SetRegId(13);
+  stat.SetSnapId(37);
+  stat.SetInodeNo(12345);
+  stat.SetFileMode(678);
+  stat.SetFileSize(90);
+  stat.SetUserId(11);
+  stat.SetGroupId(22);
+  stat.SetChangeTime(11223344);
+  stat.SetModifyTime(44332211);
+  stat.SetZerothServer(777);
+  char tmp[Stat::kFixedEncodedLength];
+  stat.EncodeFixedTo(tmp);
+  Stat stat2;
+  stat2.DecodeFixedFrom(tmp);
+  stat2.AssertAllSet();
+  ASSERT_EQ(stat2.RegId(), 13);
+  ASSERT_EQ(stat2.SnapId(), 37);
+  ASSERT_EQ(stat2.InodeNo(), 12345);
+  ASSERT_EQ(stat2.FileMode(), 678);
+  ASSERT_EQ(stat2.FileSize(), 90);
+  ASSERT_EQ(stat2.UserId(), 11);
+  ASSERT_EQ(stat2.GroupId(), 22);
+  ASSERT_EQ(stat2.ChangeTime(), 11223344);
+  ASSERT_EQ(stat2.ModifyTime(), 44332211);
+  ASSERT_EQ(stat2.ZerothServer(), 777);
+}
+
 class LookupEntryTest {};
 
 TEST(LookupEntryTest, EntryEncoding) {
@@ -123,6 +152,31 @@ TEST(LookupEntryTest, EntryEncoding) {
   ASSERT_EQ(encoding, encoding2);
 }
 
+TEST(LookupEntryTest, EntryFixedEncoding) {
+  LookupStat ent;
+  ent.SetRegId(13);
+  ent.SetSnapId(37);
+  ent.SetInodeNo(12345);
+  ent.SetDirMode(678);
+  ent.SetUserId(11);
+  ent.SetGroupId(22);
+  ent.SetZerothServer(777);
+  ent.SetLeaseDue(55667788);
+  char tmp[LookupStat::kFixedEncodedLength];
+  ent.EncodeFixedTo(tmp);
+  LookupStat ent2;
+  ent2.DecodeFixedFrom(tmp);
+  ent2.AssertAllSet();
+  ASSERT_EQ(ent2.RegId(), 13);
+  ASSERT_EQ(ent2.SnapId(), 37);
+  ASSERT_EQ(ent2.InodeNo(), 12345);
+  ASSERT_EQ(ent2.DirMode(), 678);
+  ASSERT_EQ(ent2.UserId(), 11);
+  ASSERT_EQ(ent2.GroupId(), 22);
+  ASSERT_EQ(ent2.ZerothServer(), 777);
+  ASSERT_EQ(ent2.LeaseDue(), 55667788);
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char** argv) {
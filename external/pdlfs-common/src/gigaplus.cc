@@ -531,6 +531,35 @@ int DirIndex::NewIndexForSplitting(int index) const {
   return i;
 }
 
+// The next split of a partition moves all files whose hashes have the
+// radix bit of the new child set. Until then, the partition's files share
+// all hash bits below that radix with the partition's index. Index bits are
+// taken from the hash from the most significant bit of its first byte, so
+// these files are contiguous in the byte order of their hashes.
+void DirIndex::GetSplitRange(int index, std::string* lower,
+                             std::string* upper) const {
+  const int r = ToRadix(NewIndexForSplitting(index)) - 1;
+  char tmp[8];
+  memset(tmp, 0, sizeof(tmp));
+  for (int i = 0; i < r; i++) {
+    if (index & (1 << i)) {
+      tmp[i / 8] |= static_cast<char>(0x80 >> (i % 8));
+    }
+  }
+  lower->assign(tmp, sizeof(tmp));
+  upper->clear();
+  // Add one to the last bit of the prefix and propagate the carry
+  for (int i = r - 1; i >= 0; i--) {
+    const char bit = static_cast<char>(0x80 >> (i % 8));
+    if ((tmp[i / 8] & bit) == 0) {
+      tmp[i / 8] |= bit;
+      upper->assign(tmp, sizeof(tmp));
+      break;
+    }
+    tmp[i / 8] &= ~bit;
+  }
+}
+
 // Determine the partition responsible for the given name from the
 // current state of the directory index.
 int DirIndex::GetIndex(const Slice& name) const {
@@ -606,12 +635,14 @@ DirIndex::DirIndex(const DirIndexOptions* options) {
 
 DirIndex::~DirIndex() { delete rep_; }
 
-// Return a random server for a specified directory.
+// Return a random server for a specified directory. Hashes are unsigned,
+// so the top bit is cleared to keep the result non-negative.
 int DirIndex::RandomServer(const Slice& dir, int seed) {
-  return xxhash32(dir.data(), dir.size(), seed);
+  return xxhash32(dir.data(), dir.size(), seed) & 0x7fffffff;
 }
 
 // Return a pair of random servers for a specified directory.
+// Both servers are non-negative.
 std::pair<int, int> DirIndex::RandomServers(const Slice& dir, int seed) {
   uint64_t h = xxhash64(dir.data(), dir.size(), seed);
   char* tmp = reinterpret_cast<char*>(&h);
@@ -619,7 +650,7 @@ std::pair<int, int> DirIndex::RandomServers(const Slice& dir, int seed) {
   int s2;
   memcpy(&s1, tmp, 4);
   memcpy(&s2, tmp + 4, 4);
-  std::pair<int, int> r = std::make_pair(s1, s2);
+  std::pair<int, int> r = std::make_pair(s1 & 0x7fffffff, s2 & 0x7fffffff);
   return r;
 }
 
@@ -14,6 +14,7 @@
 
 #include "pdlfs-common/gigaplus.h"
 #include "pdlfs-common/testharness.h"
+#include "pdlfs-common/xxhash.h"
 
 namespace pdlfs {
 
@@ -308,6 +309,35 @@ TEST(DirIndexTest, Split2) {
   ASSERT_TRUE(!idx_->IsSplittable(b[kNumRadix]));
 }
 
+TEST(DirIndexTest, SplitRange) {
+  std::string lower, upper;
+  idx_->GetSplitRange(0, &lower, &upper);
+  ASSERT_EQ(lower, std::string(8, 0));
+  ASSERT_TRUE(upper.empty());
+  idx_->Set(1);
+  idx_->Set(3);
+  idx_->Set(2);
+  idx_->Set(5);
+  int parts[] = {0, 1, 2, 3, 5};
+  for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+    idx_->GetSplitRange(parts[i], &lower, &upper);
+    const int child = idx_->NewIndexForSplitting(parts[i]);
+    int moved = 0;
+    for (int j = 0; j < 10000; j++) {
+      char hash[40];
+      Slice h = DirIndex::Hash(File(j), hash);
+      const int index = idx_->HashToIndex(h);
+      const bool r = h.compare(lower) >= 0 &&
+                     (upper.empty() || h.compare(upper) < 0);
+      ASSERT_EQ(index == parts[i], r);
+      if (r) {
+        moved += Migrate(child, hash);
+      }
+    }
+    ASSERT_TRUE(moved > 0);
+  }
+}
+
 static int Sum(const int* array, int size) {
   int sum = 0;
   for (int i = 0; i < size; ++i) {
@@ -495,6 +525,21 @@ TEST(DirIndexTest, RandomServer1) {
   }
 }
 
+TEST(DirIndexTest, RandomServer3) {
+  int num_large = 0;
+  for (int i = 0; i < 1000; i++) {
+    std::string dir = File(i);
+    uint32_t h = xxhash32(dir.data(), dir.size(), 0);
+    if (h & 0x80000000u) num_large++;
+    int s = DirIndex::RandomServer(dir, 0);
+    ASSERT_EQ(s, static_cast<int>(h & 0x7fffffff));
+    std::pair<int, int> r = DirIndex::RandomServers(dir, 0);
+    ASSERT_TRUE(r.first >= 0 && r.second >= 0);
+  }
+  // Roughly half of all hashes have their top bit set
+  ASSERT_TRUE(num_large > 0);
+}
+
 class Client {
  public:
   int PickupServer(const std::string& dir) {
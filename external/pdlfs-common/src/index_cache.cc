@@ -63,6 +63,11 @@ IndexCache::Handle* IndexCache::Lookup(const DirId& id) {
     mu_->Lock();
   }
   Handle* h = reinterpret_cast<Handle*>(lru_.Lookup(key, hash));
+  if (h != NULL) {
+    stats_.hits++;
+  } else {
+    stats_.misses++;
+  }
   if (mu_ != NULL) {
     mu_->Unlock();
   }
@@ -99,4 +104,14 @@ void IndexCache::Erase(const DirId& id) {
   }
 }
 
+void IndexCache::GetStats(Stats* stats) {
+  if (mu_ != NULL) {
+    mu_->Lock();
+  }
+  *stats = stats_;
+  if (mu_ != NULL) {
+    mu_->Unlock();
+  }
+}
+
 }  // namespace pdlfs
@@ -11,12 +11,16 @@
 #include "../merger.h"
 #include "db_iter.h"
 #include "memtable.h"
+#include "value_log.h"
 #include "version_edit.h"
 #include "version_set.h"
 
+#include "pdlfs-common/coding.h"
 #include "pdlfs-common/dbfiles.h"
 #include "pdlfs-common/mutexlock.h"
 
+#include <algorithm>
+
 namespace pdlfs {
 
 Column::~Column() {}
@@ -74,9 +78,504 @@ Status ColumnImpl::Recover() {
   return s;
 }
 
+// Max number of value logs to keep open at the same time
+static const size_t kMaxOpenValueLogs = 256;
+
+LSMKeyColumn::LSMKeyColumn(const Options& options, DBImpl* db)
+    : ColumnImpl(db),
+      min_value_size_(options.value_log_min_value_size),
+      gc_ratio_(options.value_log_gc_ratio),
+      env_(options.env),
+      log_cache_(NewLRUCache(kMaxOpenValueLogs)),
+      logfile_(NULL),
+      log_(NULL),
+      logfile_number_(0),
+      get_hook_(NULL),
+      get_hook_arg_(NULL) {}
+
+LSMKeyColumn::~LSMKeyColumn() {
+  delete log_;
+  if (logfile_ != NULL) {
+    logfile_->Close();
+    delete logfile_;
+  }
+  delete log_cache_;
+}
+
+static void DeleteValueLog(const Slice& key, void* value) {
+  delete reinterpret_cast<ValueLog*>(value);
+}
+
+Status LSMKeyColumn::FindLog(uint64_t number, Cache::Handle** handle) {
+  char buf[8];
+  EncodeFixed64(buf, number);
+  Slice key(buf, sizeof(buf));
+  *handle = log_cache_->Lookup(key);
+  if (*handle == NULL) {
+    ValueLog* log;
+    Status s =
+        ValueLog::Open(env_, ValueLogFileName(db_->dbname_, number), &log);
+    if (!s.ok()) {
+      return s;
+    }
+    *handle = log_cache_->Insert(key, log, 1, &DeleteValueLog);
+  }
+  return Status::OK();
+}
+
+Status LSMKeyColumn::ResolveValue(const Slice& stored, size_t limit,
+                                  bool verify_checksums, Slice* result,
+                                  std::string* scratch) {
+  Slice input = stored;
+  if (input.empty()) {
+    return Status::Corruption("Missing value tag");
+  }
+  const char tag = input[0];
+  input.remove_prefix(1);
+  if (tag == kInlineValue) {
+    *result = Slice(input.data(), std::min(limit, input.size()));
+    return Status::OK();
+  } else if (tag != kValuePointer) {
+    return Status::Corruption("Unknown value tag");
+  }
+
+  ValuePointer ptr;
+  if (!DecodeValuePointer(&input, &ptr)) {
+    return Status::Corruption("Bad value pointer");
+  }
+  Cache::Handle* handle;
+  Status s = FindLog(ptr.number, &handle);
+  if (s.ok()) {
+    ValueLog* log = reinterpret_cast<ValueLog*>(log_cache_->Value(handle));
+    s = log->Read(ptr, limit, verify_checksums, result, scratch);
+    log_cache_->Release(handle);
+  }
+  return s;
+}
+
+Status LSMKeyColumn::NewLog() {
+  assert(logfile_ == NULL);
+  {
+    MutexLock l(&db_->mutex_);
+    logfile_number_ = db_->versions_->NewFileNumber();
+  }
+  WritableFile* file;
+  const std::string fname = ValueLogFileName(db_->dbname_, logfile_number_);
+  Status s = env_->NewWritableFile(fname.c_str(), &file);
+  if (s.ok()) {
+    logfile_ = file;
+    log_ = new ValueLogWriter(logfile_);
+    s = log_->WriteHeader(kValueLog);
+  }
+  return s;
+}
+
+Status LSMKeyColumn::WriteTableStart() {
+  // Logs are created on demand
+  return Status::OK();
+}
+
+// Move large values to a value log and only insert their pointers
+// into the LSM. Values are synced to storage before the LSM may point
+// to them.
+Status LSMKeyColumn::WriteTable(Iterator* contents) {
+  MemTable* mem = new MemTable(db_->internal_comparator_);
+  mem->Ref();
+  Status s;
+  ParsedInternalKey ikey;
+  std::string stored;
+  for (contents->SeekToFirst(); s.ok() && contents->Valid();
+       contents->Next()) {
+    if (!ParseInternalKey(contents->key(), &ikey)) {
+      s = Status::Corruption("Malformed internal key");
+      break;
+    }
+    Slice value = contents->value();
+    if (ikey.type == kTypeValue) {
+      stored.clear();
+      if (value.size() >= min_value_size_) {
+        if (log_ == NULL) {
+          s = NewLog();
+        }
+        ValuePointer ptr;
+        ptr.number = logfile_number_;
+        ptr.size = static_cast<uint32_t>(value.size());
+        if (s.ok()) {
+          s = log_->AddRecord(contents->key(), value, &ptr.offset);
+        }
+        stored.push_back(static_cast<char>(kValuePointer));
+        EncodeValuePointer(&stored, ptr);
+      } else {
+        stored.push_back(static_cast<char>(kInlineValue));
+        stored.append(value.data(), value.size());
+      }
+      value = stored;
+    }
+    if (s.ok()) {
+      mem->Add(ikey.sequence, ikey.type, ikey.user_key, value);
+    }
+  }
+
+  if (s.ok()) {
+    s = contents->status();
+  }
+  if (s.ok() && logfile_ != NULL) {
+    s = logfile_->Sync();
+  }
+  if (s.ok()) {
+    Iterator* iter = mem->NewIterator();
+    s = db_->BulkInsert(iter);
+    delete iter;
+  }
+
+  mem->Unref();
+  return s;
+}
+
+Status LSMKeyColumn::WriteTableEnd() {
+  Status s;
+  uint64_t budget = 0;
+  if (logfile_ != NULL) {
+    budget = log_->FileSize();
+    s = logfile_->Close();
+    delete log_;
+    log_ = NULL;
+    delete logfile_;
+    logfile_ = NULL;
+    if (s.ok()) {
+      logs_.push_back(logfile_number_);
+    }
+  }
+
+  // Visit at least one log so space is eventually reclaimed even when
+  // no new values are written
+  uint64_t visited = 0;
+  size_t n = logs_.size();
+  while (s.ok() && n-- != 0) {
+    const uint64_t number = logs_.front();
+    logs_.pop_front();
+    uint64_t bytes = 0;
+    bool deleted = false;
+    Status gc = CollectGarbage(number, &bytes, &deleted);
+    if (!gc.ok()) {
+      // Will retry in the next round
+      Log(db_->options_.info_log, "Value log #%llu gc error: %s",
+          static_cast<unsigned long long>(number), gc.ToString().c_str());
+    }
+    if (!deleted) {
+      logs_.push_back(number);
+    }
+    visited += bytes;
+    if (visited >= budget) {
+      break;
+    }
+  }
+
+  return s;
+}
+
+struct LSMKeyColumn::LiveRecord {
+  Slice ikey;
+  Slice value;
+  uint64_t offset;  // Original offset of the value
+};
+
+// A value is live if the LSM still stores the exact key-pointer pair
+// that was written along with it. Records of a log are sorted by key,
+// so checking all of them costs a single pass over the LSM. Liveness is
+// judged against the current version only. Older versions still held by
+// iterators or reads may point to records the current version no longer
+// does, so a log is only deleted or rewritten when the current version is
+// the only live one. Otherwise it is retried in a later round. Keys needed
+// by snapshots are kept by LSM compactions and therefore remain live.
+Status LSMKeyColumn::CollectGarbage(uint64_t number, uint64_t* bytes,
+                                    bool* deleted) {
+  Cache::Handle* handle;
+  Status s = FindLog(number, &handle);
+  if (!s.ok()) {
+    return s;
+  }
+
+  ValueLog* log = reinterpret_cast<ValueLog*>(log_cache_->Value(handle));
+  std::vector<LiveRecord> live;
+  uint64_t live_bytes = 0;
+  uint64_t total_bytes = 0;
+  bool no_old_versions = false;
+  std::string scratch;
+  Slice input;
+  s = log->ReadRecords(&input, &scratch);
+  if (s.ok()) {
+    *bytes = input.size();
+    Iterator* iter = ColumnImpl::NewInternalIterator(ReadOptions());
+    const char* const start = input.data();
+    LiveRecord rec;
+    ValuePointer ptr;
+    while (!input.empty()) {
+      if (!ValueLog::ParseRecord(&input, &rec.ikey, &rec.value)) {
+        s = Status::Corruption("Bad value log record");
+        break;
+      }
+      rec.offset = log->OriginalOffset(ValueLog::RecordsOffset() +
+                                       (rec.value.data() - start));
+      total_bytes += rec.value.size();
+      iter->Seek(rec.ikey);
+      if (iter->Valid() && iter->key() == rec.ikey) {
+        Slice stored = iter->value();
+        if (!stored.empty() && stored[0] == kValuePointer) {
+          stored.remove_prefix(1);
+          if (DecodeValuePointer(&stored, &ptr) && ptr.number == number &&
+              ptr.offset == rec.offset) {
+            live_bytes += rec.value.size();
+            live.push_back(rec);
+          }
+        }
+      }
+    }
+    if (s.ok()) {
+      s = iter->status();
+    }
+    if (s.ok()) {
+      // Must be checked while iter still holds the version it has scanned
+      MutexLock l(&db_->mutex_);
+      no_old_versions = db_->versions_->OnlyCurrentIsLive();
+    }
+    delete iter;
+  }
+
+  bool changed = false;
+  if (s.ok() && no_old_versions) {
+    if (live.empty()) {
+      const std::string fname = ValueLogFileName(db_->dbname_, number);
+      s = env_->DeleteFile(fname.c_str());
+      if (s.ok()) {
+        *deleted = true;
+        changed = true;
+      }
+    } else if (live_bytes < gc_ratio_ * total_bytes) {
+      s = RewriteLog(number, live);
+      changed = s.ok();
+    }
+  }
+
+  log_cache_->Release(handle);
+  if (changed) {
+    // Readers holding the old log may continue to use it
+    char buf[8];
+    EncodeFixed64(buf, number);
+    log_cache_->Erase(Slice(buf, sizeof(buf)));
+  }
+  return s;
+}
+
+// Copy live records to a temporary file and then atomically
+// replace the old log with it.
+Status LSMKeyColumn::RewriteLog(uint64_t number,
+                                const std::vector<LiveRecord>& records) {
+  uint64_t tmp_number;
+  {
+    MutexLock l(&db_->mutex_);
+    tmp_number = db_->versions_->NewFileNumber();
+    db_->pending_outputs_.insert(tmp_number);
+  }
+  const std::string tmp = TempFileName(db_->dbname_, tmp_number);
+  WritableFile* file;
+  Status s = env_->NewWritableFile(tmp.c_str(), &file);
+  if (s.ok()) {
+    ValueLogWriter writer(file);
+    std::vector<std::pair<uint64_t, uint64_t> > remap;
+    remap.reserve(records.size());
+    s = writer.WriteHeader(kCompactedValueLog);
+    for (size_t i = 0; s.ok() && i < records.size(); i++) {
+      uint64_t offset;
+      s = writer.AddRecord(records[i].ikey, records[i].value, &offset);
+      remap.push_back(std::make_pair(records[i].offset, offset));
+    }
+    if (s.ok()) {
+      s = writer.WriteRemap(remap);
+    }
+    if (s.ok()) {
+      s = file->Sync();
+    }
+    if (s.ok()) {
+      s = file->Close();
+    }
+    delete file;
+  }
+
+  if (s.ok()) {
+    const std::string fname = ValueLogFileName(db_->dbname_, number);
+    s = env_->RenameFile(tmp.c_str(), fname.c_str());
+  }
+  if (!s.ok()) {
+    env_->DeleteFile(tmp.c_str());
+  }
+
+  MutexLock l(&db_->mutex_);
+  db_->pending_outputs_.erase(tmp_number);
+  return s;
+}
+
+// Resolve value pointers on demand while iterating the LSM.
+class LSMKeyColumn::Iter : public Iterator {
+ public:
+  Iter(LSMKeyColumn* column, Iterator* iter, bool verify_checksums)
+      : column_(column),
+        iter_(iter),
+        verify_checksums_(verify_checksums),
+        resolved_(false) {}
+
+  virtual ~Iter() { delete iter_; }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+
+  virtual void Seek(const Slice& target) {
+    iter_->Seek(target);
+    resolved_ = false;
+  }
+
+  virtual void SeekToFirst() {
+    iter_->SeekToFirst();
+    resolved_ = false;
+  }
+
+  virtual void SeekToLast() {
+    iter_->SeekToLast();
+    resolved_ = false;
+  }
+
+  virtual void Next() {
+    iter_->Next();
+    resolved_ = false;
+  }
+
+  virtual void Prev() {
+    iter_->Prev();
+    resolved_ = false;
+  }
+
+  virtual Slice key() const {
+    assert(Valid());
+    return iter_->key();
+  }
+
+  virtual Slice value() const {
+    assert(Valid());
+    if (!resolved_) {
+      resolved_ = true;
+      value_ = iter_->value();
+      ParsedInternalKey ikey;
+      if (ParseInternalKey(iter_->key(), &ikey) && ikey.type == kTypeValue) {
+        const Slice stored = value_;
+        Status s = column_->ResolveValue(stored, ReadOptions().limit,
+                                         verify_checksums_, &value_, &scratch_);
+        if (!s.ok()) {
+          status_ = s;
+          value_ = Slice();
+        }
+      }
+    }
+    return value_;
+  }
+
+  virtual Status status() const {
+    if (status_.ok()) {
+      return iter_->status();
+    } else {
+      return status_;
+    }
+  }
+
+ private:
+  LSMKeyColumn* const column_;
+  Iterator* const iter_;
+  const bool verify_checksums_;
+  mutable Status status_;
+  mutable std::string scratch_;
+  mutable Slice value_;
+  mutable bool resolved_;
+};
+
+Iterator* LSMKeyColumn::NewInternalIterator(const ReadOptions& options) {
+  return new Iter(this, ColumnImpl::NewInternalIterator(options),
+                  options.verify_checksums);
+}
+
+Status LSMKeyColumn::Get(const ReadOptions& options, const LookupKey& lkey,
+                         Buffer* result) {
+  ReadOptions opts = options;
+  opts.limit = ReadOptions().limit;  // Always fetch stored values in full
+  // Pin a version until the value is resolved so that garbage collection
+  // keeps the log the lookup may point to. Lookups only use this or newer
+  // versions. Either this version stays current, so any pointer found is
+  // live, or it becomes old and defers garbage collection.
+  Version* pinned;
+  {
+    MutexLock l(&db_->mutex_);
+    pinned = db_->versions_->current();
+    pinned->Ref();
+  }
+  std::string stored;
+  buffer::StringBuf buf(&stored);
+  Status s = db_->Get(opts, lkey, &buf);
+  if (s.ok()) {
+    if (get_hook_ != NULL) {
+      (*get_hook_)(get_hook_arg_);
+    }
+    std::string scratch;
+    Slice value;
+    s = ResolveValue(stored, options.limit, options.verify_checksums, &value,
+                     &scratch);
+    if (s.ok()) {
+      result->Fill(value.data(), value.size());
+    }
+  }
+  MutexLock l(&db_->mutex_);
+  pinned->Unref();
+  return s;
+}
+
+void LSMKeyColumn::TEST_SetGetHook(void (*hook)(void*), void* arg) {
+  get_hook_ = hook;
+  get_hook_arg_ = arg;
+}
+
+Status LSMKeyColumn::Recover() {
+  Status s = ColumnImpl::Recover();
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Logs numbered beyond what the LSM has committed were written by
+  // memtable compactions that did not finish and are never referenced
+  uint64_t next_file_number;
+  {
+    MutexLock l(&db_->mutex_);
+    next_file_number = db_->versions_->NewFileNumber();
+    db_->versions_->ReuseFileNumber(next_file_number);
+  }
+  std::vector<std::string> filenames;
+  env_->GetChildren(db_->dbname_.c_str(), &filenames);  // Ignoring errors
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) &&
+        type == kValueLogFile) {
+      if (number < next_file_number) {
+        logs_.push_back(number);
+      } else {
+        const std::string fname = db_->dbname_ + "/" + filenames[i];
+        env_->DeleteFile(fname.c_str());
+      }
+    }
+  }
+
+  std::sort(logs_.begin(), logs_.end());
+  return s;
+}
+
 ColumnarDBImpl::ColumnarDBImpl(const Options& options,
                                const std::string& dbname)
-    : DBImpl(options, dbname) {}
+    : DBImpl(options, dbname), column_pool_(ThreadPool::NewFixed(1)) {}
 
 ColumnarDBImpl::~ColumnarDBImpl() {
   // Wait for background work to finish
@@ -91,6 +590,7 @@ ColumnarDBImpl::~ColumnarDBImpl() {
   for (size_t i = 0; i < num_columns; i++) {
     columns_[i]->Unref();
   }
+  delete column_pool_;
 }
 
 Status ColumnarDBImpl::PreRecover(Column::RecoverMethod* method) {
@@ -393,6 +893,11 @@ Status ColumnarDBWrapper::TEST_CompactMemTable() {
   return impl_->TEST_CompactMemTable();
 }
 
+Column* ColumnarDBWrapper::TEST_GetColumn(size_t column_index) {
+  assert(column_index < impl_->columns_.size());
+  return impl_->columns_[column_index];
+}
+
 Status Column::Open(ColumnStyle style, RecoverMethod method,
                     const Options& options, const std::string& name,
                     Column** result) {
@@ -403,6 +908,9 @@ Status Column::Open(ColumnStyle style, RecoverMethod method,
     case kLSMStyle:
       column = new ColumnImpl(new DBImpl(options, name));
       break;
+    case kLSMKeyStyle:
+      column = new LSMKeyColumn(options, new DBImpl(options, name));
+      break;
     default:
       return Status::NotSupported(Slice());
   }
@@ -438,10 +946,12 @@ Status ColumnarDB::Open(const Options& options, const std::string& dbname,
   Column::RecoverMethod method;
   Status s = impl->PreRecover(&method);
   if (s.ok()) {
+    DBOptions column_options = options;
+    column_options.compaction_pool = impl->column_pool_;
     for (size_t i = 0; i < num_columns; i++) {
       Column* column;
-      s = Column::Open(column_styles[i], method, options, ColumnName(dbname, i),
-                       &column);
+      s = Column::Open(column_styles[i], method, column_options,
+                       ColumnName(dbname, i), &column);
       if (s.ok()) {
         impl->columns_.push_back(column);
       } else {
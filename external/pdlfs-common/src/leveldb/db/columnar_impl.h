@@ -11,8 +11,12 @@
 
 #include "db_impl.h"
 
+#include "pdlfs-common/cache.h"
 #include "pdlfs-common/leveldb/db/columnar_db.h"
 
+#include <deque>
+#include <vector>
+
 namespace pdlfs {
 
 class Column {
@@ -71,10 +75,70 @@ class ColumnImpl : public Column {
   virtual Status PreRecover(RecoverMethod method);
   virtual Status Recover();
 
- private:
+ protected:
   DBImpl* db_;
 };
 
+class ValueLog;
+class ValueLogWriter;
+
+// A column whose LSM only stores keys and pointers to values. Values at
+// least options.value_log_min_value_size bytes are written to a value log
+// and are therefore never rewritten by LSM compactions. Smaller values
+// stay inline. After each memtable compaction, logs are garbage collected
+// in a round-robin fashion until about as many bytes have been visited as
+// were just written. A value is live as long as the LSM still stores the
+// key-pointer pair that references it. Logs are not deleted or rewritten
+// while iterators or reads hold versions older than the current one.
+// Reads hold their version until values are read from logs.
+class LSMKeyColumn : public ColumnImpl {
+ public:
+  LSMKeyColumn(const Options& options, DBImpl* db);
+  virtual ~LSMKeyColumn();
+
+  virtual Status WriteTableStart();
+  virtual Status WriteTable(Iterator* contents);
+  virtual Status WriteTableEnd();
+
+  virtual Iterator* NewInternalIterator(const ReadOptions& options);
+  virtual Status Get(const ReadOptions& options, const LookupKey& lkey,
+                     Buffer* result);
+
+  virtual Status Recover();
+
+  // Invoke hook(arg) in Get() after the LSM lookup and before the value is
+  // read from its log. For testing only.
+  void TEST_SetGetHook(void (*hook)(void*), void* arg);
+
+ private:
+  class Iter;
+  struct LiveRecord;
+  Status NewLog();
+  Status FindLog(uint64_t number, Cache::Handle** handle);
+  // Translate a value stored in the LSM to the actual value.
+  Status ResolveValue(const Slice& stored, size_t limit, bool verify_checksums,
+                      Slice* result, std::string* scratch);
+  Status CollectGarbage(uint64_t number, uint64_t* bytes, bool* deleted);
+  Status RewriteLog(uint64_t number, const std::vector<LiveRecord>& records);
+
+  const size_t min_value_size_;
+  const double gc_ratio_;
+  Env* const env_;
+  Cache* log_cache_;  // Opened logs
+
+  // Log being written by the current memtable compaction
+  WritableFile* logfile_;
+  ValueLogWriter* log_;
+  uint64_t logfile_number_;
+
+  // Committed logs in the order they are to be garbage collected.
+  // Only accessed by memtable compactions.
+  std::deque<uint64_t> logs_;
+
+  void (*get_hook_)(void*);
+  void* get_hook_arg_;
+};
+
 class ColumnarDBImpl : public DBImpl {
  public:
   ColumnarDBImpl(const Options& options, const std::string& dbname);
@@ -90,6 +154,7 @@ class ColumnarDBImpl : public DBImpl {
 
  protected:
   friend class ColumnarDB;
+  friend class ColumnarDBWrapper;
 
   Status PreRecover(Column::RecoverMethod*);
 
@@ -105,6 +170,9 @@ class ColumnarDBImpl : public DBImpl {
 
   const ColumnSelector* selector_;
   std::vector<Column*> columns_;
+  // Memtable compactions wait for the compactions of columns to finish
+  // so columns cannot share their threads with us
+  ThreadPool* column_pool_;
 };
 
 class ColumnarDBWrapper : public ColumnarDB {
@@ -130,6 +198,9 @@ class ColumnarDBWrapper : public ColumnarDB {
   // Force current memtable contents to be compacted.
   Status TEST_CompactMemTable();
 
+  // Return the column at the specified index.
+  Column* TEST_GetColumn(size_t column_index);
+
  private:
   ColumnarDBImpl* impl_;
 };
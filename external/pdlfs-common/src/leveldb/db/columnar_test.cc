@@ -26,21 +26,56 @@ class TestColumnSelector : public ColumnSelector {
 
 class ColumnarTest {
  public:
-  ColumnarTest() {
+  ColumnarTest() : db_(NULL) {
     dbname_ = test::TmpDir() + "/columnar_test";
     DestroyDB(ColumnName(dbname_, 0), Options());
     DestroyDB(dbname_, Options());
     options_.create_if_missing = true;
     options_.skip_lock_file = true;
+    Open(kLSMStyle);
+  }
+
+  ~ColumnarTest() {
+    delete db_;  //
+  }
+
+  void Open(ColumnStyle style) {
+    delete db_;
+    db_ = NULL;
     ColumnStyle styles[1];
-    styles[0] = kLSMStyle;
+    styles[0] = style;
     Status s =
         ColumnarDB::Open(options_, dbname_, &column_selector_, styles, 1, &db_);
     ASSERT_OK(s);
   }
 
-  ~ColumnarTest() {
-    delete db_;  //
+  // Start over with an empty db of the specified column style.
+  void Reset(ColumnStyle style) {
+    delete db_;
+    db_ = NULL;
+    DestroyDB(ColumnName(dbname_, 0), Options());
+    DestroyDB(dbname_, Options());
+    Open(style);
+  }
+
+  // Return the total size of all value logs.
+  uint64_t ValueLogBytes() {
+    uint64_t result = 0;
+    std::vector<std::string> names;
+    const std::string column = ColumnName(dbname_, 0);
+    Env* const env = Env::Default();
+    env->GetChildren(column.c_str(), &names);
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < names.size(); i++) {
+      if (ParseFileName(names[i], &number, &type) && type == kValueLogFile) {
+        uint64_t size;
+        const std::string fname = column + "/" + names[i];
+        ASSERT_OK(env->GetFileSize(fname.c_str(), &size));
+        result += size;
+      }
+    }
+    return result;
   }
 
   std::string Get(const Slice& key) {
@@ -81,6 +116,199 @@ TEST(ColumnarTest, Put) {
   ASSERT_EQ(Get("bar"), "v2");
 }
 
+TEST(ColumnarTest, LSMKeyPut) {
+  options_.value_log_min_value_size = 8;
+  Reset(kLSMKeyStyle);
+  const std::string large(100, 'x');
+  ASSERT_OK(db_->Put(WriteOptions(), "foo", "v1"));
+  ASSERT_OK(db_->Put(WriteOptions(), "bar", large));
+  ASSERT_OK(db_->Put(WriteOptions(), "baz", large));
+  ASSERT_OK(db_->Delete(WriteOptions(), "baz"));
+  ASSERT_EQ(ValueLogBytes(), 0);
+
+  CompactMemTable();
+  ASSERT_TRUE(ValueLogBytes() > 2 * large.size());
+  ASSERT_EQ(Get("foo"), "v1");
+  ASSERT_EQ(Get("bar"), large);
+  ASSERT_EQ(Get("baz"), "NOT_FOUND");
+
+  ReadOptions options;
+  options.verify_checksums = true;
+  std::string value;
+  ASSERT_OK(db_->Get(options, "bar", &value));
+  ASSERT_EQ(value, large);
+  options.limit = 10;
+  ASSERT_OK(db_->Get(options, "bar", &value));
+  ASSERT_EQ(value, large.substr(0, 10));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(iter->key().ToString(), "bar");
+  ASSERT_EQ(iter->value().ToString(), large);
+  iter->Next();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(iter->key().ToString(), "foo");
+  ASSERT_EQ(iter->value().ToString(), "v1");
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  Open(kLSMKeyStyle);
+  ASSERT_EQ(Get("foo"), "v1");
+  ASSERT_EQ(Get("bar"), large);
+}
+
+TEST(ColumnarTest, LSMKeyGarbageCollection) {
+  options_.value_log_min_value_size = 8;
+  options_.value_log_gc_ratio = 1.0;  // Rewrite logs as soon as possible
+  Reset(kLSMKeyStyle);
+  const int kNumKeys = 100;
+  const int kRounds = 10;
+  std::vector<std::string> values(kNumKeys);
+  char key[20];
+  // The first round writes all keys. Each later round
+  // overwrites a different tenth of them.
+  for (int r = 0; r < kRounds; r++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      if (r == 0 || i % kRounds == r) {
+        snprintf(key, sizeof(key), "k%03d", i);
+        values[i] = std::string(100, 'a' + r) + key;
+        ASSERT_OK(db_->Put(WriteOptions(), key, values[i]));
+      }
+    }
+    CompactMemTable();
+    for (int i = 0; i < kNumKeys; i++) {
+      snprintf(key, sizeof(key), "k%03d", i);
+      ASSERT_EQ(Get(key), values[i]);
+    }
+  }
+
+  // Flushes without large values still let garbage collection make progress
+  for (int r = 0; r < kRounds; r++) {
+    ASSERT_OK(db_->Put(WriteOptions(), "small", "v"));
+    CompactMemTable();
+  }
+
+  // Only live values remain
+  const uint64_t bytes = ValueLogBytes();
+  ASSERT_TRUE(bytes < kNumKeys * (values[0].size() + 32)) << bytes;
+  Open(kLSMKeyStyle);
+  for (int i = 0; i < kNumKeys; i++) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    ASSERT_EQ(Get(key), values[i]);
+  }
+}
+
+// Logs must outlive older versions still held by iterators
+TEST(ColumnarTest, LSMKeyGarbageCollectionWithIterator) {
+  options_.value_log_min_value_size = 8;
+  options_.value_log_gc_ratio = 1.0;  // Rewrite logs as soon as possible
+  Reset(kLSMKeyStyle);
+  const int kNumKeys = 100;
+  const int kRounds = 10;
+  char key[20];
+  for (int i = 0; i < kNumKeys; i++) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    ASSERT_OK(db_->Put(WriteOptions(), key, std::string(100, 'a') + key));
+  }
+  CompactMemTable();
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  // Overwrite all keys so the first log no longer holds any live value
+  for (int r = 1; r < kRounds; r++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      snprintf(key, sizeof(key), "k%03d", i);
+      ASSERT_OK(db_->Put(WriteOptions(), key, std::string(100, 'a' + r) + key));
+    }
+    CompactMemTable();
+  }
+  int n = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    snprintf(key, sizeof(key), "k%03d", n++);
+    ASSERT_EQ(iter->value().ToString(), std::string(100, 'a') + key);
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(n, kNumKeys);
+  delete iter;
+
+  // Garbage collection resumes once the iterator is gone. Logs skipped
+  // while it was alive are now visited again one at a time.
+  for (int r = 0; r < 2 * kRounds; r++) {
+    ASSERT_OK(db_->Put(WriteOptions(), "small", "v"));
+    CompactMemTable();
+  }
+  const uint64_t bytes = ValueLogBytes();
+  ASSERT_TRUE(bytes < kNumKeys * (100 + 32)) << bytes;
+  for (int i = 0; i < kNumKeys; i++) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    ASSERT_EQ(Get(key), std::string(100, 'a' + kRounds - 1) + key);
+  }
+}
+
+static const int kGetHookRounds = 16;
+
+namespace {
+struct GetHookState {
+  ColumnarTest* test;
+  int calls;
+};
+}
+
+// Overwrite all keys and flush repeatedly so that the LSM compacts away
+// older values and garbage collection runs while the read is between its
+// LSM lookup and reading the value log.
+static void OverwriteAndCollect(void* arg) {
+  GetHookState* state = reinterpret_cast<GetHookState*>(arg);
+  if (state->calls++ != 0) {
+    return;
+  }
+  ColumnarTest* test = state->test;
+  char key[20];
+  for (int r = 1; r < kGetHookRounds; r++) {
+    for (int i = 0; i < 10; i++) {
+      snprintf(key, sizeof(key), "k%03d", i);
+      ASSERT_OK(test->db_->Put(WriteOptions(), key,
+                               std::string(100, 'a' + r) + key));
+    }
+    test->CompactMemTable();
+  }
+}
+
+// Logs must outlive the versions read by in-flight gets
+TEST(ColumnarTest, LSMKeyGarbageCollectionWithGet) {
+  options_.value_log_min_value_size = 8;
+  options_.value_log_gc_ratio = 1.0;  // Rewrite logs as soon as possible
+  Reset(kLSMKeyStyle);
+  char key[20];
+  for (int i = 0; i < 10; i++) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    ASSERT_OK(db_->Put(WriteOptions(), key, std::string(100, 'a') + key));
+  }
+  CompactMemTable();
+  LSMKeyColumn* column = static_cast<LSMKeyColumn*>(
+      static_cast<ColumnarDBWrapper*>(db_)->TEST_GetColumn(0));
+  GetHookState state;
+  state.test = this;
+  state.calls = 0;
+  column->TEST_SetGetHook(OverwriteAndCollect, &state);
+  ASSERT_EQ(Get("k000"), std::string(100, 'a') + "k000");
+  column->TEST_SetGetHook(NULL, NULL);
+  ASSERT_EQ(state.calls, 1);
+
+  // Logs skipped while the get was in flight are collected afterwards
+  for (int r = 0; r < 4 * kGetHookRounds; r++) {
+    ASSERT_OK(db_->Put(WriteOptions(), "small", "v"));
+    CompactMemTable();
+  }
+  const uint64_t bytes = ValueLogBytes();
+  ASSERT_TRUE(bytes < 10 * (100 + 32)) << bytes;
+  for (int i = 0; i < 10; i++) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    ASSERT_EQ(Get(key), std::string(100, 'a' + kGetHookRounds - 1) + key);
+  }
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char** argv) {
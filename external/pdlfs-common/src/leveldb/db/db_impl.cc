@@ -74,16 +74,101 @@ struct DBImpl::CompactionState {
   };
   std::vector<Output> outputs;
 
+  // Disjoint key ranges of the compaction, merged independently
+  std::vector<SubcompactionState*> subcompactions;
+
+  uint64_t total_bytes;
+
+  explicit CompactionState(Compaction* c) : compaction(c), total_bytes(0) {}
+};
+
+struct DBImpl::SubcompactionState {
+  CompactionState* const compact;
+
+  // User keys in [start, end) belong to this subcompaction. An empty
+  // start or end means the beginning or the end of the key space.
+  std::string start;
+  std::string end;
+  bool has_start;
+  bool has_end;
+
+  Compaction::ScanState scan;
+  std::vector<CompactionState::Output> outputs;
+
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
 
   uint64_t total_bytes;
+  int64_t imm_micros;  // Micros spent doing imm_ compactions
+  Status status;
+
+  CompactionState::Output* current_output() {
+    return &outputs[outputs.size() - 1];
+  }
+
+  explicit SubcompactionState(CompactionState* c)
+      : compact(c),
+        has_start(false),
+        has_end(false),
+        outfile(NULL),
+        builder(NULL),
+        total_bytes(0),
+        imm_micros(0) {}
+};
+
+// Subcompactions not yet claimed by the thread running a compaction or
+// by the compaction pool threads scheduled to help it. Pool threads may
+// start after the compaction is gone, so the queue is reference counted
+// and never accessed through the db once drained.
+struct DBImpl::SubcompactionQueue {
+  DBImpl* const db;
+  port::Mutex mu;
+  port::CondVar cv;  // Signalled when a subcompaction finishes
+  std::vector<SubcompactionState*> subcompactions;
+  size_t next;  // Next subcompaction to claim
+  int running;
+  int refs;
+
+  // Claim the next subcompaction. Return NULL if there is none.
+  // REQUIRES: mu is held
+  SubcompactionState* Claim() {
+    mu.AssertHeld();
+    if (next < subcompactions.size()) {
+      running++;
+      return subcompactions[next++];
+    } else {
+      return NULL;
+    }
+  }
 
-  Output* current_output() { return &outputs[outputs.size() - 1]; }
+  // Run all remaining subcompactions.
+  // REQUIRES: mu is held
+  void Drain(bool owner) {
+    SubcompactionState* sub;
+    while ((sub = Claim()) != NULL) {
+      mu.Unlock();
+      db->DoSubcompactionWork(sub, owner);
+      mu.Lock();
+      running--;
+      cv.SignalAll();
+    }
+  }
+
+  // REQUIRES: mu is held
+  void Unref() {
+    mu.AssertHeld();
+    assert(refs > 0);
+    if (--refs == 0) {
+      mu.Unlock();
+      delete this;
+    } else {
+      mu.Unlock();
+    }
+  }
 
-  explicit CompactionState(Compaction* c)
-      : compaction(c), outfile(NULL), builder(NULL), total_bytes(0) {}
+  SubcompactionQueue(DBImpl* db, const std::vector<SubcompactionState*>& subs)
+      : db(db), cv(&mu), subcompactions(subs), next(0), running(0), refs(1) {}
 };
 
 struct DBImpl::InsertionState {
@@ -130,7 +215,9 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       bg_compaction_paused_(0),
       bg_compaction_scheduled_(false),
       bulk_insert_in_progress_(false),
-      manual_compaction_(NULL) {
+      manual_compaction_(NULL),
+      write_slowdowns_(0),
+      write_stall_micros_(0) {
   if (!options_.no_memtable) {
     mem_ = new MemTable(internal_comparator_);
     mem_->Ref();
@@ -300,6 +387,7 @@ void DBImpl::DeleteObsoleteFiles() {
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
+        case kValueLogFile:  // Owned by kLSMKeyStyle columns
           keep = true;
           break;
       }
@@ -823,24 +911,27 @@ void DBImpl::BackgroundCompaction() {
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
   mutex_.AssertHeld();
-  if (compact->builder != NULL) {
-    // May happen if we get a shutdown call in the middle of compaction
-    compact->builder->Abandon();
-    delete compact->builder;
-  } else {
-    assert(compact->outfile == NULL);
-  }
-  delete compact->outfile;
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    const CompactionState::Output& out = compact->outputs[i];
-    pending_outputs_.erase(out.number);
+  for (size_t i = 0; i < compact->subcompactions.size(); i++) {
+    SubcompactionState* sub = compact->subcompactions[i];
+    if (sub->builder != NULL) {
+      // May happen if we get a shutdown call in the middle of compaction
+      sub->builder->Abandon();
+      delete sub->builder;
+    } else {
+      assert(sub->outfile == NULL);
+    }
+    delete sub->outfile;
+    for (size_t j = 0; j < sub->outputs.size(); j++) {
+      pending_outputs_.erase(sub->outputs[j].number);
+    }
+    delete sub;
   }
   delete compact;
 }
 
-Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
-  assert(compact != NULL);
-  assert(compact->builder == NULL);
+Status DBImpl::OpenCompactionOutputFile(SubcompactionState* sub) {
+  assert(sub != NULL);
+  assert(sub->builder == NULL);
   uint64_t file_number;
   {
     mutex_.Lock();
@@ -850,56 +941,56 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
-    compact->outputs.push_back(out);
+    sub->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname.c_str(), &compact->outfile);
+  Status s = env_->NewWritableFile(fname.c_str(), &sub->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    sub->builder = new TableBuilder(options_, sub->outfile);
   }
   return s;
 }
 
-Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
+Status DBImpl::FinishCompactionOutputFile(SubcompactionState* sub,
                                           Iterator* input) {
-  assert(compact != NULL);
-  assert(compact->outfile != NULL);
-  assert(compact->builder != NULL);
+  assert(sub != NULL);
+  assert(sub->outfile != NULL);
+  assert(sub->builder != NULL);
 
-  const uint64_t output_number = compact->current_output()->number;
+  const uint64_t output_number = sub->current_output()->number;
   assert(output_number != 0);
 
   // Check for iterator errors
   Status s = input->status();
-  const uint64_t current_entries = compact->builder->NumEntries();
+  const uint64_t current_entries = sub->builder->NumEntries();
   if (s.ok()) {
-    s = compact->builder->Finish();
+    s = sub->builder->Finish();
   } else {
-    compact->builder->Abandon();
+    sub->builder->Abandon();
   }
 
   // Obtain table properties
-  const TableProperties* props = compact->builder->properties();
-  compact->current_output()->smallest.DecodeFrom(props->first_key());
-  compact->current_output()->largest.DecodeFrom(props->last_key());
-  const uint64_t current_bytes = compact->builder->FileSize();
-  compact->current_output()->file_size = current_bytes;
-  compact->total_bytes += current_bytes;
-  delete compact->builder;
-  compact->builder = NULL;
+  const TableProperties* props = sub->builder->properties();
+  sub->current_output()->smallest.DecodeFrom(props->first_key());
+  sub->current_output()->largest.DecodeFrom(props->last_key());
+  const uint64_t current_bytes = sub->builder->FileSize();
+  sub->current_output()->file_size = current_bytes;
+  sub->total_bytes += current_bytes;
+  delete sub->builder;
+  sub->builder = NULL;
 
   // Finish and check for file errors
   if (s.ok()) {
-    s = compact->outfile->Sync();
+    s = sub->outfile->Sync();
   }
   if (s.ok()) {
-    s = compact->outfile->Close();
+    s = sub->outfile->Close();
   }
-  delete compact->outfile;
-  compact->outfile = NULL;
+  delete sub->outfile;
+  sub->outfile = NULL;
 
   if (s.ok() && current_entries > 0) {
     const SequenceOff off = 0;
@@ -937,6 +1028,28 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
 
+int64_t DBImpl::MaybeCompactMemTable() {
+  int64_t micros = 0;
+  if (has_imm_.NoBarrier_Load() != NULL) {
+    const uint64_t imm_start = env_->NowMicros();
+    mutex_.Lock();
+    if (imm_ != NULL) {
+      CompactMemTable();
+      bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+    }
+    mutex_.Unlock();
+    micros = env_->NowMicros() - imm_start;
+  }
+  return micros;
+}
+
+void DBImpl::SubcompactionWork(void* queue) {
+  SubcompactionQueue* q = reinterpret_cast<SubcompactionQueue*>(queue);
+  q->mu.Lock();
+  q->Drain(false);
+  q->Unref();
+}
+
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
   int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
@@ -947,19 +1060,109 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       compact->compaction->level() + 1);
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
-  assert(compact->builder == NULL);
-  assert(compact->outfile == NULL);
+  assert(compact->subcompactions.empty());
   if (snapshots_.empty()) {
     compact->smallest_snapshot = versions_->LastSequence();
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
 
+  // Split the compaction into disjoint key ranges
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+  for (size_t i = 0; i <= boundaries.size(); i++) {
+    SubcompactionState* sub = new SubcompactionState(compact);
+    if (i != 0) {
+      sub->start = boundaries[i - 1];
+      sub->has_start = true;
+    }
+    if (i != boundaries.size()) {
+      sub->end = boundaries[i];
+      sub->has_end = true;
+    }
+    compact->subcompactions.push_back(sub);
+  }
+  if (compact->subcompactions.size() > 1) {
+    Log(options_.info_log, "Compaction split into %d subcompactions",
+        static_cast<int>(compact->subcompactions.size()));
+  }
+
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  // Subcompactions are claimed by this thread and by any pool threads
+  // that manage to start before they are all claimed
+  SubcompactionQueue* queue =
+      new SubcompactionQueue(this, compact->subcompactions);
+  const int helpers = static_cast<int>(compact->subcompactions.size()) - 1;
+  queue->refs += helpers;
+  for (int i = 0; i < helpers; i++) {
+    if (options_.compaction_pool != NULL) {
+      options_.compaction_pool->Schedule(&DBImpl::SubcompactionWork, queue);
+    } else {
+      env_->Schedule(&DBImpl::SubcompactionWork, queue);
+    }
+  }
+  queue->mu.Lock();
+  queue->Drain(true);
+  while (queue->running != 0) {
+    // Keep prioritizing immutable compaction work while waiting
+    queue->mu.Unlock();
+    imm_micros += MaybeCompactMemTable();
+    queue->mu.Lock();
+    if (queue->running != 0) {
+      queue->cv.TimedWait(1000);
+    }
+  }
+  queue->Unref();
+
+  Status status;
+  for (size_t i = 0; i < compact->subcompactions.size(); i++) {
+    SubcompactionState* sub = compact->subcompactions[i];
+    if (status.ok()) {
+      status = sub->status;
+    }
+    compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                            sub->outputs.end());
+    compact->total_bytes += sub->total_bytes;
+    imm_micros += sub->imm_micros;
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  mutex_.Lock();
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::DoSubcompactionWork(SubcompactionState* sub, bool owner) {
+  CompactionState* const compact = sub->compact;
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
+  if (sub->has_start) {
+    InternalKey start(sub->start, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
@@ -967,21 +1170,19 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   for (; input->Valid() && !shutting_down_.Acquire_Load();) {
     // Prioritize immutable compaction work
-    if (has_imm_.NoBarrier_Load() != NULL) {
-      const uint64_t imm_start = env_->NowMicros();
-      mutex_.Lock();
-      if (imm_ != NULL) {
-        CompactMemTable();
-        bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
-      }
-      mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+    if (owner) {
+      sub->imm_micros += MaybeCompactMemTable();
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != NULL) {
-      status = FinishCompactionOutputFile(compact, input);
+    const bool parsed = ParseInternalKey(key, &ikey);
+    if (parsed && sub->has_end &&
+        user_comparator()->Compare(ikey.user_key, sub->end) >= 0) {
+      break;  // Remaining keys belong to the next subcompaction
+    }
+    if (compact->compaction->ShouldStopBefore(key, &sub->scan) &&
+        sub->builder != NULL) {
+      status = FinishCompactionOutputFile(sub, input);
       if (!status.ok()) {
         break;
       }
@@ -989,7 +1190,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
     // Handle key/value, add to state, etc.
     bool drop = false;
-    if (!ParseInternalKey(key, &ikey)) {
+    if (!parsed) {
       // Do not hide error keys
       current_user_key.clear();
       has_current_user_key = false;
@@ -1009,7 +1210,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;  // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &sub->scan)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -1028,25 +1230,25 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key, &sub->scan),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
     if (!drop) {
       // Open output file if necessary
-      if (compact->builder == NULL) {
-        status = OpenCompactionOutputFile(compact);
+      if (sub->builder == NULL) {
+        status = OpenCompactionOutputFile(sub);
         if (!status.ok()) {
           break;
         }
       }
 
-      compact->builder->Add(key, input->value());
+      sub->builder->Add(key, input->value());
 
       // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
+      if (sub->builder->FileSize() >=
           compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
+        status = FinishCompactionOutputFile(sub, input);
         if (!status.ok()) {
           break;
         }
@@ -1059,38 +1261,14 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting db during compaction");
   }
-  if (status.ok() && compact->builder != NULL) {
-    status = FinishCompactionOutputFile(compact, input);
+  if (status.ok() && sub->builder != NULL) {
+    status = FinishCompactionOutputFile(sub, input);
   }
   if (status.ok()) {
     status = input->status();
   }
   delete input;
-  input = NULL;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
+  sub->status = status;
 }
 
 namespace {
@@ -1521,9 +1699,12 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // this delay hands over some CPU to the compaction thread in
       // case it is sharing the same core as the writer.
       mutex_.Unlock();
+      const uint64_t start = env_->NowMicros();
       env_->SleepForMicroseconds(1000);
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
+      write_stall_micros_ += env_->NowMicros() - start;
+      write_slowdowns_++;
     } else if (!force && mem_ != NULL &&
                mem_->ApproximateMemoryUsage() <= options_.write_buffer_size) {
       // There is room in current memtable
@@ -1532,12 +1713,16 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
+      write_stall_micros_ += env_->NowMicros() - start;
     } else if (!options_.disable_compaction &&
                versions_->NumLevelFiles(0) >= options_.l0_hard_limit) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      const uint64_t start = env_->NowMicros();
       bg_cv_.Wait();
+      write_stall_micros_ += env_->NowMicros() - start;
     } else if (!options_.no_memtable) {
       // Close the current log file and open a new one
       if (!options_.disable_write_ahead_log) {
@@ -1651,6 +1836,10 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
         value->append(buf);
       }
     }
+    snprintf(buf, sizeof(buf), "Write stalls: %lld slowdowns, %.3f sec\n",
+             static_cast<long long>(write_slowdowns_),
+             write_stall_micros_ / 1e6);
+    value->append(buf);
     return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
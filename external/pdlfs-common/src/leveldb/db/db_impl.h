@@ -82,7 +82,10 @@ class DBImpl : public DB {
  protected:
   friend class DB;
   friend class ColumnImpl;
+  friend class LSMKeyColumn;
   struct CompactionState;
+  struct SubcompactionState;
+  struct SubcompactionQueue;
   struct InsertionState;
   struct Writer;
 
@@ -134,9 +137,15 @@ class DBImpl : public DB {
   void BackgroundCompaction();
   void CleanupCompaction(CompactionState* compact);
   Status DoCompactionWork(CompactionState* compact);
-
-  Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Merge the key range of a subcompaction into new tables. Memtable
+  // compactions are only performed by the thread that owns the compaction.
+  void DoSubcompactionWork(SubcompactionState* sub, bool owner);
+  static void SubcompactionWork(void* queue);
+  // Compact imm_ if it exists. Return the time spent.
+  int64_t MaybeCompactMemTable();
+
+  Status OpenCompactionOutputFile(SubcompactionState* sub);
+  Status FinishCompactionOutputFile(SubcompactionState* sub, Iterator* input);
   Status InstallCompactionResults(CompactionState* compact);
 
   Status LoadLevel0Table(InsertionState* insert);
@@ -222,6 +231,11 @@ class DBImpl : public DB {
   };
   CompactionStats stats_[config::kNumLevels];
 
+  // Writes delayed by a large number of level-0 files and the total time
+  // writers spent waiting for compactions to make room for them
+  int64_t write_slowdowns_;
+  int64_t write_stall_micros_;
+
   // No copying allowed
   void operator=(const DBImpl&);
   DBImpl(const DBImpl&);
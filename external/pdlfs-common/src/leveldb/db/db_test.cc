@@ -25,6 +25,8 @@
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 
+#include <map>
+
 namespace pdlfs {
 
 static const int kVerbose = 1;
@@ -200,18 +202,26 @@ class DBTest {
   const FilterPolicy* filter_policy_;
 
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kFilter,
+    kUncompressed,
+    kSubcompactions,
+    kEnd
+  };
   int option_config_;
 
  public:
   std::string dbname_;
   SpecialEnv* env_;
+  ThreadPool* compaction_pool_;
   DB* db_;
 
   Options last_options_;
 
   DBTest() : option_config_(kDefault), env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    compaction_pool_ = ThreadPool::NewFixed(3);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -222,6 +232,7 @@ class DBTest {
     delete db_;
     DestroyDB(dbname_, Options());
     delete env_;
+    delete compaction_pool_;
     delete filter_policy_;
   }
 
@@ -247,6 +258,10 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kSubcompactions:
+        options.compaction_pool = compaction_pool_;
+        options.max_subcompactions = 4;
+        break;
       default:
         break;
     }
@@ -1124,6 +1139,56 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.compaction_pool = compaction_pool_;
+  options.max_subcompactions = 4;
+  options.table_file_size = 16 << 10;
+  options.write_buffer_size = 64 << 10;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  std::map<std::string, std::string> snapshot_model;
+  const Snapshot* snapshot = NULL;
+  for (int i = 0; i < 20000; i++) {
+    const std::string k = Key(rnd.Uniform(5000));
+    if (rnd.OneIn(5)) {
+      ASSERT_OK(Delete(k));
+      model.erase(k);
+    } else {
+      const std::string v = RandomString(&rnd, 100);
+      ASSERT_OK(Put(k, v));
+      model[k] = v;
+    }
+    if (i == 10000) {
+      snapshot = db_->GetSnapshot();
+      snapshot_model = model;
+    }
+  }
+
+  dbfull()->CompactRange(NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  for (int i = 0; i < 5000; i++) {
+    const std::string k = Key(i);
+    std::map<std::string, std::string>::iterator it = model.find(k);
+    ASSERT_EQ(Get(k), it != model.end() ? it->second : "NOT_FOUND");
+    it = snapshot_model.find(k);
+    ASSERT_EQ(Get(k, snapshot), it != snapshot_model.end() ? it->second
+                                                           : "NOT_FOUND");
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  std::map<std::string, std::string>::iterator it = model.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+    ASSERT_TRUE(it != model.end());
+    ASSERT_EQ(iter->key().ToString(), it->first);
+    ASSERT_EQ(iter->value().ToString(), it->second);
+  }
+  ASSERT_TRUE(it == model.end());
+  delete iter;
+  db_->ReleaseSnapshot(snapshot);
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -26,6 +26,7 @@ DBOptions::DBOptions()
       env(Env::Default()),
       info_log(NULL),
       compaction_pool(NULL),
+      max_subcompactions(1),
       write_buffer_size(4 << 20),
       table_cache(NULL),
       block_cache(NULL),
@@ -35,6 +36,8 @@ DBOptions::DBOptions()
       index_block_restart_interval(1),
       compression(kSnappyCompression),
       filter_policy(NULL),
+      value_log_min_value_size(64),
+      value_log_gc_ratio(0.5),
       no_memtable(false),
       gc_skip_deletion(false),
       skip_lock_file(false),
@@ -85,6 +88,12 @@ DBOptions SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.index_block_restart_interval, 1, 1024);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  // The compact index relies on keys being ordered by their raw bytes
+  if (result.index_type == kCompact &&
+      icmp->user_comparator() != BytewiseComparator()) {
+    result.index_type = kMultiwaySearchTree;
+  }
   if (create_infolog && result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname.c_str());  // In case it does not exist
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2015-2018 Carnegie Mellon University.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#include "value_log.h"
+
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/crc32c.h"
+
+#include <algorithm>
+
+namespace pdlfs {
+
+static const uint32_t kValueLogMagic = 0x766c6f67u;  // "vlog"
+
+void EncodeValuePointer(std::string* dst, const ValuePointer& ptr) {
+  PutVarint64(dst, ptr.number);
+  PutVarint64(dst, ptr.offset);
+  PutVarint32(dst, ptr.size);
+}
+
+bool DecodeValuePointer(Slice* input, ValuePointer* ptr) {
+  return GetVarint64(input, &ptr->number) &&
+         GetVarint64(input, &ptr->offset) && GetVarint32(input, &ptr->size);
+}
+
+Status ValueLogWriter::WriteHeader(ValueLogFormat format) {
+  assert(offset_ == 0);
+  buf_.clear();
+  PutFixed32(&buf_, kValueLogMagic);
+  PutFixed32(&buf_, static_cast<uint32_t>(format));
+  Status s = dest_->Append(buf_);
+  if (s.ok()) {
+    offset_ += buf_.size();
+  }
+  return s;
+}
+
+Status ValueLogWriter::AddRecord(const Slice& ikey, const Slice& value,
+                                 uint64_t* offset) {
+  assert(offset_ != 0);
+  buf_.clear();
+  PutLengthPrefixedSlice(&buf_, ikey);
+  PutVarint32(&buf_, static_cast<uint32_t>(value.size()));
+  PutFixed32(&buf_, crc32c::Mask(crc32c::Value(value.data(), value.size())));
+  Status s = dest_->Append(buf_);
+  if (s.ok()) {
+    s = dest_->Append(value);
+  }
+  if (s.ok()) {
+    *offset = offset_ + buf_.size();
+    offset_ += buf_.size() + value.size();
+  }
+  return s;
+}
+
+Status ValueLogWriter::WriteRemap(
+    const std::vector<std::pair<uint64_t, uint64_t> >& remap) {
+  buf_.clear();
+  for (size_t i = 0; i < remap.size(); i++) {
+    PutFixed64(&buf_, remap[i].first);
+    PutFixed64(&buf_, remap[i].second);
+  }
+  PutFixed64(&buf_, remap.size());
+  PutFixed32(&buf_, kValueLogMagic);
+  Status s = dest_->Append(buf_);
+  if (s.ok()) {
+    offset_ += buf_.size();
+  }
+  return s;
+}
+
+ValueLog::~ValueLog() { delete file_; }
+
+Status ValueLog::Open(Env* env, const std::string& fname, ValueLog** result) {
+  *result = NULL;
+  uint64_t file_size;
+  Status s = env->GetFileSize(fname.c_str(), &file_size);
+  if (!s.ok()) {
+    return s;
+  } else if (file_size < kHeaderSize) {
+    return Status::Corruption("Value log too short", fname);
+  }
+
+  RandomAccessFile* file;
+  s = env->NewRandomAccessFile(fname.c_str(), &file);
+  if (!s.ok()) {
+    return s;
+  }
+
+  ValueLog* log = new ValueLog(file);
+  char tmp[kHeaderSize];
+  Slice header;
+  s = file->Read(0, kHeaderSize, &header, tmp);
+  if (s.ok()) {
+    if (header.size() != kHeaderSize ||
+        DecodeFixed32(header.data()) != kValueLogMagic) {
+      s = Status::Corruption("Bad value log header", fname);
+    } else {
+      switch (DecodeFixed32(header.data() + 4)) {
+        case kValueLog:
+          log->records_end_ = file_size;
+          break;
+        case kCompactedValueLog:
+          s = log->LoadRemap(file_size);
+          break;
+        default:
+          s = Status::NotSupported("Unknown value log format", fname);
+          break;
+      }
+    }
+  }
+
+  if (s.ok()) {
+    *result = log;
+  } else {
+    delete log;
+  }
+  return s;
+}
+
+Status ValueLog::LoadRemap(uint64_t file_size) {
+  if (file_size < kHeaderSize + kRemapTrailerSize) {
+    return Status::Corruption("Value log remap trailer too short");
+  }
+  char tmp[kRemapTrailerSize];
+  Slice trailer;
+  Status s = file_->Read(file_size - kRemapTrailerSize, kRemapTrailerSize,
+                         &trailer, tmp);
+  if (!s.ok()) {
+    return s;
+  } else if (trailer.size() != kRemapTrailerSize ||
+             DecodeFixed32(trailer.data() + 8) != kValueLogMagic) {
+    return Status::Corruption("Bad value log remap trailer");
+  }
+  const uint64_t n = DecodeFixed64(trailer.data());
+  if (n > (file_size - kHeaderSize - kRemapTrailerSize) / 16) {
+    return Status::Corruption("Bad value log remap trailer");
+  }
+
+  records_end_ = file_size - kRemapTrailerSize - 16 * n;
+  std::string scratch;
+  scratch.resize(16 * n);
+  Slice table;
+  s = file_->Read(records_end_, scratch.size(), &table, &scratch[0]);
+  if (s.ok()) {
+    if (table.size() != scratch.size()) {
+      s = Status::Corruption("Truncated value log remap table");
+    } else {
+      remap_.reserve(n);
+      const char* p = table.data();
+      for (uint64_t i = 0; i < n; i++) {
+        remap_.push_back(
+            std::make_pair(DecodeFixed64(p), DecodeFixed64(p + 8)));
+        p += 16;
+      }
+    }
+  }
+  return s;
+}
+
+namespace {
+struct OriginalOffsetLess {
+  bool operator()(const std::pair<uint64_t, uint64_t>& a, uint64_t b) const {
+    return a.first < b;
+  }
+};
+
+struct CurrentOffsetLess {
+  bool operator()(const std::pair<uint64_t, uint64_t>& a, uint64_t b) const {
+    return a.second < b;
+  }
+};
+}  // namespace
+
+bool ValueLog::CurrentOffset(uint64_t offset, uint64_t* result) const {
+  if (remap_.empty()) {
+    *result = offset;
+    return true;
+  }
+  std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+      std::lower_bound(remap_.begin(), remap_.end(), offset,
+                       OriginalOffsetLess());
+  if (it != remap_.end() && it->first == offset) {
+    *result = it->second;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+uint64_t ValueLog::OriginalOffset(uint64_t offset) const {
+  std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+      std::lower_bound(remap_.begin(), remap_.end(), offset,
+                       CurrentOffsetLess());
+  if (it != remap_.end() && it->second == offset) {
+    return it->first;
+  } else {
+    return offset;
+  }
+}
+
+Status ValueLog::Read(const ValuePointer& ptr, size_t limit,
+                      bool verify_checksums, Slice* result,
+                      std::string* scratch) const {
+  uint64_t offset;
+  if (!CurrentOffset(ptr.offset, &offset)) {
+    return Status::Corruption("Value no longer in log");
+  } else if (offset < kHeaderSize + 4 || offset + ptr.size > records_end_) {
+    return Status::Corruption("Bad value pointer");
+  }
+
+  const size_t n = std::min(limit, static_cast<size_t>(ptr.size));
+  const bool verify = verify_checksums && n == ptr.size;
+  if (verify) {
+    offset -= 4;  // Also fetch the checksum that precedes the value
+  }
+  const size_t bytes = n + (verify ? 4 : 0);
+  scratch->resize(bytes);
+  Slice contents;
+  Status s = file_->Read(offset, bytes, &contents, &(*scratch)[0]);
+  if (!s.ok()) {
+    return s;
+  } else if (contents.size() != bytes) {
+    return Status::Corruption("Truncated value log");
+  } else if (contents.data() != scratch->data()) {
+    scratch->assign(contents.data(), contents.size());
+    contents = *scratch;
+  }
+
+  if (verify) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(contents.data()));
+    contents.remove_prefix(4);
+    if (crc != crc32c::Value(contents.data(), contents.size())) {
+      return Status::Corruption("Value checksum mismatch");
+    }
+  }
+
+  *result = contents;
+  return s;
+}
+
+Status ValueLog::ReadRecords(Slice* contents, std::string* scratch) const {
+  const size_t bytes = static_cast<size_t>(records_end_ - kHeaderSize);
+  scratch->resize(bytes);
+  if (bytes == 0) {
+    *contents = Slice();
+    return Status::OK();
+  }
+  Status s = file_->Read(kHeaderSize, bytes, contents, &(*scratch)[0]);
+  if (s.ok() && contents->size() != bytes) {
+    s = Status::Corruption("Truncated value log");
+  }
+  return s;
+}
+
+bool ValueLog::ParseRecord(Slice* input, Slice* ikey, Slice* value) {
+  uint32_t value_len;
+  if (!GetLengthPrefixedSlice(input, ikey) ||
+      !GetVarint32(input, &value_len) || input->size() < 4 + value_len) {
+    return false;
+  }
+  *value = Slice(input->data() + 4, value_len);
+  input->remove_prefix(4 + value_len);
+  return true;
+}
+
+}  // namespace pdlfs
@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+ * Copyright (c) 2015-2018 Carnegie Mellon University.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/slice.h"
+#include "pdlfs-common/status.h"
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pdlfs {
+
+// A value log stores the values of a kLSMKeyStyle column. The LSM of the
+// column only stores keys and pointers to values in value logs. Each
+// memtable compaction writes at most one new log. The format of a log is:
+//
+//    header := magic: fixed32, format: fixed32
+//    record := key_len: varint32, internal_key: char[key_len],
+//              value_len: varint32, masked_crc32c(value): fixed32,
+//              value: char[value_len]
+//
+// A log rewritten by garbage collection (kCompactedValueLog) only keeps
+// the records that are still referenced and is followed by a remap
+// table that translates the original offsets of these values, which
+// are what the LSM keeps pointing to, to their current offsets:
+//
+//    remap := (original_offset: fixed64, offset: fixed64)*,
+//             num_entries: fixed64, magic: fixed32
+//
+// Records are never reordered so entries are sorted by both offsets.
+enum ValueLogFormat { kValueLog = 0, kCompactedValueLog = 1 };
+
+// Each value stored in the LSM of a kLSMKeyStyle column starts with one of
+// the following tags. Inline values immediately follow their tag.
+enum ValueTag { kInlineValue = 0, kValuePointer = 1 };
+
+struct ValuePointer {
+  uint64_t number;  // Log file number
+  uint64_t offset;  // Original offset of the value within the log
+  uint32_t size;
+};
+
+extern void EncodeValuePointer(std::string* dst, const ValuePointer& ptr);
+extern bool DecodeValuePointer(Slice* input, ValuePointer* ptr);
+
+// Append records to a log. Does not own the underlying file.
+class ValueLogWriter {
+ public:
+  explicit ValueLogWriter(WritableFile* dest) : dest_(dest), offset_(0) {}
+
+  // Write the log header. Must be called before any records are added.
+  Status WriteHeader(ValueLogFormat format);
+
+  // Append a record and store the offset of its value in *offset.
+  Status AddRecord(const Slice& ikey, const Slice& value, uint64_t* offset);
+
+  // Terminate a kCompactedValueLog with its remap table.
+  Status WriteRemap(const std::vector<std::pair<uint64_t, uint64_t> >& remap);
+
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  WritableFile* dest_;
+  uint64_t offset_;
+  std::string buf_;
+
+  // No copying allowed
+  void operator=(const ValueLogWriter&);
+  ValueLogWriter(const ValueLogWriter&);
+};
+
+// An opened log. Safe for concurrent reads.
+class ValueLog {
+ public:
+  static Status Open(Env* env, const std::string& fname, ValueLog** result);
+  ~ValueLog();
+
+  // Read the value pointed to by ptr. Only the first "limit" bytes are
+  // fetched. Values fetched in their entirety are verified against their
+  // checksums if "verify_checksums" is true. The result always points
+  // into *scratch.
+  Status Read(const ValuePointer& ptr, size_t limit, bool verify_checksums,
+              Slice* result, std::string* scratch) const;
+
+  // Read all records into *scratch and set *contents to them.
+  // Records start at offset RecordsOffset() within the log.
+  Status ReadRecords(Slice* contents, std::string* scratch) const;
+
+  // Parse the record at the beginning of *input and advance *input
+  // past it. Does not verify the value against its checksum.
+  static bool ParseRecord(Slice* input, Slice* ikey, Slice* value);
+
+  // Return the original offset of a value currently at "offset".
+  uint64_t OriginalOffset(uint64_t offset) const;
+
+  static uint64_t RecordsOffset() { return kHeaderSize; }
+
+ private:
+  enum { kHeaderSize = 8, kRemapTrailerSize = 12 };
+  ValueLog(RandomAccessFile* file) : file_(file), records_end_(0) {}
+  // Return the current offset of a value originally at "offset",
+  // or false if the value is no longer in the log.
+  bool CurrentOffset(uint64_t offset, uint64_t* result) const;
+  Status LoadRemap(uint64_t file_size);
+
+  RandomAccessFile* file_;
+  uint64_t records_end_;
+  std::vector<std::pair<uint64_t, uint64_t> > remap_;
+
+  // No copying allowed
+  void operator=(const ValueLog&);
+  ValueLog(const ValueLog&);
+};
+
+}  // namespace pdlfs
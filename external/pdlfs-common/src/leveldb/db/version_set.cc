@@ -1435,13 +1435,62 @@ Compaction* VersionSet::PickCompaction(bool allow_seek_compaction) {
   return c;
 }
 
+// Find the file in "level_files" that starts right after "largest_key"
+// with the same user key, or return NULL if there is no such file.
+static FileMetaData* FindSmallestBoundaryFile(
+    const InternalKeyComparator& icmp,
+    const std::vector<FileMetaData*>& level_files,
+    const InternalKey& largest_key) {
+  const Comparator* user_cmp = icmp.user_comparator();
+  FileMetaData* result = NULL;
+  for (size_t i = 0; i < level_files.size(); i++) {
+    FileMetaData* f = level_files[i];
+    if (icmp.Compare(f->smallest, largest_key) > 0 &&
+        user_cmp->Compare(f->smallest.user_key(), largest_key.user_key()) ==
+            0) {
+      if (result == NULL || icmp.Compare(f->smallest, result->smallest) < 0) {
+        result = f;
+      }
+    }
+  }
+  return result;
+}
+
+// Entries of a user key may be split across adjacent files of a level.
+// Extend "compaction_files" with all files of "level_files" holding older
+// entries of the largest user key being compacted. Otherwise, newer
+// entries would be moved to the next level while older ones stay and
+// become visible again.
+static void AddBoundaryInputs(const InternalKeyComparator& icmp,
+                              const std::vector<FileMetaData*>& level_files,
+                              std::vector<FileMetaData*>* compaction_files) {
+  if (compaction_files->empty()) {
+    return;
+  }
+  InternalKey largest_key = (*compaction_files)[0]->largest;
+  for (size_t i = 1; i < compaction_files->size(); i++) {
+    FileMetaData* f = (*compaction_files)[i];
+    if (icmp.Compare(f->largest, largest_key) > 0) {
+      largest_key = f->largest;
+    }
+  }
+  FileMetaData* f;
+  while ((f = FindSmallestBoundaryFile(icmp, level_files, largest_key)) !=
+         NULL) {
+    compaction_files->push_back(f);
+    largest_key = f->largest;
+  }
+}
+
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
+  AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
   InternalKey smallest, largest;
   GetRange(c->inputs_[0], &smallest, &largest);
 
   current_->GetOverlappingInputs(level + 1, &smallest, &largest,
                                  &c->inputs_[1]);
+  AddBoundaryInputs(icmp_, current_->files_[level + 1], &c->inputs_[1]);
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
@@ -1452,6 +1501,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   if (!c->inputs_[1].empty()) {
     std::vector<FileMetaData*> expanded0;
     current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
+    AddBoundaryInputs(icmp_, current_->files_[level], &expanded0);
     const int64_t inputs0_size = TotalFileSize(c->inputs_[0]);
     const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
     const int64_t expanded0_size = TotalFileSize(expanded0);
@@ -1463,6 +1513,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
       std::vector<FileMetaData*> expanded1;
       current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
                                      &expanded1);
+      AddBoundaryInputs(icmp_, current_->files_[level + 1], &expanded1);
       if (expanded1.size() == c->inputs_[1].size()) {
         Log(options_->info_log,
             "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
@@ -1535,14 +1586,7 @@ Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       max_grand_parent_overlap_bytes_(MaxGrandParentOverlapBytes(options)),
-      input_version_(NULL),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
-  for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
-  }
-}
+      input_version_(NULL) {}
 
 Compaction::~Compaction() {
   if (input_version_ != NULL) {
@@ -1566,13 +1610,21 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+Compaction::ScanState::ScanState()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
+  for (int i = 0; i < config::kNumLevels; i++) {
+    level_ptrs[i] = 0;
+  }
+}
+
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   ScanState* state) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size();) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    for (; state->level_ptrs[lvl] < files.size();) {
+      FileMetaData* f = files[state->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1581,35 +1633,82 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      state->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  ScanState* state) const {
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (state->grandparent_index < grandparents_.size() &&
          icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                       grandparents_[state->grandparent_index]->largest
+                           .Encode()) > 0) {
+    if (state->seen_key) {
+      state->overlapped_bytes +=
+          grandparents_[state->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    state->grandparent_index++;
   }
-  seen_key_ = true;
+  state->seen_key = true;
 
-  if (overlapped_bytes_ > max_grand_parent_overlap_bytes_) {
+  if (state->overlapped_bytes > max_grand_parent_overlap_bytes_) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    state->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+namespace {
+struct UserKeyLess {
+  explicit UserKeyLess(const Comparator* ucmp) : ucmp(ucmp) {}
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+  const Comparator* ucmp;
+};
+}  // namespace
+
+void Compaction::GetSubcompactionBoundaries(
+    int n, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (n <= 1) {
+    return;
+  }
+  // Files in level_ + 1 are disjoint and their boundaries follow the
+  // distribution of existing keys. Fall back to files in level_ when
+  // there are too few of them.
+  const int which = (inputs_[1].size() >= 2) ? 1 : 0;
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  std::vector<std::string> candidates;
+  for (size_t i = 0; i < inputs_[which].size(); i++) {
+    candidates.push_back(inputs_[which][i]->smallest.user_key().ToString());
+  }
+  std::sort(candidates.begin(), candidates.end(), UserKeyLess(user_cmp));
+  // The first part starts at the smallest key of the compaction, so
+  // the smallest candidate is not a useful boundary
+  std::vector<std::string> keys;
+  for (size_t i = 1; i < candidates.size(); i++) {
+    if (user_cmp->Compare(candidates[i], candidates[i - 1]) != 0) {
+      keys.push_back(candidates[i]);
+    }
+  }
+  const size_t k = keys.size();
+  if (k < static_cast<size_t>(n)) {
+    boundaries->swap(keys);
+  } else {
+    // Pick n - 1 keys evenly spaced among the candidates
+    for (int i = 1; i < n; i++) {
+      boundaries->push_back(keys[i * k / n]);
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != NULL) {
     input_version_->Unref();
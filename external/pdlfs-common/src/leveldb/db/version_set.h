@@ -200,6 +200,11 @@ class VersionSet {
   // Return the current version.
   Version* current() const { return current_; }
 
+  // Return true iff no version other than the current one is still
+  // referenced, such as by an iterator or an ongoing read.
+  // REQUIRES: mutex is held.
+  bool OnlyCurrentIsLive() const { return dummy_versions_.next_ == current_; }
+
   // Return the current manifest file number
   uint64_t ManifestFileNumber() const { return manifest_file_number_; }
 
@@ -363,14 +368,42 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // State of a scan over the key range of the compaction. Disjoint parts
+  // of the range may be scanned concurrently, each with its own state.
+  struct ScanState {
+    ScanState();
+
+    // State used to check for number of of overlapping grandparent files
+    // (parent == level_ + 1, grandparent == level_ + 2)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  // in levels greater than "level+1". Keys must be passed in order.
+  bool IsBaseLevelForKey(const Slice& user_key, ScanState* state) const;
 
   // Returns true iff we should stop building the current output
-  // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  // before processing "internal_key". Keys must be passed in order.
+  bool ShouldStopBefore(const Slice& internal_key, ScanState* state) const;
+
+  // Divide the key range of the compaction into at most "n" disjoint parts
+  // at the boundaries of input files so that each part may be compacted
+  // independently. Store in *boundaries the user keys at which all but the
+  // first part start, in increasing order.
+  void GetSubcompactionBoundaries(int n,
+                                  std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
   // is successful.
@@ -391,21 +424,8 @@ class Compaction {
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
-  // State used to check for number of of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Files in level_ + 2 overlapping the compaction
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace pdlfs
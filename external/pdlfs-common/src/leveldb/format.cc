@@ -44,7 +44,10 @@ void Footer::EncodeTo(std::string* dst) const {
 #endif
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
+  assert(dst->size() < original_size + 2 * BlockHandle::kMaxEncodedLength);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
+  (*dst)[2 * BlockHandle::kMaxEncodedLength - 1] =
+      static_cast<char>(index_type_);
   PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
   PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
   assert(dst->size() == original_size + kEncodedLength);
@@ -59,6 +62,16 @@ Status Footer::DecodeFrom(Slice* input) {
   if (magic != kTableMagicNumber) {
     return Status::Corruption("not an sstable (bad magic number)");
   }
+  const unsigned char type = static_cast<unsigned char>(
+      input->data()[2 * BlockHandle::kMaxEncodedLength - 1]);
+  switch (type) {
+    case kMultiwaySearchTree:
+    case kCompact:
+      index_type_ = static_cast<IndexType>(type);
+      break;
+    default:
+      return Status::Corruption("unknown index type");
+  }
 
   Status result = metaindex_handle_.DecodeFrom(input);
   if (result.ok()) {
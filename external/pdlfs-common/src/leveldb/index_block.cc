@@ -12,6 +12,7 @@
 #include "pdlfs-common/leveldb/index_block.h"
 #include "pdlfs-common/leveldb/block.h"
 #include "pdlfs-common/leveldb/block_builder.h"
+#include "pdlfs-common/leveldb/db/dbformat.h"
 #include "pdlfs-common/leveldb/db/options.h"
 #include "pdlfs-common/leveldb/format.h"
 #include "pdlfs-common/leveldb/iterator.h"
@@ -19,6 +20,9 @@
 #include "pdlfs-common/coding.h"
 #include "pdlfs-common/ect.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace pdlfs {
 
 IndexBuilder::~IndexBuilder() {}
@@ -61,6 +65,8 @@ class DefaultIndexBuilder : public IndexBuilder {
     // empty
   }
 
+  virtual IndexType type() const { return kMultiwaySearchTree; }
+
  private:
   BlockBuilder index_block_builder_;
 };
@@ -79,7 +85,6 @@ class DefaultIndexReader : public IndexReader {
   Block block_;
 };
 
-#if 0
 namespace {
 
 // Metadata on a prefix group
@@ -121,27 +126,13 @@ struct BlkInfo {
   Slice suffix;  // Suffix key
 
   void EncodeTo(std::string* dst) const {
-    unsigned char s = suffix.size();
-    dst->push_back(static_cast<char>(s));
-    dst->append(suffix.data(), s);
+    PutLengthPrefixedSlice(dst, suffix);
     PutVarint32(dst, offset);
   }
 
   bool DecodeFrom(Slice* input) {
-    if (input->size() < 1) {
-      return false;
-    } else {
-      size_t s = static_cast<unsigned char>((*input)[0]);
-      input->remove_prefix(1);
-      if (input->size() < s) {
-        return false;
-      } else {
-        suffix = Slice(input->data(), s);
-        input->remove_prefix(s);
-      }
-    }
     uint32_t off;
-    if (!GetVarint32(input, &off)) {
+    if (!GetLengthPrefixedSlice(input, &suffix) || !GetVarint32(input, &off)) {
       return false;
     } else {
       offset = off;
@@ -149,8 +140,27 @@ struct BlkInfo {
     }
   }
 };
-}
-
+}  // namespace
+
+// Keys are divided into fixed-size prefixes and variable-length suffixes.
+// Consecutive prefixes that fit in a single data block form a prefix group.
+// A prefix spanning multiple data blocks forms a prefix group on its own,
+// in which case blocks are further separated by their suffixes. Only the
+// first and the last prefix of each group are stored. The resulting index
+// block is formatted as follows:
+//
+//    prefixes: char[prefix_len] * num_prefixes
+//    groups:   num_groups: varint32,
+//              (num_blocks, first_block, first_prefix: varint32) * num_groups
+//    blocks:   num_blocks: varint32,
+//              (suffix: length-prefixed, offset: varint32) * num_blocks
+//    trailer:  prefix_len, groups_offset, blocks_offset: fixed32
+//
+// Both groups and blocks end with a sentinel entry. Block sizes are deduced
+// from the offsets of their successors. Keys must be compared bytewise and
+// user keys must be at least prefix_len bytes long. A default index is built
+// alongside and used instead for tables holding keys that break these rules
+// since their prefixes are not ordered and could never be searched.
 class ThreeLevelCompactIndexBuilder : public IndexBuilder {
   void Flush() {
     seen_new_block_ = false;
@@ -188,15 +198,21 @@ class ThreeLevelCompactIndexBuilder : public IndexBuilder {
     return Slice(key.data(), prefix_len);
   }
 
-  static Slice ExtractSuffixKey(const Slice& key, size_t prefix_len) {
-    Slice suffix = key;
-    suffix.remove_prefix(prefix_len);
-    return suffix;
+  // Internal keys end with an 8-byte tag that must stay out of prefixes.
+  static size_t MinKeyLength(const Options* options, size_t prefix_len) {
+    if (dynamic_cast<const InternalKeyComparator*>(options->comparator)) {
+      return prefix_len + 8;
+    } else {
+      return prefix_len;
+    }
   }
 
  public:
   ThreeLevelCompactIndexBuilder(const Options* options)
       : prefix_len_(8),
+        min_key_len_(MinKeyLength(options, prefix_len_)),
+        fallback_(options),
+        use_fallback_(false),
         cmp_(options->comparator),
         finished_(false),
         key_added_into_new_block_(false),
@@ -210,6 +226,29 @@ class ThreeLevelCompactIndexBuilder : public IndexBuilder {
   virtual void AddIndexEntry(std::string* last_key, const Slice* next_key,
                              const BlockHandle& handle) {
     assert(!finished_);
+    if (next_key != NULL && next_key->size() < min_key_len_) {
+      use_fallback_ = true;
+    }
+    if (!use_fallback_) {
+      AddCompactIndexEntry(last_key, next_key, handle);
+    }
+    // Separators computed above remain valid separators
+    fallback_.AddIndexEntry(last_key, next_key, handle);
+  }
+
+  virtual void OnKeyAdded(const Slice& key) {
+    assert(!finished_);
+    if (key.size() < min_key_len_) {
+      use_fallback_ = true;
+    }
+    if (!use_fallback_) {
+      AddCompactKey(key);
+    }
+  }
+
+ private:
+  void AddCompactIndexEntry(std::string* last_key, const Slice* next_key,
+                            const BlockHandle& handle) {
     // Any block generated must be non-empty
     assert(last_prefix_.size() != 0);
     if (starting_prefix_.empty()) {
@@ -227,15 +266,16 @@ class ThreeLevelCompactIndexBuilder : public IndexBuilder {
 
       assert(last_prefix == last_prefix_);
       if (last_prefix == next_prefix) {
-        std::string last_suffix =
-            ExtractSuffixKey(*last_key, prefix_len_).ToString();
-        Slice next_suffix = ExtractSuffixKey(*next_key, prefix_len_);
-        cmp_->FindShortestSeparator(&last_suffix, next_suffix);
-        blk.suffix = last_suffix;
+        // Separators are computed on full keys so that the key comparator
+        // remains in charge. They keep the prefix shared by both keys.
+        cmp_->FindShortestSeparator(last_key, *next_key);
+        assert(last_key->size() >= prefix_len_);
+        blk.suffix = Slice(*last_key);
+        blk.suffix.remove_prefix(prefix_len_);
 
         // Force splitting the current prefix group if the last prefix
         // is going to span cross a block boundary
-        if (last_prefix != starting_prefix_) {
+        if (last_prefix_ != starting_prefix_) {
           Flush();
         }
       }
@@ -253,17 +293,18 @@ class ThreeLevelCompactIndexBuilder : public IndexBuilder {
     n_blocks_++;
   }
 
-  virtual void OnKeyAdded(const Slice& key) {
-    assert(!finished_);
+  void AddCompactKey(const Slice& key) {
     Slice prefix = ExtractPrefixKey(key, prefix_len_);
     assert(prefix.size() != 0);
 
     if (last_prefix_.empty()) {
       starting_prefix_ = last_prefix_ = prefix.ToString();
       starting_block_ = 0;
-    } else {
+    } else if (prefix.compare(last_prefix_) < 0) {
       // Prefix must be pre-sorted in the raw byte order
-      assert(prefix.compare(last_prefix_) >= 0);
+      use_fallback_ = true;
+      return;
+    } else {
       if (starting_prefix_.empty()) starting_prefix_ = last_prefix_;
       if (prefix.compare(last_prefix_) != 0) {
         last_prefix_.swap(ending_prefix_);
@@ -278,8 +319,13 @@ class ThreeLevelCompactIndexBuilder : public IndexBuilder {
     n_keys_++;
   }
 
+ public:
   virtual Slice Finish() {
     assert(!finished_);
+    if (use_fallback_) {
+      finished_ = true;
+      return fallback_.Finish();
+    }
 
     // Add a dummy prefix group to serve as a sentinel
     PgInfo pg;
@@ -312,7 +358,9 @@ class ThreeLevelCompactIndexBuilder : public IndexBuilder {
   }
 
   virtual size_t CurrentSizeEstimate() const {
-    if (!finished_) {
+    if (use_fallback_) {
+      return fallback_.CurrentSizeEstimate();
+    } else if (!finished_) {
       return buffer_.size() + pg_info_.size() + blk_info_.size() +
              VarintLength(n_pgs_) + VarintLength(n_blocks_) +
              3 * sizeof(uint32_t);
@@ -325,8 +373,15 @@ class ThreeLevelCompactIndexBuilder : public IndexBuilder {
     return Status::NotSupported(Slice());
   }
 
+  virtual IndexType type() const {
+    return use_fallback_ ? kMultiwaySearchTree : kCompact;
+  }
+
  private:
   size_t prefix_len_;
+  size_t min_key_len_;
+  DefaultIndexBuilder fallback_;
+  bool use_fallback_;
   const Comparator* cmp_;
   bool finished_;
   bool key_added_into_new_block_;
@@ -346,35 +401,436 @@ class ThreeLevelCompactIndexBuilder : public IndexBuilder {
 
 namespace {
 
-class ECTBuilder {
+inline size_t PopCount(uint64_t x) {
+  x = x - ((x >> 1) & 0x5555555555555555ull);
+  x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return static_cast<size_t>((x * 0x0101010101010101ull) >> 56);
+}
+
+// A bit vector supporting rank queries. The number of bits set before
+// each 64-bit word is kept so that a query only counts bits in one word.
+class RankedBits {
  public:
-  ECTBuilder(const Slice& prefix_array, size_t prefix_len) {
-    Slice input = prefix_array;
-    while (!input.empty()) {
-      assert(input.size() >= prefix_len);
-      prefix_.push_back(Slice(input.data(), prefix_len));
-      input.remove_prefix(prefix_len);
+  RankedBits() : size_(0) {}
+
+  void Append(bool bit) {
+    if (size_ % 64 == 0) {
+      ranks_.push_back(words_.empty() ? 0
+                                      : ranks_.back() + PopCount(words_.back()));
+      words_.push_back(0);
+    }
+    if (bit) {
+      words_.back() |= static_cast<uint64_t>(1) << (size_ % 64);
     }
+    size_++;
   }
 
-  // Caller should delete the result.
-  ECT* ToECT() {
-    return ECT::Default(prefix_[0].size(), prefix_.size(), &prefix_[0]);
+  // Return the number of bits set among the first n bits.
+  size_t Rank(size_t n) const {
+    assert(n <= size_);
+    const size_t i = n / 64;
+    if (i < words_.size()) {
+      const uint64_t mask = (static_cast<uint64_t>(1) << (n % 64)) - 1;
+      return ranks_[i] + PopCount(words_[i] & mask);
+    } else if (!words_.empty()) {
+      return ranks_.back() + PopCount(words_.back());
+    } else {
+      return 0;
+    }
+  }
+
+  size_t ApproximateMemoryUsage() const {
+    return words_.capacity() * sizeof(uint64_t) +
+           ranks_.capacity() * sizeof(uint32_t);
+  }
+
+ private:
+  std::vector<uint64_t> words_;
+  std::vector<uint32_t> ranks_;
+  size_t size_;
+};
+
+}  // namespace
+
+// Load an index block generated by ThreeLevelCompactIndexBuilder. Stored
+// prefixes are indexed by a series of ECTs each covering a fixed number of
+// consecutive prefixes. Except for the first prefix of each ECT and the
+// prefixes of groups spanning multiple blocks, prefixes are discarded once
+// loaded. As a result, a lookup for a prefix that is not stored may be
+// directed to the block immediately preceding the one it should go to.
+// That block holds no keys >= the lookup key, and the first key of the
+// block following it is the smallest key >= the lookup key.
+//
+// Prefix groups are mapped to their blocks through two bit vectors: one
+// marks the first prefix of each group and the other marks groups that
+// do not start in the last block of their predecessors. Only groups
+// spanning multiple blocks are stored individually.
+class CompactIndexReader : public IndexReader {
+ public:
+  CompactIndexReader(const BlockContents& contents, const Options* options)
+      : cmp_(options->comparator), prefix_len_(0), num_prefixes_(0) {
+    status_ = Load(contents.data);
+    if (contents.heap_allocated) {
+      delete[] contents.data.data();
+    }
+  }
+
+  virtual ~CompactIndexReader() {
+    for (size_t i = 0; i < tries_.size(); i++) {
+      delete tries_[i];
+    }
+  }
+
+  virtual size_t ApproximateMemoryUsage() const {
+    size_t result = 0;
+    for (size_t i = 0; i < tries_.size(); i++) {
+      result += (tries_[i]->MemUsage() + 7) / 8;
+    }
+    result += tries_.capacity() * sizeof(ECT*);
+    result += trie_prefixes_.size() + span_prefixes_.size() + suffixes_.size();
+    result += pg_starts_.ApproximateMemoryUsage();
+    result += new_blocks_.ApproximateMemoryUsage();
+    result += spans_.capacity() * sizeof(Span);
+    result += sizeof(uint32_t) *
+              (suffix_ends_.capacity() + block_offsets_.capacity());
+    return result;
   }
 
+  virtual Iterator* NewIterator();
+
  private:
-  std::vector<Slice> prefix_;
+  class Iter;
+  // Number of prefixes indexed by each ECT. Locating a prefix costs
+  // time linear to the size of its ECT.
+  enum { kPrefixesPerTrie = 64 };
+
+  // A prefix group covering more than one block
+  struct Span {
+    uint32_t pg;
+    uint32_t first_block;
+    uint32_t num_blocks;
+    uint32_t first_suffix;  // Index into suffix_ends_
+  };
+
+  struct SpanLess {
+    bool operator()(const Span& s, size_t pg) const { return s.pg < pg; }
+  };
+
+  Status Load(const Slice& contents);
+  size_t FindBlock(const Slice& target) const;
+  size_t NumBlocks() const { return block_offsets_.size() - 1; }
+
+  const Comparator* cmp_;
+  Status status_;
+  size_t prefix_len_;
+  size_t num_prefixes_;
+  std::vector<ECT*> tries_;
+  std::string trie_prefixes_;  // First prefix of each ECT
+  RankedBits pg_starts_;       // One bit per prefix
+  RankedBits new_blocks_;      // One bit per prefix group
+  std::vector<Span> spans_;
+  std::string span_prefixes_;  // The only prefix of each span
+  std::vector<uint32_t> suffix_ends_;
+  std::string suffixes_;  // Suffixes of all but the last block of each span
+  std::vector<uint32_t> block_offsets_;  // Ends with the end of the last block
 };
+
+Status CompactIndexReader::Load(const Slice& contents) {
+  const Status corruption = Status::Corruption("bad compact index block");
+  if (contents.size() < 3 * sizeof(uint32_t)) {
+    return corruption;
+  }
+  const size_t limit = contents.size() - 3 * sizeof(uint32_t);
+  const char* p = contents.data() + limit;
+  prefix_len_ = DecodeFixed32(p);
+  const size_t pg_start = DecodeFixed32(p + 4);
+  const size_t blk_start = DecodeFixed32(p + 8);
+  if (prefix_len_ == 0 || pg_start % prefix_len_ != 0 ||
+      pg_start > blk_start || blk_start > limit) {
+    return corruption;
+  }
+
+  // Prefixes must be sorted and unique
+  num_prefixes_ = pg_start / prefix_len_;
+  std::vector<Slice> prefixes;
+  prefixes.reserve(num_prefixes_);
+  for (size_t i = 0; i < num_prefixes_; i++) {
+    prefixes.push_back(Slice(contents.data() + i * prefix_len_, prefix_len_));
+    if (i != 0 && prefixes[i - 1].compare(prefixes[i]) >= 0) {
+      return corruption;
+    }
+  }
+
+  Slice input(contents.data() + blk_start, limit - blk_start);
+  uint32_t num_blocks;
+  if (!GetVarint32(&input, &num_blocks) || num_blocks == 0) {
+    return corruption;
+  }
+  std::vector<Slice> suffixes;
+  suffixes.reserve(num_blocks);
+  block_offsets_.reserve(num_blocks);
+  for (uint32_t i = 0; i < num_blocks; i++) {
+    BlkInfo blk;
+    if (!blk.DecodeFrom(&input)) {
+      return corruption;
+    } else if (i != 0 &&
+               blk.offset < block_offsets_.back() + kBlockTrailerSize) {
+      return corruption;
+    }
+    block_offsets_.push_back(blk.offset);
+    suffixes.push_back(blk.suffix);
+  }
+  if (!input.empty()) {
+    return corruption;
+  }
+
+  input = Slice(contents.data() + pg_start, blk_start - pg_start);
+  uint32_t num_pgs;
+  if (!GetVarint32(&input, &num_pgs) || num_pgs == 0) {
+    return corruption;
+  }
+  PgInfo last;  // The previous prefix group
+  last.first_prefix = 0;
+  last.first_block = 0;
+  last.num_blocks = 0;
+  for (uint32_t i = 0; i < num_pgs; i++) {
+    PgInfo pg;
+    if (!pg.DecodeFrom(&input)) {
+      return corruption;
+    }
+    // Each group other than the sentinel has one or two prefixes and
+    // starts either in the last block of its predecessor or right after
+    const size_t last_block = last.first_block + last.num_blocks;
+    const bool is_sentinel = (i == num_pgs - 1);
+    if ((i == 0 && (pg.first_prefix != 0 || pg.first_block != 0)) ||
+        (i != 0 && (pg.first_prefix < last.first_prefix + 1 ||
+                    pg.first_prefix > last.first_prefix + 2 ||
+                    (last.num_blocks > 1 &&
+                     pg.first_prefix != last.first_prefix + 1) ||
+                    pg.first_block + 1 < last_block ||
+                    pg.first_block > last_block)) ||
+        (is_sentinel && (pg.first_prefix != num_prefixes_ ||
+                         pg.first_block != num_blocks - 1)) ||
+        (!is_sentinel && (pg.num_blocks == 0 ||
+                          pg.first_block + pg.num_blocks > num_blocks - 1))) {
+      return corruption;
+    }
+    if (i != 0) {
+      pg_starts_.Append(true);
+      if (pg.first_prefix - last.first_prefix == 2) {
+        pg_starts_.Append(false);
+      }
+    }
+    if (is_sentinel) {
+      break;
+    }
+    new_blocks_.Append(i == 0 || pg.first_block == last_block);
+    if (pg.num_blocks > 1) {
+      Span span;
+      span.pg = i;
+      span.first_block = pg.first_block;
+      span.num_blocks = pg.num_blocks;
+      span.first_suffix = suffix_ends_.size();
+      spans_.push_back(span);
+      span_prefixes_.append(prefixes[pg.first_prefix].data(), prefix_len_);
+      for (size_t b = 0; b + 1 < pg.num_blocks; b++) {
+        const Slice& suffix = suffixes[pg.first_block + b];
+        suffixes_.append(suffix.data(), suffix.size());
+        suffix_ends_.push_back(suffixes_.size());
+      }
+    }
+    last = pg;
+  }
+  if (!input.empty()) {
+    return corruption;
+  }
+
+  tries_.reserve((num_prefixes_ + kPrefixesPerTrie - 1) / kPrefixesPerTrie);
+  for (size_t i = 0; i < num_prefixes_; i += kPrefixesPerTrie) {
+    const size_t n = std::min<size_t>(kPrefixesPerTrie, num_prefixes_ - i);
+    trie_prefixes_.append(prefixes[i].data(), prefix_len_);
+    tries_.push_back(ECT::Default(prefix_len_, n, &prefixes[i]));
+  }
+
+  return Status::OK();
+}
+
+// Return the first block that may contain keys >= target. Return the block
+// immediately preceding it if target's prefix is not stored in the index
+// and falls in between two prefix groups.
+size_t CompactIndexReader::FindBlock(const Slice& target) const {
+  if (tries_.empty()) {
+    return NumBlocks();
+  }
+  std::string tmp;
+  Slice prefix;
+  if (target.size() >= prefix_len_) {
+    prefix = Slice(target.data(), prefix_len_);
+  } else {
+    tmp = target.ToString();
+    tmp.resize(prefix_len_, 0);
+    prefix = tmp;
+  }
+
+  // Find the last ECT whose first prefix is <= prefix
+  size_t left = 0;
+  size_t right = tries_.size();
+  while (left < right) {
+    const size_t mid = (left + right) / 2;
+    Slice first(&trie_prefixes_[mid * prefix_len_], prefix_len_);
+    if (first.compare(prefix) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0) {
+    return 0;  // Target is smaller than all keys
+  }
+
+  // For prefixes that are not stored, the rank returned by an ECT is
+  // either that of its successor or that of its predecessor
+  const size_t rank =
+      (left - 1) * kPrefixesPerTrie + tries_[left - 1]->Find(prefix);
+  if (rank >= num_prefixes_) {
+    return NumBlocks();
+  }
+  const size_t pg = pg_starts_.Rank(rank + 1) - 1;
+  std::vector<Span>::const_iterator it =
+      std::lower_bound(spans_.begin(), spans_.end(), pg, SpanLess());
+  if (it == spans_.end() || it->pg != pg) {
+    // Each group in between two spans covers a single block
+    if (it == spans_.begin()) {
+      return new_blocks_.Rank(pg + 1) - 1;
+    } else {
+      --it;
+      return it->first_block + it->num_blocks - 1 +
+             (new_blocks_.Rank(pg + 1) - new_blocks_.Rank(it->pg + 1));
+    }
+  }
+
+  Slice span_prefix(&span_prefixes_[(it - spans_.begin()) * prefix_len_],
+                    prefix_len_);
+  const int r = prefix.compare(span_prefix);
+  if (r < 0) {
+    return it->first_block;
+  } else if (r > 0) {
+    return it->first_block + it->num_blocks - 1;
+  }
+
+  // Find the first block whose separator is >= target. The last block
+  // of a span has no separator.
+  std::string separator;
+  left = 0;
+  right = it->num_blocks - 1;
+  while (left < right) {
+    const size_t mid = (left + right) / 2;
+    const size_t i = it->first_suffix + mid;
+    const size_t start = (i != 0) ? suffix_ends_[i - 1] : 0;
+    separator.assign(span_prefix.data(), span_prefix.size());
+    separator.append(suffixes_.data() + start, suffix_ends_[i] - start);
+    if (cmp_->Compare(separator, target) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return it->first_block + left;
+}
+
+// Iterates over data blocks. Keys are not available.
+class CompactIndexReader::Iter : public Iterator {
+ public:
+  explicit Iter(const CompactIndexReader* reader)
+      : reader_(reader),
+        num_blocks_(reader->NumBlocks()),
+        current_(num_blocks_) {}
+
+  virtual bool Valid() const { return current_ < num_blocks_; }
+  virtual Status status() const { return Status::OK(); }
+
+  virtual Slice key() const {
+    assert(Valid());
+    return Slice();
+  }
+
+  virtual Slice value() const {
+    assert(Valid());
+    return handle_;
+  }
+
+  virtual void Seek(const Slice& target) {
+    current_ = reader_->FindBlock(target);
+    Update();
+  }
+
+  virtual void SeekToFirst() {
+    current_ = 0;
+    Update();
+  }
+
+  virtual void SeekToLast() {
+    current_ = (num_blocks_ != 0) ? num_blocks_ - 1 : 0;
+    Update();
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    current_++;
+    Update();
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    current_ = (current_ != 0) ? current_ - 1 : num_blocks_;
+    Update();
+  }
+
+ private:
+  void Update() {
+    if (Valid()) {
+      const std::vector<uint32_t>& offsets = reader_->block_offsets_;
+      BlockHandle handle;
+      handle.set_offset(offsets[current_]);
+      handle.set_size(offsets[current_ + 1] - offsets[current_] -
+                      kBlockTrailerSize);
+      handle_.clear();
+      handle.EncodeTo(&handle_);
+    }
+  }
+
+  const CompactIndexReader* reader_;
+  const size_t num_blocks_;
+  size_t current_;
+  std::string handle_;  // Encoding of the current block handle
+};
+
+Iterator* CompactIndexReader::NewIterator() {
+  if (!status_.ok()) {
+    return NewErrorIterator(status_);
+  } else {
+    return new Iter(this);
+  }
 }
-#endif
 
 IndexBuilder* IndexBuilder::Create(const Options* options) {
-  return new DefaultIndexBuilder(options);
+  switch (options->index_type) {
+    case kCompact:
+      return new ThreeLevelCompactIndexBuilder(options);
+    default:
+      return new DefaultIndexBuilder(options);
+  }
 }
 
-IndexReader* IndexReader::Create(const BlockContents& contents,
+IndexReader* IndexReader::Create(IndexType type, const BlockContents& contents,
                                  const Options* options) {
-  return new DefaultIndexReader(contents, options);
+  switch (type) {
+    case kCompact:
+      return new CompactIndexReader(contents, options);
+    default:
+      return new DefaultIndexReader(contents, options);
+  }
 }
 
 }  // namespace pdlfs
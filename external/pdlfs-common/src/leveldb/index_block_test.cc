@@ -9,8 +9,12 @@
  */
 
 #include "pdlfs-common/leveldb/index_block.h"
+#include "pdlfs-common/leveldb/db/db.h"
 #include "pdlfs-common/leveldb/db/options.h"
+#include "pdlfs-common/leveldb/filter_policy.h"
 #include "pdlfs-common/leveldb/format.h"
+#include "pdlfs-common/leveldb/iterator.h"
+#include "pdlfs-common/leveldb/table.h"
 #include "pdlfs-common/leveldb/table_builder.h"
 
 #include "pdlfs-common/coding.h"
@@ -21,13 +25,13 @@
 
 #include "db/memtable.h"
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <vector>
 
 namespace pdlfs {
 
-#if 0
 class IndexLoader {
  public:
   struct PgInfo {
@@ -264,7 +268,239 @@ TEST(IndexTest, MultiBlockCrossingPg2) {
   ASSERT_EQ(loader.pg_info_[2].num_pref, 1);
   ASSERT_EQ(loader.pg_info_[2].num_blks, 1);
 }
-#endif
+
+// Build tables with compact indexes and check lookups against the keys
+// inserted into them.
+class CompactIndexTest {
+ public:
+  typedef DBOptions Options;
+
+  CompactIndexTest() : icmp_(BytewiseComparator()) {
+    dbname_ = test::TmpDir() + "/compact_index_test";
+    env_ = Env::Default();
+    env_->CreateDir(dbname_.c_str());
+    options_.env = env_;
+    options_.comparator = &icmp_;
+    options_.index_type = kCompact;
+    options_.compression = kNoCompression;
+    options_.block_size = 256;
+    options_.block_restart_interval = 4;
+    file_ = NULL;
+    table_ = NULL;
+  }
+
+  ~CompactIndexTest() {
+    delete table_;
+    delete file_;
+  }
+
+  static std::string Fixed64Key(uint64_t v) {
+    char tmp[8];
+    EncodeFixed64(tmp, v);
+    std::string result(tmp, 8);
+    std::reverse(result.begin(), result.end());  // Big endian
+    return result;
+  }
+
+  // Generate keys under "num_prefixes" random prefixes, each with at most
+  // "max_suffixes" suffixes. Some keys have multiple versions.
+  void GenerateKeys(Random* rnd, int num_prefixes, int max_suffixes) {
+    std::set<std::string> ukeys;
+    for (int i = 0; i < num_prefixes; i++) {
+      const std::string prefix = Fixed64Key(rnd->Next64());
+      const int n = 1 + rnd->Uniform(max_suffixes);
+      for (int j = 0; j < n; j++) {
+        ukeys.insert(prefix + Fixed64Key(rnd->Next64()));
+      }
+    }
+    SequenceNumber seq = 1000;
+    std::set<std::string>::iterator it;
+    for (it = ukeys.begin(); it != ukeys.end(); ++it) {
+      const int versions = rnd->OneIn(8) ? 3 : 1;
+      for (int v = 0; v < versions; v++) {
+        std::string ikey;
+        AppendInternalKey(&ikey,
+                          ParsedInternalKey(*it, seq - v, kTypeValue));
+        keys_.push_back(ikey);
+      }
+      seq += 10;
+    }
+  }
+
+  void BuildTable() {
+    const std::string fname = TableFileName(dbname_, 1);
+    env_->DeleteFile(fname.c_str());
+    WritableFile* file;
+    ASSERT_OK(env_->NewWritableFile(fname.c_str(), &file));
+    TableBuilder builder(options_, file);
+    for (size_t i = 0; i < keys_.size(); i++) {
+      builder.Add(keys_[i], keys_[i]);
+    }
+    ASSERT_OK(builder.Finish());
+    ASSERT_OK(file->Close());
+    delete file;
+
+    uint64_t size;
+    ASSERT_OK(env_->GetFileSize(fname.c_str(), &size));
+    ASSERT_OK(env_->NewRandomAccessFile(fname.c_str(), &file_));
+    ASSERT_OK(Table::Open(options_, file_, size, &table_));
+  }
+
+  // Check that a seek to "target" lands on the first key >= target
+  void CheckSeek(Iterator* iter, const Slice& target) {
+    size_t left = 0;
+    size_t right = keys_.size();
+    while (left < right) {
+      const size_t mid = (left + right) / 2;
+      if (icmp_.Compare(keys_[mid], target) < 0) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    iter->Seek(target);
+    if (left == keys_.size()) {
+      ASSERT_TRUE(!iter->Valid());
+    } else {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(iter->key().ToString(), keys_[left]);
+    }
+  }
+
+  void CheckTable(Random* rnd) {
+    ReadOptions options;
+    Iterator* iter = table_->NewIterator(options);
+    size_t i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(iter->key().ToString(), keys_[i++]);
+    }
+    ASSERT_EQ(i, keys_.size());
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      ASSERT_EQ(iter->key().ToString(), keys_[--i]);
+    }
+    ASSERT_EQ(i, 0);
+    for (i = 0; i < keys_.size(); i++) {
+      CheckSeek(iter, keys_[i]);
+      // Keys sharing a prefix with an existing key
+      std::string ukey = ExtractUserKey(keys_[i]).ToString();
+      ukey.resize(8);
+      ukey.append(Fixed64Key(rnd->Next64()));
+      std::string target;
+      AppendInternalKey(&target, ParsedInternalKey(ukey, kMaxSequenceNumber,
+                                                   kValueTypeForSeek));
+      CheckSeek(iter, target);
+    }
+    // Keys with random prefixes
+    for (i = 0; i < 1000; i++) {
+      std::string target;
+      AppendInternalKey(&target,
+                        ParsedInternalKey(Fixed64Key(rnd->Next64()) +
+                                              Fixed64Key(rnd->Next64()),
+                                          kMaxSequenceNumber, kTypeValue));
+      CheckSeek(iter, target);
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+
+  std::string dbname_;
+  Env* env_;
+  InternalKeyComparator icmp_;
+  Options options_;
+  std::vector<std::string> keys_;
+  RandomAccessFile* file_;
+  Table* table_;
+};
+
+TEST(CompactIndexTest, EmptyTable) {
+  BuildTable();
+  Random rnd(301);
+  CheckTable(&rnd);
+}
+
+TEST(CompactIndexTest, SingleKey) {
+  Random rnd(301);
+  GenerateKeys(&rnd, 1, 1);
+  BuildTable();
+  CheckTable(&rnd);
+}
+
+TEST(CompactIndexTest, SmallPrefixGroups) {
+  Random rnd(301);
+  GenerateKeys(&rnd, 5000, 2);
+  BuildTable();
+  CheckTable(&rnd);
+}
+
+TEST(CompactIndexTest, LargePrefixGroups) {
+  Random rnd(301);
+  GenerateKeys(&rnd, 50, 200);
+  BuildTable();
+  CheckTable(&rnd);
+}
+
+TEST(CompactIndexTest, MixedPrefixGroups) {
+  Random rnd(301);
+  GenerateKeys(&rnd, 2000, 40);
+  BuildTable();
+  CheckTable(&rnd);
+}
+
+TEST(CompactIndexTest, DB) {
+  const std::string dbname = test::TmpDir() + "/compact_index_db";
+  DBOptions options;
+  options.env = env_;
+  options.create_if_missing = true;
+  options.block_size = 1024;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  DestroyDB(dbname, options);
+  Random rnd(301);
+  std::vector<std::string> keys;
+  // Tables written before and after switching to the compact index
+  // should both be readable
+  for (int i = 0; i < 2; i++) {
+    options.index_type = (i == 0) ? kMultiwaySearchTree : kCompact;
+    DB* db;
+    ASSERT_OK(DB::Open(options, dbname, &db));
+    for (int j = 0; j < 10000; j++) {
+      keys.push_back(Fixed64Key(rnd.Next64()) + Fixed64Key(rnd.Next64()));
+      ASSERT_OK(db->Put(WriteOptions(), keys.back(), keys.back()));
+    }
+    ASSERT_OK(db->FlushMemTable(FlushOptions()));
+    for (size_t j = 0; j < keys.size(); j++) {
+      std::string value;
+      ASSERT_OK(db->Get(ReadOptions(), keys[j], &value));
+      ASSERT_EQ(value, keys[j]);
+      // Keys that are absent but share their prefix with one that is not
+      std::string missing = keys[j].substr(0, 8) + Fixed64Key(rnd.Next64());
+      ASSERT_TRUE(db->Get(ReadOptions(), missing, &value).IsNotFound());
+    }
+    delete db;
+  }
+  DestroyDB(dbname, options);
+  delete options.filter_policy;
+}
+
+TEST(CompactIndexTest, ShortKeys) {
+  Random rnd(301);
+  std::set<std::string> ukeys;
+  while (ukeys.size() < 2000) {
+    std::string ukey;
+    test::RandomString(&rnd, 1 + rnd.Uniform(12), &ukey);
+    ukeys.insert(ukey);
+  }
+  SequenceNumber seq = 1000;
+  std::set<std::string>::iterator it;
+  for (it = ukeys.begin(); it != ukeys.end(); ++it) {
+    std::string ikey;
+    AppendInternalKey(&ikey, ParsedInternalKey(*it, seq++, kTypeValue));
+    keys_.push_back(ikey);
+  }
+  // Tables holding keys shorter than the prefix fall back to the
+  // default index and must remain readable
+  BuildTable();
+  CheckTable(&rnd);
+}
 
 // ---------
 
@@ -472,6 +708,17 @@ TEST(IndexBench, DefaultIndexBlockBuilder) {
   }
 }
 
+TEST(IndexBench, CompactIndexBlockBuilder) {
+  options.index_type = kCompact;
+  for (int pg_size = 1; pg_size <= 4096; pg_size *= 4) {
+    Random rnd(301);
+    TableBuilderWrapper builder(&options);
+    FixedSizeGenerator size_gen(pg_size);
+    builder.CreateTable(&rnd, &size_gen);
+    builder.Report();
+  }
+}
+
 }  // namespace pdlfs
 
 int main(int argc, char** argv) {
@@ -39,6 +39,7 @@ struct Table::Rep {
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   IndexReader* index_block;
+  IndexType index_type;
 
   TableProperties props;  // All properties embedded in the table
   bool props_valid;
@@ -78,7 +79,8 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     }
     s = ReadBlock(file, opt, footer.index_handle(), &contents);
     if (s.ok()) {
-      index_block = IndexReader::Create(contents, &options);
+      index_block =
+          IndexReader::Create(footer.index_type(), contents, &options);
     }
   }
 
@@ -90,6 +92,7 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->index_type = footer.index_type();
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = NULL;
     rep->filter = NULL;
@@ -270,7 +273,11 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator();
   iiter->Seek(k);
-  if (iiter->Valid()) {
+  // A compact index may position us at the block immediately preceding
+  // the one that may contain the key, so we may have to check the block
+  // next to it as well.
+  int blocks_to_check = (rep_->index_type == kCompact) ? 2 : 1;
+  while (iiter->Valid() && blocks_to_check-- > 0) {
     Slice handle_value = iiter->value();
     FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
@@ -280,12 +287,21 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
     } else {
       Iterator* block_iter = BlockReader(this, options, iiter->value());
       block_iter->Seek(k);
+      bool done = true;
       if (block_iter->Valid()) {
         Slice v = (options.limit != 0) ? block_iter->value() : Slice();
         (*saver)(arg, block_iter->key(), v);
+      } else {
+        done = !block_iter->status().ok();
       }
       s = block_iter->status();
       delete block_iter;
+      if (done) {
+        break;
+      }
+    }
+    if (blocks_to_check != 0) {
+      iiter->Next();
     }
   }
   if (s.ok()) {
@@ -321,6 +337,10 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   return result;
 }
 
+size_t Table::ApproximateIndexMemoryUsage() const {
+  return rep_->index_block->ApproximateMemoryUsage();
+}
+
 Table::~Table() { delete rep_; }
 
 const TableProperties* Table::GetProperties() const {
@@ -113,6 +113,9 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.index_type != rep_->options.index_type) {
+    return Status::InvalidArgument("changing index type while building table");
+  }
 
   rep_->options = options;
   rep_->data_block.ChangeRestartInterval(rep_->options.block_restart_interval);
@@ -299,6 +302,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_index_type(r->index_block->type());
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
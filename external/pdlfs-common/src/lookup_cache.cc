@@ -28,6 +28,9 @@ LookupCache::~LookupCache() {
 LookupCache::LookupCache(size_t capacity, port::Mutex* mu)
     : lru_(capacity), mu_(mu) {}
 
+LookupCache::Stats::Stats()
+    : hits(0), negative_hits(0), misses(0), renewals(0) {}
+
 void LookupCache::Release(Handle* handle) {
   if (mu_ != NULL) {
     mu_->Lock();
@@ -56,7 +59,8 @@ Slice LookupCache::LRUKey(const DirId& pid, const Slice& nhash, char* scratch) {
   return Slice(scratch, p - scratch + nhash.size());
 }
 
-LookupCache::Handle* LookupCache::Lookup(const DirId& pid, const Slice& nhash) {
+LookupCache::Handle* LookupCache::Lookup(const DirId& pid, const Slice& nhash,
+                                         uint64_t min_due) {
   char tmp[50];
   Slice key = LRUKey(pid, nhash, tmp);
   uint32_t hash = Hash(key.data(), key.size(), 0);
@@ -64,7 +68,19 @@ LookupCache::Handle* LookupCache::Lookup(const DirId& pid, const Slice& nhash) {
   if (mu_ != NULL) {
     mu_->Lock();
   }
-  Handle* h = reinterpret_cast<Handle*>(lru_.Lookup(key, hash));
+  LookupEntry* e = lru_.Lookup(key, hash);
+  if (e != NULL && e->value->LeaseDue() < min_due) {
+    lru_.Release(e);
+    e = NULL;
+  }
+  if (e == NULL) {
+    stats_.misses++;
+  } else if (IsNegative(e->value)) {
+    stats_.negative_hits++;
+  } else {
+    stats_.hits++;
+  }
+  Handle* h = reinterpret_cast<Handle*>(e);
   if (mu_ != NULL) {
     mu_->Unlock();
   }
@@ -88,6 +104,21 @@ LookupCache::Handle* LookupCache::Insert(const DirId& pid, const Slice& nhash,
   return h;
 }
 
+LookupCache::Handle* LookupCache::InsertNegative(const DirId& pid,
+                                                 const Slice& nhash,
+                                                 uint64_t lease_due) {
+  LookupStat* stat = new LookupStat;
+  stat->SetRegId(0);
+  stat->SetSnapId(0);
+  stat->SetInodeNo(0);
+  stat->SetDirMode(0);
+  stat->SetZerothServer(0);
+  stat->SetUserId(0);
+  stat->SetGroupId(0);
+  stat->SetLeaseDue(lease_due);
+  return Insert(pid, nhash, stat);
+}
+
 void LookupCache::Erase(const DirId& pid, const Slice& nhash) {
   char tmp[50];
   Slice key = LRUKey(pid, nhash, tmp);
@@ -102,4 +133,24 @@ void LookupCache::Erase(const DirId& pid, const Slice& nhash) {
   }
 }
 
+void LookupCache::RecordRenewal() {
+  if (mu_ != NULL) {
+    mu_->Lock();
+  }
+  stats_.renewals++;
+  if (mu_ != NULL) {
+    mu_->Unlock();
+  }
+}
+
+void LookupCache::GetStats(Stats* stats) {
+  if (mu_ != NULL) {
+    mu_->Lock();
+  }
+  *stats = stats_;
+  if (mu_ != NULL) {
+    mu_->Unlock();
+  }
+}
+
 }  // namespace pdlfs
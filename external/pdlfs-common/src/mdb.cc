@@ -229,6 +229,110 @@ size_t MDB::List(const DirId& id, StatList* stats, NameList* names, Tx* tx,
   return num_entries;
 }
 
+Status MDB::List(const DirId& id, const Slice& start_hash, StatList* stats,
+                 NameList* names, std::string* last_hash, bool* has_more,
+                 Tx* tx, size_t limit, size_t byte_limit) {
+  Key key(KEY_INITIALIZER(id, kDirEntType));
+  ReadOptions options;
+  options.verify_checksums = options_.verify_checksums;
+  options.fill_cache = false;
+  if (tx != NULL) {
+    options.snapshot = tx->snap;
+  }
+  Slice prefix = key.prefix();
+  Iterator* iter = db_->NewIterator(options);
+  if (!start_hash.empty()) {
+    key.SetHash(start_hash);
+    iter->Seek(key.Encode());
+    if (iter->Valid() && iter->key() == key.Encode()) {
+      iter->Next();
+    }
+  } else {
+    iter->Seek(prefix);
+  }
+  Slice name;
+  Stat stat;
+  size_t num_entries = 0;
+  size_t bytes = 0;
+  for (; iter->Valid(); iter->Next()) {
+    Slice k = iter->key();
+    if (!k.starts_with(prefix)) {
+      break;
+    } else if (num_entries >= limit || bytes >= byte_limit) {
+      break;
+    }
+    Slice input = iter->value();
+    // Skip entries that cannot be decoded
+    if (stat.DecodeFrom(&input) && GetLengthPrefixedSlice(&input, &name)) {
+      if (stats != NULL) {
+        stats->push_back(stat);
+        bytes += sizeof(Stat);
+      }
+      if (names != NULL) {
+        names->push_back(name.ToString());
+      }
+      bytes += name.size();
+      num_entries++;
+    }
+    k.remove_prefix(prefix.size());
+    last_hash->assign(k.data(), k.size());
+  }
+  Status s = iter->status();
+  *has_more = s.ok() && iter->Valid() && iter->key().starts_with(prefix);
+  delete iter;
+
+  return s;
+}
+
+Status MDB::ListRange(const DirId& id, const Slice& lower_hash,
+                      const Slice& upper_hash, StatList* stats,
+                      NameList* names, NameList* hashes, Tx* tx) {
+  Status s;
+  Key key(KEY_INITIALIZER(id, kDirEntType));
+  ReadOptions options;
+  options.verify_checksums = options_.verify_checksums;
+  options.fill_cache = false;
+  if (tx != NULL) {
+    options.snapshot = tx->snap;
+  }
+  Slice prefix = key.prefix();
+  Iterator* iter = db_->NewIterator(options);
+  key.SetHash(lower_hash);
+  iter->Seek(key.Encode());
+  Slice name;
+  Stat stat;
+  for (; iter->Valid(); iter->Next()) {
+    Slice k = iter->key();
+    if (!k.starts_with(prefix)) {
+      break;
+    }
+    k.remove_prefix(prefix.size());
+    if (!upper_hash.empty() && k.compare(upper_hash) >= 0) {
+      break;
+    }
+    Slice input = iter->value();
+    if (!stat.DecodeFrom(&input) || !GetLengthPrefixedSlice(&input, &name)) {
+      s = Status::Corruption("Bad directory entry");
+      break;
+    }
+    if (stats != NULL) {
+      stats->push_back(stat);
+    }
+    if (names != NULL) {
+      names->push_back(name.ToString());
+    }
+    if (hashes != NULL) {
+      hashes->push_back(k.ToString());
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  delete iter;
+
+  return s;
+}
+
 bool MDB::Exists(const DirId& id, const Slice& hash, Tx* tx) {
   Status s;
   Key key(KEY_INITIALIZER(id, kDirEntType));
@@ -72,6 +72,7 @@ inline bool TypeOnRados(FileType type) {
     case kLogFile:
     case kDescriptorFile:
     case kCurrentFile:
+    case kValueLogFile:
       return true;
     case kDBLockFile:
     case kTempFile:
@@ -23,10 +23,14 @@
 #include "mercury_rpc.h"
 #endif
 
+#if defined(PDLFS_SOCKET_RPC)
+#include "socket_rpc.h"
+#endif
+
 namespace pdlfs {
 
 RPCOptions::RPCOptions()
-    : impl(kMercuryRPC),
+    : impl(kAutoRPC),
       mode(kServerClient),
       rpc_timeout(5000000),
       num_io_threads(1),
@@ -152,6 +156,39 @@ class MercuryRPCImpl : public RPC {
 #endif
 }
 
+namespace {
+#if defined(PDLFS_SOCKET_RPC)
+class SocketRPCImpl : public RPC {
+  SocketRPC* rpc_;
+
+ public:
+  virtual Status status() const { return rpc_->status(); }
+  virtual Status Start() { return rpc_->Start(); }
+  virtual Status Stop() { return rpc_->Stop(); }
+
+  virtual If* OpenClientFor(const std::string& addr) {
+    return new SocketRPC::Client(rpc_, addr);
+  }
+
+  SocketRPCImpl(const RPCOptions& options) {
+    rpc_ = new SocketRPC(options.mode == kServerClient, options);
+    rpc_->Ref();
+  }
+
+  virtual ~SocketRPCImpl() { rpc_->Unref(); }
+};
+#endif
+}
+
+#if defined(PDLFS_SOCKET_RPC)
+// Return true if uri names a plain tcp or udp transport, which is
+// served by the built-in socket rpc unless another rpc is requested.
+static bool IsSocketUri(const Slice& uri) {
+  return uri == "tcp" || uri == "udp" || uri.starts_with("tcp://") ||
+         uri.starts_with("udp://");
+}
+#endif
+
 }  // namespace rpc
 
 RPC* RPC::Open(const RPCOptions& raw_options) {
@@ -171,7 +208,20 @@ RPC* RPC::Open(const RPCOptions& raw_options) {
               ? options.extra_workers->ToDebugString().c_str()
               : "NULL");
 #endif
+  if (options.impl == kAutoRPC) {
+    options.impl = kMercuryRPC;
+#if defined(PDLFS_SOCKET_RPC)
+    if (rpc::IsSocketUri(options.uri)) {
+      options.impl = kSocketRPC;
+    }
+#endif
+  }
   RPC* rpc = NULL;
+#if defined(PDLFS_SOCKET_RPC)
+  if (options.impl == kSocketRPC) {
+    rpc = new rpc::SocketRPCImpl(options);
+  }
+#endif
 #if defined(PDLFS_MARGO_RPC)
   if (options.impl == kMargoRPC) {
     rpc = new rpc::MargoRPCImpl(options);
@@ -0,0 +1,758 @@
+/*
+ * Copyright (c) 2015-2017 Carnegie Mellon University.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#include "socket_rpc.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/logging.h"
+#include "pdlfs-common/pdlfs_config.h"
+
+namespace pdlfs {
+namespace rpc {
+
+namespace {
+// Frame header: payload size (excluding itself), call id, op, and err.
+const size_t kHeaderSize = 16;
+// Larger frames are treated as stream corruption.
+const size_t kMaxFrameSize = 64 << 20;
+// Max payload of a single UDP datagram.
+const size_t kMaxDatagramSize = 65507;
+// Max number of connections a client keeps per target.
+const size_t kMaxConnsPerClient = 4;
+// Number of bytes read from a stream socket at a time.
+const size_t kReadSize = 64 << 10;
+// Max time a looping thread blocks in epoll_wait, in milliseconds.
+const int kLoopTimeout = 200;
+
+void EncodeHeader(char* dst, uint32_t xid, const If::Message& msg) {
+  EncodeFixed32(dst, static_cast<uint32_t>(12 + msg.contents.size()));
+  EncodeFixed32(dst + 4, xid);
+  EncodeFixed32(dst + 8, static_cast<uint32_t>(msg.op));
+  EncodeFixed32(dst + 12, static_cast<uint32_t>(msg.err));
+}
+
+// Copy message body into msg's own buffer space.
+void SetContents(If::Message* msg, const char* p, size_t n) {
+  char* dst;
+  if (n <= sizeof(msg->buf)) {
+    dst = &msg->buf[0];
+  } else {
+    msg->extra_buf.resize(n);
+    dst = &msg->extra_buf[0];
+  }
+  if (n != 0) {
+    memcpy(dst, p, n);
+  }
+  msg->contents = Slice(dst, n);
+}
+
+Status IOError(const char* context, int err_number) {
+  return Status::IOError(context, strerror(err_number));
+}
+
+// Split uri into its proto, host, and port. The proto part is optional.
+// Return false if the uri is not understood.
+bool ParseUri(const std::string& uri, std::string* proto, std::string* host,
+              std::string* port) {
+  std::string rest = uri;
+  size_t pos = rest.find("://");
+  if (pos != std::string::npos) {
+    *proto = rest.substr(0, pos);
+    rest = rest.substr(pos + 3);
+  }
+  pos = rest.rfind(':');
+  if (pos == std::string::npos) {
+    return false;
+  } else {
+    *host = rest.substr(0, pos);
+    *port = rest.substr(pos + 1);
+    return !port->empty();
+  }
+}
+
+Status Resolve(const std::string& host, const std::string& port, bool udp,
+               bool passive, struct sockaddr_storage* sa, socklen_t* salen) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+  if (passive) {
+    hints.ai_flags = AI_PASSIVE;
+  }
+  struct addrinfo* ai;
+  const char* node = host.empty() ? NULL : host.c_str();
+  int r = getaddrinfo(node, port.c_str(), &hints, &ai);
+  if (r != 0) {
+    return Status::IOError(host, gai_strerror(r));
+  } else {
+    memcpy(sa, ai->ai_addr, ai->ai_addrlen);
+    *salen = ai->ai_addrlen;
+    freeaddrinfo(ai);
+    return Status::OK();
+  }
+}
+
+// Wait until fd becomes ready for the given events. Return false on
+// timeouts or errors.
+bool WaitFor(int fd, short events, uint64_t timeout) {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = events;
+  pfd.revents = 0;
+  int ms = static_cast<int>(timeout / 1000);
+  int r;
+  do {
+    r = poll(&pfd, 1, ms > 0 ? ms : 1);
+  } while (r < 0 && errno == EINTR);
+  return r > 0 && (pfd.revents & events) != 0;
+}
+
+// Send a frame without copying its body. For stream sockets the caller
+// must prevent concurrent writers from interleaving frames.
+Status SendFrame(int fd, const char* hdr, const Slice& body,
+                 const struct sockaddr* to, socklen_t tolen,
+                 uint64_t timeout) {
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<char*>(hdr);
+  iov[0].iov_len = kHeaderSize;
+  iov[1].iov_base = const_cast<char*>(body.data());
+  iov[1].iov_len = body.size();
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = const_cast<struct sockaddr*>(to);
+  msg.msg_namelen = tolen;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = body.empty() ? 1 : 2;
+  while (msg.msg_iovlen != 0) {
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (!WaitFor(fd, POLLOUT, timeout)) {
+          return Status::IOError("send timeout");
+        }
+        continue;
+      } else {
+        return IOError("sendmsg", errno);
+      }
+    }
+    // Skip data that has been sent
+    size_t sent = static_cast<size_t>(n);
+    while (msg.msg_iovlen != 0 && sent >= msg.msg_iov[0].iov_len) {
+      sent -= msg.msg_iov[0].iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen != 0) {
+      char* base = static_cast<char*>(msg.msg_iov[0].iov_base);
+      msg.msg_iov[0].iov_base = base + sent;
+      msg.msg_iov[0].iov_len -= sent;
+    }
+  }
+  return Status::OK();
+}
+
+void SetNoDelay(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+struct PendingCall {
+  If::Message* out;
+  bool done;
+  bool ok;
+};
+
+}  // namespace
+
+// ====================
+// Socket connection
+// ====================
+
+struct SocketRPC::Conn {
+  enum Kind { kListener, kDatagramServer, kServer, kClient };
+  Conn(Kind k, int sockfd, bool is_udp)
+      : kind(k),
+        fd(sockfd),
+        udp(is_udp),
+        epfd(-1),
+        cv(&mu),
+        refs(1),
+        dead(false),
+        next_xid(0) {}
+
+  const Kind kind;
+  const int fd;
+  const bool udp;
+  int epfd;  // Set once when registered with a looping thread
+
+  // State below is protected by mu
+  port::Mutex mu;
+  port::CondVar cv;
+  int refs;
+  bool dead;
+  uint32_t next_xid;
+  std::map<uint32_t, PendingCall*> pending;  // Client side only
+
+  // Serializes writers of a stream socket
+  port::Mutex wmu;
+
+  // Only accessed by the looping thread owning the connection
+  std::string rbuf;
+
+  void Ref() {
+    MutexLock ml(&mu);
+    refs++;
+  }
+
+  void Unref() {
+    mu.Lock();
+    assert(refs > 0);
+    bool last = --refs == 0;
+    mu.Unlock();
+    if (last) {
+      close(fd);
+      delete this;
+    }
+  }
+
+  // Hand a reply to its waiting caller. Replies that arrive after their
+  // callers have timed out are dropped.
+  void Complete(uint32_t xid, int op, int err, const Slice& body) {
+    MutexLock ml(&mu);
+    std::map<uint32_t, PendingCall*>::iterator it = pending.find(xid);
+    if (it != pending.end()) {
+      PendingCall* call = it->second;
+      call->out->op = op;
+      call->out->err = err;
+      SetContents(call->out, body.data(), body.size());
+      call->done = true;
+      call->ok = true;
+      pending.erase(it);
+      cv.SignalAll();
+    }
+  }
+
+  // Fail all outstanding calls. No more calls may be added.
+  void Fail() {
+    MutexLock ml(&mu);
+    dead = true;
+    std::map<uint32_t, PendingCall*>::iterator it;
+    for (it = pending.begin(); it != pending.end(); ++it) {
+      it->second->done = true;
+      it->second->ok = false;
+    }
+    pending.clear();
+    cv.SignalAll();
+  }
+};
+
+// An incoming call waiting to be executed.
+struct SocketRPC::Job {
+  Conn* conn;
+  If* fs;
+  uint64_t timeout;
+  uint32_t xid;
+  If::Message in;
+  struct sockaddr_storage from;  // UDP only
+  socklen_t fromlen;
+};
+
+void SocketRPC::RunJob(void* arg) {
+  Job* j = reinterpret_cast<Job*>(arg);
+  If::Message out;
+  j->fs->Call(j->in, out);  // Execute callback
+  char hdr[kHeaderSize];
+  EncodeHeader(hdr, j->xid, out);
+  Conn* c = j->conn;
+  Status s;
+  if (c->udp) {
+    if (out.contents.size() > kMaxDatagramSize - kHeaderSize) {
+      s = Status::BufferFull("reply too large for udp");
+    } else {
+      s = SendFrame(c->fd, hdr, out.contents,
+                    reinterpret_cast<struct sockaddr*>(&j->from), j->fromlen,
+                    j->timeout);
+    }
+  } else {
+    MutexLock ml(&c->wmu);
+    s = SendFrame(c->fd, hdr, out.contents, NULL, 0, j->timeout);
+  }
+  if (!s.ok()) {
+    Error(__LOG_ARGS__, "cannot send rpc reply: %s", s.ToString().c_str());
+    if (!c->udp) {
+      shutdown(c->fd, SHUT_RDWR);  // Let the looping thread drop it
+    }
+  }
+  c->Unref();
+  delete j;
+}
+
+void SocketRPC::Dispatch(Conn* c, const char* frame, size_t size,
+                         const struct sockaddr* from, socklen_t fromlen) {
+  const uint32_t xid = DecodeFixed32(frame);
+  const int op = static_cast<int32_t>(DecodeFixed32(frame + 4));
+  const int err = static_cast<int32_t>(DecodeFixed32(frame + 8));
+  Slice body(frame + 12, size - 12);
+  if (c->kind == Conn::kClient) {
+    c->Complete(xid, op, err, body);
+  } else if (fs_ != NULL) {
+    Job* j = new Job;
+    j->conn = c;
+    c->Ref();
+    j->fs = fs_;
+    j->timeout = rpc_timeout_;
+    j->xid = xid;
+    j->in.op = op;
+    j->in.err = err;
+    SetContents(&j->in, body.data(), body.size());
+    j->fromlen = fromlen;
+    if (fromlen != 0) {
+      memcpy(&j->from, from, fromlen);
+    }
+    if (pool_ != NULL) {
+      pool_->Schedule(RunJob, j);
+    } else {
+      RunJob(j);
+    }
+  }
+}
+
+// Return false if the connection should be dropped.
+bool SocketRPC::ReceiveStream(Conn* c) {
+  std::string* const buf = &c->rbuf;
+  const size_t off = buf->size();
+  buf->resize(off + kReadSize);
+  ssize_t n = recv(c->fd, &(*buf)[off], kReadSize, 0);
+  buf->resize(off + (n > 0 ? n : 0));
+  if (n == 0) {
+    return false;  // EOF
+  } else if (n < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+  size_t pos = 0;
+  while (buf->size() - pos >= 4) {
+    const size_t size = DecodeFixed32(buf->data() + pos);
+    if (size < 12 || size > kMaxFrameSize) {
+      Error(__LOG_ARGS__, "bad rpc frame size: %zu", size);
+      return false;
+    } else if (buf->size() - pos < 4 + size) {
+      break;  // Wait for more data
+    }
+    Dispatch(c, buf->data() + pos + 4, size, NULL, 0);
+    pos += 4 + size;
+  }
+  buf->erase(0, pos);
+  return true;
+}
+
+// Return false if the connection should be dropped.
+bool SocketRPC::ReceiveDatagrams(Conn* c) {
+  std::string* const buf = &c->rbuf;
+  buf->resize(kMaxDatagramSize + 1);
+  while (true) {
+    struct sockaddr_storage from;
+    socklen_t fromlen = sizeof(from);
+    ssize_t n = recvfrom(c->fd, &(*buf)[0], buf->size(), 0,
+                         reinterpret_cast<struct sockaddr*>(&from), &fromlen);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return true;
+      } else {
+        // Connected clients see ECONNREFUSED when the server is gone
+        return c->kind == Conn::kDatagramServer;
+      }
+    } else if (n == 0 && c->kind == Conn::kClient) {
+      return false;  // Shut down by the client
+    } else if (n >= static_cast<ssize_t>(kHeaderSize) &&
+               DecodeFixed32(buf->data()) + 4 == static_cast<size_t>(n)) {
+      Dispatch(c, buf->data() + 4, n - 4,
+               reinterpret_cast<struct sockaddr*>(&from), fromlen);
+    }
+    // Malformed datagrams are silently ignored
+  }
+}
+
+void SocketRPC::Accept(Conn* listener) {
+  while (true) {
+    int fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        Error(__LOG_ARGS__, "accept: %s", strerror(errno));
+      }
+      return;
+    }
+    SetNoDelay(fd);
+    Conn* c = new Conn(Conn::kServer, fd, false);
+    Register(c);
+    c->Unref();
+  }
+}
+
+// Assign a connection to one of the looping threads.
+void SocketRPC::Register(Conn* c) {
+  c->Ref();
+  mutex_.Lock();
+  conns_.insert(c);
+  c->epfd = epfds_[next_loop_++ % epfds_.size()];
+  mutex_.Unlock();
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.ptr = c;
+  epoll_ctl(c->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+// REQUIRES: called by the looping thread owning the connection, or
+// after all looping threads have stopped.
+void SocketRPC::Drop(Conn* c) {
+  mutex_.Lock();
+  conns_.erase(c);
+  mutex_.Unlock();
+  epoll_ctl(c->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+  c->Fail();
+  c->Unref();
+}
+
+void SocketRPC::BGLoop() {
+  mutex_.Lock();
+  const int epfd = epfds_[bg_id_++ % epfds_.size()];
+  mutex_.Unlock();
+  struct epoll_event events[64];
+
+  while (!shutting_down_.Acquire_Load()) {
+    int n = epoll_wait(epfd, events, 64, kLoopTimeout);
+    if (n < 0 && errno != EINTR) {
+      Error(__LOG_ARGS__, "epoll_wait: %s", strerror(errno));
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      Conn* c = reinterpret_cast<Conn*>(events[i].data.ptr);
+      bool ok = true;
+      if (c->kind == Conn::kListener) {
+        Accept(c);
+      } else if (c->udp) {
+        ok = ReceiveDatagrams(c);
+      } else {
+        ok = ReceiveStream(c);
+      }
+      if (!ok) {
+        Drop(c);
+      }
+    }
+  }
+
+  mutex_.Lock();
+  assert(bg_loops_ > 0);
+  bg_loops_--;
+  bg_cv_.SignalAll();
+  mutex_.Unlock();
+}
+
+Status SocketRPC::Start() {
+  MutexLock ml(&mutex_);
+  if (bg_loops_ == 0) {
+    shutting_down_.Release_Store(NULL);
+    bg_id_ = 0;
+    while (bg_loops_ < static_cast<int>(epfds_.size())) {
+      bg_loops_++;
+      env_->StartThread(BGLoopWrapper, this);
+    }
+  }
+  return status_;
+}
+
+Status SocketRPC::Stop() {
+  MutexLock ml(&mutex_);
+  shutting_down_.Release_Store(this);
+  while (bg_loops_ != 0) {
+    bg_cv_.Wait();
+  }
+  return Status::OK();
+}
+
+void SocketRPC::Ref() {
+  MutexLock ml(&mutex_);
+  ++refs_;
+}
+
+void SocketRPC::Unref() {
+  mutex_.Lock();
+  --refs_;
+  assert(refs_ >= 0);
+  bool last = refs_ <= 0;
+  mutex_.Unlock();
+  if (last) {
+    delete this;
+  }
+}
+
+SocketRPC::SocketRPC(bool listen, const RPCOptions& options)
+    : shutting_down_(NULL),
+      bg_cv_(&mutex_),
+      next_loop_(0),
+      bg_loops_(0),
+      bg_id_(0),
+      refs_(0),
+      udp_(Slice(options.uri).starts_with("udp")),
+      rpc_timeout_(options.rpc_timeout),
+      pool_(options.extra_workers),
+      env_(options.env != NULL ? options.env : Env::Default()),
+      fs_(options.fs) {
+  const int loops = options.num_io_threads > 0 ? options.num_io_threads : 1;
+  for (int i = 0; i < loops; i++) {
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+      status_ = IOError("epoll_create1", errno);
+      break;
+    }
+    epfds_.push_back(epfd);
+  }
+  if (status_.ok() && listen) {
+    std::string proto, host, port;
+    struct sockaddr_storage sa;
+    socklen_t salen;
+    int fd = -1;
+    if (!ParseUri(options.uri, &proto, &host, &port)) {
+      status_ = Status::InvalidArgument("bad uri", options.uri);
+    } else {
+      status_ = Resolve(host, port, udp_, true, &sa, &salen);
+    }
+    if (status_.ok()) {
+      int type = udp_ ? SOCK_DGRAM : SOCK_STREAM;
+      fd = socket(sa.ss_family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (fd < 0) {
+        status_ = IOError("socket", errno);
+      }
+    }
+    if (status_.ok()) {
+      int one = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (bind(fd, reinterpret_cast<struct sockaddr*>(&sa), salen) != 0) {
+        status_ = IOError("bind", errno);
+      } else if (!udp_ && ::listen(fd, 1024) != 0) {
+        status_ = IOError("listen", errno);
+      }
+    }
+    if (status_.ok()) {
+      // Obtain the actual port in case an ephemeral one has been requested
+      salen = sizeof(sa);
+      getsockname(fd, reinterpret_cast<struct sockaddr*>(&sa), &salen);
+      char tmp[20];
+      snprintf(tmp, sizeof(tmp), "%d",
+               int(ntohs(reinterpret_cast<struct sockaddr_in*>(&sa)->sin_port)));
+      uri_ = udp_ ? "udp://" : "tcp://";
+      uri_ += host.empty() ? "0.0.0.0" : host;
+      uri_ += ":";
+      uri_ += tmp;
+      Conn* c = new Conn(udp_ ? Conn::kDatagramServer : Conn::kListener, fd,
+                         udp_);
+      Register(c);
+      c->Unref();
+    } else {
+      if (fd >= 0) {
+        close(fd);
+      }
+      Error(__LOG_ARGS__, "cannot listen on %s: %s", options.uri.c_str(),
+            status_.ToString().c_str());
+    }
+  }
+}
+
+SocketRPC::~SocketRPC() {
+  Stop();
+  mutex_.Lock();
+  std::vector<Conn*> conns(conns_.begin(), conns_.end());
+  mutex_.Unlock();
+  for (size_t i = 0; i < conns.size(); i++) {
+    Drop(conns[i]);
+  }
+  for (size_t i = 0; i < epfds_.size(); i++) {
+    close(epfds_[i]);
+  }
+}
+
+SocketRPC::Client::Client(SocketRPC* rpc, const std::string& addr)
+    : rpc_(rpc), addr_(addr), salen_(0), udp_(rpc->udp_) {
+  if (Slice(addr_).starts_with("udp://")) {
+    udp_ = true;
+  } else if (Slice(addr_).starts_with("tcp://")) {
+    udp_ = false;
+  }
+  rpc_->Ref();
+}
+
+SocketRPC::Client::~Client() {
+  for (size_t i = 0; i < conns_.size(); i++) {
+    // Wake up the looping thread owning the connection to drop it
+    shutdown(conns_[i]->fd, SHUT_RDWR);
+    conns_[i]->Unref();
+  }
+  rpc_->Unref();
+}
+
+Status SocketRPC::Client::Connect(Conn** result) {
+  Status s;
+  if (salen_ == 0) {
+    std::string proto, host, port;
+    if (!ParseUri(addr_, &proto, &host, &port)) {
+      return Status::InvalidArgument("bad uri", addr_);
+    }
+    s = Resolve(host, port, udp_, false, &sa_, &salen_);
+    if (!s.ok()) {
+      salen_ = 0;
+      return s;
+    }
+  }
+  int type = udp_ ? SOCK_DGRAM : SOCK_STREAM;
+  int fd = socket(sa_.ss_family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return IOError("socket", errno);
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&sa_), salen_) != 0) {
+    if (errno != EINPROGRESS) {
+      s = IOError("connect", errno);
+    } else if (!WaitFor(fd, POLLOUT, rpc_->rpc_timeout_)) {
+      s = Status::IOError("connect timeout", addr_);
+    } else {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) {
+        s = IOError("connect", err);
+      }
+    }
+  }
+  if (!s.ok()) {
+    close(fd);
+    return s;
+  }
+  if (!udp_) {
+    SetNoDelay(fd);
+  }
+  Conn* c = new Conn(Conn::kClient, fd, udp_);
+  rpc_->Register(c);
+  *result = c;
+  return s;
+}
+
+// Return the connection with the fewest outstanding calls, opening a new
+// one if all existing connections are busy and the pool is not yet full.
+SocketRPC::Conn* SocketRPC::Client::PickConn(Status* status) {
+  MutexLock ml(&mu_);
+  Conn* best = NULL;
+  size_t best_load = 0;
+  for (size_t i = 0; i < conns_.size();) {
+    Conn* c = conns_[i];
+    c->mu.Lock();
+    bool dead = c->dead;
+    size_t load = c->pending.size();
+    c->mu.Unlock();
+    if (dead) {
+      conns_.erase(conns_.begin() + i);
+      c->Unref();
+      continue;
+    }
+    if (best == NULL || load < best_load) {
+      best = c;
+      best_load = load;
+    }
+    i++;
+  }
+  if (best == NULL || (best_load != 0 && conns_.size() < kMaxConnsPerClient)) {
+    Conn* c;
+    Status s = Connect(&c);
+    if (s.ok()) {
+      conns_.push_back(c);
+      best = c;
+    } else if (best == NULL) {
+      *status = s;
+      return NULL;
+    }
+  }
+  best->Ref();
+  return best;
+}
+
+Status SocketRPC::Client::Call(Message& in, Message& out) RPCNOEXCEPT {
+  if (udp_ && in.contents.size() > kMaxDatagramSize - kHeaderSize) {
+    return Status::InvalidArgument("message too large for udp");
+  }
+  Status s;
+  Conn* c = PickConn(&s);
+  if (c == NULL) {
+    return Status::Disconnected(s.ToString());
+  }
+  PendingCall call;
+  call.out = &out;
+  call.done = false;
+  call.ok = false;
+  uint32_t xid;
+  c->mu.Lock();
+  if (c->dead) {
+    s = Status::Disconnected("connection closed");
+  } else {
+    xid = c->next_xid++;
+    c->pending.insert(std::make_pair(xid, &call));
+  }
+  c->mu.Unlock();
+
+  bool broken = false;
+  if (s.ok()) {
+    char hdr[kHeaderSize];
+    EncodeHeader(hdr, xid, in);
+    if (udp_) {
+      s = SendFrame(c->fd, hdr, in.contents, NULL, 0, rpc_->rpc_timeout_);
+    } else {
+      MutexLock ml(&c->wmu);
+      s = SendFrame(c->fd, hdr, in.contents, NULL, 0, rpc_->rpc_timeout_);
+    }
+    MutexLock ml(&c->mu);
+    if (!s.ok()) {
+      c->pending.erase(xid);
+      s = Status::Disconnected(s.ToString());
+      broken = true;
+    } else {
+      const uint64_t due = rpc_->env_->NowMicros() + rpc_->rpc_timeout_;
+      while (!call.done) {
+        const uint64_t now = rpc_->env_->NowMicros();
+        if (now >= due) break;
+        c->cv.TimedWait(std::min<uint64_t>(due - now, 500 * 1000));
+      }
+      if (!call.done) {
+        c->pending.erase(xid);
+        s = Status::Disconnected("rpc timeout");
+      } else if (!call.ok) {
+        s = Status::Disconnected("connection closed");
+      }
+    }
+  }
+
+  if (broken && !udp_) {
+    // The stream may now carry a partial frame so it cannot be reused
+    shutdown(c->fd, SHUT_RDWR);
+  }
+  c->Unref();
+  return s;
+}
+
+}  // namespace rpc
+}  // namespace pdlfs
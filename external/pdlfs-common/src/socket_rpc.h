@@ -0,0 +1,126 @@
+#pragma once
+
+/*
+ * Copyright (c) 2015-2017 Carnegie Mellon University.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#include <sys/socket.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "pdlfs-common/mutexlock.h"
+#include "pdlfs-common/port.h"
+#include "pdlfs-common/rpc.h"
+
+namespace pdlfs {
+namespace rpc {
+
+// A native RPC implementation built directly on top of TCP or UDP sockets.
+// URIs take the form of "tcp://host:port" or "udp://host:port". A server
+// may listen on port 0 to get an ephemeral port. A client-only instance
+// may simply use "tcp" or "udp" as its uri.
+//
+// Each message is framed as a 16-byte header (frame size, call id, op,
+// err) followed by the message body. All sockets are driven by
+// num_io_threads epoll looping threads. Incoming calls are executed by
+// extra_workers if set, or by the looping thread that received them
+// otherwise. Each client keeps a small pool of connections and may
+// pipeline many outstanding calls on each of them. Replies are matched
+// to their calls by call id.
+class SocketRPC {
+ public:
+  SocketRPC(bool listen, const RPCOptions& options);
+  // Return the uri we are listening on, or an empty string if we don't.
+  std::string GetUri() const { return uri_; }
+  Status status() const { return status_; }
+  Status Start();
+  Status Stop();
+  void Unref();
+  void Ref();
+
+  class Client;
+  struct Conn;
+
+ private:
+  ~SocketRPC();
+  // No copying allowed
+  void operator=(const SocketRPC&);
+  SocketRPC(const SocketRPC&);
+
+  struct Job;
+  static void RunJob(void* arg);
+  void Dispatch(Conn* c, const char* frame, size_t size,
+                const struct sockaddr* from, socklen_t fromlen);
+  bool ReceiveStream(Conn* c);
+  bool ReceiveDatagrams(Conn* c);
+  void Accept(Conn* listener);
+  void Register(Conn* c);
+  void Drop(Conn* c);
+
+  void BGLoop();
+  static void BGLoopWrapper(void* arg) {
+    SocketRPC* rpc = reinterpret_cast<SocketRPC*>(arg);
+    rpc->BGLoop();
+  }
+
+  // State below is protected by mutex_
+  port::Mutex mutex_;
+  port::AtomicPointer shutting_down_;
+  port::CondVar bg_cv_;
+  std::set<Conn*> conns_;  // All connections registered with epoll
+  size_t next_loop_;
+  int bg_loops_;
+  int bg_id_;
+  int refs_;
+
+  // Constant after construction
+  std::vector<int> epfds_;  // One epoll instance per looping thread
+  std::string uri_;
+  Status status_;
+  bool udp_;
+  uint64_t rpc_timeout_;
+  ThreadPool* pool_;
+  Env* env_;
+  If* fs_;
+};
+
+// ====================
+// Socket client
+// ====================
+
+class SocketRPC::Client : public If {
+ public:
+  Client(SocketRPC* rpc, const std::string& addr);
+
+  // Return OK on success, a non-OK status on RPC errors.
+  virtual Status Call(Message& in, Message& out) RPCNOEXCEPT;
+
+  virtual ~Client();
+
+ private:
+  Status Connect(Conn** result);
+  Conn* PickConn(Status* status);
+
+  SocketRPC* rpc_;
+  std::string addr_;  // Unresolved target address
+
+  port::Mutex mu_;
+  std::vector<Conn*> conns_;  // Pool of connections to the target
+  struct sockaddr_storage sa_;
+  socklen_t salen_;  // 0 if addr_ has not been resolved
+  bool udp_;
+
+  // No copying allowed
+  void operator=(const Client&);
+  Client(const Client&);
+};
+
+}  // namespace rpc
+}  // namespace pdlfs
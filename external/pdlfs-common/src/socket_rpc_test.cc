@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2015-2017 Carnegie Mellon University.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#include "pdlfs-common/histogram.h"
+#include "pdlfs-common/pdlfs_config.h"
+#include "pdlfs-common/testharness.h"
+#include "pdlfs-common/testutil.h"
+
+#include "socket_rpc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace pdlfs {
+namespace rpc {
+
+// Echo server listening on an ephemeral loopback port.
+class SocketServer : public If {
+ public:
+  SocketServer(const std::string& proto, int io_threads, int workers)
+      : delay_(0) {
+    env_ = Env::Default();
+    pool_ = workers > 0 ? ThreadPool::NewFixed(workers) : NULL;
+    RPCOptions options;
+    options.env = env_;
+    options.extra_workers = pool_;
+    options.num_io_threads = io_threads;
+    options.uri = proto + "://127.0.0.1:0";
+    options.fs = this;
+    rpc_ = new SocketRPC(true, options);
+    rpc_->Ref();
+    ASSERT_OK(rpc_->status());
+    ASSERT_OK(rpc_->Start());
+  }
+
+  virtual ~SocketServer() {
+    rpc_->Stop();
+    rpc_->Unref();
+    delete pool_;
+  }
+
+  virtual Status Call(Message& in, Message& out) RPCNOEXCEPT {
+    if (delay_ != 0) {
+      env_->SleepForMicroseconds(delay_);
+    }
+    out.op = in.op;
+    out.err = in.err;
+    out.extra_buf = in.contents.ToString();
+    out.contents = out.extra_buf;
+    return Status::OK();
+  }
+
+  std::string uri() const { return rpc_->GetUri(); }
+
+  int delay_;  // Microseconds to sleep before replying
+  ThreadPool* pool_;
+  SocketRPC* rpc_;
+  Env* env_;
+};
+
+// Client-side rpc instance obtained through RPC::Open().
+class SocketClient {
+ public:
+  SocketClient(const std::string& proto, const std::string& uri,
+               uint64_t timeout = 5000000) {
+    RPCOptions options;
+    options.mode = kClientOnly;
+    options.uri = proto;
+    options.rpc_timeout = timeout;
+    options.num_io_threads = 2;
+    rpc_ = RPC::Open(options);
+    ASSERT_OK(rpc_->Start());
+    stub_ = rpc_->OpenClientFor(uri);
+  }
+
+  ~SocketClient() {
+    delete stub_;
+    rpc_->Stop();
+    delete rpc_;
+  }
+
+  If* stub_;
+  RPC* rpc_;
+};
+
+class SocketRPCTest {
+ public:
+  SocketRPCTest() : cv_(&mu_), num_tasks_(0), msg_size_(1400) {}
+
+  void BGTask() {
+    Random rnd(301);
+    for (int i = 0; i < 1000; ++i) {
+      std::string buf;
+      If::Message input;
+      input.contents = test::RandomString(&rnd, msg_size_, &buf);
+      input.op = rnd.Uniform(128);
+      input.err = -1 * static_cast<int>(rnd.Uniform(128));
+      If::Message output;
+      ASSERT_OK(client_->stub_->Call(input, output));
+      ASSERT_EQ(input.contents, output.contents);
+      ASSERT_EQ(input.op, output.op);
+      ASSERT_EQ(input.err, output.err);
+    }
+    mu_.Lock();
+    assert(num_tasks_ > 0);
+    num_tasks_--;
+    cv_.SignalAll();
+    mu_.Unlock();
+  }
+
+  static void BGTaskWrapper(void* arg) {
+    SocketRPCTest* test = reinterpret_cast<SocketRPCTest*>(arg);
+    test->BGTask();
+  }
+
+  // All tasks share a single stub so calls are pipelined over the
+  // stub's pool of connections.
+  void RunTasks(int num_tasks) {
+    assert(num_tasks_ == 0);
+    fprintf(stderr, "%d client threads\n", num_tasks);
+    num_tasks_ = num_tasks;
+    for (int i = 0; i < num_tasks_; ++i) {
+      Env::Default()->StartThread(BGTaskWrapper, this);
+    }
+    mu_.Lock();
+    while (num_tasks_ != 0) {
+      cv_.Wait();
+    }
+    mu_.Unlock();
+  }
+
+  void SendReceive(const std::string& proto, int workers) {
+    SocketServer server(proto, 2, workers);
+    client_ = new SocketClient(proto, server.uri());
+    RunTasks(1);
+    RunTasks(4);
+    RunTasks(8);
+    delete client_;
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  int num_tasks_;
+  size_t msg_size_;
+  SocketClient* client_;
+};
+
+TEST(SocketRPCTest, TCP) {
+  SendReceive("tcp", 0);
+  SendReceive("tcp", 4);
+}
+
+TEST(SocketRPCTest, UDP) {
+  SendReceive("udp", 0);
+  SendReceive("udp", 4);
+}
+
+TEST(SocketRPCTest, LargeMessages) {
+  msg_size_ = 64 << 10;
+  SendReceive("tcp", 2);
+}
+
+TEST(SocketRPCTest, Timeout) {
+  SocketServer server("tcp", 1, 2);
+  server.delay_ = 500 * 1000;
+  SocketClient client("tcp", server.uri(), 100 * 1000);
+  If::Message input;
+  input.contents = "x";
+  If::Message output;
+  Status s = client.stub_->Call(input, output);
+  ASSERT_TRUE(s.IsDisconnected());
+  // The same connection keeps working after late replies are dropped
+  server.delay_ = 0;
+  Env::Default()->SleepForMicroseconds(500 * 1000);
+  ASSERT_OK(client.stub_->Call(input, output));
+  ASSERT_EQ(output.contents, "x");
+}
+
+TEST(SocketRPCTest, NoServer) {
+  std::string uri;
+  {
+    SocketServer server("tcp", 1, 0);
+    uri = server.uri();
+  }
+  SocketClient client("tcp", uri, 100 * 1000);
+  If::Message input;
+  If::Message output;
+  ASSERT_TRUE(client.stub_->Call(input, output).IsDisconnected());
+}
+
+// Measure the latency and throughput of many threads sending small
+// messages to a server on the loopback interface.
+class SocketRPCBench {
+ public:
+  static int GetOption(const char* key, int def) {
+    const char* env = getenv(key);
+    if (env == NULL || env[0] == 0) {
+      return def;
+    } else {
+      return atoi(env);
+    }
+  }
+
+  explicit SocketRPCBench(const std::string& proto)
+      : proto_(proto),
+        num_threads_(GetOption("RPC_THREADS", 8)),
+        num_ops_(GetOption("RPC_OPS", 10000)),
+        msg_size_(GetOption("RPC_SIZE", 64)),
+        io_threads_(GetOption("RPC_IO_THREADS", 2)),
+        workers_(GetOption("RPC_WORKERS", 4)),
+        cv_(&mu_),
+        num_running_(0) {
+    hist_.Clear();
+  }
+
+  void Run() {
+    SocketServer server(proto_, io_threads_, workers_);
+    client_ = new SocketClient(proto_, server.uri());
+    num_running_ = num_threads_;
+    const uint64_t start = Env::Default()->NowMicros();
+    for (int i = 0; i < num_threads_; i++) {
+      Env::Default()->StartThread(BGWork, this);
+    }
+    mu_.Lock();
+    while (num_running_ != 0) {
+      cv_.Wait();
+    }
+    mu_.Unlock();
+    const uint64_t dura = Env::Default()->NowMicros() - start;
+    delete client_;
+    const double ops = double(num_threads_) * num_ops_;
+    fprintf(stderr, "%s: %d threads, %d io threads, %d workers, %d bytes\n",
+            proto_.c_str(), num_threads_, io_threads_, workers_, msg_size_);
+    fprintf(stderr, "  %.0f calls/s, %.3f MB/s\n", 1e6 * ops / dura,
+            1e6 * ops * msg_size_ / dura / 1048576.0);
+    fprintf(stderr, "Latency (us):\n%s", hist_.ToString().c_str());
+  }
+
+ private:
+  static void BGWork(void* arg) {
+    SocketRPCBench* bench = reinterpret_cast<SocketRPCBench*>(arg);
+    bench->DoWork();
+  }
+
+  void DoWork() {
+    Histogram hist;
+    hist.Clear();
+    std::string buf(msg_size_, 'x');
+    If::Message input;
+    input.contents = buf;
+    for (int i = 0; i < num_ops_; i++) {
+      If::Message output;
+      const uint64_t start = Env::Default()->NowMicros();
+      Status s = client_->stub_->Call(input, output);
+      hist.Add(Env::Default()->NowMicros() - start);
+      if (!s.ok()) {
+        fprintf(stderr, "rpc error: %s\n", s.ToString().c_str());
+        break;
+      }
+    }
+    MutexLock ml(&mu_);
+    hist_.Merge(hist);
+    num_running_--;
+    cv_.SignalAll();
+  }
+
+  std::string proto_;
+  int num_threads_;
+  int num_ops_;  // Per thread
+  int msg_size_;
+  int io_threads_;
+  int workers_;
+  SocketClient* client_;
+  port::Mutex mu_;
+  port::CondVar cv_;
+  int num_running_;
+  Histogram hist_;
+};
+
+}  // namespace rpc
+}  // namespace pdlfs
+
+static void BM_Usage() {
+  fprintf(stderr, "Use --bench=[tcp,udp] to run benchmark.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options (via env vars):\n");
+  fprintf(stderr, "  RPC_THREADS     number of client threads (8)\n");
+  fprintf(stderr, "  RPC_OPS         calls issued per thread (10000)\n");
+  fprintf(stderr, "  RPC_SIZE        message size in bytes (64)\n");
+  fprintf(stderr, "  RPC_IO_THREADS  server io threads (2)\n");
+  fprintf(stderr, "  RPC_WORKERS     server worker threads, 0 for none (4)\n");
+}
+
+static void BM_Main(int* argc, char*** argv) {
+  pdlfs::Slice bench_name;
+  if (*argc > 1) {
+    bench_name = pdlfs::Slice((*argv)[*argc - 1]);
+  }
+  if (bench_name == "--bench=tcp") {
+    pdlfs::rpc::SocketRPCBench bench("tcp");
+    bench.Run();
+  } else if (bench_name == "--bench=udp") {
+    pdlfs::rpc::SocketRPCBench bench("udp");
+    bench.Run();
+  } else {
+    BM_Usage();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  pdlfs::Slice token;
+  if (argc > 1) {
+    token = pdlfs::Slice(argv[argc - 1]);
+  }
+  if (!token.starts_with("--bench")) {
+    return ::pdlfs::test::RunAllTests(&argc, &argv);
+  } else {
+    BM_Main(&argc, &argv);
+    return 0;
+  }
+}
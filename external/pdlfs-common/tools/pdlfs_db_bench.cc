@@ -8,15 +8,20 @@
 
 #include "pdlfs-common/cache.h"
 #include "pdlfs-common/crc32c.h"
+#include "pdlfs-common/dbfiles.h"
 #include "pdlfs-common/env.h"
 #include "pdlfs-common/histogram.h"
+#include "pdlfs-common/leveldb/db/columnar_db.h"
 #include "pdlfs-common/leveldb/db/db.h"
+#include "pdlfs-common/leveldb/db/dbformat.h"
 #include "pdlfs-common/leveldb/db/write_batch.h"
+#include "pdlfs-common/leveldb/table.h"
 #include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/pdlfs_config.h"
 #include "pdlfs-common/port.h"
 #include "pdlfs-common/random.h"
 #include "pdlfs-common/testutil.h"
+#include "pdlfs-common/xxhash.h"
 
 // Comma-separated list of operations to run in the specified order
 //   Actual benchmarks:
@@ -40,6 +45,9 @@
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      writeamp    -- Print bytes written to storage per byte of user data
+//                     written since the db was last created
+//      indexmem    -- Print memory needed to hold the indexes of all sstables
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -83,6 +91,14 @@ static bool FLAGS_histogram = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Number of threads of a dedicated compaction pool. If 0, compactions
+// run on the background thread of the env.
+static int FLAGS_compaction_threads = 0;
+
+// Maximum number of subcompactions a compaction may be split into.
+// (initialized to default value by "main")
+static int FLAGS_max_subcompactions = 0;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
@@ -113,6 +129,23 @@ static bool FLAGS_reuse_logs = false;
 // Use the db with the following name.
 static const char* FLAGS_db = NULL;
 
+// Store all data in a single column of a columnar db instead of a regular
+// db.  Either "lsm" (keys and values in an LSM) or "lsmkey" (only keys and
+// pointers to values in an LSM, and values in value logs).
+static const char* FLAGS_column_style = NULL;
+
+// Values at least this large go to value logs in a "lsmkey" column.
+// (initialized to default value by "main")
+static int FLAGS_value_log_min_value_size = 0;
+
+// Type of sstable indexes. Either "default" or "compact".
+static const char* FLAGS_index_type = NULL;
+
+// If true, use the hex-formatted hash of each key number as the key
+// instead of the key number itself. Hashed keys share no common prefixes
+// and are spread evenly across the key space.
+static bool FLAGS_hashed_keys = false;
+
 namespace pdlfs {
 
 namespace {
@@ -164,6 +197,17 @@ static Slice TrimSpace(Slice s) {
 }
 #endif
 
+// Format the key of the k-th entry into key[0,size).
+static void MakeKey(char* key, size_t size, int k, const char* suffix = "") {
+  if (FLAGS_hashed_keys) {
+    const uint64_t h = xxhash64(&k, sizeof(k), 0);
+    snprintf(key, size, "%016llx%s", static_cast<unsigned long long>(h),
+             suffix);
+  } else {
+    snprintf(key, size, "%016d%s", k, suffix);
+  }
+}
+
 static void AppendWithSpace(std::string* str, Slice msg) {
   if (msg.empty()) return;
   if (!str->empty()) {
@@ -172,6 +216,73 @@ static void AppendWithSpace(std::string* str, Slice msg) {
   str->append(msg.data(), msg.size());
 }
 
+// Count all bytes written to storage through an underlying Env.
+class CountingEnv : public EnvWrapper {
+ public:
+  explicit CountingEnv(Env* base) : EnvWrapper(base), bytes_(0) {}
+  virtual ~CountingEnv() {}
+
+  virtual Status NewWritableFile(const char* f, WritableFile** r) {
+    WritableFile* file;
+    Status s = target()->NewWritableFile(f, &file);
+    if (s.ok()) {
+      *r = new CountingFile(this, file);
+    }
+    return s;
+  }
+
+  uint64_t BytesWritten() {
+    MutexLock l(&mu_);
+    return bytes_;
+  }
+
+  void Reset() {
+    MutexLock l(&mu_);
+    bytes_ = 0;
+  }
+
+ private:
+  class CountingFile : public WritableFile {
+   public:
+    CountingFile(CountingEnv* env, WritableFile* base)
+        : env_(env), base_(base) {}
+    virtual ~CountingFile() { delete base_; }
+
+    virtual Status Append(const Slice& data) {
+      Status s = base_->Append(data);
+      if (s.ok()) {
+        MutexLock l(&env_->mu_);
+        env_->bytes_ += data.size();
+      }
+      return s;
+    }
+
+    virtual Status Close() { return base_->Close(); }
+    virtual Status Flush() { return base_->Flush(); }
+    virtual Status Sync() { return base_->Sync(); }
+
+   private:
+    CountingEnv* const env_;
+    WritableFile* const base_;
+  };
+
+  port::Mutex mu_;
+  uint64_t bytes_;
+};
+
+CountingEnv* g_counting_env = NULL;
+
+class SingleColumnSelector : public ColumnSelector {
+ public:
+  virtual const char* Name() const { return "pdlfs.SingleColumnSelector"; }
+  virtual size_t Select(const Slice& k) const { return 0; }
+};
+
+static void DestroyBenchDB() {
+  DestroyDB(ColumnName(FLAGS_db, 0), DBOptions());
+  DestroyDB(FLAGS_db, DBOptions());
+}
+
 class Stats {
  private:
   double start_;
@@ -314,7 +425,11 @@ class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  ThreadPool* compaction_pool_;
   DB* db_;
+  SingleColumnSelector column_selector_;
+  port::Mutex user_mu_;
+  int64_t user_bytes_;  // User data written since the db was last created
   int num_;
   int value_size_;
   int entries_per_batch_;
@@ -402,7 +517,11 @@ class Benchmark {
         filter_policy_(FLAGS_bloom_bits >= 0
                            ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                            : NULL),
+        compaction_pool_(FLAGS_compaction_threads > 0
+                             ? ThreadPool::NewFixed(FLAGS_compaction_threads)
+                             : NULL),
         db_(NULL),
+        user_bytes_(0),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
         entries_per_batch_(1),
@@ -412,16 +531,17 @@ class Benchmark {
     g_env->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
       if (Slice(files[i]).starts_with("heap-")) {
-        g_env->DeleteFile(std::string(FLAGS_db) + "/" + files[i]);
+        g_env->DeleteFile((std::string(FLAGS_db) + "/" + files[i]).c_str());
       }
     }
     if (!FLAGS_use_existing_db) {
-      DestroyDB(FLAGS_db, DBOptions());
+      DestroyBenchDB();
     }
   }
 
   ~Benchmark() {
     delete db_;
+    delete compaction_pool_;
     delete cache_;
     delete filter_policy_;
   }
@@ -518,6 +638,10 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("writeamp")) {
+        PrintWriteAmplification();
+      } else if (name == Slice("indexmem")) {
+        PrintIndexMemoryUsage();
       } else {
         if (name != Slice()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -532,8 +656,9 @@ class Benchmark {
         } else {
           delete db_;
           db_ = NULL;
-          DestroyDB(FLAGS_db, DBOptions());
+          DestroyBenchDB();
           Open();
+          ResetWriteAmplification();
         }
       }
 
@@ -709,6 +834,8 @@ class Benchmark {
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.compaction_pool = compaction_pool_;
+    options.max_subcompactions = FLAGS_max_subcompactions;
 #if 0 /* XXXCDC: not imported into our options yet */
     options.max_file_size = FLAGS_max_file_size;
 #endif
@@ -720,7 +847,21 @@ class Benchmark {
 #if 0 /* XXXCDC: not imported into our options yet */
     options.reuse_logs = FLAGS_reuse_logs;
 #endif
-    Status s = DB::Open(options, FLAGS_db, &db_);
+    options.value_log_min_value_size = FLAGS_value_log_min_value_size;
+    if (FLAGS_index_type != NULL && strcmp(FLAGS_index_type, "compact") == 0) {
+      options.index_type = kCompact;
+    }
+    Status s;
+    if (FLAGS_column_style != NULL) {
+      ColumnStyle style = kLSMStyle;
+      if (strcmp(FLAGS_column_style, "lsmkey") == 0) {
+        style = kLSMKeyStyle;
+      }
+      s = ColumnarDB::Open(options, FLAGS_db, &column_selector_, &style, 1,
+                           &db_);
+    } else {
+      s = DB::Open(options, FLAGS_db, &db_);
+    }
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
       exit(1);
@@ -755,7 +896,7 @@ class Benchmark {
       for (int j = 0; j < entries_per_batch_; j++) {
         const int k = seq ? i + j : (thread->rand.Next() % FLAGS_num);
         char key[100];
-        snprintf(key, sizeof(key), "%016d", k);
+        MakeKey(key, sizeof(key), k);
         batch.Put(key, gen.Generate(value_size_));
         bytes += value_size_ + strlen(key);
         thread->stats.FinishedSingleOp();
@@ -767,6 +908,8 @@ class Benchmark {
       }
     }
     thread->stats.AddBytes(bytes);
+    MutexLock l(&user_mu_);
+    user_bytes_ += bytes;
   }
 
   void ReadSequential(ThreadState* thread) {
@@ -802,7 +945,7 @@ class Benchmark {
     for (int i = 0; i < reads_; i++) {
       char key[100];
       const int k = thread->rand.Next() % FLAGS_num;
-      snprintf(key, sizeof(key), "%016d", k);
+      MakeKey(key, sizeof(key), k);
       if (db_->Get(options, key, &value).ok()) {
         found++;
       }
@@ -819,7 +962,7 @@ class Benchmark {
     for (int i = 0; i < reads_; i++) {
       char key[100];
       const int k = thread->rand.Next() % FLAGS_num;
-      snprintf(key, sizeof(key), "%016d.", k);
+      MakeKey(key, sizeof(key), k, ".");
       db_->Get(options, key, &value);
       thread->stats.FinishedSingleOp();
     }
@@ -832,7 +975,7 @@ class Benchmark {
     for (int i = 0; i < reads_; i++) {
       char key[100];
       const int k = thread->rand.Next() % range;
-      snprintf(key, sizeof(key), "%016d", k);
+      MakeKey(key, sizeof(key), k);
       db_->Get(options, key, &value);
       thread->stats.FinishedSingleOp();
     }
@@ -845,7 +988,7 @@ class Benchmark {
       Iterator* iter = db_->NewIterator(options);
       char key[100];
       const int k = thread->rand.Next() % FLAGS_num;
-      snprintf(key, sizeof(key), "%016d", k);
+      MakeKey(key, sizeof(key), k);
       iter->Seek(key);
       if (iter->Valid() && iter->key() == key) found++;
       delete iter;
@@ -865,7 +1008,7 @@ class Benchmark {
       for (int j = 0; j < entries_per_batch_; j++) {
         const int k = seq ? i + j : (thread->rand.Next() % FLAGS_num);
         char key[100];
-        snprintf(key, sizeof(key), "%016d", k);
+        MakeKey(key, sizeof(key), k);
         batch.Delete(key);
         thread->stats.FinishedSingleOp();
       }
@@ -898,7 +1041,7 @@ class Benchmark {
 
         const int k = thread->rand.Next() % FLAGS_num;
         char key[100];
-        snprintf(key, sizeof(key), "%016d", k);
+        MakeKey(key, sizeof(key), k);
         Status s = db_->Put(write_options_, key, gen.Generate(value_size_));
         if (!s.ok()) {
           fprintf(stderr, "put error: %s\n", s.ToString().c_str());
@@ -921,6 +1064,67 @@ class Benchmark {
     fprintf(stdout, "\n%s\n", stats.c_str());
   }
 
+  void ResetWriteAmplification() {
+    g_counting_env->Reset();
+    MutexLock l(&user_mu_);
+    user_bytes_ = 0;
+  }
+
+  void PrintWriteAmplification() {
+    const uint64_t written = g_counting_env->BytesWritten();
+    MutexLock l(&user_mu_);
+    fprintf(stdout, "%-12s : %11.3f (%.1f MB written for %.1f MB of data)\n",
+            "writeamp", user_bytes_ > 0 ? double(written) / user_bytes_ : 0.0,
+            written / 1048576.0, user_bytes_ / 1048576.0);
+    fflush(stdout);
+  }
+
+  // Open every sstable of the db and sum up the memory taken by their
+  // indexes once loaded.
+  void PrintIndexMemoryUsage() {
+    InternalKeyComparator icmp(BytewiseComparator());
+    DBOptions options;
+    options.comparator = &icmp;
+    int tables = 0;
+    uint64_t bytes = 0;
+    const std::string dirs[2] = {FLAGS_db, ColumnName(FLAGS_db, 0)};
+    for (int i = 0; i < 2; i++) {
+      std::vector<std::string> files;
+      g_env->GetChildren(dirs[i].c_str(), &files);
+      for (size_t j = 0; j < files.size(); j++) {
+        uint64_t number;
+        FileType type;
+        if (!ParseFileName(files[j], &number, &type) || type != kTableFile) {
+          continue;
+        }
+        const std::string fname = dirs[i] + "/" + files[j];
+        uint64_t size;
+        RandomAccessFile* file;
+        Table* table;
+        Status s = g_env->GetFileSize(fname.c_str(), &size);
+        if (s.ok()) {
+          s = g_env->NewRandomAccessFile(fname.c_str(), &file);
+        }
+        if (s.ok()) {
+          s = Table::Open(options, file, size, &table);
+          if (s.ok()) {
+            bytes += table->ApproximateIndexMemoryUsage();
+            tables++;
+            delete table;
+          }
+          delete file;
+        }
+        if (!s.ok()) {
+          fprintf(stderr, "%s: %s\n", fname.c_str(), s.ToString().c_str());
+        }
+      }
+    }
+    fprintf(stdout, "%-12s : %11.1f KB (%d tables, %.2f bytes per entry)\n",
+            "indexmem", bytes / 1024.0, tables,
+            num_ > 0 ? double(bytes) / num_ : 0.0);
+    fflush(stdout);
+  }
+
   static void WriteToFile(void* arg, const char* buf, int n) {
     reinterpret_cast<WritableFile*>(arg)->Append(Slice(buf, n));
   }
@@ -951,6 +1155,9 @@ int main(int argc, char** argv) {
   FLAGS_max_file_size = pdlfs::DBOptions().max_file_size;
 #endif
   FLAGS_block_size = pdlfs::DBOptions().block_size;
+  FLAGS_max_subcompactions = pdlfs::DBOptions().max_subcompactions;
+  FLAGS_value_log_min_value_size =
+      pdlfs::DBOptions().value_log_min_value_size;
 #if 0 /* XXXCDC: not imported into our options yet */
   FLAGS_open_files = pdlfs::DBOptions().max_open_files;
 #endif
@@ -983,6 +1190,11 @@ int main(int argc, char** argv) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--compaction_threads=%d%c", &n, &junk) == 1) {
+      FLAGS_compaction_threads = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_max_subcompactions = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
@@ -993,6 +1205,26 @@ int main(int argc, char** argv) {
       FLAGS_bloom_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--value_log_min_value_size=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_value_log_min_value_size = n;
+    } else if (sscanf(argv[i], "--hashed_keys=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_hashed_keys = n;
+    } else if (strncmp(argv[i], "--index_type=", 13) == 0) {
+      FLAGS_index_type = argv[i] + 13;
+      if (strcmp(FLAGS_index_type, "default") != 0 &&
+          strcmp(FLAGS_index_type, "compact") != 0) {
+        fprintf(stderr, "Invalid index type '%s'\n", FLAGS_index_type);
+        exit(1);
+      }
+    } else if (strncmp(argv[i], "--column_style=", 15) == 0) {
+      FLAGS_column_style = argv[i] + 15;
+      if (strcmp(FLAGS_column_style, "lsm") != 0 &&
+          strcmp(FLAGS_column_style, "lsmkey") != 0) {
+        fprintf(stderr, "Invalid column style '%s'\n", FLAGS_column_style);
+        exit(1);
+      }
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -1001,7 +1233,8 @@ int main(int argc, char** argv) {
     }
   }
 
-  pdlfs::g_env = pdlfs::Env::Default();
+  pdlfs::g_counting_env = new pdlfs::CountingEnv(pdlfs::Env::Default());
+  pdlfs::g_env = pdlfs::g_counting_env;
 
   // Choose a location for the test database if none given with --db=<path>
   if (FLAGS_db == NULL) {
@@ -45,6 +45,13 @@ int deltafs_openstat(const char* __path, int __oflags, mode_t, struct stat*);
 int deltafs_openat(int fd, const char* __path, int __oflags, mode_t __mode);
 int deltafs_getattr(const char* __path, struct stat* __stbuf);
 int deltafs_mkfile(const char* __path, mode_t __mode);
+/* Create or stat __n files under __dir in bulk. Return the number of files
+ * successfully processed, or -1 on errors. Per-file errno values are stored
+ * in __errs (0 on success) if it is not NULL. */
+int deltafs_mkfiles(const char* __dir, const char* const* __names, size_t __n,
+                    mode_t __mode, int* __errs);
+int deltafs_getattrs(const char* __dir, const char* const* __names, size_t __n,
+                     struct stat* __stbufs, int* __errs);
 int deltafs_mkdirs(const char* __path, mode_t __mode);
 int deltafs_mkdir(const char* __path, mode_t __mode);
 int deltafs_chmod(const char* __path, mode_t __mode);
@@ -54,8 +61,15 @@ int deltafs_truncate(const char* __path, off_t __len);
 int deltafs_access(const char* __path, int __mode);
 int deltafs_accessdir(const char* __path, int __mode);
 int deltafs_unlink(const char* __path);
+/* Fillers always run on the calling thread. Listing stops once the filler
+   returns non-zero. */
 typedef int (*deltafs_filler_t)(const char* __name, void* __arg);
 int deltafs_listdir(const char* __path, deltafs_filler_t, void* __arg);
+/* Same as deltafs_listdir() but also passes the stat of each entry. Entries
+   are streamed from metadata servers page by page. */
+typedef int (*deltafs_statfiller_t)(const char* __name,
+                                    const struct stat* __stbuf, void* __arg);
+int deltafs_listdirplus(const char* __path, deltafs_statfiller_t, void* __arg);
 ssize_t deltafs_pread(int __fd, void* __buf, size_t __sz, off_t __off);
 ssize_t deltafs_read(int __fd, void* __buf, size_t __sz);
 ssize_t deltafs_pwrite(int __fd, const void* __buf, size_t __sz, off_t __off);
@@ -157,6 +171,22 @@ int deltafs_plfsdir_io_finish(deltafs_plfsdir_t* __dir);
 ssize_t deltafs_plfsdir_put(deltafs_plfsdir_t* __dir, const char* __key,
                             size_t __keylen, int __epoch, const char* __value,
                             size_t __sz);
+/* Put __n pieces of data into their keys in a single call. The i-th key
+   is __keys[i] (__keylens[i] bytes) and its data is __values[i] (__sizes[i]
+   bytes). Nothing is written if any key is NULL or empty or any value is
+   NULL with a non-zero size, in which case errno is set to EINVAL.
+   Return -1 on errors, or the total num bytes written. */
+ssize_t deltafs_plfsdir_put_batch(deltafs_plfsdir_t* __dir,
+                                  const char* const* __keys,
+                                  const size_t* __keylens, int __epoch,
+                                  const char* const* __values,
+                                  const size_t* __sizes, size_t __n);
+/* Put __n fixed-sized records packed back-to-back in __buf. Each record
+   is a key of the configured key size immediately followed by a value of the
+   configured value size. Requires fixed kv mode.
+   Return -1 on errors, or the total num bytes written. */
+ssize_t deltafs_plfsdir_put_packed(deltafs_plfsdir_t* __dir, int __epoch,
+                                   const void* __buf, size_t __n);
 /* Appends a piece of data into a given file.
    __fname will be hashed to become a fixed-sized key.
    Return -1 on errors, or num bytes written. */
@@ -176,6 +206,18 @@ char* deltafs_plfsdir_get(deltafs_plfsdir_t* __dir, const char* __key,
 void* deltafs_plfsdir_read(deltafs_plfsdir_t* __dir, const char* __fname,
                            int __epoch, size_t* __sz, size_t* __table_seeks,
                            size_t* __seeks);
+/* Retrieve data from __n keys at a specific epoch, or all epochs if
+   __epoch is -1. The i-th key is __keys[i] (__keylens[i] bytes). Keys are
+   looked up together so that each epoch and each table is read at most once.
+   For each value found, *saver is called with the index of its key and the
+   value. Values of a key are reported in epoch order. Reporting stops if
+   *saver returns -1. Return -1 on errors. Otherwise, return the total
+   number of values reported. */
+ssize_t deltafs_plfsdir_multiget(
+    deltafs_plfsdir_t* __dir, const char* const* __keys,
+    const size_t* __keylens, size_t __n, int __epoch,
+    int (*saver)(void* arg, size_t __i, const char* __value, size_t __sz),
+    void* arg, size_t* __table_seeks, size_t* __seeks);
 /* Scan directory contents at a specific epoch, or all
    epochs if __epoch is -1. Report results to *saver. Return -1 on errors.
    Otherwise, return the total number of entries scanned. */
@@ -206,6 +248,60 @@ int deltafs_plfsdir_wait(deltafs_plfsdir_t* __dir);
 int deltafs_plfsdir_finish(deltafs_plfsdir_t* __dir);
 int deltafs_plfsdir_free_handle(deltafs_plfsdir_t* __dir);
 
+/*
+ * ------------------------
+ * Asynchronous I/O
+ * ------------------------
+ */
+#define DELTAFS_AIO_PREAD 1     /* deltafs_pread(fd, buf, sz, off) */
+#define DELTAFS_AIO_PWRITE 2    /* deltafs_pwrite(fd, buf, sz, off) */
+#define DELTAFS_AIO_FDATASYNC 3 /* deltafs_fdatasync(fd) */
+/* deltafs_plfsdir_append(dir, fname, epoch, buf, sz) */
+#define DELTAFS_AIO_PLFSDIR_APPEND 4
+/* deltafs_plfsdir_epoch_flush(dir, epoch) */
+#define DELTAFS_AIO_PLFSDIR_EPOCH_FLUSH 5
+/* Description of an asynchronous operation. Only fields used by the
+   operation's synchronous counterpart need to be set. */
+typedef struct deltafs_aiocb {
+  int op; /* One of DELTAFS_AIO_xxx */
+  int fd;
+  deltafs_plfsdir_t* dir;
+  const char* fname;
+  int epoch;
+  void* buf;
+  size_t sz;
+  off_t off;
+  void* data; /* Opaque user data not interpreted by deltafs */
+  /* Set when the operation completes */
+  ssize_t ret; /* Return value of the synchronous counterpart */
+  int err;     /* errno if ret is -1, or 0 otherwise */
+} deltafs_aiocb_t;
+struct deltafs_aioq; /* Opaque handle for an async I/O completion queue */
+typedef struct deltafs_aioq deltafs_aioq_t;
+/* Returns NULL on errors. A heap-allocated queue otherwise. Operations are
+   executed by __tp, or by the process's default background thread if __tp
+   is NULL. __tp must outlive the queue. The returned object should be
+   deleted via deltafs_aioq_close(). */
+deltafs_aioq_t* deltafs_aioq_init(deltafs_tp_t* __tp);
+/* Submit an operation without waiting for it to complete. __cb must remain
+   valid until it is retrieved through deltafs_aio_poll() or
+   deltafs_aio_wait(). Operations against a same fd or plfsdir are executed
+   in submission order. Operations against different targets may be
+   executed concurrently and complete in any order.
+   Return 0 on success, or -1 on errors. */
+int deltafs_aio_submit(deltafs_aioq_t* __q, deltafs_aiocb_t* __cb);
+/* Retrieve up to __n completed operations without blocking. Return the
+   number of operations stored in __cbs, or -1 on errors. */
+int deltafs_aio_poll(deltafs_aioq_t* __q, deltafs_aiocb_t** __cbs, int __n);
+/* Same as deltafs_aio_poll(), but first wait until at least one operation
+   completes, no operation is outstanding, or __timeout_us microseconds
+   have passed. A negative timeout waits forever. */
+int deltafs_aio_wait(deltafs_aioq_t* __q, deltafs_aiocb_t** __cbs, int __n,
+                     long long __timeout_us);
+/* Wait for all outstanding operations to complete and then free the queue.
+   Completed operations that have not been retrieved are discarded. */
+int deltafs_aioq_close(deltafs_aioq_t* __q);
+
 /*
  * -------------
  * Version query
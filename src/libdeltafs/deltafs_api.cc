@@ -35,7 +35,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <deque>
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #ifndef EHOSTUNREACH
 #define EHOSTUNREACH ENODEV
@@ -424,6 +428,33 @@ int deltafs_accessdir(const char* __path, int __mode) {
   }
 }
 
+namespace {
+// Pass each page of a listing to the user's filler as it arrives.
+struct ListdirFiller {
+  deltafs_filler_t filler;
+  deltafs_statfiller_t statfiller;
+  void* arg;
+
+  static bool Fill(const std::vector<std::string>& names,
+                   const std::vector<pdlfs::Stat>* stats, void* arg) {
+    ListdirFiller* f = reinterpret_cast<ListdirFiller*>(arg);
+    struct stat buf;
+    for (size_t i = 0; i < names.size(); i++) {
+      if (f->statfiller != NULL) {
+        assert(stats != NULL);
+        pdlfs::__cpstat((*stats)[i], &buf);
+        if (f->statfiller(names[i].c_str(), &buf, f->arg) != 0) {
+          return false;
+        }
+      } else if (f->filler(names[i].c_str(), f->arg) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+}  // namespace
+
 int deltafs_listdir(const char* __path, deltafs_filler_t __filler,
                     void* __arg) {
   if (client == NULL) {
@@ -432,16 +463,35 @@ int deltafs_listdir(const char* __path, deltafs_filler_t __filler,
       return NoClient();
     }
   }
-  std::vector<std::string> names;
+  ListdirFiller f;
+  f.filler = __filler;
+  f.statfiller = NULL;
+  f.arg = __arg;
   pdlfs::Status s;
-  s = client->Listdir(__path, &names);
+  s = client->Listdir(__path, ListdirFiller::Fill, &f);
   if (s.ok()) {
-    for (std::vector<std::string>::iterator iter = names.begin();
-         iter != names.end(); ++iter) {
-      if (__filler(iter->c_str(), __arg) != 0) {
-        break;
-      }
+    return 0;
+  } else {
+    SetErrno(s);
+    return -1;
+  }
+}
+
+int deltafs_listdirplus(const char* __path, deltafs_statfiller_t __filler,
+                        void* __arg) {
+  if (client == NULL) {
+    pdlfs::port::InitOnce(&once, InitClient);
+    if (client == NULL) {
+      return NoClient();
     }
+  }
+  ListdirFiller f;
+  f.filler = NULL;
+  f.statfiller = __filler;
+  f.arg = __arg;
+  pdlfs::Status s;
+  s = client->Listdir(__path, ListdirFiller::Fill, &f, true);
+  if (s.ok()) {
     return 0;
   } else {
     SetErrno(s);
@@ -506,6 +556,69 @@ int deltafs_mkfile(const char* __path, mode_t __mode) {
   }
 }
 
+// Store per-name errno values and return the number of names succeeded.
+static int BulkResults(const std::vector<pdlfs::Status>& results, int* __errs) {
+  const int saved_errno = errno;
+  int num_ok = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    if (results[i].ok()) {
+      num_ok++;
+    }
+    if (__errs != NULL) {
+      SetErrno(results[i]);
+      __errs[i] = errno;
+    }
+  }
+  errno = saved_errno;
+  return num_ok;
+}
+
+int deltafs_mkfiles(const char* __dir, const char* const* __names, size_t __n,
+                    mode_t __mode, int* __errs) {
+  if (client == NULL) {
+    pdlfs::port::InitOnce(&once, InitClient);
+    if (client == NULL) {
+      return NoClient();
+    }
+  }
+  std::vector<pdlfs::Slice> names(__names, __names + __n);
+  std::vector<pdlfs::Status> results;
+  pdlfs::Status s;
+  s = client->Mkfiles(__dir, names, __mode, &results);
+  if (s.ok()) {
+    return BulkResults(results, __errs);
+  } else {
+    SetErrno(s);
+    return -1;
+  }
+}
+
+int deltafs_getattrs(const char* __dir, const char* const* __names, size_t __n,
+                     struct stat* __bufs, int* __errs) {
+  if (client == NULL) {
+    pdlfs::port::InitOnce(&once, InitClient);
+    if (client == NULL) {
+      return NoClient();
+    }
+  }
+  std::vector<pdlfs::Slice> names(__names, __names + __n);
+  std::vector<pdlfs::Stat> stats;
+  std::vector<pdlfs::Status> results;
+  pdlfs::Status s;
+  s = client->Getattrs(__dir, names, &stats, &results);
+  if (s.ok()) {
+    for (size_t i = 0; i < __n; i++) {
+      if (results[i].ok()) {
+        pdlfs::__cpstat(stats[i], &__bufs[i]);
+      }
+    }
+    return BulkResults(results, __errs);
+  } else {
+    SetErrno(s);
+    return -1;
+  }
+}
+
 int deltafs_mkdirs(const char* __path, mode_t __mode) {
   if (client == NULL) {
     pdlfs::port::InitOnce(&once, InitClient);
@@ -1761,6 +1874,103 @@ ssize_t deltafs_plfsdir_put(deltafs_plfsdir_t* __dir, const char* __key,
   }
 }
 
+ssize_t deltafs_plfsdir_put_batch(deltafs_plfsdir_t* __dir,
+                                  const char* const* __keys,
+                                  const size_t* __keylens, int __epoch,
+                                  const char* const* __values,
+                                  const size_t* __sizes, size_t __n) {
+  pdlfs::Status s;
+  size_t total = 0;
+
+  if (!IsDirOpened(__dir)) {
+    s = BadArgs();
+  } else if (__dir->mode != O_WRONLY) {
+    s = BadArgs();
+  } else if (__n != 0 && (!__keys || !__keylens || !__values || !__sizes)) {
+    s = BadArgs();
+  } else {
+    // Reject the entire batch before any of it is written
+    for (size_t i = 0; i < __n && s.ok(); i++) {
+      if (!__keys[i] || __keylens[i] == 0) {
+        s = BadArgs();
+      } else if (!__values[i] && __sizes[i] != 0) {
+        s = BadArgs();
+      }
+    }
+  }
+
+  if (s.ok()) {
+    std::vector<pdlfs::Slice> keys(__n);
+    std::vector<pdlfs::Slice> values(__n);
+    for (size_t i = 0; i < __n; i++) {
+      keys[i] = pdlfs::Slice(__keys[i], __keylens[i]);
+      values[i] = pdlfs::Slice(__values[i], __sizes[i]);
+      total += __sizes[i];
+    }
+    if (__n != 0) {
+      if (__dir->io_engine == DELTAFS_PLFSDIR_DEFAULT) {
+        s = __dir->writer->AddBatch(&keys[0], &values[0], __n, __epoch);
+      } else {
+        for (size_t i = 0; i < __n && s.ok(); i++) {
+          if (__dir->io_engine == DELTAFS_PLFSDIR_PLAINDB) {
+            s = __dir->blk_writer_->Add(keys[i], values[i]);
+          } else {
+            s = LevelDbPut(__dir, keys[i], values[i]);
+          }
+        }
+      }
+    }
+  }
+
+  if (!s.ok()) {
+    return DirError(__dir, s);
+  } else {
+    return total;
+  }
+}
+
+ssize_t deltafs_plfsdir_put_packed(deltafs_plfsdir_t* __dir, int __epoch,
+                                   const void* __buf, size_t __n) {
+  pdlfs::Status s;
+  size_t total = 0;
+
+  if (!IsDirOpened(__dir)) {
+    s = BadArgs();
+  } else if (__dir->mode != O_WRONLY) {
+    s = BadArgs();
+  } else if (!__dir->io_options->fixed_kv_length) {
+    s = BadArgs();
+  } else if (__n != 0 && !__buf) {
+    s = BadArgs();
+  } else {
+    const size_t key_size = __dir->io_options->key_size;
+    const size_t value_size = __dir->io_options->value_size;
+    const char* data = static_cast<const char*>(__buf);
+    total = value_size * __n;
+    if (__dir->io_engine == DELTAFS_PLFSDIR_DEFAULT) {
+      pdlfs::Slice records(data, (key_size + value_size) * __n);
+      s = __dir->writer->AddPacked(records, __epoch);
+    } else {
+      for (size_t i = 0; i < __n && s.ok(); i++) {
+        pdlfs::Slice k(data, key_size);
+        pdlfs::Slice v(data + key_size, value_size);
+        if (__dir->io_engine == DELTAFS_PLFSDIR_PLAINDB) {
+          s = __dir->blk_writer_->Add(k, v);
+        } else {
+          s = LevelDbPut(__dir, k, v);
+        }
+        data += key_size + value_size;
+      }
+    }
+  }
+
+  if (!s.ok()) {
+    return DirError(__dir, s);
+  } else {
+    return total;
+  }
+}
+
 ssize_t deltafs_plfsdir_append(deltafs_plfsdir_t* __dir, const char* __fname,
                                int __ep, const void* __buf, size_t __sz) {
   pdlfs::Status s;
@@ -2180,7 +2390,31 @@ char* deltafs_plfsdir_get_property(deltafs_plfsdir_t* __dir,
         return MakeChar(tbs);
       }
     } else if (__dir->reader != NULL) {
-      // TODO
+      if (k == "index_cache_hits") {
+        uint64_t ich = __dir->reader->TEST_iostats().index_cache_hits;
+        return MakeChar(ich);
+      } else if (k == "index_cache_misses") {
+        uint64_t icm = __dir->reader->TEST_iostats().index_cache_misses;
+        return MakeChar(icm);
+      } else if (k == "filter_cache_hits") {
+        uint64_t fch = __dir->reader->TEST_iostats().filter_cache_hits;
+        return MakeChar(fch);
+      } else if (k == "filter_cache_misses") {
+        uint64_t fcm = __dir->reader->TEST_iostats().filter_cache_misses;
+        return MakeChar(fcm);
+      } else if (k == "data_cache_hits") {
+        uint64_t dch = __dir->reader->TEST_iostats().data_cache_hits;
+        return MakeChar(dch);
+      } else if (k == "data_cache_misses") {
+        uint64_t dcm = __dir->reader->TEST_iostats().data_cache_misses;
+        return MakeChar(dcm);
+      } else if (k == "data_cache_bytes_saved") {
+        uint64_t dbs = __dir->reader->TEST_iostats().data_cache_bytes_saved;
+        return MakeChar(dbs);
+      } else if (k == "readahead_hits") {
+        uint64_t rah = __dir->reader->TEST_iostats().readahead_hits;
+        return MakeChar(rah);
+      }
     }
     return NULL;
   }
@@ -2295,6 +2529,87 @@ void* deltafs_plfsdir_read(deltafs_plfsdir_t* __dir, const char* __fname,
 
 namespace {
 
+struct MultiGetState {
+  int (*saver)(void*, size_t i, const char* d, size_t dlen);
+  void* arg;
+  size_t n;  // Number of values reported
+};
+
+int MultiGetSaver(void* arg, size_t i, const pdlfs::Slice& v) {
+  MultiGetState* s = reinterpret_cast<MultiGetState*>(arg);
+  s->n++;
+  return s->saver(s->arg, i, v.data(), v.size());
+}
+
+}  // namespace
+
+ssize_t deltafs_plfsdir_multiget(
+    deltafs_plfsdir_t* __dir, const char* const* __keys,
+    const size_t* __keylens, size_t __n, int __epoch,
+    int (*saver)(void* arg, size_t __i, const char* __value, size_t __sz),
+    void* arg, size_t* __table_seeks, size_t* __seeks) {
+  pdlfs::Status s;
+  MultiGetState state;
+  state.saver = saver;
+  state.arg = arg;
+  state.n = 0;
+
+  if (!IsDirOpened(__dir)) {
+    s = BadArgs();
+  } else if (__dir->mode != O_RDONLY) {
+    s = BadArgs();
+  } else if (__n != 0 && (!__keys || !__keylens)) {
+    s = BadArgs();
+  } else if (!saver) {
+    s = BadArgs();
+  } else {
+    std::vector<pdlfs::Slice> keys;
+    keys.reserve(__n);
+    for (size_t i = 0; i < __n; i++) {
+      if (!__keys[i] || __keylens[i] == 0) {
+        s = BadArgs();
+        break;
+      }
+      keys.push_back(pdlfs::Slice(__keys[i], __keylens[i]));
+    }
+    if (s.ok() && __dir->io_engine == DELTAFS_PLFSDIR_DEFAULT) {
+      DirReader::ReadOp op;
+      op.SetEpoch(__epoch);
+      op.table_seeks = __table_seeks;
+      op.seeks = __seeks;
+      if (__n != 0) {
+        s = __dir->reader->MultiRead(op, &keys[0], __n, MultiGetSaver,
+                                     &state);
+      }
+    } else if (s.ok()) {  // Fall back to one get per key
+      std::string dst;
+      for (size_t i = 0; i < __n; i++) {
+        dst.resize(0);
+        if (__dir->io_engine == DELTAFS_PLFSDIR_PLAINDB) {
+          s = __dir->blk_reader_->Get(keys[i], &dst);
+        } else {
+          s = DbGet(__dir, keys[i], &dst);
+        }
+        if (!s.ok()) {
+          break;
+        } else if (!dst.empty()) {
+          if (MultiGetSaver(&state, i, dst) == -1) {
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  if (!s.ok()) {
+    return DirError(__dir, s);
+  } else {
+    return state.n;
+  }
+}
+
+namespace {
+
 struct ScanState {
   int (*saver)(void*, const char* key, size_t keylen, const char* d,
                size_t dlen);
@@ -2469,3 +2784,183 @@ int deltafs_plfsdir_free_handle(deltafs_plfsdir_t* __dir) {
 }
 
 }  // extern C
+
+// Operations are executed by draining a per-target list of pending
+// operations. At most one task is scheduled for each target at a time, so
+// operations against a same fd or plfsdir run in submission order.
+struct deltafs_aioq {
+  typedef std::pair<const void*, int> Target;  // Either a dir or an fd
+  typedef std::deque<deltafs_aiocb_t*> OpList;
+
+  deltafs_aioq() : cv(&mu), outstanding(0), pool(NULL) {}
+
+  // State below is protected by mu
+  pdlfs::port::Mutex mu;
+  pdlfs::port::CondVar cv;
+  std::map<Target, OpList> pending;  // Front op of each list is running
+  std::deque<deltafs_aiocb_t*> completed;
+  int outstanding;  // Submitted but not yet completed
+
+  // Constant after construction
+  pdlfs::ThreadPool* pool;  // NULL if the default env is used
+};
+
+namespace {
+struct AioTask {
+  deltafs_aioq_t* q;
+  deltafs_aioq::Target target;
+};
+
+void ExecuteAio(deltafs_aiocb_t* cb) {
+  errno = 0;
+  switch (cb->op) {
+    case DELTAFS_AIO_PREAD:
+      cb->ret = deltafs_pread(cb->fd, cb->buf, cb->sz, cb->off);
+      break;
+    case DELTAFS_AIO_PWRITE:
+      cb->ret = deltafs_pwrite(cb->fd, cb->buf, cb->sz, cb->off);
+      break;
+    case DELTAFS_AIO_FDATASYNC:
+      cb->ret = deltafs_fdatasync(cb->fd);
+      break;
+    case DELTAFS_AIO_PLFSDIR_APPEND:
+      cb->ret =
+          deltafs_plfsdir_append(cb->dir, cb->fname, cb->epoch, cb->buf, cb->sz);
+      break;
+    case DELTAFS_AIO_PLFSDIR_EPOCH_FLUSH:
+      cb->ret = deltafs_plfsdir_epoch_flush(cb->dir, cb->epoch);
+      break;
+    default:
+      cb->ret = -1;
+      errno = EINVAL;
+  }
+  cb->err = cb->ret == -1 ? errno : 0;
+}
+
+// Run all pending operations of a target in order.
+void DrainAio(void* arg) {
+  AioTask* const t = reinterpret_cast<AioTask*>(arg);
+  deltafs_aioq_t* const q = t->q;
+  pdlfs::MutexLock ml(&q->mu);
+  deltafs_aioq::OpList* const ops = &q->pending[t->target];
+  while (!ops->empty()) {
+    deltafs_aiocb_t* const cb = ops->front();
+    q->mu.Unlock();
+    ExecuteAio(cb);
+    q->mu.Lock();
+    ops->pop_front();
+    q->completed.push_back(cb);
+    assert(q->outstanding > 0);
+    q->outstanding--;
+    q->cv.SignalAll();
+  }
+  q->pending.erase(t->target);
+  delete t;
+}
+
+int RetrieveAio(deltafs_aioq_t* q, deltafs_aiocb_t** cbs, int n) {
+  q->mu.AssertHeld();
+  int i = 0;
+  while (i < n && !q->completed.empty()) {
+    cbs[i++] = q->completed.front();
+    q->completed.pop_front();
+  }
+  return i;
+}
+
+}  // namespace
+
+extern "C" {
+
+deltafs_aioq_t* deltafs_aioq_init(deltafs_tp_t* __tp) {
+  deltafs_aioq_t* q = new deltafs_aioq_t;
+  if (__tp != NULL) {
+    q->pool = __tp->pool;
+  }
+  return q;
+}
+
+int deltafs_aio_submit(deltafs_aioq_t* __q, deltafs_aiocb_t* __cb) {
+  pdlfs::Status s;
+  if (!__q || !__cb) {
+    s = BadArgs();
+  } else if (__cb->op < DELTAFS_AIO_PREAD ||
+             __cb->op > DELTAFS_AIO_PLFSDIR_EPOCH_FLUSH) {
+    s = BadArgs();
+  } else {
+    deltafs_aioq::Target target;
+    if (__cb->op >= DELTAFS_AIO_PLFSDIR_APPEND) {
+      target = deltafs_aioq::Target(__cb->dir, -1);
+    } else {
+      target = deltafs_aioq::Target(NULL, __cb->fd);
+    }
+    pdlfs::MutexLock ml(&__q->mu);
+    deltafs_aioq::OpList* const ops = &__q->pending[target];
+    ops->push_back(__cb);
+    __q->outstanding++;
+    if (ops->size() == 1) {  // No one is draining the target
+      AioTask* t = new AioTask;
+      t->q = __q;
+      t->target = target;
+      if (__q->pool != NULL) {
+        __q->pool->Schedule(DrainAio, t);
+      } else {
+        pdlfs::Env::Default()->Schedule(DrainAio, t);
+      }
+    }
+  }
+
+  if (!s.ok()) {
+    SetErrno(s);
+    return -1;
+  } else {
+    return 0;
+  }
+}
+
+int deltafs_aio_poll(deltafs_aioq_t* __q, deltafs_aiocb_t** __cbs, int __n) {
+  if (!__q || !__cbs || __n < 0) {
+    SetErrno(BadArgs());
+    return -1;
+  }
+  pdlfs::MutexLock ml(&__q->mu);
+  return RetrieveAio(__q, __cbs, __n);
+}
+
+int deltafs_aio_wait(deltafs_aioq_t* __q, deltafs_aiocb_t** __cbs, int __n,
+                     long long __timeout_us) {
+  if (!__q || !__cbs || __n < 0) {
+    SetErrno(BadArgs());
+    return -1;
+  }
+  pdlfs::Env* const env = pdlfs::Env::Default();
+  const uint64_t start = env->NowMicros();
+  pdlfs::MutexLock ml(&__q->mu);
+  while (__q->completed.empty() && __q->outstanding != 0) {
+    if (__timeout_us < 0) {
+      __q->cv.Wait();
+    } else {
+      const uint64_t dura = env->NowMicros() - start;
+      if (dura >= static_cast<uint64_t>(__timeout_us)) {
+        break;
+      }
+      __q->cv.TimedWait(__timeout_us - dura);
+    }
+  }
+  return RetrieveAio(__q, __cbs, __n);
+}
+
+int deltafs_aioq_close(deltafs_aioq_t* __q) {
+  if (!__q) return 0;
+
+  __q->mu.Lock();
+  while (__q->outstanding != 0 || !__q->pending.empty()) {
+    __q->cv.Wait();
+  }
+  __q->mu.Unlock();
+
+  delete __q;
+  return 0;
+}
+
+}  // extern C
@@ -9,17 +9,23 @@
 
 #include "deltafs/deltafs_api.h"
 
+#include "deltafs_mds.h"
+
 #include "plfsio/v1/deltafs_plfsio_cuckoo.h"
 #include "plfsio/v1/deltafs_plfsio_filter.h"
 #include "plfsio/v1/deltafs_plfsio_types.h"
 
 #include "pdlfs-common/coding.h"
+#include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 #include "pdlfs-common/xxhash.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <string>
 #include <vector>
@@ -164,6 +170,164 @@ TEST(PlfsDirTest, SingleEpoch) {
   ASSERT_EQ(Get("k6"), "v6");
 }
 
+TEST(PlfsDirTest, BatchedPuts) {
+  OpenWriter(kDefEngine);
+  const char* keys[] = {"k1", "k2", "k3"};
+  const char* values[] = {"v1", "v2", "v3"};
+  const size_t lens[] = {2, 2, 2};
+  ssize_t r =
+      deltafs_plfsdir_put_batch(wdir_, keys, lens, epoch_, values, lens, 3);
+  ASSERT_TRUE(r == 6);
+  const char packed[] = "k4v4k5v5k6v6";
+  r = deltafs_plfsdir_put_packed(wdir_, epoch_, packed, 3);
+  ASSERT_TRUE(r == 6);
+  FinishEpoch();
+  r = deltafs_plfsdir_put_packed(wdir_, epoch_, "k7v7", 1);
+  ASSERT_TRUE(r == 2);
+  FinishEpoch();
+  ASSERT_EQ(Get("k1"), "v1");
+  ASSERT_EQ(Get("k2"), "v2");
+  ASSERT_EQ(Get("k3"), "v3");
+  ASSERT_EQ(Get("k4"), "v4");
+  ASSERT_EQ(Get("k5"), "v5");
+  ASSERT_EQ(Get("k6"), "v6");
+  ASSERT_EQ(Get("k7"), "v7");
+}
+
+TEST(PlfsDirTest, BadBatchedPuts) {
+  OpenWriter(kDefEngine);
+  const char* keys[] = {"k1", "k2"};
+  const char* values[] = {"v1", NULL};
+  const size_t lens[] = {2, 2};
+  ssize_t r =
+      deltafs_plfsdir_put_batch(wdir_, keys, lens, epoch_, values, lens, 2);
+  ASSERT_TRUE(r == -1);
+  ASSERT_TRUE(errno == EINVAL);
+  const char* no_keys[] = {"k1", NULL};
+  values[1] = "v2";
+  r = deltafs_plfsdir_put_batch(wdir_, no_keys, lens, epoch_, values, lens, 2);
+  ASSERT_TRUE(r == -1);
+  ASSERT_TRUE(errno == EINVAL);
+  Put("k3", "v3");
+  FinishEpoch();
+  // No part of a rejected batch is written
+  ASSERT_EQ(Get("k1"), "");
+  ASSERT_EQ(Get("k3"), "v3");
+}
+
+TEST(PlfsDirTest, AsyncAppends) {
+  OpenWriter(kDefEngine);
+  deltafs_tp_t* tp = deltafs_tp_init(4);
+  ASSERT_TRUE(tp != NULL);
+  deltafs_aioq_t* q = deltafs_aioq_init(tp);
+  ASSERT_TRUE(q != NULL);
+  deltafs_aiocb_t* done[8];
+  ASSERT_TRUE(deltafs_aio_poll(q, done, 8) == 0);
+  ASSERT_TRUE(deltafs_aio_wait(q, done, 8, -1) == 0);  // Nothing outstanding
+  const char* fnames[] = {"f1", "f2", "f3"};
+  const char* values[] = {"v1", "v2", "v3"};
+  deltafs_aiocb_t cbs[6];
+  memset(cbs, 0, sizeof(cbs));
+  for (int i = 0; i < 3; i++) {
+    cbs[i].op = DELTAFS_AIO_PLFSDIR_APPEND;
+    cbs[i].dir = wdir_;
+    cbs[i].fname = fnames[i];
+    cbs[i].epoch = epoch_;
+    cbs[i].buf = const_cast<char*>(values[i]);
+    cbs[i].sz = 2;
+  }
+  // Executed after all appends above
+  cbs[3].op = DELTAFS_AIO_PLFSDIR_EPOCH_FLUSH;
+  cbs[3].dir = wdir_;
+  cbs[3].epoch = epoch_;
+  // Rejected since its epoch has been flushed
+  cbs[4] = cbs[0];
+  cbs[5].op = -1;
+  for (int i = 0; i < 5; i++) {
+    cbs[i].data = &cbs[i];
+    ASSERT_TRUE(deltafs_aio_submit(q, &cbs[i]) == 0);
+  }
+  ASSERT_TRUE(deltafs_aio_submit(q, &cbs[5]) == -1);
+  int n = 0;
+  while (n < 5) {
+    int r = deltafs_aio_wait(q, done + n, 8 - n, -1);
+    ASSERT_TRUE(r > 0);
+    n += r;
+  }
+  ASSERT_TRUE(deltafs_aio_wait(q, done, 8, 1000) == 0);
+  for (int i = 0; i < 5; i++) {  // Ops against a same dir complete in order
+    ASSERT_TRUE(done[i] == &cbs[i]);
+    ASSERT_TRUE(done[i]->data == &cbs[i]);
+  }
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(cbs[i].ret == 2);
+    ASSERT_TRUE(cbs[i].err == 0);
+  }
+  ASSERT_TRUE(cbs[3].ret == 0);
+  ASSERT_TRUE(cbs[4].ret == -1);
+  ASSERT_TRUE(cbs[4].err != 0);
+  ASSERT_TRUE(deltafs_aioq_close(q) == 0);
+  ASSERT_TRUE(deltafs_tp_close(tp) == 0);
+  epoch_++;
+  Finish();
+  rdir_ = deltafs_plfsdir_create_handle(dirconf_.c_str(), O_RDONLY, kDefEngine);
+  ASSERT_TRUE(rdir_ != NULL);
+  deltafs_plfsdir_set_key_size(rdir_, 2);  // Names are hashed to keys
+  ASSERT_TRUE(deltafs_plfsdir_open(rdir_, dirname_.c_str()) == 0);
+  for (int i = 0; i < 3; i++) {
+    size_t sz = 0;
+    void* result = deltafs_plfsdir_read(rdir_, fnames[i], -1, &sz, NULL, NULL);
+    ASSERT_TRUE(result != NULL);
+    ASSERT_EQ(Slice(static_cast<char*>(result), sz), values[i]);
+    free(result);
+  }
+}
+
+static int MultiGetSaver(void* arg, size_t i, const char* value, size_t sz) {
+  std::vector<std::string>* const results =
+      reinterpret_cast<std::vector<std::string>*>(arg);
+  (*results)[i].append(value, sz);
+  return 0;
+}
+
+TEST(PlfsDirTest, MultiGet) {
+  Put("k1", "v1");
+  Put("k2", "v2");
+  FinishEpoch();
+  Put("k1", "v3");
+  Put("k4", "v4");
+  FinishEpoch();
+  Finish();
+  OpenReader(kDefEngine);
+  const char* keys[] = {"k4", "k3", "k1", "k2"};
+  const size_t lens[] = {2, 2, 2, 2};
+  std::vector<std::string> results(4);
+  ssize_t r = deltafs_plfsdir_multiget(rdir_, keys, lens, 4, -1, MultiGetSaver,
+                                       &results, NULL, NULL);
+  ASSERT_TRUE(r == 4);
+  ASSERT_EQ(results[0], "v4");
+  ASSERT_TRUE(results[1].empty());
+  ASSERT_EQ(results[2], "v1v3");
+  ASSERT_EQ(results[3], "v2");
+}
+
+TEST(PlfsDirTest, IndexCache) {
+  dirconf_ = "index_cache_size=1048576";
+  Put("k1", "v1");
+  Put("k2", "v2");
+  FinishEpoch();
+  ASSERT_EQ(Get("k1"), "v1");
+  ASSERT_EQ(Get("k2"), "v2");
+  ASSERT_EQ(Get("k1"), "v1");
+  long long r =
+      deltafs_plfsdir_get_integer_property(rdir_, "filter_cache_hits");
+  ASSERT_TRUE(r == 2);
+  r = deltafs_plfsdir_get_integer_property(rdir_, "filter_cache_misses");
+  ASSERT_TRUE(r == 1);
+  r = deltafs_plfsdir_get_integer_property(rdir_, "index_cache_hits");
+  ASSERT_TRUE(r > 0);
+}
+
 TEST(PlfsDirTest, PdbEmpty) {
   OpenWriter(DELTAFS_PLFSDIR_PLAINDB);
   FinishEpoch();
@@ -263,6 +427,7 @@ class PlfsWiscBench {
     GetIoOptions();
 
     value_size_ = 40;
+    batch_size_ = GetOptions("BATCH_SIZE", 1);  // Records per put call
     unordered_ = 0;
     mfiles_ = 1;
     kranks_ = 1;
@@ -288,6 +453,9 @@ class PlfsWiscBench {
     uint32_t num_files = mfiles_ << 20;
     uint32_t comm_sz = kranks_ << 10;
     uint32_t k = 0;
+    std::string batch;
+    int batched = 0;
+    const uint64_t start = Env::Default()->NowMicros();
     fprintf(stderr, "Inserting data...\n");
     for (uint32_t i = 0; i < num_files / comm_sz; i++) {
       for (uint32_t j = 0; j < comm_sz; j++) {
@@ -305,14 +473,31 @@ class PlfsWiscBench {
         uint64_t c = i * comm_sz + h % comm_sz;
         // c *= value_size_;
         EncodeFixed64(tmp2 + 4, c);
-        ssize_t rr = deltafs_plfsdir_put(dir_, tmp1, sizeof(tmp1), 0, tmp2,
-                                         sizeof(tmp2));
-        ASSERT_TRUE(rr == sizeof(tmp2));
+        if (batch_size_ > 1) {
+          batch.append(tmp1, sizeof(tmp1));
+          batch.append(tmp2, sizeof(tmp2));
+          if (++batched == batch_size_) {
+            ssize_t rr = deltafs_plfsdir_put_packed(dir_, 0, batch.data(),
+                                                    batched);
+            ASSERT_TRUE(rr == sizeof(tmp2) * batched);
+            batch.clear();
+            batched = 0;
+          }
+        } else {
+          ssize_t rr = deltafs_plfsdir_put(dir_, tmp1, sizeof(tmp1), 0, tmp2,
+                                           sizeof(tmp2));
+          ASSERT_TRUE(rr == sizeof(tmp2));
+        }
         k++;
       }
     }
+    if (batched != 0) {
+      ssize_t rr = deltafs_plfsdir_put_packed(dir_, 0, batch.data(), batched);
+      ASSERT_TRUE(rr == sizeof(tmp2) * batched);
+    }
     fprintf(stderr, "\r100.00%%");
     fprintf(stderr, "\n");
+    const uint64_t dura = Env::Default()->NowMicros() - start;
 
     int r = deltafs_plfsdir_epoch_flush(dir_, 0);
     ASSERT_TRUE(r == 0);
@@ -322,10 +507,10 @@ class PlfsWiscBench {
     ASSERT_TRUE(r == 0);
 
     fprintf(stderr, "Done!\n");
-    PrintStats();
+    PrintStats(dura);
   }
 
-  void PrintStats() {
+  void PrintStats(uint64_t dura) {
     typedef long long integer;
 #define GETPROP(h, k) deltafs_plfsdir_get_integer_property(h, k)
     const double ki = 1024.0;
@@ -357,12 +542,16 @@ class PlfsWiscBench {
 
     fprintf(stderr, "             Value: %d Bytes\n", value_size_);
     fprintf(stderr, "               Key: 8 Bytes\n");
+    fprintf(stderr, "        Batch Size: %d\n", batch_size_);
+    fprintf(stderr, "       Insert Time: %.3f s (%.3f Mop/s)\n",
+            dura / 1000.0 / 1000.0, 1.0 * num_files / dura);
 #undef GETPROP
   }
 
  private:
   int unordered_;
   int value_size_;
+  int batch_size_;
   deltafs_plfsdir_t* dir_;
   std::vector<std::string> dirconfs_;
   std::string dirname_;
@@ -657,6 +846,139 @@ class PlfsFtBenchKv
   }
 };
 
+// Measure the throughput of many threads issuing small writes, each to a
+// file of its own, through a single deltafs client. The client talks to
+// a metadata server running in the same process.
+class ClientWriteBench {
+  static int GetOptions(const char* key, int defval) {
+    const char* env = getenv(key);
+    if (!env || !env[0]) {
+      return defval;
+    } else {
+      return atoi(env);
+    }
+  }
+
+  static void SetDefault(const char* key, const std::string& value) {
+    setenv(key, value.c_str(), 0 /* Do not overwrite user settings */);
+  }
+
+ public:
+  ClientWriteBench()
+      : num_threads_(GetOptions("CW_THREADS", 8)),
+        num_writes_(GetOptions("CW_WRITES", 100000)),
+        write_size_(GetOptions("CW_SIZE", 64)),
+        srv_(NULL),
+        cv_(&mu_),
+        num_running_(0),
+        next_id_(0),
+        errors_(0) {}
+
+  void LogAndApply() {
+    StartServer();
+    fprintf(stderr, "%d writes per thread, %d bytes per write\n", num_writes_,
+            write_size_);
+    for (int n = 1; n <= num_threads_; n *= 2) {
+      Run(n);
+    }
+    StopServer();
+  }
+
+ private:
+  void StartServer() {
+    char tmp[30];
+    snprintf(tmp, sizeof(tmp), "127.0.0.1:%d", GetOptions("CW_PORT", 50505));
+    const std::string root = test::TmpDir() + "/deltafs_client_bench";
+    Env::Default()->CreateDir(root.c_str());
+    DBOptions dbopts;
+    dbopts.env = Env::Default();
+    DestroyDB(root + "/outputs/shard-00000000", dbopts);
+    SetDefault("DELTAFS_RPCProto", "tcp");
+    SetDefault("DELTAFS_MetadataSrvAddrs", tmp);
+    SetDefault("DELTAFS_NumOfMetadataSrvs", "1");
+    SetDefault("DELTAFS_InstanceId", "0");
+    SetDefault("DELTAFS_RunDir", root + "/run");
+    SetDefault("DELTAFS_Outputs", root + "/outputs");
+    SetDefault("DELTAFS_Inputs", root + "/inputs");
+    SetDefault("DELTAFS_FioConf", "root=" + root + "/data");
+    SetDefault("DELTAFS_MaxNumOfOpenFiles", "4096");
+    ASSERT_OK(MetadataServer::Open(&srv_));
+    Env::Default()->StartThread(RunServer, srv_);
+    // Give the server some time to start listening
+    Env::Default()->SleepForMicroseconds(500 * 1000);
+  }
+
+  static void RunServer(void* arg) {
+    MetadataServer* srv = reinterpret_cast<MetadataServer*>(arg);
+    srv->RunTillInterruptionOrError();
+  }
+
+  void StopServer() {
+    delete srv_;  // Interrupts the server and waits for it to stop
+    srv_ = NULL;
+  }
+
+  void Run(int num_threads) {
+    num_running_ = num_threads;
+    errors_ = 0;
+    const uint64_t start = Env::Default()->NowMicros();
+    for (int i = 0; i < num_threads; i++) {
+      Env::Default()->StartThread(BGWork, this);
+    }
+    mu_.Lock();
+    while (num_running_ != 0) {
+      cv_.Wait();
+    }
+    mu_.Unlock();
+    const uint64_t dura = Env::Default()->NowMicros() - start;
+    const double ops = double(num_threads) * num_writes_;
+    fprintf(stderr, "%2d threads: %10.0f writes/s, %8.3f MB/s, %d errors\n",
+            num_threads, 1e6 * ops / dura,
+            1e6 * ops * write_size_ / dura / 1048576.0, errors_);
+  }
+
+  static void BGWork(void* arg) {
+    ClientWriteBench* bench = reinterpret_cast<ClientWriteBench*>(arg);
+    bench->DoWork();
+  }
+
+  void DoWork() {
+    mu_.Lock();
+    const int id = next_id_++;
+    mu_.Unlock();
+    char path[50];
+    snprintf(path, sizeof(path), "/client_bench_%d", id);
+    std::string buf(write_size_, 'x');
+    int errors = 0;
+    int fd = deltafs_open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd == -1) {
+      errors++;
+    } else {
+      for (int i = 0; i < num_writes_; i++) {
+        if (deltafs_write(fd, buf.data(), buf.size()) != buf.size()) {
+          errors++;
+          break;
+        }
+      }
+      deltafs_close(fd);
+    }
+    MutexLock ml(&mu_);
+    errors_ += errors;
+    num_running_--;
+    cv_.SignalAll();
+  }
+
+  int num_threads_;
+  int num_writes_;  // Per thread
+  int write_size_;
+  MetadataServer* srv_;
+  port::Mutex mu_;
+  port::CondVar cv_;
+  int num_running_;
+  int next_id_;  // Each thread writes its own file
+  int errors_;
+};
+
 }  // namespace pdlfs
 
 #if defined(PDLFS_GFLAGS)
@@ -667,10 +989,17 @@ class PlfsFtBenchKv
 #endif
 
 static void BM_Usage() {
-  fprintf(stderr, "Use --bench=[wisc, bf, cf[n], or kv[m]] to launch tests.\n");
+  fprintf(stderr,
+          "Use --bench=[wisc, bf, cf[n], kv[m], or client] to launch tests.\n");
   fprintf(stderr, "n = 8,16,24,32.\n");
   fprintf(stderr, "m = 1,2,4,8.\n");
   fprintf(stderr, "\n");
+  fprintf(stderr, "Options for client (via env vars):\n");
+  fprintf(stderr, "  CW_THREADS  max number of writing threads (8)\n");
+  fprintf(stderr, "  CW_WRITES   writes issued per thread (100000)\n");
+  fprintf(stderr, "  CW_SIZE     write size in bytes (64)\n");
+  fprintf(stderr, "  CW_PORT     metadata server port (50505)\n");
+  fprintf(stderr, "\n");
 }
 
 static void BM_LogAndApply(const char* bm) {
@@ -710,6 +1039,9 @@ static void BM_LogAndApply(const char* bm) {
   } else if (strcmp(bm, "cf32") == 0) {
     CF_BENCH(32) bench;
     bench.LogAndApply();
+  } else if (strcmp(bm, "client") == 0) {
+    pdlfs::ClientWriteBench bench;
+    bench.LogAndApply();
   } else {
     BM_Usage();
   }
@@ -190,10 +190,8 @@ Client::Client(size_t max_open_files) {
   mask_.Release_Store(reinterpret_cast<void*>(S_IWGRP | S_IWOTH));
   has_curroot_set_.Release_Store(NULL);
   has_curdir_set_.Release_Store(NULL);
-  dummy_.prev = &dummy_;
-  dummy_.next = &dummy_;
   max_open_fds_ = max_open_files;
-  fds_ = new File*[max_open_fds_]();
+  fds_ = new FdSlot[max_open_fds_];
   num_open_fds_ = 0;
   fd_slot_ = 0;
 }
@@ -212,25 +210,37 @@ Client::~Client() {
 size_t Client::Alloc(File* f) {
   mutex_.AssertHeld();
   assert(num_open_fds_ < max_open_fds_);
-  while (fds_[fd_slot_] != NULL) {
+  while (true) {
+    FdSlot* const slot = &fds_[fd_slot_];
+    MutexLock ml(&slot->mu);
+    if (slot->file == NULL) {
+      f->slot = slot;
+      slot->file = f;
+      break;
+    }
     fd_slot_ = (1 + fd_slot_) % max_open_fds_;
   }
-  fds_[fd_slot_] = f;
   num_open_fds_++;
   return fd_slot_;
 }
 
-// Deallocate a given file descriptor slot.
-// The associated file entry is not un-referenced.
-// REQUIRES: mutex_ has been locked.
-Client::File* Client::Free(size_t index) {
-  mutex_.AssertHeld();
-  File* f = fds_[index];
-  assert(f != NULL);
-  fds_[index] = NULL;
-  assert(num_open_fds_ > 0);
-  num_open_fds_--;
-  return f;
+// Release the descriptor slot holding a given file. Return false if the
+// slot has already been released by someone else. The file is not
+// un-referenced.
+bool Client::Free(File* f) {
+  FdSlot* const slot = f->slot;
+  slot->mu.Lock();
+  const bool freed = slot->file == f;
+  if (freed) {
+    slot->file = NULL;
+  }
+  slot->mu.Unlock();
+  if (freed) {
+    MutexLock ml(&mutex_);
+    assert(num_open_fds_ > 0);
+    num_open_fds_--;
+  }
+  return freed;
 }
 
 // REQUIRES: less than "max_open_files_" files have been opened.
@@ -240,10 +250,7 @@ size_t Client::Open(const Slice& encoding, int flags, Fio::Handle* fh) {
   File* file = static_cast<File*>(malloc(sizeof(File) + encoding.size() - 1));
   memcpy(file->encoding_data, encoding.data(), encoding.size());
   file->encoding_length = encoding.size();
-  file->next = &dummy_;
-  file->prev = dummy_.prev;
-  file->prev->next = file;
-  file->next->prev = file;
+  file->slot = NULL;
   file->seq_write = 0;
   file->seq_flush = 0;
   file->flags = flags;
@@ -252,39 +259,51 @@ size_t Client::Open(const Slice& encoding, int flags, Fio::Handle* fh) {
   return Alloc(file);
 }
 
-// REQUIRES: mutex_ has been locked.
+// Drop a reference to a file. The last reference closes the file.
+// REQUIRES: the slot lock of the file has NOT been locked.
 void Client::Unref(File* f, const Fentry& fentry) {
-  mutex_.AssertHeld();
+  FdSlot* const slot = f->slot;
+  slot->mu.Lock();
   assert(f->refs > 0);
   f->refs--;
-  if (f->refs == 0) {
-    f->next->prev = f->prev;
-    f->prev->next = f->next;
-    if (!DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
-      if (S_ISREG(fentry.file_mode())) {
-        fio_->Close(fentry, f->fh);
-      } else {
-        assert(f->fh == NULL);
-      }
-    } else if (S_ISDIR(fentry.file_mode())) {
-      if ((f->flags & O_ACCMODE) == O_WRONLY) {
-        ToWritablePlfsDir(f->fh)->Unref();
-      } else if ((f->flags & O_ACCMODE) == O_RDONLY) {
-        ToReadablePlfsDir(f->fh)->Unref();
-      } else {
-        assert(false);
-      }
+  const bool last = f->refs == 0;
+  slot->mu.Unlock();
+  if (last) {
+    // Plfs directory handles are shared by multiple files and are
+    // reference counted under mutex_
+    MutexLock ml(&mutex_);
+    Release(f, fentry);
+  }
+}
+
+// REQUIRES: mutex_ has been locked.
+void Client::Release(File* f, const Fentry& fentry) {
+  mutex_.AssertHeld();
+  assert(f->refs == 0);
+  if (!DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
+    if (S_ISREG(fentry.file_mode())) {
+      fio_->Close(fentry, f->fh);
     } else {
-      if ((f->flags & O_ACCMODE) == O_WRONLY) {
-        delete ToWritablePlfsFile(f->fh);
-      } else if ((f->flags & O_ACCMODE) == O_RDONLY) {
-        delete ToReadablePlfsFile(f->fh);
-      } else {
-        assert(false);
-      }
+      assert(f->fh == NULL);
+    }
+  } else if (S_ISDIR(fentry.file_mode())) {
+    if ((f->flags & O_ACCMODE) == O_WRONLY) {
+      ToWritablePlfsDir(f->fh)->Unref();
+    } else if ((f->flags & O_ACCMODE) == O_RDONLY) {
+      ToReadablePlfsDir(f->fh)->Unref();
+    } else {
+      assert(false);
+    }
+  } else {
+    if ((f->flags & O_ACCMODE) == O_WRONLY) {
+      delete ToWritablePlfsFile(f->fh);
+    } else if ((f->flags & O_ACCMODE) == O_RDONLY) {
+      delete ToReadablePlfsFile(f->fh);
+    } else {
+      assert(false);
     }
-    free(f);
   }
+  free(f);
 }
 
 // Sanitize path by removing all tailing slashes.
@@ -347,19 +366,24 @@ Status Client::Fopenat(int fd, const char* path, int flags, mode_t mode,
                        FileInfo* info) {
   Status s;
   Fentry fentry;
-  MutexLock ml(&mutex_);
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     s = BadDescriptor();
-  } else if (num_open_fds_ < max_open_fds_) {
-    FileAndEntry at;
-    at.ent = &fentry;
-    at.file = file;
-    std::string p = "/";
-    p += path;
-    s = InternalOpen(p, flags, mode, &at, info);
   } else {
-    s = Status::TooManyOpens(Slice());
+    MutexLock ml(&mutex_);
+    if (num_open_fds_ < max_open_fds_) {
+      FileAndEntry at;
+      at.ent = &fentry;
+      at.file = file;
+      std::string p = "/";
+      p += path;
+      s = InternalOpen(p, flags, mode, &at, info);
+    } else {
+      s = Status::TooManyOpens(Slice());
+    }
+  }
+  if (file != NULL) {
+    Unref(file, fentry);
   }
 
 #if VERBOSE >= OP_VERBOSE_LEVEL
@@ -677,11 +701,19 @@ bool Client::IsWriteOk(const File* f) {
   }
 }
 
-// REQUIRES: mutex_ has been locked.
+// Obtain a reference to the file held by a given descriptor and decode its
+// file entry. Return NULL if the descriptor is not in use. The caller must
+// un-reference the returned file when it is done with it.
 Client::File* Client::FetchFile(int fd, Fentry* result) {
   size_t index = fd;
   if (index < max_open_fds_) {
-    File* f = fds_[index];
+    FdSlot* const slot = &fds_[index];
+    slot->mu.Lock();
+    File* f = slot->file;
+    if (f != NULL) {
+      f->refs++;
+    }
+    slot->mu.Unlock();
     if (f != NULL) {
       Slice input = f->fentry_encoding();
 #ifndef NDEBUG
@@ -698,17 +730,14 @@ Client::File* Client::FetchFile(int fd, Fentry* result) {
 }
 
 Status Client::Fstat(int fd, Stat* statbuf) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
   } else {
     Status s;
-    file->refs++;  // Ref
     if (!DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
       if (S_ISREG(fentry.file_mode())) {
-        mutex_.Unlock();
         uint64_t mtime = 0;
         uint64_t size = 0;
         s = fio_->Fstat(fentry, file->fh, &mtime, &size);
@@ -716,7 +745,6 @@ Status Client::Fstat(int fd, Stat* statbuf) {
           fentry.stat.SetModifyTime(mtime);
           fentry.stat.SetFileSize(size);
         }
-        mutex_.Lock();
       }
     }
     if (s.ok()) *statbuf = fentry.stat;
@@ -726,19 +754,17 @@ Status Client::Fstat(int fd, Stat* statbuf) {
 }
 
 Status Client::Pwrite(int fd, const Slice& data, uint64_t off) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
-  } else if (!S_ISREG(fentry.file_mode())) {
-    return FileAccessModeNotMatched();
+  }
+  Status s;
+  if (!S_ISREG(fentry.file_mode())) {
+    s = FileAccessModeNotMatched();
   } else if (!IsWriteOk(file)) {
-    return FileAccessModeNotMatched();
+    s = FileAccessModeNotMatched();
   } else {
-    Status s;
-    file->refs++;  // Ref
-    mutex_.Unlock();
     if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
       plfsio::DirWriter* writer = ToWritablePlfsFile(file->fh)->parent->writer;
       assert(writer != NULL);
@@ -746,29 +772,27 @@ Status Client::Pwrite(int fd, const Slice& data, uint64_t off) {
     } else {
       s = fio_->Pwrite(fentry, file->fh, data, off);
     }
-    mutex_.Lock();
     if (s.ok()) {
+      MutexLock ml(&file->slot->mu);
       file->seq_write++;
     }
-    Unref(file, fentry);
-    return s;
   }
+  Unref(file, fentry);
+  return s;
 }
 
 Status Client::Write(int fd, const Slice& data) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
-  } else if (!S_ISREG(fentry.file_mode())) {
-    return FileAccessModeNotMatched();
+  }
+  Status s;
+  if (!S_ISREG(fentry.file_mode())) {
+    s = FileAccessModeNotMatched();
   } else if (!IsWriteOk(file)) {
-    return FileAccessModeNotMatched();
+    s = FileAccessModeNotMatched();
   } else {
-    Status s;
-    file->refs++;  // Ref
-    mutex_.Unlock();
     if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
       plfsio::DirWriter* writer = ToWritablePlfsFile(file->fh)->parent->writer;
       assert(writer != NULL);
@@ -776,39 +800,37 @@ Status Client::Write(int fd, const Slice& data) {
     } else {
       s = fio_->Write(fentry, file->fh, data);
     }
-    mutex_.Lock();
     if (s.ok()) {
+      MutexLock ml(&file->slot->mu);
       file->seq_write++;
     }
-    Unref(file, fentry);
-    return s;
   }
+  Unref(file, fentry);
+  return s;
 }
 
 Status Client::Ftruncate(int fd, uint64_t len) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
-  } else if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
-    return FileAccessModeNotMatched();
+  }
+  Status s;
+  if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
+    s = FileAccessModeNotMatched();
   } else if (!S_ISREG(fentry.file_mode())) {
-    return FileAccessModeNotMatched();
+    s = FileAccessModeNotMatched();
   } else if (!IsWriteOk(file)) {
-    return FileAccessModeNotMatched();
+    s = FileAccessModeNotMatched();
   } else {
-    Status s;
-    file->refs++;  // Ref
-    mutex_.Unlock();
     s = fio_->Ftrunc(fentry, file->fh, len);
-    mutex_.Lock();
     if (s.ok()) {
+      MutexLock ml(&file->slot->mu);
       file->seq_write++;
     }
-    Unref(file, fentry);
-    return s;
   }
+  Unref(file, fentry);
+  return s;
 }
 
 // If fd refers to a plfs directory, we do a forced sync.
@@ -816,38 +838,36 @@ Status Client::Ftruncate(int fd, uint64_t len) {
 // If fd refers to a normal file, we sync its data and update its metadata.
 // If fd refers to a normal directory, we don't yet have that logic.
 Status Client::Fdatasync(int fd) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
-  } else if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
-    Status s;
+  }
+  Status s;
+  if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
     if (S_ISDIR(fentry.file_mode())) {
       plfsio::DirWriter* writer = ToWritablePlfsDir(file->fh)->writer;
       assert(writer != NULL);
-      mutex_.Unlock();
       s = writer->Flush();
-      mutex_.Lock();
     }
-    return s;
   } else if (!S_ISREG(fentry.file_mode())) {
-    return Status::NotSupported(Slice());
+    s = Status::NotSupported(Slice());
   } else if (IsWriteOk(file)) {
-    return InternalFdatasync(file, fentry);
-  } else {
-    return Status::OK();
+    s = InternalFdatasync(file, fentry);
   }
+  Unref(file, fentry);
+  return s;
 }
 
 Status Client::InternalFdatasync(File* file, const Fentry& fentry) {
   Status s;
   uint64_t mtime;
   uint64_t size;
+  port::Mutex* const mu = &file->slot->mu;
+  mu->Lock();
   uint32_t seq_write = file->seq_write;
   uint32_t seq_flush = file->seq_flush;
-  file->refs++;  // Ref
-  mutex_.Unlock();
+  mu->Unlock();
   s = fio_->Flush(fentry, file->fh, true /*force*/);
   if (s.ok()) {
     if (seq_flush < seq_write) {
@@ -857,56 +877,50 @@ Status Client::InternalFdatasync(File* file, const Fentry& fentry) {
       }
     }
   }
-  mutex_.Lock();
   if (s.ok()) {
+    MutexLock ml(mu);
     if (seq_write > file->seq_flush) {
       file->seq_flush = seq_write;
     }
   }
-  Unref(file, fentry);
   return s;
 }
 
 Status Client::Pread(int fd, Slice* result, uint64_t off, uint64_t size,
                      char* scratch) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
-  } else if (!S_ISREG(fentry.file_mode())) {
-    return FileAccessModeNotMatched();
+  }
+  Status s;
+  if (!S_ISREG(fentry.file_mode())) {
+    s = FileAccessModeNotMatched();
   } else if (!IsReadOk(file)) {
-    return FileAccessModeNotMatched();
+    s = FileAccessModeNotMatched();
   } else {
-    Status s;
-    file->refs++;  // Ref
-    mutex_.Unlock();
     if (!DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
       s = fio_->Pread(fentry, file->fh, result, off, size, scratch);
     } else {
       // TODO
     }
-    mutex_.Lock();
-    Unref(file, fentry);
-    return s;
   }
+  Unref(file, fentry);
+  return s;
 }
 
 Status Client::Read(int fd, Slice* result, uint64_t size, char* scratch) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
-  } else if (!S_ISREG(fentry.file_mode())) {
-    return FileAccessModeNotMatched();
+  }
+  Status s;
+  if (!S_ISREG(fentry.file_mode())) {
+    s = FileAccessModeNotMatched();
   } else if (!IsReadOk(file)) {
-    return FileAccessModeNotMatched();
+    s = FileAccessModeNotMatched();
   } else {
-    Status s;
-    file->refs++;  // Ref
-    mutex_.Unlock();
     if (!DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
       s = fio_->Read(fentry, file->fh, result, size, scratch);
     } else {
@@ -925,10 +939,9 @@ Status Client::Read(int fd, Slice* result, uint64_t size, char* scratch) {
         *result = Slice();
       }
     }
-    mutex_.Lock();
-    Unref(file, fentry);
-    return s;
   }
+  Unref(file, fentry);
+  return s;
 }
 
 // If fd refers to a plfs directory, we do flush epoch.
@@ -936,38 +949,36 @@ Status Client::Read(int fd, Slice* result, uint64_t size, char* scratch) {
 // If fd refers to a normal file, we flush its data and update its metadata.
 // If fd refers to a normal directory, we don't yet have that logic.
 Status Client::Flush(int fd) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
-  } else if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
-    Status s;
+  }
+  Status s;
+  if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
     if (S_ISDIR(fentry.file_mode())) {
       plfsio::DirWriter* writer = ToWritablePlfsDir(file->fh)->writer;
       assert(writer != NULL);
-      mutex_.Unlock();
       s = writer->EpochFlush();
-      mutex_.Lock();
     }
-    return s;
   } else if (!S_ISREG(fentry.file_mode())) {
-    return Status::NotSupported(Slice());
+    s = Status::NotSupported(Slice());
   } else if (IsWriteOk(file)) {
-    return InternalFlush(file, fentry);
-  } else {
-    return Status::OK();
+    s = InternalFlush(file, fentry);
   }
+  Unref(file, fentry);
+  return s;
 }
 
 Status Client::InternalFlush(File* file, const Fentry& fentry) {
   Status s;
   uint64_t mtime;
   uint64_t size;
+  port::Mutex* const mu = &file->slot->mu;
+  mu->Lock();
   uint32_t seq_write = file->seq_write;
   uint32_t seq_flush = file->seq_flush;
-  file->refs++;  // Ref
-  mutex_.Unlock();
+  mu->Unlock();
   s = fio_->Flush(fentry, file->fh);
   if (s.ok()) {
     if (seq_flush < seq_write) {
@@ -977,50 +988,52 @@ Status Client::InternalFlush(File* file, const Fentry& fentry) {
       }
     }
   }
-  mutex_.Lock();
   if (s.ok()) {
+    MutexLock ml(mu);
     if (seq_write > file->seq_flush) {
       file->seq_flush = seq_write;
     }
   }
-  Unref(file, fentry);
   return s;
 }
 
 Status Client::Close(int fd) {
-  MutexLock ml(&mutex_);
   Fentry fentry;
   File* file = FetchFile(fd, &fentry);
   if (file == NULL) {
     return BadDescriptor();
+  }
+  if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
+    if (S_ISDIR(fentry.file_mode())) {
+      plfsio::DirWriter* writer = ToWritablePlfsDir(file->fh)->writer;
+      assert(writer != NULL);
+      writer->Finish();
+    } else {
+      // Do nothing
+    }
   } else {
-    if (DELTAFS_DIR_IS_PLFS_STYLE(fentry.file_mode())) {
-      if (S_ISDIR(fentry.file_mode())) {
-        plfsio::DirWriter* writer = ToWritablePlfsDir(file->fh)->writer;
-        assert(writer != NULL);
-        mutex_.Unlock();
-        writer->Finish();
-        mutex_.Lock();
-      } else {
-        // Do nothing
+    if (S_ISREG(fentry.file_mode())) {
+      port::Mutex* const mu = &file->slot->mu;
+      mu->Lock();
+      while (file->seq_flush < file->seq_write) {
+        mu->Unlock();
+        InternalFlush(file, fentry);  // Ignore errors
+        mu->Lock();
       }
+      mu->Unlock();
     } else {
-      if (S_ISREG(fentry.file_mode())) {
-        while (file->seq_flush < file->seq_write) {
-          mutex_.Unlock();
-          Flush(fd);  // Ignore errors
-          mutex_.Lock();
-        }
-      } else {
-        // Do nothing
-      }
+      // Do nothing
     }
+  }
 
-    Free(fd);  // Release fd slot
-
+  Status s;
+  if (Free(file)) {  // Release fd slot
     Unref(file, fentry);
-    return Status::OK();
+  } else {  // Concurrently closed by someone else
+    s = BadDescriptor();
   }
+  Unref(file, fentry);
+  return s;
 }
 
 Status Client::Access(const char* path, int mode) {
@@ -1071,6 +1084,23 @@ Status Client::Listdir(const char* path, std::vector<std::string>* names) {
   return s;
 }
 
+Status Client::Listdir(const char* path, MDS::CLI::ListdirCallback callback,
+                       void* arg, bool with_stats) {
+  Status s;
+  Slice p = path;
+  std::string tmp;
+  s = ExpandPath(&p, &tmp);
+  if (s.ok()) {
+    s = mdscli_->Listdir(p, callback, arg, with_stats);
+  }
+
+#if VERBOSE >= OP_VERBOSE_LEVEL
+  OP_VERBOSE(p, s);
+#endif
+
+  return s;
+}
+
 Status Client::Lstat(const char* path, Stat* statbuf) {
   Status s;
   Slice p = path;
@@ -1142,6 +1172,42 @@ Status Client::Mkfile(const char* path, mode_t mode) {
   return s;
 }
 
+Status Client::Mkfiles(const char* dir, const std::vector<Slice>& names,
+                       mode_t mode, std::vector<Status>* results) {
+  Status s;
+  Slice p = dir;
+  std::string tmp;
+  s = ExpandPath(&p, &tmp);
+  if (s.ok()) {
+    mode = MaskMode(mode);
+    s = mdscli_->Bulkcreat(p, names, mode, results);
+  }
+
+#if VERBOSE >= OP_VERBOSE_LEVEL
+  OP_VERBOSE(p, s);
+#endif
+
+  return s;
+}
+
+Status Client::Getattrs(const char* dir, const std::vector<Slice>& names,
+                        std::vector<Stat>* results,
+                        std::vector<Status>* statuses) {
+  Status s;
+  Slice p = dir;
+  std::string tmp;
+  s = ExpandPath(&p, &tmp);
+  if (s.ok()) {
+    s = mdscli_->Bulkstat(p, names, results, statuses);
+  }
+
+#if VERBOSE >= OP_VERBOSE_LEVEL
+  OP_VERBOSE(p, s);
+#endif
+
+  return s;
+}
+
 Status Client::Mkdirs(const char* path, mode_t mode) {
   Status s;
   Slice p = path;
@@ -1610,6 +1676,22 @@ void Client::Builder::OpenMDSCli() {
 
   if (ok()) {
     status_ = config::LoadAtomicPathRes(&mdscliopts_.atomic_path_resolution);
+    if (ok()) {
+      status_ = config::LoadBatchedPathRes(
+          &mdscliopts_.batched_path_resolution);
+    }
+    if (ok()) {
+      status_ = config::LoadNegativeLookups(&mdscliopts_.negative_lookups);
+    }
+    if (ok()) {
+      status_ = config::LoadLookupLeaseRenewal(
+          &mdscliopts_.lease_renewal_window);
+    }
+    if (ok()) {
+      uint64_t listdir_parallelism;
+      status_ = config::LoadListdirParallelism(&listdir_parallelism);
+      mdscliopts_.listdir_parallelism = static_cast<int>(listdir_parallelism);
+    }
     if (ok()) {
       status_ = config::LoadParanoidChecks(&mdscliopts_.paranoid_checks);
     }
@@ -41,10 +41,20 @@ class Client {
   Status Access(const char* path, int mode);
   Status Accessdir(const char* path, int mode);
   Status Listdir(const char* path, std::vector<std::string>* names);
+  // Stream the entries of a directory to a callback one page at a time.
+  Status Listdir(const char* path, MDS::CLI::ListdirCallback callback,
+                 void* arg, bool with_stats = false);
   Status Truncate(const char* path, uint64_t len);
   Status Lstat(const char* path, Stat* result);
   Status Getattr(const char* path, Stat* result);
   Status Mkfile(const char* path, mode_t mode);
+  // Create a batch of files under a common parent directory. The outcome
+  // of each name is stored in *results.
+  Status Mkfiles(const char* dir, const std::vector<Slice>& names, mode_t mode,
+                 std::vector<Status>* results);
+  // Read the stats of a batch of names under a common parent directory.
+  Status Getattrs(const char* dir, const std::vector<Slice>& names,
+                  std::vector<Stat>* results, std::vector<Status>* statuses);
   Status Mkdirs(const char* path, mode_t mode);
   Status Mkdir(const char* path, mode_t mode);
   Status Chmod(const char* path, mode_t mode);
@@ -64,11 +74,11 @@ class Client {
   void operator=(const Client&);
   Client(const Client&);
 
+  struct FdSlot;
   // State for each opened file
   struct File {
     size_t encoding_length;
-    File* next;
-    File* prev;
+    FdSlot* slot;  // Descriptor slot holding the file
     Fio::Handle* fh;
     int flags;
     uint32_t seq_flush;  // Latest file metadata update
@@ -81,6 +91,16 @@ class Client {
     }
   };
 
+  // An entry of the file descriptor table. Each slot has its own lock,
+  // which protects the slot and the reference count and sequence numbers
+  // of every file ever held by the slot, so operations on different
+  // descriptors never contend with each other.
+  struct FdSlot {
+    FdSlot() : file(NULL) {}
+    port::Mutex mu;
+    File* file;  // NULL if the slot is free
+  };
+
   struct FileAndEntry {
     const Fentry* ent;
     File* file;
@@ -88,9 +108,9 @@ class Client {
   // REQUIRES: mutex_ has been locked
   Status InternalOpen(const Slice& p, int flags, mode_t mode, FileAndEntry* at,
                       FileInfo* result);
-  // REQUIRES: mutex_ has been locked
+  // REQUIRES: file has been referenced by the caller
   Status InternalFdatasync(File* file, const Fentry& ent);
-  // REQUIRES: mutex_ has been locked
+  // REQUIRES: file has been referenced by the caller
   Status InternalFlush(File* file, const Fentry& ent);
 
   // State below is protected by mutex_
@@ -104,13 +124,13 @@ class Client {
   std::string curdir_;  // Set by chdir
   File* FetchFile(int fd, Fentry*);
   size_t Alloc(File*);
-  File* Free(size_t idx);
+  bool Free(File*);
   size_t Open(const Slice& encoding, int flags, Fio::Handle*);
   bool IsWriteOk(const File*);
   bool IsReadOk(const File*);
   void Unref(File*, const Fentry&);
-  File dummy_;  // File table as a doubly linked list
-  File** fds_;  // File descriptor table
+  void Release(File*, const Fentry&);
+  FdSlot* fds_;  // File descriptor table
   size_t num_open_fds_;
   size_t fd_slot_;
 
@@ -59,7 +59,14 @@ DEFINE_FLAG(SizeOfMetadataWriteBuffer, "32M")
 DEFINE_FLAG(SizeOfMetadataTables, "32M")
 DEFINE_FLAG(DisableMetadataCompaction, "true")
 DEFINE_FLAG(AtomicPathRes, "false")
+DEFINE_FLAG(BatchedPathRes, "false")
+DEFINE_FLAG(NegativeLookups, "false")
+DEFINE_FLAG(LookupLeaseRenewal, "0")
+DEFINE_FLAG(ListdirParallelism, "4")
 DEFINE_FLAG(ParanoidChecks, "false")
+DEFINE_FLAG(MDSGroupCommit, "false")
+DEFINE_FLAG(NumOfMDSShards, "16")
+DEFINE_FLAG(MDSSplitThreshold, "0")
 DEFINE_FLAG(VerifyChecksums, "false")
 DEFINE_FLAG(Inputs, "/tmp/deltafs_inputs")
 DEFINE_FLAG(Outputs, "/tmp/deltafs_outputs")
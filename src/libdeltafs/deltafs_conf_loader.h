@@ -60,7 +60,14 @@ CONF_LOADER_UI64(SizeOfMetadataWriteBuffer)
 CONF_LOADER_UI64(SizeOfMetadataTables)
 CONF_LOADER_BOOL(DisableMetadataCompaction)
 CONF_LOADER_BOOL(AtomicPathRes)
+CONF_LOADER_BOOL(BatchedPathRes)
+CONF_LOADER_BOOL(NegativeLookups)
+CONF_LOADER_UI64(LookupLeaseRenewal)
+CONF_LOADER_UI64(ListdirParallelism)
 CONF_LOADER_BOOL(ParanoidChecks)
+CONF_LOADER_BOOL(MDSGroupCommit)
+CONF_LOADER_UI64(NumOfMDSShards)
+CONF_LOADER_UI64(MDSSplitThreshold)
 CONF_LOADER_BOOL(VerifyChecksums)
 
 #undef CONF_LOADER_UI64
@@ -24,7 +24,7 @@ extern std::string NumOfVirMetadataSrvs();
 // e.g. 0
 extern std::string InstanceId();
 // Return the name of the RPC proto.
-// e.g. bmi+tcp, cci, mpi
+// e.g. bmi+tcp, cci, mpi, or tcp and udp for the built-in socket rpc
 extern std::string RPCProto();
 // Indicate if deltafs should trace calls to metadata server.
 // e.g. true, yes
@@ -50,9 +50,38 @@ extern std::string SizeOfCliIndexCache();
 // Indicate if deltafs should ensure atomic pathname resolutions.
 // e.g. true, yes
 extern std::string AtomicPathRes();
+// Indicate if deltafs should resolve multiple path components in a single
+// request to a metadata server whenever possible.
+// e.g. true, yes
+extern std::string BatchedPathRes();
+// Indicate if deltafs clients should cache the absence of directories
+// found missing during pathname resolutions under server-granted leases.
+// e.g. true, yes
+extern std::string NegativeLookups();
+// Microseconds before a cached lookup state expires within which an access
+// to it triggers a background lease renewal. Set to 0 to disable.
+// e.g. 0, 200000
+extern std::string LookupLeaseRenewal();
+// Max number of metadata servers a client lists in parallel when
+// listing a directory.
+// e.g. 1, 4
+extern std::string ListdirParallelism();
 // Indicate if deltafs should perform paranoid checks.
 // e.g. true, yes
 extern std::string ParanoidChecks();
+// Indicate if metadata servers should group commit concurrent creations
+// against the same parent directory.
+// e.g. true, yes
+extern std::string MDSGroupCommit();
+// Number of independently locked partitions of the directory and lease
+// tables of each metadata server.
+// e.g. 1, 16
+extern std::string NumOfMDSShards();
+// Number of entries a directory partition may hold before it is split.
+// New directories start on a single server and grow to other servers by
+// splitting. Set to 0 to pre-split new directories to all servers.
+// e.g. 0, 8k
+extern std::string MDSSplitThreshold();
 // Indicate if deltafs should always verify checksums.
 // e.g. true, yes
 extern std::string VerifyChecksums();
@@ -16,6 +16,9 @@
 #if defined(DELTAFS_BBOS)
 #include "bbos_env.h"
 #endif
+#if defined(DELTAFS_IOURING)
+#include "uring_env.h"
+#endif
 
 #include <ctype.h>
 #include <stdio.h>
@@ -139,6 +142,11 @@ EnvRef OpenEnvOrDie(int argc, void* argv[]) {
       Error(__LOG_ARGS__, "Abort...");
       abort();
     }
+#endif
+#if defined(DELTAFS_IOURING)
+    if (strcmp(name, "iouring") == 0 && argc >= 2) {
+      return OpenEnvOrDie(name, static_cast<const char*>(argv[1]));
+    }
 #endif
     return OpenEnvOrDie(name, "");  // Compatibility mode
   } else {
@@ -151,6 +159,25 @@ EnvRef OpenEnvOrDie(int argc, void* argv[]) {
 
 // XXX: BBOS is not supported in this path
 EnvRef OpenEnvOrDie(const char* name, const char* conf) {
+#if defined(DELTAFS_IOURING)
+  // The configuration string optionally specifies the queue depth
+  if (strcmp(name, "iouring") == 0) {
+    Env* env = NULL;
+    Status s = uring::IoUringInit(&env, Env::Default(),
+                                  static_cast<unsigned>(atoi(conf)));
+    if (s.ok()) {
+      EnvRef ref;
+      ref.is_system = false;
+      ref.env = env;
+      return ref;
+    } else {
+      Error(__LOG_ARGS__, "Cannot create io_uring env: %s",
+            s.ToString().c_str());
+      Error(__LOG_ARGS__, "Abort...");
+      abort();
+    }
+  }
+#endif
   bool is_system;
   Env* env = Env::Open(name, conf, &is_system);
   if (env != NULL) {
@@ -48,6 +48,10 @@ Status MetadataServer::Dispose() {
     delete mdsmon_;
     mdsmon_ = NULL;
   }
+  if (peers_ != NULL) {
+    delete peers_;
+    peers_ = NULL;
+  }
   if (mdb_ != NULL) {
     delete mdb_;
     mdb_ = NULL;
@@ -135,7 +139,8 @@ class MetadataServer::Builder {
         db_(NULL),
         mdb_(NULL),
         mds_(NULL),
-        mdsmon_(NULL) {}
+        mdsmon_(NULL),
+        peers_(NULL) {}
   ~Builder() {}
 
   Status status() const { return status_; }
@@ -164,6 +169,7 @@ class MetadataServer::Builder {
   MDSOptions mdsopts_;
   MDS* mds_;
   MDSMonitor* mdsmon_;
+  MDSFactoryImpl* peers_;
   uint64_t snap_id_;  // snapshot id
   uint64_t reg_id_;   // registry id
   int srv_id_;
@@ -359,6 +365,8 @@ void MetadataServer::Builder::OpenDB() {
 void MetadataServer::Builder::OpenMDS() {
   uint64_t lease_table_size;
   uint64_t dir_table_size;
+  uint64_t num_shards;
+  uint64_t split_threshold;
 
   if (ok()) {
     status_ = config::LoadSizeOfSrvLeaseTable(&lease_table_size);
@@ -371,11 +379,43 @@ void MetadataServer::Builder::OpenMDS() {
     status_ = config::LoadParanoidChecks(&mdsopts_.paranoid_checks);
   }
 
+  if (ok()) {
+    status_ = config::LoadMDSGroupCommit(&mdsopts_.group_commit);
+  }
+
+  if (ok()) {
+    status_ = config::LoadNumOfMDSShards(&num_shards);
+    if (ok() && num_shards == 0) {
+      status_ = Status::InvalidArgument("num of mds shards must be positive");
+    }
+  }
+
+  if (ok()) {
+    status_ = config::LoadMDSSplitThreshold(&split_threshold);
+  }
+
+  // Splits migrate directory entries to other servers through rpc
+  if (ok() && split_threshold != 0 && mdstopo_.num_srvs > 1) {
+    MDSFactoryImpl* fty = new MDSFactoryImpl;
+    status_ = fty->Init(mdstopo_);
+    if (ok()) {
+      status_ = fty->Start();
+    }
+    if (ok()) {
+      peers_ = fty;
+    } else {
+      delete fty;
+    }
+  }
+
   if (ok()) {
     mdsopts_.mdb = mdb_;
     mdsopts_.mds_env = myenv_;
     mdsopts_.lease_table_size = lease_table_size;
     mdsopts_.dir_table_size = dir_table_size;
+    mdsopts_.num_shards = num_shards;
+    mdsopts_.split_threshold = split_threshold;
+    mdsopts_.peers = peers_;
     mdsopts_.num_virtual_servers = mdstopo_.num_vir_srvs;
     mdsopts_.num_servers = mdstopo_.num_srvs;
     mdsopts_.snap_id = snap_id_;
@@ -460,6 +500,7 @@ MetadataServer* MetadataServer::Builder::BuildServer() {
     srv->wrapper_ = wrapper_;
     srv->mds_ = mds_;
     srv->mdsmon_ = mdsmon_;
+    srv->peers_ = peers_;
     srv->myenv_ = myenv_;
     srv->mdb_ = mdb_;
     srv->db_ = db_;
@@ -469,6 +510,7 @@ MetadataServer* MetadataServer::Builder::BuildServer() {
     delete wrapper_;
     delete mdsmon_;
     delete mds_;
+    delete peers_;
     delete myenv_;
     delete mdb_;
     delete db_;
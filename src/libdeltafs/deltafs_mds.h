@@ -15,6 +15,8 @@
 
 namespace pdlfs {
 
+class MDSFactoryImpl;
+
 class MetadataServer {
   typedef PseudoConcurrentMDSMonitor MDSMonitor;
   typedef MDS::RPC::SRV RPCWrapper;
@@ -47,6 +49,7 @@ class MetadataServer {
 
   MDS* mds_;
   MDSMonitor* mdsmon_;
+  MDSFactoryImpl* peers_;  // NULL if directories do not split dynamically
   MDB* mdb_;
   DB* db_;
 };
@@ -38,6 +38,10 @@ MDSOptions::MDSOptions()
       snap_id(0),
       reg_id(0),
       paranoid_checks(false),
+      group_commit(false),
+      num_shards(16),
+      split_threshold(0),
+      peers(NULL),
       num_virtual_servers(1),
       num_servers(1),
       srv_id(0) {}
@@ -46,23 +50,31 @@ MDS::SRV::SRV(const MDSOptions& options)
     : mds_env_(options.mds_env),
       mdb_(options.mdb),
       paranoid_checks_(options.paranoid_checks),
+      group_commit_(options.group_commit),
+      split_threshold_(options.split_threshold),
+      peers_(options.peers),
       lease_duration_(options.lease_duration),
       snap_id_(options.snap_id),
       reg_id_(options.reg_id),
       srv_id_(options.srv_id),
-      loading_cv_(&mutex_),
+      no_more_inos_(NULL),
       session_(0),
       ino_(0) {
   giga_.num_servers = options.num_servers;
   giga_.num_virtual_servers = options.num_virtual_servers;
   giga_.paranoid_checks = options.paranoid_checks;
 
+  // Table capacities are divided evenly among all shards
+  const size_t num_shards = options.num_shards > 0 ? options.num_shards : 1;
   LeaseOptions lease_options;
   lease_options.max_lease_duration = options.lease_duration;
-  lease_options.max_num_leases = options.lease_table_size;
-  leases_ = new LeaseTable(lease_options);
-
-  dirs_ = new DirTable(options.dir_table_size);
+  lease_options.max_num_leases =
+      (options.lease_table_size + num_shards - 1) / num_shards;
+  const size_t dir_table_size =
+      (options.dir_table_size + num_shards - 1) / num_shards;
+  for (size_t i = 0; i < num_shards; i++) {
+    shards_.push_back(new Shard(lease_options, dir_table_size));
+  }
 
   assert(srv_id_ >= 0);
   session_ = srv_id_;
@@ -72,8 +84,21 @@ MDS::SRV::SRV(const MDSOptions& options)
 }
 
 MDS::SRV::~SRV() {
-  delete leases_;
-  delete dirs_;
+  for (size_t i = 0; i < shards_.size(); i++) {
+    delete shards_[i];
+  }
+}
+
+MDS::SRV::Shard::Shard(const LeaseOptions& lease_options,
+                       size_t dir_table_size)
+    : loading_cv(&mutex) {
+  leases = new LeaseTable(lease_options);
+  dirs = new DirTable(dir_table_size);
+}
+
+MDS::SRV::Shard::~Shard() {
+  delete leases;
+  delete dirs;
 }
 
 MDS* MDS::Open(const MDSOptions& options) {
@@ -91,6 +116,11 @@ MDS* MDS::Open(const MDSOptions& options) {
   Verbose(__LOG_ARGS__, 1, "mds.snap_id -> %llu",
           (unsigned long long)options.snap_id);
   Verbose(__LOG_ARGS__, 1, "mds.srv_id -> %d", options.srv_id);
+  Verbose(__LOG_ARGS__, 1, "mds.group_commit -> %s",
+          int(options.group_commit) ? "Yes" : "No");
+  Verbose(__LOG_ARGS__, 1, "mds.num_shards -> %zu", options.num_shards);
+  Verbose(__LOG_ARGS__, 1, "mds.split_threshold -> %zu",
+          options.split_threshold);
 #endif
   MDS* mds = new SRV(options);
   return mds;
@@ -105,6 +135,11 @@ MDSCliOptions::MDSCliOptions()
       lookup_cache_size(4096),
       paranoid_checks(false),
       atomic_path_resolution(false),
+      batched_path_resolution(false),
+      negative_lookups(false),
+      lease_renewal_window(0),
+      listdir_parallelism(4),
+      listdir_page_size(0),
       max_redirects_allowed(20),
       num_virtual_servers(1),
       num_servers(1),
@@ -118,11 +153,17 @@ MDS::CLI::CLI(const MDSCliOptions& options)
       factory_(options.factory),
       paranoid_checks_(options.paranoid_checks),
       atomic_path_resolution_(options.atomic_path_resolution),
+      batched_path_resolution_(options.batched_path_resolution),
+      negative_lookups_(options.negative_lookups),
+      lease_renewal_window_(options.lease_renewal_window),
+      listdir_parallelism_(options.listdir_parallelism),
+      listdir_page_size_(options.listdir_page_size),
       max_redirects_allowed_(options.max_redirects_allowed),
       session_id_(options.session_id),
       cli_id_(options.cli_id),
       uid_(options.uid),
-      gid_(options.gid) {
+      gid_(options.gid),
+      bg_cv_(&mutex_) {
   giga_.num_servers = options.num_servers;
   giga_.num_virtual_servers = options.num_virtual_servers;
   giga_.paranoid_checks = options.paranoid_checks;
@@ -132,6 +173,12 @@ MDS::CLI::CLI(const MDSCliOptions& options)
 }
 
 MDS::CLI::~CLI() {
+  mutex_.Lock();
+  // Wait for all background lease renewals to finish
+  while (!renewals_.empty()) {
+    bg_cv_.Wait();
+  }
+  mutex_.Unlock();
   delete index_cache_;
   delete lookup_cache_;
 }
@@ -147,6 +194,14 @@ MDS::CLI* MDS::CLI::Open(const MDSCliOptions& options) {
           options.index_cache_size);
   Verbose(__LOG_ARGS__, 1, "mds.cli.lookup_cache_size -> %zu",
           options.lookup_cache_size);
+  Verbose(__LOG_ARGS__, 1, "mds.cli.batched_path_resolution -> %s",
+          options.batched_path_resolution ? "yes" : "no");
+  Verbose(__LOG_ARGS__, 1, "mds.cli.negative_lookups -> %s",
+          options.negative_lookups ? "yes" : "no");
+  Verbose(__LOG_ARGS__, 1, "mds.cli.lease_renewal_window -> %llu",
+          static_cast<unsigned long long>(options.lease_renewal_window));
+  Verbose(__LOG_ARGS__, 1, "mds.cli.listdir_parallelism -> %d",
+          options.listdir_parallelism);
   Verbose(__LOG_ARGS__, 1, "mds.cli.session_id -> %d", options.session_id);
   Verbose(__LOG_ARGS__, 1, "mds.cli.cli_id -> %d", options.cli_id);
   Verbose(__LOG_ARGS__, 1, "mds.cli.uid -> %d", options.uid);
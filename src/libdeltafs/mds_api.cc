@@ -9,6 +9,10 @@
 
 #include "mds_api.h"
 
+#include "pdlfs-common/coding.h"
+
+#include <algorithm>
+
 namespace pdlfs {
 
 MDS::~MDS() {}
@@ -25,36 +29,6 @@ MDSWrapper::~MDSWrapper() {}
 
 MDSTracer::~MDSTracer() {}
 
-static char* EncodeDirId(char* dst, const DirId& id) {
-  dst = EncodeVarint64(dst, id.reg);
-  dst = EncodeVarint64(dst, id.snap);
-  dst = EncodeVarint64(dst, id.ino);
-  return dst;
-}
-
-static void PutDirId(std::string* dst, const DirId& id) {
-  PutVarint64(dst, id.reg);
-  PutVarint64(dst, id.snap);
-  PutVarint64(dst, id.ino);
-}
-
-static bool GetDirId(Slice* input, DirId* id) {
-  if (!GetVarint64(input, &id->reg) || !GetVarint64(input, &id->snap) ||
-      !GetVarint64(input, &id->ino)) {
-    return false;
-  } else {
-    return true;
-  }
-}
-
-#ifndef NDEBUG
-#define DELTAFS_RPC_DEBUG 1
-#else
-#define DELTAFS_RPC_DEBUG 0
-#endif  // NDEBUG
-
-static const bool kDebugRPC = DELTAFS_RPC_DEBUG;
-#undef DELTAFS_RPC_DEBUG
 // RPC op types
 namespace {
 /* clang-format off */
@@ -64,9 +38,253 @@ enum {
   kUnlink, kLookup, kListdir, kReadidx,
   kOpensession,
   kGetinput,
-  kGetoutput
+  kGetoutput,
+  kMigrate,
+  kResolvepath,
+  kBulkcreat, kBulkstat
 };
 /* clang-format on */
+
+// All RPC messages use a fixed-width encoding: integers are encoded as
+// fixed32 or fixed64, byte strings are prefixed by a fixed32 length, and
+// stats are copied as their fixed-width encodings. Variable-sized fields
+// always come after fixed-sized ones.
+
+// Build a message body in place. A body is first written into the message's
+// own fixed-size buffer and only moves to extra_buf when it outgrows that
+// buffer, so most messages are encoded without any memory allocation.
+class MsgWriter {
+ public:
+  explicit MsgWriter(rpc::If::Message* msg)
+      : msg_(msg), base_(&msg->buf[0]), cap_(sizeof(msg->buf)), size_(0) {}
+
+  // Make room for at least n more bytes.
+  void Reserve(size_t n) {
+    if (size_ + n > cap_) {
+      std::string* const extra = &msg_->extra_buf;
+      const size_t cap = std::max(size_ + n, 2 * cap_);
+      if (base_ != &msg_->buf[0]) {
+        extra->resize(cap);
+      } else {
+        extra->resize(cap);
+        memcpy(&(*extra)[0], base_, size_);
+      }
+      base_ = &(*extra)[0];
+      cap_ = cap;
+    }
+  }
+
+  void PutFixed32(uint32_t v) {
+    Reserve(4);
+    EncodeFixed32(base_ + size_, v);
+    size_ += 4;
+  }
+
+  void PutFixed64(uint64_t v) {
+    Reserve(8);
+    EncodeFixed64(base_ + size_, v);
+    size_ += 8;
+  }
+
+  void PutByte(unsigned char c) {
+    Reserve(1);
+    base_[size_++] = static_cast<char>(c);
+  }
+
+  void PutSlice(const Slice& value) {
+    PutFixed32(static_cast<uint32_t>(value.size()));
+    Reserve(value.size());
+    memcpy(base_ + size_, value.data(), value.size());
+    size_ += value.size();
+  }
+
+  void PutDirId(const DirId& id) {
+    PutFixed64(id.reg);
+    PutFixed64(id.snap);
+    PutFixed64(id.ino);
+  }
+
+  void PutStat(const Stat& stat) {
+    Reserve(Stat::kFixedEncodedLength);
+    stat.EncodeFixedTo(base_ + size_);
+    size_ += Stat::kFixedEncodedLength;
+  }
+
+  void PutLookupStat(const LookupStat& stat) {
+    Reserve(LookupStat::kFixedEncodedLength);
+    stat.EncodeFixedTo(base_ + size_);
+    size_ += LookupStat::kFixedEncodedLength;
+  }
+
+  size_t size() const { return size_; }
+
+  // Point the message's contents at the encoded body.
+  void Finish() { msg_->contents = Slice(base_, size_); }
+
+ private:
+  rpc::If::Message* msg_;
+  char* base_;
+  size_t cap_;
+  size_t size_;
+};
+
+// Parse a message body written by MsgWriter. Parsed byte strings point
+// into the message itself. Once a read runs past the end of the input,
+// ok() returns false and all subsequent reads return empty values.
+class MsgReader {
+ public:
+  explicit MsgReader(const Slice& input) : input_(input), ok_(true) {}
+
+  bool ok() const { return ok_; }
+  size_t remaining() const { return input_.size(); }
+
+  uint32_t GetFixed32() {
+    uint32_t v = 0;
+    if (Has(4)) {
+      v = DecodeFixed32(input_.data());
+      input_.remove_prefix(4);
+    }
+    return v;
+  }
+
+  uint64_t GetFixed64() {
+    uint64_t v = 0;
+    if (Has(8)) {
+      v = DecodeFixed64(input_.data());
+      input_.remove_prefix(8);
+    }
+    return v;
+  }
+
+  unsigned char GetByte() {
+    unsigned char c = 0;
+    if (Has(1)) {
+      c = static_cast<unsigned char>(input_[0]);
+      input_.remove_prefix(1);
+    }
+    return c;
+  }
+
+  Slice GetSlice() {
+    Slice value;
+    const size_t n = GetFixed32();
+    if (Has(n)) {
+      value = Slice(input_.data(), n);
+      input_.remove_prefix(n);
+    }
+    return value;
+  }
+
+  void GetDirId(DirId* id) {
+    id->reg = GetFixed64();
+    id->snap = GetFixed64();
+    id->ino = GetFixed64();
+  }
+
+  void GetStat(Stat* stat) {
+    if (Has(Stat::kFixedEncodedLength)) {
+      stat->DecodeFixedFrom(input_.data());
+      input_.remove_prefix(Stat::kFixedEncodedLength);
+    }
+  }
+
+  void GetLookupStat(LookupStat* stat) {
+    if (Has(LookupStat::kFixedEncodedLength)) {
+      stat->DecodeFixedFrom(input_.data());
+      input_.remove_prefix(LookupStat::kFixedEncodedLength);
+    }
+  }
+
+ private:
+  bool Has(size_t n) {
+    if (ok_ && input_.size() < n) {
+      ok_ = false;
+    }
+    return ok_;
+  }
+
+  Slice input_;
+  bool ok_;
+};
+
+// Fields shared by all requests.
+void PutBase(MsgWriter* w, const MDS::BaseOptions& options) {
+  w->PutDirId(options.dir_id);
+  w->PutFixed32(options.session_id);
+  w->PutFixed64(options.op_due);
+}
+
+void GetBase(MsgReader* r, MDS::BaseOptions* options) {
+  r->GetDirId(&options->dir_id);
+  options->session_id = r->GetFixed32();
+  options->op_due = r->GetFixed64();
+}
+
+// Fields shared by all requests that operate on a single name.
+void PutName(MsgWriter* w, const MDS::BaseOptions& options) {
+  w->PutSlice(options.name_hash);
+  w->PutSlice(options.name);
+}
+
+void GetName(MsgReader* r, MDS::BaseOptions* options) {
+  options->name_hash = r->GetSlice();
+  options->name = r->GetSlice();
+}
+
+// Convert the error code of a reply to a status. Redirects are re-thrown
+// to the caller.
+Status CheckReply(const rpc::If::Message& out) {
+  if (out.err == -1) {
+    MDS::Redirect re(out.contents.data(), out.contents.size());
+    throw re;
+  } else if (out.err != 0) {
+    return Status::FromCode(out.err);
+  } else {
+    return Status::OK();
+  }
+}
+
+void SetRedirect(rpc::If::Message& out, MDS::Redirect& re) {
+  out.extra_buf.swap(re);
+  out.contents = Slice(out.extra_buf);
+  out.err = -1;
+}
+
+void SetStatReply(rpc::If::Message& out, const Status& s, const Stat& stat) {
+  if (s.ok()) {
+    MsgWriter w(&out);
+    w.PutStat(stat);
+    w.Finish();
+    out.err = 0;
+  } else {
+    out.err = s.err_code();
+  }
+}
+
+Status GetStatReply(const rpc::If::Message& out, Stat* stat) {
+  Status s = CheckReply(out);
+  if (s.ok()) {
+    MsgReader r(out.contents);
+    r.GetStat(stat);
+    if (!r.ok()) {
+      s = Status::Corruption(Slice());
+    }
+  }
+  return s;
+}
+
+// Move a reply's contents into dst, avoiding a copy when the contents
+// occupy the message's extra_buf as a whole.
+void TakeContents(rpc::If::Message& out, std::string* dst) {
+  if (out.contents.data() == out.extra_buf.data() &&
+      out.contents.size() == out.extra_buf.size()) {
+    dst->swap(out.extra_buf);
+    out.contents = Slice(*dst);
+  } else {
+    dst->assign(out.contents.data(), out.contents.size());
+  }
+}
+
 }  // namespace
 
 // Convenient method that adds op code to a message.
@@ -87,6 +305,12 @@ Status MDS::RPC::SRV::Call(Msg& in, Msg& out) RPCNOEXCEPT {
     case kFcreat:
       FCRET(in, out);
       break;
+    case kBulkcreat:
+      BCRET(in, out);
+      break;
+    case kBulkstat:
+      BSTAT(in, out);
+      break;
     case kTrunc:
       TRUNC(in, out);
       break;
@@ -114,6 +338,12 @@ Status MDS::RPC::SRV::Call(Msg& in, Msg& out) RPCNOEXCEPT {
     case kReadidx:
       RDIDX(in, out);
       break;
+    case kMigrate:
+      MIGRT(in, out);
+      break;
+    case kResolvepath:
+      RSLVP(in, out);
+      break;
     case kOpensession:
       OPSES(in, out);
       break;
@@ -134,42 +364,15 @@ Status MDS::RPC::SRV::Call(Msg& in, Msg& out) RPCNOEXCEPT {
 }
 
 Status MDS::RPC::CLI::Fstat(const FstatOptions& options, FstatRet* ret) {
-  Status s;
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
-  } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
-    }
-  }
-
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  PutName(&w, options);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kFstat), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kFstat), out);
-    if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
-        s = Status::Corruption(Slice());
-      }
-    }
+    s = GetStatReply(out, &ret->stat);
   }
   return s;
 }
@@ -179,79 +382,42 @@ void MDS::RPC::SRV::FSTAT(Msg& in, Msg& out) {
   FstatOptions options;
   FstatRet ret;
   assert(in.op == kFstat);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  GetName(&r, &options);
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
       s = mds_->Fstat(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
-  if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
-    out.err = 0;
-  } else {
-    out.err = s.err_code();
-  }
+  SetStatReply(out, s, ret.stat);
 }
 
 Status MDS::RPC::CLI::Fcreat(const FcreatOptions& options, FcreatRet* ret) {
-  Status s;
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint32(p, options.flags);
-    p = EncodeVarint32(p, options.mode);
-    p = EncodeVarint32(p, options.uid);
-    p = EncodeVarint32(p, options.gid);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
-  } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint32(&in.extra_buf, options.flags);
-    PutVarint32(&in.extra_buf, options.mode);
-    PutVarint32(&in.extra_buf, options.uid);
-    PutVarint32(&in.extra_buf, options.gid);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
-    }
-  }
-
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed32(options.flags);
+  w.PutFixed32(options.mode);
+  w.PutFixed32(options.uid);
+  w.PutFixed32(options.gid);
+  PutName(&w, options);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kFcreat), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kFcreat), out);
+    s = CheckReply(out);
     if (s.ok()) {
-      Slice contents = out.contents;
-      if (out.err == -1) {
-        Redirect re(contents.data(), contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(&contents)) {
-        s = Status::Corruption(Slice());
-      } else if (contents.empty()) {
+      MsgReader r(out.contents);
+      r.GetStat(&ret->stat);
+      ret->created = r.GetByte();
+      if (!r.ok()) {
         s = Status::Corruption(Slice());
-      } else {
-        ret->created = contents[0];
       }
     }
   }
@@ -263,156 +429,235 @@ void MDS::RPC::SRV::FCRET(Msg& in, Msg& out) {
   FcreatOptions options;
   FcreatRet ret;
   assert(in.op == kFcreat);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint32(&input, &options.flags) ||
-      !GetVarint32(&input, &options.mode) ||
-      !GetVarint32(&input, &options.uid) ||
-      !GetVarint32(&input, &options.gid) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.flags = r.GetFixed32();
+  options.mode = r.GetFixed32();
+  options.uid = r.GetFixed32();
+  options.gid = r.GetFixed32();
+  GetName(&r, &options);
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
       s = mds_->Fcreat(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
   if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
-    out.buf[out.contents.size()] = static_cast<char>(ret.created);
-    out.contents = Slice(out.buf, out.contents.size() + 1);
+    MsgWriter w(&out);
+    w.PutStat(ret.stat);
+    w.PutByte(ret.created);
+    w.Finish();
     out.err = 0;
   } else {
     out.err = s.err_code();
   }
 }
 
-Status MDS::RPC::CLI::Mkdir(const MkdirOptions& options, MkdirRet* ret) {
-  Status s;
+// Encode the per-name results of a bulk operation. Stats are only encoded
+// for names that succeeded.
+static void PutBulkResults(rpc::If::Message* msg,
+                           const std::vector<Stat>& stats,
+                           const std::vector<int>& errs) {
+  assert(stats.size() == errs.size());
+  MsgWriter w(msg);
+  w.Reserve(4 + errs.size() * (4 + Stat::kFixedEncodedLength));
+  w.PutFixed32(errs.size());
+  for (size_t i = 0; i < errs.size(); i++) {
+    w.PutFixed32(errs[i]);
+    if (errs[i] == 0) {
+      w.PutStat(stats[i]);
+    }
+  }
+  w.Finish();
+}
+
+static bool GetBulkResults(const Slice& input, std::vector<Stat>* stats,
+                           std::vector<int>* errs) {
+  MsgReader r(input);
+  const uint32_t num = r.GetFixed32();
+  // Each result takes at least 4 bytes
+  if (!r.ok() || num > r.remaining() / 4) {
+    return false;
+  }
+  stats->resize(num);
+  errs->resize(num);
+  for (uint32_t i = 0; i < num; i++) {
+    (*errs)[i] = static_cast<int>(r.GetFixed32());
+    if ((*errs)[i] == 0) {
+      r.GetStat(&(*stats)[i]);
+    }
+  }
+  return r.ok();
+}
+
+Status MDS::RPC::CLI::Bulkcreat(const BulkcreatOptions& options,
+                                BulkcreatRet* ret) {
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint32(p, options.flags);
-    p = EncodeVarint32(p, options.mode);
-    p = EncodeVarint32(p, options.uid);
-    p = EncodeVarint32(p, options.gid);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
+  MsgWriter w(&in);
+  // Batches rarely fit into the fixed size buffer
+  w.Reserve(64 + options.names.size());
+  PutBase(&w, options);
+  w.PutFixed32(options.flags);
+  w.PutFixed32(options.mode);
+  w.PutFixed32(options.uid);
+  w.PutFixed32(options.gid);
+  w.PutSlice(options.names);
+  w.Finish();
+  Msg out;
+  Status s = stub_->Call(AddOp(in, kBulkcreat), out);
+  if (s.ok()) {
+    s = CheckReply(out);
+    if (s.ok() && !GetBulkResults(out.contents, &ret->stats, &ret->errs)) {
+      s = Status::Corruption(Slice());
+    }
+  }
+  return s;
+}
+
+void MDS::RPC::SRV::BCRET(Msg& in, Msg& out) {
+  Status s;
+  BulkcreatOptions options;
+  BulkcreatRet ret;
+  assert(in.op == kBulkcreat);
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.flags = r.GetFixed32();
+  options.mode = r.GetFixed32();
+  options.uid = r.GetFixed32();
+  options.gid = r.GetFixed32();
+  options.names = r.GetSlice();
+  if (!r.ok()) {
+    s = Status::InvalidArgument(Slice());
   } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint32(&in.extra_buf, options.flags);
-    PutVarint32(&in.extra_buf, options.mode);
-    PutVarint32(&in.extra_buf, options.uid);
-    PutVarint32(&in.extra_buf, options.gid);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
+    try {
+      s = mds_->Bulkcreat(options, &ret);
+    } catch (Redirect& re) {
+      SetRedirect(out, re);
+      return;
     }
   }
+  if (s.ok()) {
+    PutBulkResults(&out, ret.stats, ret.errs);
+    out.err = 0;
+  } else {
+    out.err = s.err_code();
+  }
+}
 
+Status MDS::RPC::CLI::Bulkstat(const BulkstatOptions& options,
+                               BulkstatRet* ret) {
+  Msg in;
+  MsgWriter w(&in);
+  w.Reserve(64 + options.names.size());
+  PutBase(&w, options);
+  w.PutSlice(options.names);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kBulkstat), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kMkdir), out);
-    if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
-        s = Status::Corruption(Slice());
-      }
+    s = CheckReply(out);
+    if (s.ok() && !GetBulkResults(out.contents, &ret->stats, &ret->errs)) {
+      s = Status::Corruption(Slice());
     }
   }
   return s;
 }
 
-void MDS::RPC::SRV::MKDIR(Msg& in, Msg& out) {
+void MDS::RPC::SRV::BSTAT(Msg& in, Msg& out) {
   Status s;
-  MkdirOptions options;
-  MkdirRet ret;
-  assert(in.op == kMkdir);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint32(&input, &options.flags) ||
-      !GetVarint32(&input, &options.mode) ||
-      !GetVarint32(&input, &options.uid) ||
-      !GetVarint32(&input, &options.gid) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  BulkstatOptions options;
+  BulkstatRet ret;
+  assert(in.op == kBulkstat);
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.names = r.GetSlice();
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
-      s = mds_->Mkdir(options, &ret);
+      s = mds_->Bulkstat(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
   if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
+    PutBulkResults(&out, ret.stats, ret.errs);
     out.err = 0;
   } else {
     out.err = s.err_code();
   }
 }
 
-Status MDS::RPC::CLI::Lookup(const LookupOptions& options, LookupRet* ret) {
-  Status s;
+Status MDS::RPC::CLI::Mkdir(const MkdirOptions& options, MkdirRet* ret) {
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed32(options.flags);
+  w.PutFixed32(options.mode);
+  w.PutFixed32(options.uid);
+  w.PutFixed32(options.gid);
+  PutName(&w, options);
+  w.Finish();
+  Msg out;
+  Status s = stub_->Call(AddOp(in, kMkdir), out);
+  if (s.ok()) {
+    s = GetStatReply(out, &ret->stat);
+  }
+  return s;
+}
+
+void MDS::RPC::SRV::MKDIR(Msg& in, Msg& out) {
+  Status s;
+  MkdirOptions options;
+  MkdirRet ret;
+  assert(in.op == kMkdir);
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.flags = r.GetFixed32();
+  options.mode = r.GetFixed32();
+  options.uid = r.GetFixed32();
+  options.gid = r.GetFixed32();
+  GetName(&r, &options);
+  if (!r.ok()) {
+    s = Status::InvalidArgument(Slice());
   } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
+    try {
+      s = mds_->Mkdir(options, &ret);
+    } catch (Redirect& re) {
+      SetRedirect(out, re);
+      return;
     }
   }
+  SetStatReply(out, s, ret.stat);
+}
 
+Status MDS::RPC::CLI::Lookup(const LookupOptions& options, LookupRet* ret) {
+  Msg in;
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  PutName(&w, options);
+  w.PutByte(options.negative_lease);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kLookup), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kLookup), out);
+    s = CheckReply(out);
     if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
+      MsgReader r(out.contents);
+      r.GetLookupStat(&ret->stat);
+      if (!r.ok()) {
         s = Status::Corruption(Slice());
       }
+    } else if (s.IsNotFound()) {
+      // A negative result may come with a lease due
+      MsgReader r(out.contents);
+      uint64_t due = r.GetFixed64();
+      ret->stat.SetLeaseDue(r.ok() ? due : 0);
     }
   }
   return s;
@@ -423,146 +668,149 @@ void MDS::RPC::SRV::LOKUP(Msg& in, Msg& out) {
   LookupOptions options;
   LookupRet ret;
   assert(in.op == kLookup);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  GetName(&r, &options);
+  options.negative_lease = r.GetByte() != 0;
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
+    ret.stat.SetLeaseDue(0);
     try {
       s = mds_->Lookup(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
   if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
+    MsgWriter w(&out);
+    w.PutLookupStat(ret.stat);
+    w.Finish();
     out.err = 0;
   } else {
+    if (s.IsNotFound() && ret.stat.LeaseDue() != 0) {
+      MsgWriter w(&out);
+      w.PutFixed64(ret.stat.LeaseDue());
+      w.Finish();
+    }
     out.err = s.err_code();
   }
 }
 
-Status MDS::RPC::CLI::Chmod(const ChmodOptions& options, ChmodRet* ret) {
-  Status s;
+Status MDS::RPC::CLI::Resolvepath(const ResolvepathOptions& options,
+                                  ResolvepathRet* ret) {
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint32(p, options.mode);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
-  } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint32(&in.extra_buf, options.mode);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
-    }
-  }
-
+  MsgWriter w(&in);
+  // Long paths may not fit into the fixed size buffer
+  w.Reserve(64 + options.name_hash.size() + options.names.size());
+  PutBase(&w, options);
+  w.PutSlice(options.name_hash);
+  w.PutSlice(options.names);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kResolvepath), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kChmod), out);
+    s = CheckReply(out);
     if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
+      MsgReader r(out.contents);
+      const uint32_t num = r.GetFixed32();
+      if (!r.ok() ||
+          num > r.remaining() / LookupStat::kFixedEncodedLength) {
         s = Status::Corruption(Slice());
+      } else {
+        ret->stats.resize(num);
+        for (uint32_t i = 0; i < num; i++) {
+          r.GetLookupStat(&ret->stats[i]);
+        }
       }
     }
   }
   return s;
 }
 
-void MDS::RPC::SRV::CHMOD(Msg& in, Msg& out) {
+void MDS::RPC::SRV::RSLVP(Msg& in, Msg& out) {
   Status s;
-  ChmodOptions options;
-  ChmodRet ret;
-  assert(in.op == kChmod);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint32(&input, &options.mode) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  ResolvepathOptions options;
+  ResolvepathRet ret;
+  assert(in.op == kResolvepath);
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.name_hash = r.GetSlice();
+  options.names = r.GetSlice();
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
-      s = mds_->Chmod(options, &ret);
+      s = mds_->Resolvepath(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
   if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
+    MsgWriter w(&out);
+    w.Reserve(4 + ret.stats.size() * LookupStat::kFixedEncodedLength);
+    w.PutFixed32(ret.stats.size());
+    for (size_t i = 0; i < ret.stats.size(); i++) {
+      w.PutLookupStat(ret.stats[i]);
+    }
+    w.Finish();
     out.err = 0;
   } else {
     out.err = s.err_code();
   }
 }
 
-Status MDS::RPC::CLI::Chown(const ChownOptions& options, ChownRet* ret) {
-  Status s;
+Status MDS::RPC::CLI::Chmod(const ChmodOptions& options, ChmodRet* ret) {
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint32(p, options.uid);
-    p = EncodeVarint32(p, options.gid);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed32(options.mode);
+  PutName(&w, options);
+  w.Finish();
+  Msg out;
+  Status s = stub_->Call(AddOp(in, kChmod), out);
+  if (s.ok()) {
+    s = GetStatReply(out, &ret->stat);
+  }
+  return s;
+}
+
+void MDS::RPC::SRV::CHMOD(Msg& in, Msg& out) {
+  Status s;
+  ChmodOptions options;
+  ChmodRet ret;
+  assert(in.op == kChmod);
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.mode = r.GetFixed32();
+  GetName(&r, &options);
+  if (!r.ok()) {
+    s = Status::InvalidArgument(Slice());
   } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint32(&in.extra_buf, options.uid);
-    PutVarint32(&in.extra_buf, options.gid);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
+    try {
+      s = mds_->Chmod(options, &ret);
+    } catch (Redirect& re) {
+      SetRedirect(out, re);
+      return;
     }
   }
+  SetStatReply(out, s, ret.stat);
+}
 
+Status MDS::RPC::CLI::Chown(const ChownOptions& options, ChownRet* ret) {
+  Msg in;
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed32(options.uid);
+  w.PutFixed32(options.gid);
+  PutName(&w, options);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kChown), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kChown), out);
-    if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
-        s = Status::Corruption(Slice());
-      }
-    }
+    s = GetStatReply(out, &ret->stat);
   }
   return s;
 }
@@ -572,76 +820,37 @@ void MDS::RPC::SRV::CHOWN(Msg& in, Msg& out) {
   ChownOptions options;
   ChownRet ret;
   assert(in.op == kChown);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint32(&input, &options.uid) ||
-      !GetVarint32(&input, &options.gid) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.uid = r.GetFixed32();
+  options.gid = r.GetFixed32();
+  GetName(&r, &options);
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
       s = mds_->Chown(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
-  if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
-    out.err = 0;
-  } else {
-    out.err = s.err_code();
-  }
+  SetStatReply(out, s, ret.stat);
 }
 
 Status MDS::RPC::CLI::Uperm(const UpermOptions& options, UpermRet* ret) {
-  Status s;
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint32(p, options.mode);
-    p = EncodeVarint32(p, options.uid);
-    p = EncodeVarint32(p, options.gid);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
-  } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint32(&in.extra_buf, options.mode);
-    PutVarint32(&in.extra_buf, options.uid);
-    PutVarint32(&in.extra_buf, options.gid);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
-    }
-  }
-
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed32(options.mode);
+  w.PutFixed32(options.uid);
+  w.PutFixed32(options.gid);
+  PutName(&w, options);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kUperm), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kUperm), out);
-    if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
-        s = Status::Corruption(Slice());
-      }
-    }
+    s = GetStatReply(out, &ret->stat);
   }
   return s;
 }
@@ -651,75 +860,37 @@ void MDS::RPC::SRV::UPERM(Msg& in, Msg& out) {
   UpermOptions options;
   UpermRet ret;
   assert(in.op == kUperm);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint32(&input, &options.mode) ||
-      !GetVarint32(&input, &options.uid) ||
-      !GetVarint32(&input, &options.gid) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.mode = r.GetFixed32();
+  options.uid = r.GetFixed32();
+  options.gid = r.GetFixed32();
+  GetName(&r, &options);
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
       s = mds_->Uperm(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
-  if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
-    out.err = 0;
-  } else {
-    out.err = s.err_code();
-  }
+  SetStatReply(out, s, ret.stat);
 }
 
 Status MDS::RPC::CLI::Utime(const UtimeOptions& options, UtimeRet* ret) {
-  Status s;
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint64(p, options.atime);
-    p = EncodeVarint64(p, options.mtime);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
-  } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint64(&in.extra_buf, options.atime);
-    PutVarint64(&in.extra_buf, options.mtime);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
-    }
-  }
-
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed64(options.atime);
+  w.PutFixed64(options.mtime);
+  PutName(&w, options);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kUtime), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kUtime), out);
-    if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
-        s = Status::Corruption(Slice());
-      }
-    }
+    s = GetStatReply(out, &ret->stat);
   }
   return s;
 }
@@ -729,74 +900,36 @@ void MDS::RPC::SRV::UTIME(Msg& in, Msg& out) {
   UtimeOptions options;
   UtimeRet ret;
   assert(in.op == kUtime);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint64(&input, &options.atime) ||
-      !GetVarint64(&input, &options.mtime) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.atime = r.GetFixed64();
+  options.mtime = r.GetFixed64();
+  GetName(&r, &options);
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
       s = mds_->Utime(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
-  if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
-    out.err = 0;
-  } else {
-    out.err = s.err_code();
-  }
+  SetStatReply(out, s, ret.stat);
 }
 
 Status MDS::RPC::CLI::Trunc(const TruncOptions& options, TruncRet* ret) {
-  Status s;
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint64(p, options.mtime);
-    p = EncodeVarint64(p, options.size);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
-  } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint64(&in.extra_buf, options.mtime);
-    PutVarint64(&in.extra_buf, options.size);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
-    }
-  }
-
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed64(options.mtime);
+  w.PutFixed64(options.size);
+  PutName(&w, options);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kTrunc), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kTrunc), out);
-    if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
-        s = Status::Corruption(Slice());
-      }
-    }
+    s = GetStatReply(out, &ret->stat);
   }
   return s;
 }
@@ -806,72 +939,35 @@ void MDS::RPC::SRV::TRUNC(Msg& in, Msg& out) {
   TruncOptions options;
   TruncRet ret;
   assert(in.op == kTrunc);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint64(&input, &options.mtime) ||
-      !GetVarint64(&input, &options.size) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.mtime = r.GetFixed64();
+  options.size = r.GetFixed64();
+  GetName(&r, &options);
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
       s = mds_->Trunc(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
-  if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
-    out.err = 0;
-  } else {
-    out.err = s.err_code();
-  }
+  SetStatReply(out, s, ret.stat);
 }
 
 Status MDS::RPC::CLI::Unlink(const UnlinkOptions& options, UnlinkRet* ret) {
-  Status s;
   Msg in;
-  if (!kDebugRPC) {
-    char* scratch = &in.buf[0];
-    char* p = scratch;
-    p = EncodeDirId(p, options.dir_id);
-    p = EncodeLengthPrefixedSlice(p, options.name_hash);
-    p = EncodeLengthPrefixedSlice(p, options.name);
-    p = EncodeVarint32(p, options.flags);
-    p = EncodeVarint32(p, options.session_id);
-    p = EncodeVarint64(p, options.op_due);
-    in.contents = Slice(scratch, p - scratch);
-  } else {
-    PutDirId(&in.extra_buf, options.dir_id);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name_hash);
-    PutLengthPrefixedSlice(&in.extra_buf, options.name);
-    PutVarint32(&in.extra_buf, options.flags);
-    PutVarint32(&in.extra_buf, options.session_id);
-    PutVarint64(&in.extra_buf, options.op_due);
-    in.contents = Slice(in.extra_buf);
-    if (in.contents.size() > sizeof(in.buf)) {
-      s = Status::BufferFull(Slice());
-    }
-  }
-
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed32(options.flags);
+  PutName(&w, options);
+  w.Finish();
   Msg out;
+  Status s = stub_->Call(AddOp(in, kUnlink), out);
   if (s.ok()) {
-    s = stub_->Call(AddOp(in, kUnlink), out);
-    if (s.ok()) {
-      if (out.err == -1) {
-        Redirect re(out.contents.data(), out.contents.size());
-        throw re;
-      } else if (out.err != 0) {
-        s = Status::FromCode(out.err);
-      } else if (!ret->stat.DecodeFrom(out.contents)) {
-        s = Status::Corruption(Slice());
-      }
-    }
+    s = GetStatReply(out, &ret->stat);
   }
   return s;
 }
@@ -881,63 +977,71 @@ void MDS::RPC::SRV::UNLNK(Msg& in, Msg& out) {
   UnlinkOptions options;
   UnlinkRet ret;
   assert(in.op == kUnlink);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetLengthPrefixedSlice(&input, &options.name_hash) ||
-      !GetLengthPrefixedSlice(&input, &options.name) ||
-      !GetVarint32(&input, &options.flags) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.flags = r.GetFixed32();
+  GetName(&r, &options);
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     try {
       s = mds_->Unlink(options, &ret);
     } catch (Redirect& re) {
-      out.extra_buf.swap(re);
-      out.contents = Slice(out.extra_buf);
-      out.err = -1;
+      SetRedirect(out, re);
       return;
     }
   }
-  if (s.ok()) {
-    out.contents = ret.stat.EncodeTo(out.buf);
-    out.err = 0;
-  } else {
-    out.err = s.err_code();
-  }
+  SetStatReply(out, s, ret.stat);
 }
 
+// A listdir reply carries the number of entries, the cursor of the next
+// page, followed by all names and then, if requested, all stats.
 Status MDS::RPC::CLI::Listdir(const ListdirOptions& options, ListdirRet* ret) {
-  Status s;
   Msg in;
-  char* scratch = &in.buf[0];
-  char* p = scratch;
-  p = EncodeDirId(p, options.dir_id);
-  p = EncodeVarint32(p, options.session_id);
-  p = EncodeVarint64(p, options.op_due);
-  in.contents = Slice(scratch, p - scratch);
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.PutFixed32(options.limit);
+  w.PutByte(options.with_stats);
+  w.PutSlice(options.start_hash);
+  w.Finish();
   Msg out;
-  s = stub_->Call(AddOp(in, kListdir), out);
+  Status s = stub_->Call(AddOp(in, kListdir), out);
   if (s.ok()) {
     std::vector<std::string>* names = ret->names;
+    std::vector<Stat>* stats = options.with_stats ? ret->stats : NULL;
     if (out.err != 0) {
       s = Status::FromCode(out.err);
     } else {
-      Slice name;
-      Slice encoding = out.contents;
-      if (encoding.size() < 4) {
+      MsgReader r(out.contents);
+      const uint32_t num = r.GetFixed32();
+      ret->has_more = r.GetByte() != 0;
+      Slice last_hash = r.GetSlice();
+      ret->last_hash.assign(last_hash.data(), last_hash.size());
+      // Each name takes at least 4 bytes
+      if (!r.ok() || num > r.remaining() / 4) {
         s = Status::Corruption(Slice());
       } else {
-        uint32_t num = DecodeFixed32(encoding.data() + encoding.size() - 4);
-        encoding.remove_suffix(4);
-        while (num-- != 0) {
-          if (GetLengthPrefixedSlice(&encoding, &name)) {
-            names->push_back(name.ToString());
-          } else {
-            s = Status::Corruption(Slice());
-            break;
+        if (names != NULL) {
+          names->reserve(names->size() + num);
+        }
+        for (uint32_t i = 0; i < num; i++) {
+          Slice name = r.GetSlice();
+          if (names != NULL) {
+            names->push_back(std::string(name.data(), name.size()));
+          }
+        }
+        if (options.with_stats) {
+          Stat stat;
+          for (uint32_t i = 0; i < num; i++) {
+            r.GetStat(&stat);
+            if (stats != NULL) {
+              stats->push_back(stat);
+            }
           }
         }
+        if (!r.ok()) {
+          s = Status::Corruption(Slice());
+        }
       }
     }
   }
@@ -948,29 +1052,38 @@ void MDS::RPC::SRV::LSDIR(Msg& in, Msg& out) {
   Status s;
   ListdirOptions options;
   std::vector<std::string> names;
+  std::vector<Stat> stats;
   ListdirRet ret;
   ret.names = &names;
+  ret.stats = &stats;
   assert(in.op == kListdir);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.limit = r.GetFixed32();
+  options.with_stats = r.GetByte() != 0;
+  options.start_hash = r.GetSlice();
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     s = mds_->Listdir(options, &ret);
   }
   if (s.ok()) {
-    size_t num_entries = 0;
+    MsgWriter w(&out);
+    w.PutFixed32(static_cast<uint32_t>(names.size()));
+    w.PutByte(ret.has_more);
+    w.PutSlice(ret.last_hash);
     for (std::vector<std::string>::iterator it = names.begin();
          it != names.end(); ++it) {
-      PutLengthPrefixedSlice(&out.extra_buf, *it);
-      num_entries++;
-      if (out.extra_buf.size() >= 1000) {
-        break;  // Silently discard rest entries
+      w.PutSlice(*it);
+    }
+    if (options.with_stats) {
+      assert(stats.size() == names.size());
+      for (std::vector<Stat>::iterator it = stats.begin(); it != stats.end();
+           ++it) {
+        w.PutStat(*it);
       }
     }
-    PutFixed32(&out.extra_buf, num_entries);
-    out.contents = Slice(out.extra_buf);
+    w.Finish();
     out.err = 0;
   } else {
     out.err = s.err_code();
@@ -978,21 +1091,17 @@ void MDS::RPC::SRV::LSDIR(Msg& in, Msg& out) {
 }
 
 Status MDS::RPC::CLI::Readidx(const ReadidxOptions& options, ReadidxRet* ret) {
-  Status s;
   Msg in;
-  char* scratch = &in.buf[0];
-  char* p = scratch;
-  p = EncodeDirId(p, options.dir_id);
-  p = EncodeVarint32(p, options.session_id);
-  p = EncodeVarint64(p, options.op_due);
-  in.contents = Slice(scratch, p - scratch);
+  MsgWriter w(&in);
+  PutBase(&w, options);
+  w.Finish();
   Msg out;
-  s = stub_->Call(AddOp(in, kReadidx), out);
+  Status s = stub_->Call(AddOp(in, kReadidx), out);
   if (s.ok()) {
     if (out.err != 0) {
       s = Status::FromCode(out.err);
     } else {
-      ret->idx.assign(out.contents.data(), out.contents.size());
+      TakeContents(out, &ret->idx);
     }
   }
   return s;
@@ -1003,10 +1112,9 @@ void MDS::RPC::SRV::RDIDX(Msg& in, Msg& out) {
   ReadidxOptions options;
   ReadidxRet ret;
   assert(in.op == kReadidx);
-  Slice input = in.contents;
-  if (!GetDirId(&input, &options.dir_id) ||
-      !GetVarint32(&input, &options.session_id) ||
-      !GetVarint64(&input, &options.op_due)) {
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  if (!r.ok()) {
     s = Status::InvalidArgument(Slice());
   } else {
     s = mds_->Readidx(options, &ret);
@@ -1020,6 +1128,48 @@ void MDS::RPC::SRV::RDIDX(Msg& in, Msg& out) {
   }
 }
 
+Status MDS::RPC::CLI::Migrate(const MigrateOptions& options, MigrateRet* ret) {
+  Msg in;
+  MsgWriter w(&in);
+  // Directory entries may not fit into the fixed size buffer
+  w.Reserve(64 + options.idx.size() + options.entries.size());
+  PutBase(&w, options);
+  w.PutFixed32(options.index);
+  w.PutSlice(options.idx);
+  w.PutSlice(options.entries);
+  w.Finish();
+  Msg out;
+  Status s = stub_->Call(AddOp(in, kMigrate), out);
+  if (s.ok()) {
+    if (out.err != 0) {
+      s = Status::FromCode(out.err);
+    }
+  }
+  return s;
+}
+
+void MDS::RPC::SRV::MIGRT(Msg& in, Msg& out) {
+  Status s;
+  MigrateOptions options;
+  MigrateRet ret;
+  assert(in.op == kMigrate);
+  MsgReader r(in.contents);
+  GetBase(&r, &options);
+  options.index = static_cast<int>(r.GetFixed32());
+  options.idx = r.GetSlice();
+  options.entries = r.GetSlice();
+  if (!r.ok()) {
+    s = Status::InvalidArgument(Slice());
+  } else {
+    s = mds_->Migrate(options, &ret);
+  }
+  if (s.ok()) {
+    out.err = 0;
+  } else {
+    out.err = s.err_code();
+  }
+}
+
 Status MDS::RPC::CLI::Opensession(const OpensessionOptions& options,
                                   OpensessionRet* ret) {
   Status s;
@@ -1030,16 +1180,13 @@ Status MDS::RPC::CLI::Opensession(const OpensessionOptions& options,
     if (out.err != 0) {
       s = Status::FromCode(out.err);
     } else {
-      Slice msg = out.contents;
-      Slice env_name;
-      Slice env_conf;
-      Slice fio_name;
-      Slice fio_conf;
-      uint32_t id;
-      if (!GetLengthPrefixedSlice(&msg, &env_name) ||
-          !GetLengthPrefixedSlice(&msg, &env_conf) ||
-          !GetLengthPrefixedSlice(&msg, &fio_name) ||
-          !GetLengthPrefixedSlice(&msg, &fio_conf) || !GetVarint32(&msg, &id)) {
+      MsgReader r(out.contents);
+      Slice env_name = r.GetSlice();
+      Slice env_conf = r.GetSlice();
+      Slice fio_name = r.GetSlice();
+      Slice fio_conf = r.GetSlice();
+      uint32_t id = r.GetFixed32();
+      if (!r.ok()) {
         s = Status::Corruption(Slice());
       } else {
         ret->env_name = env_name.ToString();
@@ -1060,12 +1207,13 @@ void MDS::RPC::SRV::OPSES(Msg& in, Msg& out) {
   assert(in.op == kOpensession);
   s = mds_->Opensession(options, &ret);
   if (s.ok()) {
-    PutLengthPrefixedSlice(&out.extra_buf, ret.env_name);
-    PutLengthPrefixedSlice(&out.extra_buf, ret.env_conf);
-    PutLengthPrefixedSlice(&out.extra_buf, ret.fio_name);
-    PutLengthPrefixedSlice(&out.extra_buf, ret.fio_conf);
-    PutVarint32(&out.extra_buf, ret.session_id);
-    out.contents = Slice(out.extra_buf);
+    MsgWriter w(&out);
+    w.PutSlice(ret.env_name);
+    w.PutSlice(ret.env_conf);
+    w.PutSlice(ret.fio_name);
+    w.PutSlice(ret.fio_conf);
+    w.PutFixed32(ret.session_id);
+    w.Finish();
     out.err = 0;
   } else {
     out.err = s.err_code();
@@ -1082,13 +1230,7 @@ Status MDS::RPC::CLI::Getinput(const GetinputOptions& options,
     if (out.err != 0) {
       s = Status::FromCode(out.err);
     } else {
-      Slice msg = out.contents;
-      Slice info;
-      if (!GetLengthPrefixedSlice(&msg, &info)) {
-        s = Status::Corruption(Slice());
-      } else {
-        ret->info = info.ToString();
-      }
+      TakeContents(out, &ret->info);
     }
   }
   return s;
@@ -1101,7 +1243,7 @@ void MDS::RPC::SRV::GINPT(Msg& in, Msg& out) {
   assert(in.op == kGetinput);
   s = mds_->Getinput(options, &ret);
   if (s.ok()) {
-    PutLengthPrefixedSlice(&out.extra_buf, ret.info);
+    out.extra_buf.swap(ret.info);
     out.contents = Slice(out.extra_buf);
     out.err = 0;
   } else {
@@ -1119,13 +1261,7 @@ Status MDS::RPC::CLI::Getoutput(const GetoutputOptions& options,
     if (out.err != 0) {
       s = Status::FromCode(out.err);
     } else {
-      Slice msg = out.contents;
-      Slice info;
-      if (!GetLengthPrefixedSlice(&msg, &info)) {
-        s = Status::Corruption(Slice());
-      } else {
-        ret->info = info.ToString();
-      }
+      TakeContents(out, &ret->info);
     }
   }
   return s;
@@ -1138,7 +1274,7 @@ void MDS::RPC::SRV::GOUPT(Msg& in, Msg& out) {
   assert(in.op == kGetoutput);
   s = mds_->Getoutput(options, &ret);
   if (s.ok()) {
-    PutLengthPrefixedSlice(&out.extra_buf, ret.info);
+    out.extra_buf.swap(ret.info);
     out.contents = Slice(out.extra_buf);
     out.err = 0;
   } else {
@@ -1157,8 +1293,12 @@ void PseudoConcurrentMDSMonitor::Reset() {
   Reset_Trunc_count();
   Reset_Unlink_count();
   Reset_Lookup_count();
+  Reset_Resolvepath_count();
+  Reset_Bulkcreat_count();
+  Reset_Bulkstat_count();
   Reset_Listdir_count();
   Reset_Readidx_count();
+  Reset_Migrate_count();
 }
 
 void SimpleMDSMonitor::Reset() {
@@ -1172,8 +1312,12 @@ void SimpleMDSMonitor::Reset() {
   Reset_Trunc_count();
   Reset_Unlink_count();
   Reset_Lookup_count();
+  Reset_Resolvepath_count();
+  Reset_Bulkcreat_count();
+  Reset_Bulkstat_count();
   Reset_Listdir_count();
   Reset_Readidx_count();
+  Reset_Migrate_count();
 }
 
 }  // namespace pdlfs
@@ -25,6 +25,7 @@ namespace pdlfs {
 class Env;
 class Fio;
 class MDB;
+class MDSFactory;
 
 #define DELTAFS_MAX_MICROS ((uint64_t(1) << 63) - 1) /* Max future */
 
@@ -58,6 +59,22 @@ struct MDSOptions {
   uint64_t snap_id;
   uint64_t reg_id;
   bool paranoid_checks;
+  // Merge concurrent file and directory creations against the same parent
+  // directory into a single transaction so that they are committed
+  // to the DB using a single write
+  bool group_commit;
+  // Number of partitions the directory and lease tables are split into.
+  // Each partition is protected by its own lock so that operations against
+  // different parent directories can proceed in parallel
+  size_t num_shards;
+  // Start new directories on their zeroth servers and split a directory
+  // partition once it holds more than this number of entries. Set to "0"
+  // to disable dynamic splitting and pre-split new directories to all
+  // servers. All servers must use the same setting.
+  size_t split_threshold;
+  // Access to other metadata servers for migrating directory entries
+  // during splits. Splits will only occur locally if this is NULL.
+  MDSFactory* peers;
   int num_virtual_servers;
   int num_servers;
   int srv_id;
@@ -105,6 +122,33 @@ class MDS {
   };
   MDS_OP(Fcreat)
 
+  // Create a batch of regular files under a single parent directory. Names
+  // are encoded as a sequence of length-prefixed strings and must all be
+  // stored by the current server. The outcome of each name is reported
+  // through errs, with zero indicating success, along with the resulting
+  // file stats. Return a non-OK status only if the batch as a whole fails.
+  MDS_OP_OPTIONS(Bulkcreat) {
+    Slice names;
+    uint32_t flags;
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+  };
+  MDS_OP_RET(Bulkcreat) {
+    std::vector<Stat> stats;
+    std::vector<int> errs;
+  };
+  MDS_OP(Bulkcreat)
+
+  // Read the stats of a batch of files or directories under a single
+  // parent directory. Names are encoded the same way as in Bulkcreat.
+  MDS_OP_OPTIONS(Bulkstat) { Slice names; };
+  MDS_OP_RET(Bulkstat) {
+    std::vector<Stat> stats;
+    std::vector<int> errs;
+  };
+  MDS_OP(Bulkstat)
+
   MDS_OP_OPTIONS(Mkdir) {
     uint32_t flags;
     uint32_t mode;
@@ -151,18 +195,62 @@ class MDS {
   MDS_OP_RET(Unlink) { Stat stat; };
   MDS_OP(Unlink)
 
-  MDS_OP_OPTIONS(Lookup){};
+  // If negative_lease is set and the name does not exist, the server may
+  // still return a lease due in stat, until which the caller may cache
+  // the absence of the name.
+  MDS_OP_OPTIONS(Lookup) {
+    LookupOptions() : negative_lease(false) {}
+    bool negative_lease;
+  };
   MDS_OP_RET(Lookup) { LookupStat stat; };
   MDS_OP(Lookup)
 
-  MDS_OP_OPTIONS(Listdir){};
-  MDS_OP_RET(Listdir) { std::vector<std::string>* names; };
+  // Look up a chain of directories starting from the parent directory.
+  // Names are encoded as a sequence of length-prefixed strings, and name_hash
+  // is the hash of the first name. The server looks up names one after
+  // another until it reaches a name not stored by it, and returns the
+  // lookup states of all names resolved so far.
+  MDS_OP_OPTIONS(Resolvepath) { Slice names; };
+  MDS_OP_RET(Resolvepath) { std::vector<LookupStat> stats; };
+  MDS_OP(Resolvepath)
+
+  // List a page of the entries stored by a server under a directory in the
+  // order of their name hashes, starting after the entry whose hash is
+  // start_hash, or from the first entry if start_hash is empty. At most
+  // "limit" entries are returned, and a server may return fewer to keep
+  // the page small. A "limit" of 0 lets the server pick a page size.
+  // Stats are returned along with names if with_stats is set and stats is
+  // not NULL. If has_more is set, the next page starts after last_hash.
+  MDS_OP_OPTIONS(Listdir) {
+    ListdirOptions() : limit(0), with_stats(false) {}
+    Slice start_hash;
+    uint32_t limit;
+    bool with_stats;
+  };
+  MDS_OP_RET(Listdir) {
+    ListdirRet() : names(NULL), stats(NULL), has_more(false) {}
+    std::vector<std::string>* names;
+    std::vector<Stat>* stats;
+    std::string last_hash;
+    bool has_more;
+  };
   MDS_OP(Listdir)
 
   MDS_OP_OPTIONS(Readidx){};
   MDS_OP_RET(Readidx) { std::string idx; };
   MDS_OP(Readidx)
 
+  // Install a new directory partition, along with all its entries,
+  // moved from another server when that server splits a partition.
+  // Invoked by metadata servers, not clients.
+  MDS_OP_OPTIONS(Migrate) {
+    int index;      // The new partition
+    Slice idx;      // Directory index after the split
+    Slice entries;  // Encoded directory entries of the new partition
+  };
+  MDS_OP_RET(Migrate) {};
+  MDS_OP(Migrate)
+
   // -------------
   // MDS admin interface
   // -------------
@@ -219,6 +307,8 @@ class MDSWrapper : public MDS {
 
   DEF_OP(Fstat)
   DEF_OP(Fcreat)
+  DEF_OP(Bulkcreat)
+  DEF_OP(Bulkstat)
   DEF_OP(Mkdir)
   DEF_OP(Chmod)
   DEF_OP(Chown)
@@ -227,8 +317,10 @@ class MDSWrapper : public MDS {
   DEF_OP(Trunc)
   DEF_OP(Unlink)
   DEF_OP(Lookup)
+  DEF_OP(Resolvepath)
   DEF_OP(Listdir)
   DEF_OP(Readidx)
+  DEF_OP(Migrate)
   DEF_OP(Opensession)
   DEF_OP(Getinput)
   DEF_OP(Getoutput)
@@ -263,6 +355,8 @@ class SimpleMDSMonitor : public MDSWrapper {
 
   DEF_OP(Fstat)
   DEF_OP(Fcreat)
+  DEF_OP(Bulkcreat)
+  DEF_OP(Bulkstat)
   DEF_OP(Mkdir)
   DEF_OP(Chmod)
   DEF_OP(Chown)
@@ -271,8 +365,10 @@ class SimpleMDSMonitor : public MDSWrapper {
   DEF_OP(Trunc)
   DEF_OP(Unlink)
   DEF_OP(Lookup)
+  DEF_OP(Resolvepath)
   DEF_OP(Listdir)
   DEF_OP(Readidx)
+  DEF_OP(Migrate)
 
 #undef DEF_OP
 
@@ -316,6 +412,8 @@ class PseudoConcurrentMDSMonitor : public MDSWrapper {
 
   DEF_OP(Fstat)
   DEF_OP(Fcreat)
+  DEF_OP(Bulkcreat)
+  DEF_OP(Bulkstat)
   DEF_OP(Mkdir)
   DEF_OP(Chmod)
   DEF_OP(Chown)
@@ -324,8 +422,10 @@ class PseudoConcurrentMDSMonitor : public MDSWrapper {
   DEF_OP(Trunc)
   DEF_OP(Unlink)
   DEF_OP(Lookup)
+  DEF_OP(Resolvepath)
   DEF_OP(Listdir)
   DEF_OP(Readidx)
+  DEF_OP(Migrate)
 
 #undef DEF_OP
 
@@ -372,6 +472,8 @@ class MDSTracer : public MDSWrapper {
   DEF_OP(Getoutput)
   DEF_OP(Fstat)
   DEF_OP(Fcreat)
+  DEF_OP(Bulkcreat)
+  DEF_OP(Bulkstat)
   DEF_OP(Mkdir)
   DEF_OP(Chmod)
   DEF_OP(Chown)
@@ -380,8 +482,10 @@ class MDSTracer : public MDSWrapper {
   DEF_OP(Trunc)
   DEF_OP(Unlink)
   DEF_OP(Lookup)
+  DEF_OP(Resolvepath)
   DEF_OP(Listdir)
   DEF_OP(Readidx)
+  DEF_OP(Migrate)
 
 #undef DEF_OP
 
@@ -406,6 +510,8 @@ class MDS::RPC::CLI : public MDS {
 
   DEC_OP(Fstat)
   DEC_OP(Fcreat)
+  DEC_OP(Bulkcreat)
+  DEC_OP(Bulkstat)
   DEC_OP(Mkdir)
   DEC_OP(Chmod)
   DEC_OP(Chown)
@@ -414,8 +520,10 @@ class MDS::RPC::CLI : public MDS {
   DEC_OP(Trunc)
   DEC_OP(Unlink)
   DEC_OP(Lookup)
+  DEC_OP(Resolvepath)
   DEC_OP(Listdir)
   DEC_OP(Readidx)
+  DEC_OP(Migrate)
   DEC_OP(Opensession)
   DEC_OP(Getinput)
   DEC_OP(Getoutput)
@@ -440,6 +548,8 @@ class MDS::RPC::SRV : public rpc::If {
   DEC_RPC(FSTAT)
   DEC_RPC(MKDIR)
   DEC_RPC(FCRET)
+  DEC_RPC(BCRET)
+  DEC_RPC(BSTAT)
   DEC_RPC(CHMOD)
   DEC_RPC(CHOWN)
   DEC_RPC(UPERM)
@@ -447,8 +557,10 @@ class MDS::RPC::SRV : public rpc::If {
   DEC_RPC(TRUNC)
   DEC_RPC(UNLNK)
   DEC_RPC(LOKUP)
+  DEC_RPC(RSLVP)
   DEC_RPC(LSDIR)
   DEC_RPC(RDIDX)
+  DEC_RPC(MIGRT)
   DEC_RPC(OPSES)
   DEC_RPC(GINPT)
   DEC_RPC(GOUPT)
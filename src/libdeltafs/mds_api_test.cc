@@ -7,7 +7,13 @@
  * found in the LICENSE file. See the AUTHORS file for names of contributors.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
 #include "mds_api.h"
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/gigaplus.h"
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 
@@ -90,8 +96,519 @@ TEST(APITest<FstatWrapper>, FstatException) {
   ASSERT_TRUE(false) << "No exception!";
 }
 
+class MigrateWrapper : public MDSWrapper {
+ public:
+  MigrateOptions options_;
+  MigrateRet ret_;
+  Status status_;
+  virtual Status Migrate(const MigrateOptions& options, MigrateRet* ret) {
+    ASSERT_TRUE(options.dir_id.compare(options_.dir_id) == 0);
+    ASSERT_EQ(options.index, options_.index);
+    ASSERT_EQ(options.idx, options_.idx);
+    ASSERT_EQ(options.entries, options_.entries);
+    return status_;
+  }
+};
+
+TEST(APITest<MigrateWrapper>, Migrate) {
+  t_opts_.dir_id = DirId(31, 13, 301);
+  t_opts_.index = 5;
+  t_opts_.idx = "xyz";
+  // Larger than what fits in a fixed size rpc message buffer
+  std::string entries(4000, 'e');
+  t_opts_.entries = entries;
+  t_status_ = Status::TryAgain(Slice());
+  Status s = mds_->Migrate(t_opts_, &t_ret_);
+  ASSERT_TRUE(s.IsTryAgain());
+  t_status_ = Status::OK();
+  ASSERT_OK(mds_->Migrate(t_opts_, &t_ret_));
+}
+
+class ResolvepathWrapper : public MDSWrapper {
+ public:
+  ResolvepathOptions options_;
+  ResolvepathRet ret_;
+  Status status_;
+  virtual Status Resolvepath(const ResolvepathOptions& options,
+                             ResolvepathRet* ret) {
+    ASSERT_TRUE(options.dir_id.compare(options_.dir_id) == 0);
+    ASSERT_EQ(options.name_hash, options_.name_hash);
+    ASSERT_EQ(options.names, options_.names);
+    *ret = ret_;
+    return status_;
+  }
+};
+
+TEST(APITest<ResolvepathWrapper>, Resolvepath) {
+  t_opts_.dir_id = DirId(31, 13, 301);
+  t_opts_.name_hash = "aabbccdd";
+  std::string names;
+  for (int i = 0; i < 200; i++) {
+    PutLengthPrefixedSlice(&names, "abcdefghijklmnopqrstuvwxyz");
+  }
+  t_opts_.names = names;
+  for (int i = 0; i < 100; i++) {
+    LookupStat stat;
+    stat.SetInodeNo(1000 + i);
+    stat.SetDirMode(S_IFDIR | 0755);
+    stat.SetZerothServer(i);
+    stat.SetUserId(11);
+    stat.SetGroupId(4);
+    stat.SetLeaseDue(12345);
+    t_ret_.stats.push_back(stat);
+  }
+  MDS::ResolvepathRet ret;
+  ASSERT_OK(mds_->Resolvepath(t_opts_, &ret));
+  ASSERT_EQ(ret.stats.size(), 100);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(ret.stats[i].InodeNo(), 1000 + i);
+    ASSERT_EQ(ret.stats[i].DirMode(), S_IFDIR | 0755);
+    ASSERT_EQ(ret.stats[i].ZerothServer(), i);
+    ASSERT_EQ(ret.stats[i].LeaseDue(), 12345);
+  }
+  t_status_ = Status::NotFound(Slice());
+  ASSERT_TRUE(mds_->Resolvepath(t_opts_, &ret).IsNotFound());
+}
+
+class BulkcreatWrapper : public MDSWrapper {
+ public:
+  BulkcreatOptions options_;
+  BulkcreatRet ret_;
+  Status status_;
+  virtual Status Bulkcreat(const BulkcreatOptions& options,
+                           BulkcreatRet* ret) {
+    ASSERT_TRUE(options.dir_id.compare(options_.dir_id) == 0);
+    ASSERT_EQ(options.names, options_.names);
+    ASSERT_EQ(options.flags, options_.flags);
+    ASSERT_EQ(options.mode, options_.mode);
+    *ret = ret_;
+    return status_;
+  }
+};
+
+TEST(APITest<BulkcreatWrapper>, Bulkcreat) {
+  t_opts_.dir_id = DirId(31, 13, 301);
+  std::string names;
+  for (int i = 0; i < 500; i++) {
+    PutLengthPrefixedSlice(&names, "abcdefghijklmnopqrstuvwxyz");
+  }
+  t_opts_.names = names;
+  t_opts_.flags = 1;
+  t_opts_.mode = 0644;
+  t_opts_.uid = t_opts_.gid = 0;
+  for (int i = 0; i < 500; i++) {
+    Stat stat;
+    stat.SetInodeNo(1000 + i);
+    stat.SetFileMode(S_IFREG | 0644);
+    stat.SetFileSize(0);
+    stat.SetZerothServer(0);
+    stat.SetUserId(11);
+    stat.SetGroupId(4);
+    stat.SetModifyTime(1);
+    stat.SetChangeTime(2);
+    t_ret_.stats.push_back(stat);
+    t_ret_.errs.push_back(i % 3 == 0 ? Status::kAlreadyExists : 0);
+  }
+  MDS::BulkcreatRet ret;
+  ASSERT_OK(mds_->Bulkcreat(t_opts_, &ret));
+  ASSERT_EQ(ret.errs.size(), 500);
+  for (int i = 0; i < 500; i++) {
+    ASSERT_EQ(ret.errs[i], t_ret_.errs[i]);
+    if (ret.errs[i] == 0) {
+      ASSERT_EQ(ret.stats[i].InodeNo(), 1000 + i);
+      ASSERT_EQ(ret.stats[i].FileMode(), S_IFREG | 0644);
+    }
+  }
+  t_status_ = Status::NotFound(Slice());
+  ASSERT_TRUE(mds_->Bulkcreat(t_opts_, &ret).IsNotFound());
+}
+
+class ListdirWrapper : public MDSWrapper {
+ public:
+  ListdirOptions options_;
+  std::vector<std::string> names_;
+  std::vector<Stat> stats_;
+  std::string last_hash_;
+  bool has_more_;
+  Status status_;
+  virtual Status Listdir(const ListdirOptions& options, ListdirRet* ret) {
+    ASSERT_TRUE(options.dir_id.compare(options_.dir_id) == 0);
+    ASSERT_EQ(options.session_id, options_.session_id);
+    ASSERT_EQ(options.start_hash, options_.start_hash);
+    ASSERT_EQ(options.limit, options_.limit);
+    ASSERT_EQ(options.with_stats, options_.with_stats);
+    ret->names->insert(ret->names->end(), names_.begin(), names_.end());
+    if (options.with_stats) {
+      ret->stats->insert(ret->stats->end(), stats_.begin(), stats_.end());
+    }
+    ret->last_hash = last_hash_;
+    ret->has_more = has_more_;
+    return status_;
+  }
+};
+
+TEST(APITest<ListdirWrapper>, Listdir) {
+  t_opts_.dir_id = DirId(31, 13, 301);
+  t_opts_.session_id = 7;
+  t_opts_.start_hash = "aabbccdd";
+  t_opts_.limit = 3;
+  target_.names_.push_back("a");
+  target_.names_.push_back("");
+  target_.names_.push_back("bb");
+  target_.last_hash_ = "ddccbbaa";
+  target_.has_more_ = true;
+  std::vector<std::string> names;
+  names.push_back("x");
+  MDS::ListdirRet ret;
+  ret.names = &names;
+  ASSERT_OK(mds_->Listdir(t_opts_, &ret));
+  ASSERT_EQ(names.size(), 4);
+  ASSERT_EQ(names[1], "a");
+  ASSERT_EQ(names[2], "");
+  ASSERT_EQ(names[3], "bb");
+  ASSERT_EQ(ret.last_hash, "ddccbbaa");
+  ASSERT_TRUE(ret.has_more);
+  // Pages are never truncated in transit
+  target_.names_.assign(1000, "abcdefghijklmnopqrstuvwxyz");
+  target_.has_more_ = false;
+  names.clear();
+  ASSERT_OK(mds_->Listdir(t_opts_, &ret));
+  ASSERT_EQ(names.size(), 1000);
+  ASSERT_EQ(names.back(), "abcdefghijklmnopqrstuvwxyz");
+  ASSERT_FALSE(ret.has_more);
+}
+
+TEST(APITest<ListdirWrapper>, Listdirplus) {
+  t_opts_.dir_id = DirId(31, 13, 301);
+  t_opts_.with_stats = true;
+  for (int i = 0; i < 3; i++) {
+    Stat stat;
+    stat.SetInodeNo(100 + i);
+    stat.SetFileSize(i);
+    stat.SetFileMode(S_IFREG | 0644);
+    target_.stats_.push_back(stat);
+    target_.names_.push_back(std::string(i + 1, 'a'));
+  }
+  target_.has_more_ = false;
+  std::vector<std::string> names;
+  std::vector<Stat> stats;
+  MDS::ListdirRet ret;
+  ret.names = &names;
+  ret.stats = &stats;
+  ASSERT_OK(mds_->Listdir(t_opts_, &ret));
+  ASSERT_EQ(names.size(), 3);
+  ASSERT_EQ(stats.size(), 3);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(names[i], std::string(i + 1, 'a'));
+    ASSERT_EQ(stats[i].InodeNo(), 100 + i);
+    ASSERT_EQ(stats[i].FileSize(), i);
+  }
+  t_status_ = Status::NotFound(Slice());
+  ASSERT_TRUE(mds_->Listdir(t_opts_, &ret).IsNotFound());
+}
+
+class LookupWrapper : public MDSWrapper {
+ public:
+  LookupOptions options_;
+  LookupRet ret_;
+  Status status_;
+  virtual Status Lookup(const LookupOptions& options, LookupRet* ret) {
+    ASSERT_TRUE(options.dir_id.compare(options_.dir_id) == 0);
+    ASSERT_EQ(options.name_hash, options_.name_hash);
+    ASSERT_EQ(options.negative_lease, options_.negative_lease);
+    ret->stat.SetLeaseDue(ret_.stat.LeaseDue());
+    return status_;
+  }
+};
+
+TEST(APITest<LookupWrapper>, NegativeLease) {
+  t_opts_.dir_id = DirId(31, 13, 301);
+  t_opts_.name_hash = "aabbccdd";
+  t_opts_.negative_lease = true;
+  t_ret_.stat.SetLeaseDue(12345);
+  t_status_ = Status::NotFound(Slice());
+  MDS::LookupRet ret;
+  ret.stat.SetLeaseDue(0);
+  ASSERT_TRUE(mds_->Lookup(t_opts_, &ret).IsNotFound());
+  ASSERT_EQ(ret.stat.LeaseDue(), 12345);
+  t_opts_.negative_lease = false;
+  t_ret_.stat.SetLeaseDue(0);
+  ASSERT_TRUE(mds_->Lookup(t_opts_, &ret).IsNotFound());
+  ASSERT_EQ(ret.stat.LeaseDue(), 0);
+}
+
+class PickupServerTest {};
+
+TEST(PickupServerTest, NonNegative) {
+  char tmp[30];
+  for (uint64_t ino = 0; ino < 1000; ino++) {
+    DirId id(0, 0, ino);
+    int zserver = MDS::PickupServer(id);
+    ASSERT_TRUE(zserver >= 0);
+    ASSERT_EQ(zserver, DirIndex::RandomServer(MDS::EncodeId(id, tmp), 0));
+    ASSERT_EQ(zserver, MDS::PickupServer(id));  // Deterministic
+    for (int n = 1; n <= 17; n++) {
+      ASSERT_TRUE(zserver % n >= 0 && zserver % n < n);
+    }
+  }
+}
+
+// A metadata server that returns canned results for every op.
+class CannedMDS : public MDSWrapper {
+ public:
+  CannedMDS(int batch_size) {
+    stat_.SetInodeNo(1000);
+    stat_.SetFileMode(S_IFREG | 0644);
+    stat_.SetFileSize(4096);
+    stat_.SetZerothServer(3);
+    stat_.SetUserId(11);
+    stat_.SetGroupId(4);
+    stat_.SetModifyTime(12345);
+    stat_.SetChangeTime(12345);
+    lstat_.SetInodeNo(1000);
+    lstat_.SetDirMode(S_IFDIR | 0755);
+    lstat_.SetZerothServer(3);
+    lstat_.SetUserId(11);
+    lstat_.SetGroupId(4);
+    lstat_.SetLeaseDue(12345);
+    stats_.assign(batch_size, stat_);
+    errs_.assign(batch_size, 0);
+    lstats_.assign(batch_size, lstat_);
+    for (int i = 0; i < batch_size; i++) {
+      names_.push_back("abcdefghijklmnop");
+    }
+    idx_.assign(64, 'x');
+  }
+
+#define CANNED_STAT_OP(OP)                                      \
+  virtual Status OP(const OP##Options& options, OP##Ret* ret) { \
+    ret->stat = stat_;                                          \
+    return Status::OK();                                        \
+  }
+
+  CANNED_STAT_OP(Fstat)
+  CANNED_STAT_OP(Mkdir)
+  CANNED_STAT_OP(Chmod)
+  CANNED_STAT_OP(Chown)
+  CANNED_STAT_OP(Uperm)
+  CANNED_STAT_OP(Utime)
+  CANNED_STAT_OP(Trunc)
+  CANNED_STAT_OP(Unlink)
+
+#undef CANNED_STAT_OP
+
+  virtual Status Lookup(const LookupOptions& options, LookupRet* ret) {
+    ret->stat = lstat_;
+    return Status::OK();
+  }
+
+  virtual Status Fcreat(const FcreatOptions& options, FcreatRet* ret) {
+    ret->stat = stat_;
+    ret->created = 1;
+    return Status::OK();
+  }
+
+  virtual Status Bulkcreat(const BulkcreatOptions& options,
+                           BulkcreatRet* ret) {
+    ret->stats = stats_;
+    ret->errs = errs_;
+    return Status::OK();
+  }
+
+  virtual Status Bulkstat(const BulkstatOptions& options, BulkstatRet* ret) {
+    ret->stats = stats_;
+    ret->errs = errs_;
+    return Status::OK();
+  }
+
+  virtual Status Resolvepath(const ResolvepathOptions& options,
+                             ResolvepathRet* ret) {
+    ret->stats = lstats_;
+    return Status::OK();
+  }
+
+  virtual Status Listdir(const ListdirOptions& options, ListdirRet* ret) {
+    *ret->names = names_;
+    return Status::OK();
+  }
+
+  virtual Status Readidx(const ReadidxOptions& options, ReadidxRet* ret) {
+    ret->idx = idx_;
+    return Status::OK();
+  }
+
+ private:
+  Stat stat_;
+  LookupStat lstat_;
+  std::vector<Stat> stats_;
+  std::vector<int> errs_;
+  std::vector<LookupStat> lstats_;
+  std::vector<std::string> names_;
+  std::string idx_;
+};
+
+// Measure the cost of encoding and decoding each MDS op, with a client
+// directly calling a server in the same address space. Each call encodes
+// the request, decodes it at the server, encodes the reply, and decodes
+// the reply at the client.
+class CodecBench {
+ public:
+  static int GetOption(const char* key, int def) {
+    const char* env = getenv(key);
+    if (env == NULL || env[0] == 0) {
+      return def;
+    } else {
+      return atoi(env);
+    }
+  }
+
+  CodecBench()
+      : num_ops_(GetOption("CODEC_OPS", 1000000)),
+        batch_size_(GetOption("CODEC_BATCH_SIZE", 16)),
+        mds_(batch_size_) {
+    srv_ = new MDS::RPC::SRV(&mds_);
+    cli_ = new MDS::RPC::CLI(srv_);
+    for (int i = 0; i < batch_size_; i++) {
+      PutLengthPrefixedSlice(&names_, "abcdefghijklmnop");
+    }
+  }
+
+  ~CodecBench() {
+    delete cli_;
+    delete srv_;
+  }
+
+  void Run() {
+    fprintf(stderr, "%d ops, batch size %d\n", num_ops_, batch_size_);
+#define BENCH_OP(OP)                    \
+  {                                     \
+    MDS::OP##Options options;           \
+    Init(&options);                     \
+    MDS::OP##Ret ret;                   \
+    Time(#OP, &MDS::OP, options, &ret); \
+  }
+    BENCH_OP(Fstat)
+    BENCH_OP(Fcreat)
+    BENCH_OP(Mkdir)
+    BENCH_OP(Chmod)
+    BENCH_OP(Chown)
+    BENCH_OP(Uperm)
+    BENCH_OP(Utime)
+    BENCH_OP(Trunc)
+    BENCH_OP(Unlink)
+    BENCH_OP(Lookup)
+    BENCH_OP(Resolvepath)
+    BENCH_OP(Bulkcreat)
+    BENCH_OP(Bulkstat)
+    BENCH_OP(Readidx)
+#undef BENCH_OP
+    std::vector<std::string> names;
+    MDS::ListdirOptions options;
+    Init(&options);
+    MDS::ListdirRet ret;
+    ret.names = &names;
+    Time("Listdir", &MDS::Listdir, options, &ret);
+  }
+
+ private:
+  void Init(MDS::BaseOptions* options) {
+    options->dir_id = DirId(31, 13, 301);
+    options->session_id = 1;
+    options->op_due = 12345;
+    options->name_hash = "aabbccdd";
+    options->name = "abcdefghijklmnop";
+  }
+
+  void Init(MDS::FcreatOptions* options) {
+    Init(static_cast<MDS::BaseOptions*>(options));
+    options->flags = 0;
+    options->mode = 0644;
+    options->uid = 11;
+    options->gid = 4;
+  }
+
+  void Init(MDS::BulkcreatOptions* options) {
+    Init(static_cast<MDS::BaseOptions*>(options));
+    options->names = names_;
+    options->flags = 0;
+    options->mode = 0644;
+    options->uid = 11;
+    options->gid = 4;
+  }
+
+  void Init(MDS::BulkstatOptions* options) {
+    Init(static_cast<MDS::BaseOptions*>(options));
+    options->names = names_;
+  }
+
+  void Init(MDS::ResolvepathOptions* options) {
+    Init(static_cast<MDS::BaseOptions*>(options));
+    options->names = names_;
+  }
+
+  // Listing results are appended to the caller's vector
+  static void Reset(MDS::ListdirRet* ret) { ret->names->clear(); }
+  template <typename R>
+  static void Reset(R* ret) {}
+
+  template <typename O, typename R>
+  void Time(const char* name, Status (MDS::*op)(const O&, R*),
+            const O& options, R* ret) {
+    Env* const env = Env::Default();
+    const uint64_t start = env->NowMicros();
+    for (int i = 0; i < num_ops_; i++) {
+      Reset(ret);
+      Status s = (cli_->*op)(options, ret);
+      if (!s.ok()) {
+        fprintf(stderr, "%s: %s\n", name, s.ToString().c_str());
+        return;
+      }
+    }
+    const uint64_t dura = env->NowMicros() - start;
+    fprintf(stderr, "%-12s: %10.1f ns/op\n", name,
+            1e3 * dura / (num_ops_ ? num_ops_ : 1));
+  }
+
+  int num_ops_;
+  int batch_size_;
+  CannedMDS mds_;
+  std::string names_;
+  rpc::If* srv_;
+  MDS* cli_;
+};
+
 }  // namespace pdlfs
 
-int main(int argc, char** argv) {
-  return ::pdlfs::test::RunAllTests(&argc, &argv);
+static void BM_Usage() {
+  fprintf(stderr, "Use --bench=codec to run benchmark.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options (via env vars):\n");
+  fprintf(stderr, "  CODEC_OPS         calls issued per op type (1000000)\n");
+  fprintf(stderr, "  CODEC_BATCH_SIZE  names per batched op (16)\n");
+}
+
+static void BM_Main(int* argc, char*** argv) {
+  pdlfs::Slice bench_name;
+  if (*argc > 1) {
+    bench_name = pdlfs::Slice((*argv)[*argc - 1]);
+  }
+  if (bench_name == "--bench=codec") {
+    pdlfs::CodecBench bench;
+    bench.Run();
+  } else {
+    BM_Usage();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  pdlfs::Slice token;
+  if (argc > 1) {
+    token = pdlfs::Slice(argv[argc - 1]);
+  }
+  if (!token.starts_with("--bench")) {
+    return ::pdlfs::test::RunAllTests(&argc, &argv);
+  } else {
+    BM_Main(&argc, &argv);
+    return 0;
+  }
 }
@@ -11,8 +11,12 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <algorithm>
+#include <deque>
+#include <map>
 #include <set>
 
+#include "pdlfs-common/coding.h"
 #include "pdlfs-common/mutexlock.h"
 
 #include "mds_cli.h"
@@ -55,23 +59,96 @@ Status MDS::CLI::FetchIndex(const DirId& id, int zserver,
   return s;
 }
 
+// Encode "name" followed by the names of the directories in "path" as a
+// sequence of length-prefixed strings. Stop at the first "." or ".." as
+// these cannot be resolved without knowing the parent of each directory.
+// Return the total number of names encoded.
+static int EncodeNames(const Slice& name, const Slice& path, std::string* dst) {
+  PutLengthPrefixedSlice(dst, name);
+  int n = 1;
+  Slice input = path;
+  while (!input.empty()) {
+    const char* p = static_cast<const char*>(
+        memchr(input.data(), '/', input.size()));
+    size_t len = (p != NULL) ? p - input.data() : input.size();
+    Slice dname = Slice(input.data(), len);
+    input.remove_prefix((p != NULL) ? len + 1 : len);
+    if (!dname.empty()) {
+      if (dname == "." || dname == "..") {
+        break;
+      } else {
+        PutLengthPrefixedSlice(dst, dname);
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
 Status MDS::CLI::Lookup(const DirId& pid, const Slice& name, int zserver,
-                        uint64_t op_due, LookupHandle** result) {
+                        uint64_t op_due, LookupHandle** result,
+                        const Slice& ahead, bool negative) {
   Status s;
   char tmp[20];
   Slice nhash = DirIndex::Hash(name, tmp);
   mutex_.AssertHeld();
 
   uint64_t now = Env::Default()->NowMicros();
-  LookupHandle* h = lookup_cache_->Lookup(pid, nhash);
-
   // Ask for a new lookup state lease only if
   // we don't have one yet or
   // the one we current have has expired
-  if (h == NULL || (now + 10) > lookup_cache_->Value(h)->LeaseDue()) {
+  LookupHandle* h = lookup_cache_->Lookup(pid, nhash, now + 10);
+  if (h != NULL) {
+    const LookupStat* stat = lookup_cache_->Value(h);
+    // Renew hot leases before they expire so lookups won't block on them
+    if (now + lease_renewal_window_ > stat->LeaseDue()) {
+      ScheduleRenewal(pid, name, zserver);
+    }
+    if (LookupCache::IsNegative(stat)) {
+      lookup_cache_->Release(h);
+      h = NULL;
+      s = Status::NotFound(Slice());
+    }
+  } else {
+    std::string names;
+    int num_names = 1;
+    if (batched_path_resolution_ && !ahead.empty()) {
+      num_names = EncodeNames(name, ahead, &names);
+    }
     IndexHandle* idxh = NULL;
     s = FetchIndex(pid, zserver, &idxh);
-    if (s.ok()) {
+    if (s.ok() && num_names > 1) {
+      assert(idxh != NULL);
+      IndexGuard idxg(index_cache_, idxh);
+      ResolvepathOptions options;
+      options.op_due = atomic_path_resolution_ ? op_due : DELTAFS_MAX_MICROS;
+      options.session_id = session_id_;
+      options.dir_id = pid;
+      options.name_hash = nhash;
+      options.names = names;
+      ResolvepathRet ret;
+      s = _Resolvepath(index_cache_->Value(idxh), options, &ret);
+      if (s.ok()) {
+        // Cache all directories resolved, chaining each to its parent
+        DirId dir_id = pid;
+        Slice input = options.names;
+        Slice dname;
+        char dtmp[20];
+        for (size_t i = 0; i < ret.stats.size(); i++) {
+          if (!GetLengthPrefixedSlice(&input, &dname)) {
+            break;  // Server sent back more than asked
+          }
+          Slice dhash = (i == 0) ? nhash : DirIndex::Hash(dname, dtmp);
+          LookupHandle* lh = CacheLookup(dir_id, dhash, s, ret.stats[i]);
+          dir_id = DirId(*lookup_cache_->Value(lh));
+          if (i == 0) {
+            h = lh;
+          } else {
+            lookup_cache_->Release(lh);
+          }
+        }
+      }
+    } else if (s.ok()) {
       assert(idxh != NULL);
       IndexGuard idxg(index_cache_, idxh);
       LookupOptions options;
@@ -82,15 +159,11 @@ Status MDS::CLI::Lookup(const DirId& pid, const Slice& name, int zserver,
       if (paranoid_checks_) {
         options.name = name;
       }
+      options.negative_lease = negative_lookups_ && negative;
       LookupRet ret;
+      ret.stat.SetLeaseDue(0);
       s = _Lookup(index_cache_->Value(idxh), options, &ret);
-      if (s.ok()) {
-        LookupStat* stat = new LookupStat(ret.stat);
-        h = lookup_cache_->Insert(pid, nhash, stat);
-        if (stat->LeaseDue() == 0) {
-          lookup_cache_->Erase(pid, nhash);
-        }
-      }
+      h = CacheLookup(pid, nhash, s, ret.stat);
     }
   }
 
@@ -98,6 +171,99 @@ Status MDS::CLI::Lookup(const DirId& pid, const Slice& name, int zserver,
   return s;
 }
 
+MDS::CLI::LookupHandle* MDS::CLI::CacheLookup(const DirId& pid,
+                                             const Slice& nhash,
+                                             const Status& s,
+                                             const LookupStat& stat) {
+  mutex_.AssertHeld();
+  LookupHandle* h = NULL;
+  if (s.ok()) {
+    h = lookup_cache_->Insert(pid, nhash, new LookupStat(stat));
+    if (stat.LeaseDue() == 0) {
+      lookup_cache_->Erase(pid, nhash);
+    }
+  } else if (s.IsNotFound() && negative_lookups_ && stat.LeaseDue() != 0) {
+    lookup_cache_->Release(
+        lookup_cache_->InsertNegative(pid, nhash, stat.LeaseDue()));
+  }
+  return h;
+}
+
+// A background renewal of the lookup state of a name.
+struct MDS::CLI::Renewal {
+  CLI* cli;
+  DirId pid;
+  std::string name;
+  std::string key;  // pid and name hash
+  int zserver;
+};
+
+void MDS::CLI::ScheduleRenewal(const DirId& pid, const Slice& name,
+                               int zserver) {
+  mutex_.AssertHeld();
+  std::string key;
+  PutFixed64(&key, pid.reg);
+  PutFixed64(&key, pid.snap);
+  PutFixed64(&key, pid.ino);
+  key.append(name.data(), name.size());
+  // Skip if a renewal is already in progress
+  if (renewals_.insert(key).second) {
+    Renewal* r = new Renewal;
+    r->cli = this;
+    r->pid = pid;
+    r->name = name.ToString();
+    r->key.swap(key);
+    r->zserver = zserver;
+    env_->Schedule(RenewLease, r);
+  }
+}
+
+void MDS::CLI::RenewLease(void* arg) {
+  Renewal* r = reinterpret_cast<Renewal*>(arg);
+  r->cli->DoRenewal(r);
+  delete r;
+}
+
+void MDS::CLI::DoRenewal(Renewal* r) {
+  MutexLock ml(&mutex_);
+  char tmp[20];
+  Slice nhash = DirIndex::Hash(r->name, tmp);
+  IndexHandle* idxh = NULL;
+  Status s = FetchIndex(r->pid, r->zserver, &idxh);
+  if (s.ok()) {
+    assert(idxh != NULL);
+    IndexGuard idxg(index_cache_, idxh);
+    LookupOptions options;
+    options.op_due = DELTAFS_MAX_MICROS;
+    options.session_id = session_id_;
+    options.dir_id = r->pid;
+    options.name_hash = nhash;
+    if (paranoid_checks_) {
+      options.name = r->name;
+    }
+    options.negative_lease = negative_lookups_;
+    LookupRet ret;
+    ret.stat.SetLeaseDue(0);
+    s = _Lookup(index_cache_->Value(idxh), options, &ret);
+    LookupHandle* h = CacheLookup(r->pid, nhash, s, ret.stat);
+    if (h != NULL) {
+      lookup_cache_->Release(h);
+    }
+    if (ret.stat.LeaseDue() != 0) {
+      lookup_cache_->RecordRenewal();
+    }
+  }
+  renewals_.erase(r->key);
+  bg_cv_.SignalAll();
+}
+
+void MDS::CLI::GetCacheStats(LookupCache::Stats* lookup,
+                             IndexCache::Stats* index) {
+  MutexLock ml(&mutex_);
+  lookup_cache_->GetStats(lookup);
+  index_cache_->GetStats(index);
+}
+
 Status MDS::CLI::_Lookup(const DirIndex* idx, const LookupOptions& options,
                          LookupRet* ret) {
   Status s;
@@ -151,6 +317,65 @@ Status MDS::CLI::_Lookup(const DirIndex* idx, const LookupOptions& options,
   return s;
 }
 
+Status MDS::CLI::_Resolvepath(const DirIndex* idx,
+                              const ResolvepathOptions& options,
+                              ResolvepathRet* ret) {
+  Status s;
+  mutex_.AssertHeld();
+  DirIndex* tmp_idx = NULL;
+  assert(idx != NULL);
+  const DirIndex* latest_idx = idx;
+  int remaining_redirects = max_redirects_allowed_;
+  mutex_.Unlock();
+
+  do {
+    try {
+      assert(latest_idx != NULL);
+      size_t server = latest_idx->HashToServer(options.name_hash);
+      assert(server < giga_.num_servers);
+      s = factory_->Get(server)->Resolvepath(options, ret);
+    } catch (Redirect& re) {
+      if (tmp_idx == NULL) {
+        tmp_idx = new DirIndex(&giga_);
+        tmp_idx->Update(*idx);
+      }
+      if (--remaining_redirects == 0 || !tmp_idx->Update(re)) {
+        s = Status::Corruption("bad giga+ index");
+      } else {
+        s = Status::TryAgain(Slice());
+      }
+      assert(tmp_idx);
+      latest_idx = tmp_idx;
+    }
+  } while (s.IsTryAgain());
+
+  if (s.ok()) {
+    if (ret->stats.empty()) {
+      s = Status::Corruption(Slice());
+    } else if (paranoid_checks_) {
+      for (size_t i = 0; i < ret->stats.size(); i++) {
+        if (!S_ISDIR(ret->stats[i].DirMode())) {
+          s = Status::Corruption(Slice());
+          break;
+        }
+      }
+    }
+  }
+
+  mutex_.Lock();
+  if (tmp_idx != NULL) {
+    if (s.ok()) {
+      const DirId& pid = options.dir_id;
+      IndexHandle* h = index_cache_->Insert(pid, tmp_idx);
+      index_cache_->Release(h);
+    } else {
+      delete tmp_idx;
+    }
+  }
+
+  return s;
+}
+
 bool MDS::CLI::IsReadDirOk(const PathInfo* info) {
   if (info == NULL) {
     return false;
@@ -235,6 +460,8 @@ Status MDS::CLI::ResolvePath(const Slice& path, PathInfo* result,
   if (!input.empty()) {
     // Start regular path resolution
     assert(!input.ends_with("/"));
+    // Directories that remain to be resolved end at the last slash
+    const char* const end = strrchr(input.c_str(), '/');
     const char* p = strchr(input.c_str(), '/');
     for (; p != NULL; p = strchr(input.c_str(), '/')) {
       const char* q = input.c_str();
@@ -255,8 +482,15 @@ Status MDS::CLI::ResolvePath(const Slice& path, PathInfo* result,
           depth++;
           result->name = name;
           parents.push_back(*result);
+          Slice ahead;
+          if (end != NULL && input.data() < end) {
+            ahead = Slice(input.data(), end - input.data());
+          }
           LookupHandle* lh = NULL;
-          s = Lookup(result->pid, name, result->zserver, lease_due, &lh);
+          // Missing parents are about to be created by the caller, which
+          // would then have to wait out any negative lease we ask for
+          s = Lookup(result->pid, name, result->zserver, lease_due, &lh,
+                     ahead, missing_parent == NULL);
           if (s.ok()) {
             assert(lh != NULL);
             const LookupStat* stat = lookup_cache_->Value(lh);
@@ -1088,7 +1322,185 @@ Status MDS::CLI::Ftruncate(const Fentry& ent, uint64_t mtime, uint64_t size) {
   return s;
 }
 
+namespace {
+bool AppendNames(const std::vector<std::string>& names,
+                 const std::vector<Stat>* stats, void* arg) {
+  std::vector<std::string>* result =
+      reinterpret_cast<std::vector<std::string>*>(arg);
+  result->insert(result->end(), names.begin(), names.end());
+  return true;
+}
+}  // namespace
+
 Status MDS::CLI::Listdir(const Slice& p, std::vector<std::string>* names) {
+  return Listdir(p, AppendNames, names);
+}
+
+// State shared by the threads listing a directory. Each page to fetch is
+// a task naming a server and the cursor to resume from. Helpers scheduled
+// in the background only fetch pages into a bounded queue. The calling
+// thread delivers queued pages to the callback with no lock held and
+// fetches pages itself whenever the queue is empty, so a listing never
+// waits for a busy background thread. Helpers exit instead of waiting
+// once the queue is full or all tasks are claimed, so they never park a
+// shared background thread; the calling thread schedules new helpers as
+// it drains the queue.
+struct MDS::CLI::Lister {
+  Lister(CLI* cli)
+      : cli(cli),
+        cv(&mu),
+        max_pages(1),
+        max_helpers(0),
+        helpers(0),
+        refs(1),
+        busy(0),
+        stop(false) {}
+  ~Lister() {
+    for (size_t i = 0; i < pages.size(); i++) {
+      delete pages[i];
+    }
+  }
+  struct Page {
+    std::vector<std::string> names;
+    std::vector<Stat> stats;
+  };
+  CLI* const cli;
+  ListdirOptions options;  // Template of each page request
+  ListdirCallback callback;
+  void* arg;
+  port::Mutex mu;
+  port::CondVar cv;
+  // Servers and cursors of the pages not yet claimed
+  std::deque<std::pair<size_t, std::string> > todo;
+  std::deque<Page*> pages;  // Pages fetched but not yet delivered
+  size_t max_pages;
+  int max_helpers;
+  int helpers;  // Number of background helpers scheduled or running
+  int refs;
+  int busy;   // Number of pages being fetched
+  bool stop;  // Stop listing more pages
+  Status status;
+
+  void Unref() {
+    mu.AssertHeld();
+    assert(refs > 0);
+    if (--refs == 0) {
+      mu.Unlock();
+      delete this;
+      return;
+    }
+    mu.Unlock();
+  }
+
+  // Schedule background helpers for unclaimed tasks as long as the queue
+  // has room and the number of helpers is below the listing parallelism.
+  // REQUIRES: mu has been locked.
+  void MaybeScheduleHelpers() {
+    mu.AssertHeld();
+    while (!stop && helpers < max_helpers &&
+           todo.size() > static_cast<size_t>(helpers) &&
+           pages.size() < max_pages) {
+      helpers++;
+      refs++;
+      cli->env_->Schedule(ListWork, this);
+    }
+  }
+};
+
+void MDS::CLI::ListWork(void* arg) {
+  Lister* lister = reinterpret_cast<Lister*>(arg);
+  lister->mu.Lock();
+  while (!lister->stop && !lister->todo.empty() &&
+         lister->pages.size() < lister->max_pages) {
+    FetchPage(lister);
+  }
+  assert(lister->helpers > 0);
+  lister->helpers--;
+  lister->Unref();
+}
+
+// Claim the next task and fetch its page into the queue. The remaining
+// pages of the same server are queued as a new task.
+// REQUIRES: lister->mu has been locked.
+void MDS::CLI::FetchPage(Lister* lister) {
+  lister->mu.AssertHeld();
+  assert(!lister->todo.empty());
+  const size_t server = lister->todo.front().first;
+  std::string cursor;
+  cursor.swap(lister->todo.front().second);
+  lister->todo.pop_front();
+  lister->busy++;
+  Lister::Page* page = new Lister::Page;
+  ListdirOptions options = lister->options;
+  options.start_hash = cursor;
+  ListdirRet ret;
+  ret.names = &page->names;
+  ret.stats = &page->stats;
+  MDS* const mds = lister->cli->factory_->Get(server);
+  lister->mu.Unlock();
+  Status s = mds->Listdir(options, &ret);
+  lister->mu.Lock();
+  lister->busy--;
+  if (!s.ok()) {
+    if (lister->status.ok()) lister->status = s;
+    lister->stop = true;
+    delete page;
+  } else {
+    if (ret.has_more) {
+      lister->todo.push_front(std::make_pair(server, ret.last_hash));
+    }
+    if (!page->names.empty()) {
+      lister->pages.push_back(page);
+    } else {
+      delete page;
+    }
+  }
+  lister->cv.SignalAll();
+}
+
+Status MDS::CLI::ListServers(Lister* lister, const std::set<size_t>& servers,
+                             bool* stopped) {
+  MutexLock ml(&lister->mu);
+  std::set<size_t>::const_iterator it = servers.begin();
+  for (; it != servers.end(); ++it) {
+    lister->todo.push_back(std::make_pair(*it, std::string()));
+  }
+  const int parallelism = std::max(listdir_parallelism_, 1);
+  const size_t n = std::min(servers.size(), static_cast<size_t>(parallelism));
+  lister->max_pages = std::max(n, static_cast<size_t>(1));
+  lister->max_helpers = static_cast<int>(lister->max_pages) - 1;
+  lister->MaybeScheduleHelpers();
+  while (true) {
+    if (!lister->pages.empty()) {
+      Lister::Page* const page = lister->pages.front();
+      lister->pages.pop_front();
+      lister->MaybeScheduleHelpers();
+      if (!lister->stop) {
+        lister->mu.Unlock();
+        const std::vector<Stat>* st =
+            lister->options.with_stats ? &page->stats : NULL;
+        const bool more = lister->callback(page->names, st, lister->arg);
+        lister->mu.Lock();
+        if (!more) {
+          lister->stop = true;
+          lister->cv.SignalAll();
+        }
+      }
+      delete page;
+    } else if (!lister->stop && !lister->todo.empty()) {
+      FetchPage(lister);
+    } else if (lister->busy != 0) {
+      lister->cv.Wait();
+    } else {
+      break;
+    }
+  }
+  *stopped = lister->stop;
+  return lister->status;
+}
+
+Status MDS::CLI::Listdir(const Slice& p, ListdirCallback callback, void* arg,
+                         bool with_stats) {
   Status s;
   assert(p.size() != 0);
   assert(p.size() == 1 || !p.ends_with("/"));
@@ -1111,13 +1523,16 @@ Status MDS::CLI::Listdir(const Slice& p, std::vector<std::string>* names) {
         assert(idxh != NULL);
         const DirIndex* idx = index_cache_->Value(idxh);
         assert(idx != NULL);
-        ListdirOptions options;
-        options.op_due =
+        Lister* lister = new Lister(this);
+        ListdirOptions* const options = &lister->options;
+        options->op_due =
             atomic_path_resolution_ ? path.lease_due : DELTAFS_MAX_MICROS;
-        options.session_id = session_id_;
-        options.dir_id = path.pid;
-        ListdirRet ret;
-        ret.names = names;
+        options->session_id = session_id_;
+        options->dir_id = path.pid;
+        options->limit = listdir_page_size_;
+        options->with_stats = with_stats;
+        lister->callback = callback;
+        lister->arg = arg;
 
         std::set<size_t> visited;
         int num_parts = 1 << idx->Radix();
@@ -1125,16 +1540,59 @@ Status MDS::CLI::Listdir(const Slice& p, std::vector<std::string>* names) {
           if (idx->IsSet(i)) {
             size_t server = idx->GetServerForIndex(i);
             assert(server < giga_.num_servers);
-            if (visited.count(server) == 0) {
-              factory_->Get(server)->Listdir(options, &ret);
-              visited.insert(server);
-              if (visited.size() >= giga_.num_servers) {
-                break;
+            visited.insert(server);
+            if (visited.size() >= giga_.num_servers) {
+              break;
+            }
+          }
+        }
+        bool stopped;
+        s = ListServers(lister, visited, &stopped);
+
+        // Directories that split dynamically may have partitions unknown
+        // to our cached index. Ask each visited server for its view
+        // of the index until no more servers are discovered.
+        if (s.ok() && !stopped && visited.size() < giga_.num_servers) {
+          DirIndex tmp_idx(&giga_);
+          tmp_idx.Update(*idx);
+          std::set<size_t> probed;
+          bool more = true;
+          while (s.ok() && !stopped && more &&
+                 visited.size() < giga_.num_servers) {
+            std::set<size_t>::iterator it = visited.begin();
+            for (; it != visited.end(); ++it) {
+              if (probed.count(*it) == 0) {
+                ReadidxOptions ropts;
+                ropts.op_due = DELTAFS_MAX_MICROS;
+                ropts.session_id = session_id_;
+                ropts.dir_id = path.pid;
+                ReadidxRet rret;
+                if (factory_->Get(*it)->Readidx(ropts, &rret).ok()) {
+                  tmp_idx.Update(rret.idx);
+                }
+                probed.insert(*it);
+              }
+            }
+            std::set<size_t> discovered;
+            num_parts = 1 << tmp_idx.Radix();
+            for (int i = 0; i < num_parts; i++) {
+              if (tmp_idx.IsSet(i)) {
+                size_t server = tmp_idx.GetServerForIndex(i);
+                if (visited.count(server) == 0) {
+                  discovered.insert(server);
+                  visited.insert(server);
+                }
               }
             }
+            more = !discovered.empty();
+            if (more) {
+              s = ListServers(lister, discovered, &stopped);
+            }
           }
         }
 
+        lister->mu.Lock();
+        lister->Unref();
         mutex_.Lock();
         index_cache_->Release(idxh);
       }
@@ -1144,6 +1602,196 @@ Status MDS::CLI::Listdir(const Slice& p, std::vector<std::string>* names) {
   return s;
 }
 
+// Check names of a bulk operation and compute their hashes. Names that are
+// not valid file names are rejected individually. Return the indexes
+// of the names that remain to be sent to servers.
+static std::vector<size_t> PrepareNames(const std::vector<Slice>& names,
+                                        std::vector<std::string>* nhashes,
+                                        std::vector<Status>* results) {
+  std::vector<size_t> todo;
+  results->assign(names.size(), Status::OK());
+  nhashes->resize(names.size());
+  for (size_t i = 0; i < names.size(); i++) {
+    const Slice& name = names[i];
+    if (name.empty() || name == "." || name == ".." ||
+        memchr(name.data(), '/', name.size()) != NULL) {
+      (*results)[i] = Status::InvalidArgument("bad file name");
+    } else if (name.size() > DELTAFS_NAME_MAX) {
+      (*results)[i] = FileNameExceeedsLimit();
+    } else {
+      DirIndex::PutHash(&(*nhashes)[i], name);
+      todo.push_back(i);
+    }
+  }
+  return todo;
+}
+
+template <typename Options, typename Ret>
+Status MDS::CLI::_Bulk(Status (MDS::*op)(const Options&, Ret*),
+                       const DirIndex* idx, const Options& opts,
+                       const std::vector<Slice>& names,
+                       const std::vector<std::string>& nhashes,
+                       std::vector<size_t> todo, std::vector<Stat>* stats,
+                       std::vector<Status>* results) {
+  static const size_t kMaxBatchSize = 1024;
+  Status s;
+  mutex_.AssertHeld();
+  DirIndex* tmp_idx = NULL;
+  assert(idx != NULL);
+  const DirIndex* latest_idx = idx;
+  int remaining_redirects = max_redirects_allowed_;
+  mutex_.Unlock();
+
+  while (s.ok() && !todo.empty()) {
+    // Partition names by the server storing them
+    std::map<size_t, std::vector<size_t> > parts;
+    for (size_t i = 0; i < todo.size(); i++) {
+      size_t server = latest_idx->HashToServer(nhashes[todo[i]]);
+      assert(server < giga_.num_servers);
+      parts[server].push_back(todo[i]);
+    }
+    todo.clear();
+    std::map<size_t, std::vector<size_t> >::iterator it = parts.begin();
+    for (; s.ok() && it != parts.end(); ++it) {
+      const std::vector<size_t>& part = it->second;
+      bool redirected = false;
+      for (size_t off = 0; s.ok() && !redirected && off < part.size();
+           off += kMaxBatchSize) {
+        const size_t end = std::min(part.size(), off + kMaxBatchSize);
+        std::string encoding;
+        for (size_t i = off; i < end; i++) {
+          PutLengthPrefixedSlice(&encoding, names[part[i]]);
+        }
+        Options options = opts;
+        options.names = encoding;
+        Ret ret;
+        try {
+          s = (factory_->Get(it->first)->*op)(options, &ret);
+          if (s.ok() && ret.errs.size() != end - off) {
+            s = Status::Corruption(Slice());
+          }
+          for (size_t i = off; s.ok() && i < end; i++) {
+            const int err = ret.errs[i - off];
+            if (err != 0) {
+              (*results)[part[i]] = Status::FromCode(err);
+            } else if (stats != NULL) {
+              (*stats)[part[i]] = ret.stats[i - off];
+            }
+          }
+        } catch (Redirect& re) {
+          if (tmp_idx == NULL) {
+            tmp_idx = new DirIndex(&giga_);
+            tmp_idx->Update(*idx);
+          }
+          if (--remaining_redirects == 0 || !tmp_idx->Update(re)) {
+            s = Status::Corruption("bad giga+ index");
+          } else {
+            // Re-route the rest of this partition using the updated index
+            todo.insert(todo.end(), part.begin() + off, part.end());
+            redirected = true;
+          }
+          assert(tmp_idx != NULL);
+          latest_idx = tmp_idx;
+        }
+      }
+    }
+  }
+
+  mutex_.Lock();
+  if (tmp_idx != NULL) {
+    if (s.ok()) {
+      const DirId& pid = opts.dir_id;
+      IndexHandle* h = index_cache_->Insert(pid, tmp_idx);
+      index_cache_->Release(h);
+    } else {
+      delete tmp_idx;
+    }
+  }
+
+  return s;
+}
+
+Status MDS::CLI::Bulkcreat(const Slice& p, const std::vector<Slice>& names,
+                           mode_t mode, std::vector<Status>* results,
+                           bool error_if_exists) {
+  Status s;
+  assert(p.size() != 0);
+  assert(p.size() == 1 || !p.ends_with("/"));
+  std::vector<std::string> nhashes;
+  std::vector<size_t> todo = PrepareNames(names, &nhashes, results);
+  std::string fake_path = p.ToString();
+  fake_path += "/_";
+  PathInfo path;
+  MutexLock ml(&mutex_);
+  s = ResolvePath(fake_path, &path);
+  if (s.ok()) {
+    if (!IsWriteDirOk(&path)) {
+      s = Status::AccessDenied(Slice());
+    } else if (DELTAFS_DIR_IS_PLFS_STYLE(path.mode)) {
+      s = Status::NotSupported("bulk creation under plfs dirs");
+    } else if (!todo.empty()) {
+      IndexHandle* idxh = NULL;
+      s = FetchIndex(path.pid, path.zserver, &idxh);
+      if (s.ok()) {
+        assert(idxh != NULL);
+        IndexGuard idxg(index_cache_, idxh);
+        BulkcreatOptions options;
+        options.op_due =
+            atomic_path_resolution_ ? path.lease_due : DELTAFS_MAX_MICROS;
+        options.session_id = session_id_;
+        options.dir_id = path.pid;
+        options.flags = error_if_exists ? O_EXCL : 0;
+        options.mode = mode;
+        options.uid = uid_;
+        options.gid = gid_;
+        s = _Bulk(&MDS::Bulkcreat, index_cache_->Value(idxh), options, names,
+                  nhashes, todo, NULL, results);
+      }
+    }
+  }
+
+  return s;
+}
+
+Status MDS::CLI::Bulkstat(const Slice& p, const std::vector<Slice>& names,
+                          std::vector<Stat>* stats,
+                          std::vector<Status>* results) {
+  Status s;
+  assert(p.size() != 0);
+  assert(p.size() == 1 || !p.ends_with("/"));
+  std::vector<std::string> nhashes;
+  std::vector<size_t> todo = PrepareNames(names, &nhashes, results);
+  stats->resize(names.size());
+  std::string fake_path = p.ToString();
+  fake_path += "/_";
+  PathInfo path;
+  MutexLock ml(&mutex_);
+  s = ResolvePath(fake_path, &path);
+  if (s.ok()) {
+    if (!IsLookupOk(&path)) {
+      s = Status::AccessDenied(Slice());
+    } else if (DELTAFS_DIR_IS_PLFS_STYLE(path.mode)) {
+      s = Status::NotSupported("bulk stat under plfs dirs");
+    } else if (!todo.empty()) {
+      IndexHandle* idxh = NULL;
+      s = FetchIndex(path.pid, path.zserver, &idxh);
+      if (s.ok()) {
+        assert(idxh != NULL);
+        IndexGuard idxg(index_cache_, idxh);
+        BulkstatOptions options;
+        options.op_due =
+            atomic_path_resolution_ ? path.lease_due : DELTAFS_MAX_MICROS;
+        options.session_id = session_id_;
+        options.dir_id = path.pid;
+        s = _Bulk(&MDS::Bulkstat, index_cache_->Value(idxh), options, names,
+                  nhashes, todo, stats, results);
+      }
+    }
+  }
+
+  return s;
+}
+
 Status MDS::CLI::Accessdir(const Slice& p, int mode) {
   Status s;
   assert(p.size() != 0);
@@ -16,6 +16,9 @@
 #include "pdlfs-common/lookup_cache.h"
 #include "pdlfs-common/port.h"
 
+#include <set>
+#include <string>
+
 namespace pdlfs {
 
 class MDSFactory {
@@ -34,6 +37,20 @@ struct MDSCliOptions {
   size_t lookup_cache_size;
   bool paranoid_checks;
   bool atomic_path_resolution;
+  bool batched_path_resolution;
+  // Cache the absence of directories found missing during path resolution
+  // for as long as servers grant a lease on it
+  bool negative_lookups;
+  // Renew the lease of a cached lookup state in the background if it is
+  // accessed within this many microseconds before it expires. Set to "0"
+  // to only fetch new leases after old ones expire
+  uint64_t lease_renewal_window;
+  // Max number of servers listed in parallel by a single listdir.
+  // Pages fetched from different servers are still delivered one at a time
+  int listdir_parallelism;
+  // Max number of entries in each page of a listdir. Set to "0" to let
+  // servers choose
+  uint32_t listdir_page_size;
   int max_redirects_allowed;
   int num_virtual_servers;
   int num_servers;
@@ -61,9 +78,35 @@ class MDS::CLI {
   Status Unlink(const Slice& path, Fentry* result = NULL,
                 bool error_if_absent = true, const Fentry* at = NULL);
   Status Listdir(const Slice& path, std::vector<std::string>* names);
+  // Invoked for each page of entries listed under a directory. stats is NULL
+  // unless stats are requested. Return false to stop listing.
+  typedef bool (*ListdirCallback)(const std::vector<std::string>& names,
+                                  const std::vector<Stat>* stats, void* arg);
+  // List a directory one page at a time. The servers storing the directory
+  // are listed in parallel and each page is passed to the callback as soon
+  // as it arrives, so memory usage is bounded by the page size rather than
+  // the size of the directory. The callback is only invoked by the calling
+  // thread and no internal locks are held while it runs.
+  Status Listdir(const Slice& path, ListdirCallback callback, void* arg,
+                 bool with_stats = false);
+  // Create a batch of regular files under a common parent directory. Names
+  // are routed to metadata servers by the GIGA+ index of the parent and each
+  // server creates its share with a single request. The outcome of each
+  // name is stored in *results. Return a non-OK status only if the
+  // parent directory cannot be resolved or the batch as a whole fails.
+  Status Bulkcreat(const Slice& parent, const std::vector<Slice>& names,
+                   mode_t mode, std::vector<Status>* results,
+                   bool error_if_exists = true);
+  // Read the stats of a batch of names under a common parent directory.
+  // Stats and per-name outcomes are stored in *stats and *results.
+  Status Bulkstat(const Slice& parent, const std::vector<Slice>& names,
+                  std::vector<Stat>* stats, std::vector<Status>* results);
   Status Accessdir(const Slice& path, int mode);
   Status Access(const Slice& path, int mode);
 
+  // Return the counters of the lookup cache and the index cache.
+  void GetCacheStats(LookupCache::Stats* lookup, IndexCache::Stats* index);
+
   uid_t uid() const { return uid_; }
   gid_t gid() const { return gid_; }
 
@@ -82,6 +125,7 @@ class MDS::CLI {
 
   // REQUIRES: mutex_ has been locked.
   HELPER(Lookup);
+  HELPER(Resolvepath);
   HELPER(Fstat);
   HELPER(Fcreat);
   HELPER(Mkdir);
@@ -91,6 +135,16 @@ class MDS::CLI {
 
 #undef HELPER
 
+  // Send a batch of names to the servers storing them, following redirects
+  // until all names are processed or an error occurs.
+  // REQUIRES: mutex_ has been locked.
+  template <typename Options, typename Ret>
+  Status _Bulk(Status (MDS::*op)(const Options&, Ret*), const DirIndex*,
+               const Options& opts, const std::vector<Slice>& names,
+               const std::vector<std::string>& nhashes,
+               std::vector<size_t> todo, std::vector<Stat>* stats,
+               std::vector<Status>* results);
+
   // Result of a successful path resolution
   struct PathInfo {
     DirId pid;
@@ -117,8 +171,30 @@ class MDS::CLI {
   bool IsLookupOk(const PathInfo*);
 
   typedef LookupCache::Handle LookupHandle;
+  // If "ahead" is not empty and batched path resolution is enabled, the
+  // directories named by it are resolved along with "name" and their lookup
+  // states are inserted into the lookup cache for later use. A missing name
+  // is cached as a negative entry if negative lookups are enabled and
+  // "negative" is true.
   Status Lookup(const DirId&, const Slice& name, int zserver, uint64_t op_due,
-                LookupHandle**);
+                LookupHandle**, const Slice& ahead = Slice(),
+                bool negative = true);
+  // Insert the result of a single lookup into the lookup cache. Return the
+  // handle of the new entry if the result is positive, or NULL otherwise.
+  // REQUIRES: mutex_ has been locked.
+  LookupHandle* CacheLookup(const DirId&, const Slice& nhash, const Status&,
+                            const LookupStat&);
+  // Renew the lease of a cached lookup state in the background.
+  // REQUIRES: mutex_ has been locked.
+  struct Renewal;
+  void ScheduleRenewal(const DirId&, const Slice& name, int zserver);
+  static void RenewLease(void*);
+  void DoRenewal(Renewal*);
+  // List the pages of a directory stored by a set of servers in parallel.
+  struct Lister;
+  Status ListServers(Lister*, const std::set<size_t>& servers, bool* stopped);
+  static void ListWork(void*);
+  static void FetchPage(Lister*);
   typedef IndexCache::Handle IndexHandle;
   Status FetchIndex(const DirId&, int zserver, IndexHandle**);
   typedef RefGuard<IndexCache, IndexHandle> IndexGuard;
@@ -130,6 +206,11 @@ class MDS::CLI {
   GIGA giga_;
   bool paranoid_checks_;
   bool atomic_path_resolution_;
+  bool batched_path_resolution_;
+  bool negative_lookups_;
+  uint64_t lease_renewal_window_;
+  int listdir_parallelism_;
+  uint32_t listdir_page_size_;
   int max_redirects_allowed_;
   int session_id_;
   int cli_id_;
@@ -139,6 +220,8 @@ class MDS::CLI {
   friend class MDS;
   // State below is protected by mutex_
   port::Mutex mutex_;
+  port::CondVar bg_cv_;
+  std::set<std::string> renewals_;  // Lookup states being renewed
   LookupCache* lookup_cache_;
   IndexCache* index_cache_;
   // No copying allowed
@@ -11,15 +11,20 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <algorithm>
+#include <vector>
 
+#include "pdlfs-common/coding.h"
 #include "pdlfs-common/dirlock.h"
+#include "pdlfs-common/hash.h"
 #include "pdlfs-common/mutexlock.h"
 
+#include "mds_cli.h"
 #include "mds_srv.h"
 
 namespace pdlfs {
 
-// NOTE: can be called while mutex_ is NOT locked.
+// NOTE: can be called while no shard mutex is locked.
 Status MDS::SRV::LoadDir(const DirId& id, DirInfo* info, DirIndex* index) {
   Status s;
   MDB::Tx* mdb_tx = NULL;
@@ -39,7 +44,9 @@ Status MDS::SRV::LoadDir(const DirId& id, DirInfo* info, DirIndex* index) {
     if (s.IsNotFound()) {
       int zserver = PickupServer(id) % giga_.num_virtual_servers;
       DirIndex tmp(zserver, &giga_);
-      tmp.SetAll();  // Pre-split to all servers
+      if (split_threshold_ == 0) {
+        tmp.SetAll();  // Pre-split to all servers
+      }
       if (mdb_tx == NULL) {
         mdb_tx = mdb_->CreateTx();
       }
@@ -66,33 +73,33 @@ Status MDS::SRV::LoadDir(const DirId& id, DirInfo* info, DirIndex* index) {
 // Errors might occur when the directory being searched does not exist, when
 // the LRU-cache is full, when the data read from DB is corrupted, and
 // when there are bugs somewhere in the codebase :-|
-// REQUIRES: mutex_ has been locked.
-Status MDS::SRV::FetchDir(const DirId& id, Dir::Ref** ref) {
+// REQUIRES: shard->mutex has been locked.
+Status MDS::SRV::FetchDir(Shard* shard, const DirId& id, Dir::Ref** ref) {
   char tmp[30];
   Slice id_encoding = EncodeId(id, tmp);
-  mutex_.AssertHeld();
+  shard->mutex.AssertHeld();
   *ref = NULL;
   Status s;
 
   while (s.ok() && (*ref) == NULL) {
-    Dir::Ref* r = dirs_->Lookup(id);
+    Dir::Ref* r = shard->dirs->Lookup(id);
     if (r != NULL) {
       *ref = r;
     } else {
       // Prevent multiple threads from loading a same directory at the same time
-      if (loading_dirs_.Contains(id_encoding)) {
+      if (shard->loading_dirs.Contains(id_encoding)) {
         do {
-          loading_cv_.Wait();
-        } while (loading_dirs_.Contains(id_encoding));
+          shard->loading_cv.Wait();
+        } while (shard->loading_dirs.Contains(id_encoding));
       } else {
-        loading_dirs_.Insert(id_encoding);
-        mutex_.Unlock();
+        shard->loading_dirs.Insert(id_encoding);
+        shard->mutex.Unlock();
         DirInfo dir_info;
         DirIndex dir_index(&giga_);
         s = LoadDir(id, &dir_info, &dir_index);
-        mutex_.Lock();
+        shard->mutex.Lock();
         if (s.ok()) {
-          Dir* d = new Dir(&mutex_, &giga_);
+          Dir* d = new Dir(&shard->mutex, &giga_);
           d->mtime = dir_info.mtime;
           assert(dir_info.size >= 0);
           d->size = dir_info.size;
@@ -100,9 +107,12 @@ Status MDS::SRV::FetchDir(const DirId& id, Dir::Ref** ref) {
           d->index.Swap(dir_index);
           d->tx.NoBarrier_Store(NULL);
           d->seq = 0;
+          d->neg_due = 0;
+          d->split_size = 0;
+          d->split_seq = 0;
           d->locked = false;
           try {
-            r = dirs_->Insert(id, d);
+            r = shard->dirs->Insert(id, d);
           } catch (int err) {
             // Not expecting errors other than "buffer-full", which happens
             // when the directory cache is full and no entries can be evicted
@@ -117,9 +127,9 @@ Status MDS::SRV::FetchDir(const DirId& id, Dir::Ref** ref) {
           }
         }
 
-        assert(loading_dirs_.Contains(id_encoding));
-        loading_dirs_.Erase(id_encoding);
-        loading_cv_.SignalAll();
+        assert(shard->loading_dirs.Contains(id_encoding));
+        shard->loading_dirs.Erase(id_encoding);
+        shard->loading_cv.SignalAll();
       }
     }
   }
@@ -130,11 +140,10 @@ Status MDS::SRV::FetchDir(const DirId& id, Dir::Ref** ref) {
 // Quickly check background status. Return OK on success.
 // Return a non-OK status when the directory (or the server as a whole)
 // contains errors and must be fenced from online operations.
-// REQUIRES: mutex_ has been locked.
+// REQUIRES: the mutex of the directory's shard has been locked.
 Status MDS::SRV::ProbeDir(const Dir* d) {
-  mutex_.AssertHeld();
-  if (!status_.ok()) {
-    return status_;
+  if (no_more_inos_.Acquire_Load() != NULL) {
+    return Status::BufferFull("No more free inodes");
   } else if (!d->status.ok()) {
     return d->status;
   } else {
@@ -142,34 +151,582 @@ Status MDS::SRV::ProbeDir(const Dir* d) {
   }
 }
 
-// REQUIRES: mutex_ has been locked.
+// Return true if a given partition of a directory is owned by us and can be
+// split by us. Partitions whose next child lives on a different server can
+// only be split when we have access to other servers.
+// REQUIRES: the mutex of the directory's shard has been locked.
+bool MDS::SRV::CanSplit(const DirIndex& idx, int index) {
+  if (!idx.IsSet(index) || idx.GetServerForIndex(index) != srv_id_) {
+    return false;
+  } else if (!idx.IsSplittable(index)) {
+    return false;
+  } else if (peers_ == NULL) {
+    int child = idx.NewIndexForSplitting(index);
+    return idx.GetServerForIndex(child) == srv_id_;
+  } else {
+    return true;
+  }
+}
+
+// Return true if the partitions of a directory stored at this server
+// have on average grown beyond the split threshold and at least one
+// of them can be split. A directory whose last split attempt found the
+// partition expected to be the largest not oversized is not considered
+// again until enough entries have been inserted for it to become oversized.
+// REQUIRES: the mutex of the directory's shard has been locked.
+bool MDS::SRV::NeedSplit(const Dir* d) {
+  if (split_threshold_ == 0 || d->size <= split_threshold_) {
+    return false;
+  } else if (d->size <= d->split_size) {
+    return false;
+  }
+  size_t num_parts = 0;
+  bool splittable = false;
+  const int n = 1 << d->index.Radix();
+  for (int i = 0; i < n; i++) {
+    if (d->index.IsSet(i) && d->index.GetServerForIndex(i) == srv_id_) {
+      if (!splittable) splittable = CanSplit(d->index, i);
+      num_parts++;
+    }
+  }
+  return splittable && d->size > split_threshold_ * num_parts;
+}
+
+// Split the splittable partition of a directory that we own and that is
+// expected to be the largest if it holds more entries than the split
+// threshold. Since names are uniformly hashed, this is the partition whose
+// next split covers the widest range of hashes. Only the entries in that
+// range are read from our DB. Entries hashed to the new child partition are
+// sent to the child's server in a single Migrate call and are then removed
+// from our DB. The split is skipped, and will be retried by a future
+// insertion, when any entry to be moved is under an active lease, when
+// there is an active negative lease below the directory, or when the
+// child's server is busy. Once a split starts, no lease is issued below the
+// directory until it ends. Return OK on success, or a non-OK status on errors.
+// REQUIRES: the mutex of the directory's shard has been locked, and the
+// directory has been locked by the caller via a DirLock.
+Status MDS::SRV::SplitDir(Shard* shard, const DirId& dir_id, Dir* d) {
+  shard->mutex.AssertHeld();
+  assert(d->locked);
+  Status s;
+  // The index won't change while we hold the lock of the directory
+  DirIndex idx(&giga_);
+  idx.Update(d->index);
+  DirInfo dir_info;
+  dir_info.mtime = d->mtime;
+  dir_info.size = d->size;
+  int parent = -1;
+  int next_child = 0;
+  const int n = 1 << idx.Radix();
+  for (int i = 0; i < n; i++) {
+    if (CanSplit(idx, i)) {
+      // A smaller child index has a smaller radix and a wider hash range
+      const int c = idx.NewIndexForSplitting(i);
+      if (parent == -1 || c < next_child) {
+        next_child = c;
+        parent = i;
+      }
+    }
+  }
+  if (parent == -1) {
+    return s;
+  }
+  shard->mutex.Unlock();
+
+  std::string lower_hash;
+  std::string upper_hash;
+  idx.GetSplitRange(parent, &lower_hash, &upper_hash);
+  MDB::StatList stats;
+  MDB::NameList names;
+  std::vector<std::string> hashes;
+  s = mdb_->ListRange(dir_id, lower_hash, upper_hash, &stats, &names,
+                      &hashes, NULL);
+  if (!s.ok()) {
+    shard->mutex.Lock();
+    Error(__LOG_ARGS__, "%s: cannot list partition %d: %s",
+          dir_id.DebugString().c_str(), parent, s.ToString().c_str());
+    return s;
+  }
+  size_t parent_size = 0;
+  for (size_t i = 0; i < hashes.size(); i++) {
+    if (idx.HashToIndex(hashes[i]) == parent) {
+      parent_size++;
+    }
+  }
+  if (parent_size <= split_threshold_) {
+    // The partition expected to be the largest is not oversized. Skip the
+    // directory until it may have outgrown the threshold.
+    shard->mutex.Lock();
+    d->split_size = dir_info.size +
+                    static_cast<int>(split_threshold_ - parent_size);
+    return s;
+  }
+
+  const int child = idx.NewIndexForSplitting(parent);
+  idx.Set(child);
+  const int target = idx.GetServerForIndex(child);
+  std::vector<size_t> moved;
+  for (size_t i = 0; i < hashes.size(); i++) {
+    if (idx.HashToIndex(hashes[i]) == child) {
+      moved.push_back(i);
+    }
+  }
+
+  shard->mutex.Lock();
+  const uint64_t now = NowMicros();
+  // Negative leases are not migrated so names that are absent now could be
+  // created by the child's server while we still have leases on them
+  bool busy = d->neg_due > now;
+  for (size_t i = 0; i < moved.size() && !busy; i++) {
+    Lease::Ref* lref = shard->leases->Lookup(dir_id, hashes[moved[i]]);
+    if (lref != NULL) {
+      const Lease* lease = lref->value;
+      busy = lease->state == kLeaseLocked || lease->due > now;
+      shard->leases->Release(lref);
+    }
+  }
+  const bool splitting = !busy;
+  if (splitting) {
+    // Stop issuing leases until the split ends
+    assert((d->split_seq & 1) == 0);
+    d->split_seq++;
+  }
+  shard->mutex.Unlock();
+
+  if (!busy && target != srv_id_) {
+    std::string entries;
+    char tmp[sizeof(Stat)];
+    for (size_t i = 0; i < moved.size(); i++) {
+      PutLengthPrefixedSlice(&entries, hashes[moved[i]]);
+      PutLengthPrefixedSlice(&entries, names[moved[i]]);
+      Slice encoding = stats[moved[i]].EncodeTo(tmp);
+      entries.append(encoding.data(), encoding.size());
+    }
+    MigrateOptions options;
+    options.dir_id = dir_id;
+    options.session_id = 0;
+    options.op_due = DELTAFS_MAX_MICROS;
+    options.index = child;
+    options.idx = idx.Encode();
+    options.entries = entries;
+    MigrateRet ret;
+    assert(peers_ != NULL);
+    s = peers_->Get(target)->Migrate(options, &ret);
+    if (s.IsTryAgain()) {
+      busy = true;
+      s = Status::OK();
+    } else if (!s.ok()) {
+      // The child's server may have installed the partition before the
+      // error. Fence the directory so the two copies never diverge.
+      shard->mutex.Lock();
+      d->status = s;
+      shard->mutex.Unlock();
+    }
+  }
+
+  if (s.ok() && !busy) {
+    // Start redirecting requests of the new partition before the
+    // migrated entries are removed from our DB
+    shard->mutex.Lock();
+    DirIndex old_idx(&giga_);
+    old_idx.Update(d->index);
+    d->index.Update(idx);
+    shard->mutex.Unlock();
+
+    if (target != srv_id_) {
+      dir_info.size -= moved.size();
+    }
+    // The entries may already live at the child's server so the split
+    // can no longer be undone there. Retry our part before giving up.
+    static const int kMaxCommitAttempts = 3;
+    for (int attempt = 0; attempt < kMaxCommitAttempts; attempt++) {
+      MDB::Tx* mdb_tx = mdb_->CreateTx();
+      s = Status::OK();
+      if (target != srv_id_) {
+        for (size_t i = 0; i < moved.size() && s.ok(); i++) {
+          s = mdb_->DelNode(dir_id, hashes[moved[i]], mdb_tx);
+        }
+      }
+      if (s.ok()) {
+        s = mdb_->SetIdx(dir_id, idx, mdb_tx);
+      }
+      if (s.ok()) {
+        s = mdb_->SetInfo(dir_id, dir_info, mdb_tx);
+      }
+      if (s.ok()) {
+        s = mdb_->Commit(mdb_tx);
+      }
+      mdb_->Release(mdb_tx);
+      if (s.ok()) {
+        break;
+      }
+    }
+
+    if (!s.ok()) {
+      // Stop redirecting requests that our DB still owns and fence the
+      // directory so it is never served from diverged states
+      shard->mutex.Lock();
+      d->index.Swap(old_idx);
+      d->status = s;
+      shard->mutex.Unlock();
+    }
+  }
+
+  shard->mutex.Lock();
+  if (splitting) {
+    assert((d->split_seq & 1) == 1);
+    d->split_seq++;
+  }
+  if (s.ok() && !busy) {
+    d->size = dir_info.size;
+#if VERBOSE >= 2
+    Verbose(__LOG_ARGS__, 2, "%s: partition %d split into %d (srv %d, %zu)",
+            dir_id.DebugString().c_str(), parent, child, target,
+            moved.size());
+#endif
+  } else if (!s.ok()) {
+    Error(__LOG_ARGS__, "%s: cannot split partition %d: %s",
+          dir_id.DebugString().c_str(), parent, s.ToString().c_str());
+  }
+
+  return s;
+}
+
+// Publish the creation of a sub-directory to concurrent lookups and wait
+// until any negative lease issued against its name expires. Lookups that
+// overlap with the creation see a new sequence number of the parent and
+// won't issue further negative leases.
+// REQUIRES: the mutex of the directory's shard has been locked, and the
+// directory has been locked by the caller via a DirLock.
+void MDS::SRV::RevokeNegativeLease(Shard* shard, const DirId& dir_id, Dir* d,
+                                   const Slice& name_hash) {
+  shard->mutex.AssertHeld();
+  assert(d->locked);
+  d->seq = 1 + d->seq;
+  uint64_t now = NowMicros();
+  if (d->neg_due <= now) {
+    return;  // No negative lease may still be active
+  }
+  Lease::Ref* lref = shard->leases->Lookup(dir_id, name_hash);
+  if (lref != NULL) {
+    Lease::Guard lguard(shard->leases, lref);
+    Lease* const lease = lref->value;
+    assert(lease != NULL && lease->state != kLeaseLocked);
+    while (lease->state == kLeaseShared && lease->due > now) {
+      lease->state = kLeaseLocked;
+      uint64_t diff = lease->due - now + 10;
+      shard->mutex.Unlock();
+      // Wait past lease due
+      SleepForMicroseconds(diff);
+      shard->mutex.Lock();
+      now = NowMicros();
+    }
+    lease->seq = d->seq;
+    lease->state = kLeaseFree;
+  }
+}
+
+// Insert a new file or directory on behalf of a queued writer as part of a
+// group transaction. Names inserted by earlier writers of the same group are
+// tracked in *inserted since they are not yet visible through the DB.
+// Return OK on success, or a non-OK status if the writer fails.
+// NOTE: called while no shard mutex is locked.
+Status MDS::SRV::GroupInsert(const DirId& dir_id, Dir::Writer* w,
+                             uint64_t my_time,
+                             std::map<std::string, Dir::Writer*>* inserted,
+                             MDB::Tx* mdb_tx) {
+  Status s;
+  const BaseOptions& options = *w->options;
+  const Slice& name_hash = options.name_hash;
+  Stat* stat = w->stat;
+  std::map<std::string, Dir::Writer*>::iterator it =
+      inserted->find(name_hash.ToString());
+  if (it != inserted->end()) {
+    *stat = *it->second->stat;
+  } else {
+    Slice name;
+    s = mdb_->GetNode(dir_id, name_hash, stat, &name, mdb_tx);
+
+    if (s.ok() && paranoid_checks_) {
+      std::string tmp;
+      DirIndex::PutHash(&tmp, name);
+      if (name_hash.compare(tmp) != 0) {
+        s = Status::Corruption("name and hash don't match");
+
+        Error(__LOG_ARGS__, "%s/%s: %s", dir_id.DebugString().c_str(),
+              name.ToString().c_str(), s.ToString().c_str());
+      }
+    }
+  }
+
+  if (s.ok()) {
+    if ((w->flags & O_EXCL) == O_EXCL) {
+      s = Status::AlreadyExists(Slice());
+    } else if (w->is_dir && !S_ISDIR(stat->FileMode())) {
+      s = Status::DirExpected(Slice());
+    } else if (!w->is_dir && !S_ISREG(stat->FileMode())) {
+      s = Status::FileExpected(Slice());
+    }
+  } else if (s.IsNotFound()) {
+    uint32_t mode;
+    int zserver = 0;
+    if (w->is_dir) {
+      mode = S_IFDIR;
+      mode |= (w->mode & ACCESSPERMS);
+      mode |= (w->mode & DELTAFS_DIR_MASK);
+      DirId my_id(reg_id_, snap_id_, w->ino);
+      int rserver = PickupServer(my_id);
+      zserver = rserver % giga_.num_virtual_servers;
+    } else {
+      mode = S_IFREG | (w->mode & ACCESSPERMS);
+    }
+    stat->SetRegId(reg_id_);
+    stat->SetSnapId(snap_id_);
+    stat->SetInodeNo(w->ino);
+    stat->SetFileSize(0);
+    stat->SetFileMode(mode);
+    stat->SetUserId(w->uid);
+    stat->SetGroupId(w->gid);
+    stat->SetZerothServer(zserver);
+    stat->SetModifyTime(my_time);
+    stat->SetChangeTime(my_time);
+    s = mdb_->SetNode(dir_id, name_hash, *stat, options.name, mdb_tx);
+    if (s.ok()) {
+      inserted->insert(std::make_pair(name_hash.ToString(), w));
+      w->created = true;
+    }
+  }
+
+  return s;
+}
+
+// Queue a file or directory creation against its parent directory and wait
+// until it is committed. The writer at the front of the queue becomes the
+// leader and commits all queued writers, up to a limit, using a single DB
+// write. Results are stored in each writer. Return OK on success, or a
+// non-OK status on errors.
+//
+// Queued writers against the same parent are committed as a group so
+// clients creating a large number of files in a single directory at the same
+// time no longer wait for one DB write per file. The directory may split
+// while a writer is queued. The leader therefore checks each name against
+// the current index again and redirects the writers whose names have moved.
+Status MDS::SRV::GroupCommit(Dir::Writer* w) {
+  static const size_t kMaxGroupSize = 1024;
+  Status s;
+  Dir::Tx* tx = NULL;
+  Dir::Ref* ref;
+  const DirId& dir_id = w->options->dir_id;
+  const Slice& name_hash = w->options->name_hash;
+  std::string redirect;  // Index encoding to redirect the caller with
+  w->status = Status::OK();
+  w->redirected = false;
+  w->done = false;
+
+  {
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
+    if (s.ok()) {
+      assert(ref != NULL);
+      Dir::Guard guard(shard->dirs, ref);
+      Dir* const d = ref->value;
+      assert(d != NULL);
+      s = ProbeDir(d);
+      if (s.ok()) {
+        int srv_id = d->index.HashToServer(name_hash);
+        if (srv_id != srv_id_) {
+          Slice encoding = d->index.Encode();
+          Redirect re(encoding.data(), encoding.size());
+          throw re;
+        }
+      }
+      if (s.ok()) {
+        d->writers.push_back(w);
+        while (!w->done && w != d->writers.front()) {
+          w->cv.Wait();
+        }
+      }
+      if (s.ok() && !w->done) {
+        std::vector<Dir::Writer*> group;
+        {
+          // Exclude concurrent non-grouped write operations
+          DirLock dl(d);
+          std::deque<Dir::Writer*>::iterator it = d->writers.begin();
+          for (; it != d->writers.end() && group.size() < kMaxGroupSize;
+               ++it) {
+            group.push_back(*it);
+          }
+          s = ProbeDir(d);
+          if (s.ok()) {
+            int num_inserted = 0;
+            uint64_t my_time = NowMicros();
+            for (size_t i = 0; i < group.size(); i++) {
+              const Slice& h = group[i]->options->name_hash;
+              if (d->index.HashToServer(h) != srv_id_) {
+                group[i]->redirected = true;
+              } else {
+                group[i]->ino = NextIno();
+              }
+            }
+            shard->mutex.Unlock();
+
+            tx = new Dir::Tx(mdb_);
+            tx->Ref();
+            assert(d->tx.Acquire_Load() == NULL);
+            d->tx.Release_Store(tx);
+            MDB::Tx* mdb_tx = tx->rep();
+
+            std::map<std::string, Dir::Writer*> inserted;
+            for (size_t i = 0; i < group.size(); i++) {
+              if (group[i]->redirected) {
+                continue;
+              }
+              group[i]->status =
+                  GroupInsert(dir_id, group[i], my_time, &inserted, mdb_tx);
+              if (group[i]->created) {
+                num_inserted++;
+              }
+            }
+
+            if (num_inserted != 0) {
+              DirInfo dir_info;
+              dir_info.mtime = my_time;
+              dir_info.size = num_inserted + d->size;
+              s = mdb_->SetInfo(dir_id, dir_info, mdb_tx);
+              if (s.ok()) {
+                s = mdb_->Commit(mdb_tx);
+              }
+            }
+
+            shard->mutex.Lock();
+            if (s.ok() && num_inserted != 0) {
+              d->size = num_inserted + d->size;
+              assert(my_time >= d->mtime);
+              d->mtime = my_time;
+              for (size_t i = 0; i < group.size(); i++) {
+                if (group[i]->is_dir && group[i]->created) {
+                  RevokeNegativeLease(shard, dir_id, d,
+                                      group[i]->options->name_hash);
+                }
+              }
+            }
+            for (size_t i = group.size(); i != 0; i--) {
+              if (group[i - 1]->redirected) {
+                continue;
+              }
+              if (!s.ok() || !group[i - 1]->created) {
+                TryReuseIno(group[i - 1]->ino);
+              }
+            }
+            assert(d->tx.NoBarrier_Load() == tx);
+            d->tx.NoBarrier_Store(NULL);
+            assert(tx != NULL);
+            bool last_ref = tx->Unref();
+            if (!last_ref) {
+              tx = NULL;
+            }
+            if (s.ok() && num_inserted != 0 && NeedSplit(d)) {
+              SplitDir(shard, dir_id, d);  // Errors are logged and ignored
+            }
+          }
+        }
+
+        // Fan results out to all group members
+        for (size_t i = 0; i < group.size(); i++) {
+          Dir::Writer* const member = group[i];
+          if (!s.ok() && !member->redirected) {
+            member->status = s;
+            member->created = false;
+          }
+          assert(d->writers.front() == member);
+          d->writers.pop_front();
+          if (member != w) {
+            member->done = true;
+            member->cv.Signal();
+          }
+        }
+        if (!d->writers.empty()) {
+          d->writers.front()->cv.Signal();  // Wake up the next leader
+        }
+        s = w->status;
+      } else if (s.ok()) {
+        s = w->status;
+      }
+      if (s.ok() && w->redirected) {
+        // Only the caller's thread may throw the redirect
+        Slice encoding = d->index.Encode();
+        redirect.assign(encoding.data(), encoding.size());
+      }
+    }
+  }
+
+  if (tx != NULL) {
+    tx->Dispose(mdb_);
+  }
+  if (!redirect.empty()) {
+    Redirect re(redirect);
+    throw re;
+  }
+  return s;
+}
+
+// Allocate a new inode number. Thread-safe and lock-free when c++11
+// atomics are available.
 uint64_t MDS::SRV::NextIno() {
-  mutex_.AssertHeld();
+#if __cplusplus >= 201103L
+  uint64_t result = ++ino_;
+#else
+  id_mutex_.Lock();
   uint64_t result = ++ino_;
+  id_mutex_.Unlock();
+#endif
   if (paranoid_checks_) {
     assert(srv_id_ >= 0);
     uint64_t limit = srv_id_ + 1;
     limit <<= 32;
     if (result + 1 >= limit) {
-      status_ = Status::BufferFull("No more free inodes");
+      no_more_inos_.Release_Store(this);  // Any non-NULL value will do
     }
   }
   return result;
 }
 
-// REQUIRES: mutex_ has been locked.
+// Give back an inode number that ended up not being used. This only succeeds
+// when no other inode number has been allocated after it.
 void MDS::SRV::TryReuseIno(uint64_t ino) {
-  mutex_.AssertHeld();
+#if __cplusplus >= 201103L
+  ino_.compare_exchange_strong(ino, ino - 1);
+#else
+  MutexLock ml(&id_mutex_);
   if (ino == ino_) {
     --ino_;
   }
+#endif
 }
 
-// REQUIRES: mutex_ has been locked.
 uint32_t MDS::SRV::NextSession() {
-  mutex_.AssertHeld();
+#if __cplusplus >= 201103L
+  return session_ += giga_.num_servers;
+#else
+  MutexLock ml(&id_mutex_);
   session_ += giga_.num_servers;
   return session_;
+#endif
+}
+
+// Map a parent directory to the shard holding its in-memory states.
+MDS::SRV::Shard* MDS::SRV::PickShard(const DirId& id) {
+  if (shards_.size() == 1) {
+    return shards_[0];
+  } else {
+    char tmp[30];
+    Slice encoding = EncodeId(id, tmp);
+    // Use a seed different from the one used by the LRU tables so that
+    // entries of a same shard are still spread across all hash buckets
+    uint32_t hash = Hash(encoding.data(), encoding.size(), 0x9e3779b9);
+    return shards_[hash % shards_.size()];
+  }
 }
 
 // Read file or directory stats. Return OK on success.
@@ -186,6 +743,7 @@ Status MDS::SRV::Fstat(const FstatOptions& options, FstatRet* ret) {
   Status s;
   Dir::Tx* tx = NULL;
   Dir::Ref* ref;
+  std::string redirect;
   const DirId& dir_id = options.dir_id;
   const Slice& name_hash = options.name_hash;
   if (name_hash.empty()) {
@@ -199,11 +757,12 @@ Status MDS::SRV::Fstat(const FstatOptions& options, FstatRet* ret) {
   }
 
   if (s.ok()) {
-    MutexLock ml(&mutex_);
-    s = FetchDir(dir_id, &ref);
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
     if (s.ok()) {
       assert(ref != NULL);
-      Dir::Guard guard(dirs_, ref);
+      Dir::Guard guard(shard->dirs, ref);
       const Dir* const d = ref->value;
       assert(d != NULL);
       s = ProbeDir(d);
@@ -216,7 +775,7 @@ Status MDS::SRV::Fstat(const FstatOptions& options, FstatRet* ret) {
         }
       }
       if (s.ok()) {
-        mutex_.Unlock();
+        shard->mutex.Unlock();
 
         MDB::Tx* mdb_tx = NULL;
         tx = reinterpret_cast<Dir::Tx*>(d->tx.Acquire_Load());
@@ -239,7 +798,13 @@ Status MDS::SRV::Fstat(const FstatOptions& options, FstatRet* ret) {
                 name.ToString().c_str(), s.ToString().c_str());
         }
 
-        mutex_.Lock();
+        shard->mutex.Lock();
+        if (d->index.HashToServer(name_hash) != srv_id_) {
+          // The name has moved to another server by a concurrent split
+          // and may no longer be in our DB
+          Slice encoding = d->index.Encode();
+          redirect.assign(encoding.data(), encoding.size());
+        }
         if (tx != NULL) {
           bool last_ref = tx->Unref();
           if (!last_ref) {
@@ -250,12 +815,16 @@ Status MDS::SRV::Fstat(const FstatOptions& options, FstatRet* ret) {
     }
   }
 
-  if (s.ok()) {
-    ret->stat.AssertAllSet();
-  }
   if (tx != NULL) {
     tx->Dispose(mdb_);
   }
+  if (!redirect.empty()) {
+    Redirect re(redirect);
+    throw re;
+  }
+  if (s.ok()) {
+    ret->stat.AssertAllSet();
+  }
   return s;
 }
 
@@ -289,12 +858,31 @@ Status MDS::SRV::Fcreat(const FcreatOptions& options, FcreatRet* ret) {
     }
   }
 
+  if (s.ok() && group_commit_) {
+    Dir::Writer w(&PickShard(options.dir_id)->mutex);
+    w.options = &options;
+    w.flags = options.flags;
+    w.mode = options.mode;
+    w.uid = options.uid;
+    w.gid = options.gid;
+    w.is_dir = false;
+    w.stat = &ret->stat;
+    w.created = false;
+    s = GroupCommit(&w);
+    ret->created = w.created;
+    if (s.ok()) {
+      ret->stat.AssertAllSet();
+    }
+    return s;
+  }
+
   if (s.ok()) {
-    MutexLock ml(&mutex_);
-    s = FetchDir(dir_id, &ref);
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
     if (s.ok()) {
       assert(ref != NULL);
-      Dir::Guard guard(dirs_, ref);
+      Dir::Guard guard(shard->dirs, ref);
       Dir* const d = ref->value;
       assert(d != NULL);
       DirLock dl(d);
@@ -311,7 +899,7 @@ Status MDS::SRV::Fcreat(const FcreatOptions& options, FcreatRet* ret) {
         bool entry_exists = false;
         uint64_t my_time = NowMicros();
         uint64_t my_ino = NextIno();
-        mutex_.Unlock();
+        shard->mutex.Unlock();
 
         tx = new Dir::Tx(mdb_);
         tx->Ref();
@@ -373,7 +961,7 @@ Status MDS::SRV::Fcreat(const FcreatOptions& options, FcreatRet* ret) {
           }
         }
 
-        mutex_.Lock();
+        shard->mutex.Lock();
         if (s.ok() && !entry_exists) {
           d->size = 1 + d->size;
           assert(my_time >= d->mtime);
@@ -388,6 +976,9 @@ Status MDS::SRV::Fcreat(const FcreatOptions& options, FcreatRet* ret) {
         if (!last_ref) {
           tx = NULL;
         }
+        if (s.ok() && !entry_exists && NeedSplit(d)) {
+          SplitDir(shard, dir_id, d);  // Errors are logged and ignored
+        }
       }
     }
   }
@@ -401,6 +992,241 @@ Status MDS::SRV::Fcreat(const FcreatOptions& options, FcreatRet* ret) {
   return s;
 }
 
+// Decode a sequence of length-prefixed names and compute their hashes.
+// Return false if the encoding is corrupted or if there are empty names.
+static bool DecodeNames(const Slice& encoding, std::vector<Slice>* names,
+                        std::vector<std::string>* hashes) {
+  Slice input = encoding;
+  Slice name;
+  while (GetLengthPrefixedSlice(&input, &name)) {
+    if (name.empty()) {
+      return false;
+    }
+    names->push_back(name);
+    hashes->push_back(std::string());
+    DirIndex::PutHash(&hashes->back(), name);
+  }
+  return input.empty();
+}
+
+// Insert a batch of new files into a parent directory using a single DB
+// write. Return OK on success, in which case the outcome of each name is
+// reported separately in the same way as a regular file creation. Updates
+// generated by this operation are not guaranteed to reach disk. Must do a
+// db sync to ensure durability.
+//
+// All names must be stored by the current server according to the latest
+// GIGA+ index of the parent directory, or the entire batch is redirected.
+// Errors may occur when names are malformed, when data would not go into the
+// db, and when other internal or external errors occur...
+Status MDS::SRV::Bulkcreat(const BulkcreatOptions& options,
+                           BulkcreatRet* ret) {
+  Status s;
+  Dir::Tx* tx = NULL;
+  Dir::Ref* ref;
+  const DirId& dir_id = options.dir_id;
+  std::vector<Slice> names;
+  std::vector<std::string> hashes;
+  if (!DecodeNames(options.names, &names, &hashes)) {
+    s = Status::InvalidArgument("bad names");
+  }
+
+  const size_t n = names.size();
+  std::vector<BaseOptions> opts(n);
+  std::vector<Dir::Writer*> writers;
+  ret->stats.resize(n);
+  ret->errs.assign(n, 0);
+
+  if (s.ok()) {
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
+    if (s.ok()) {
+      assert(ref != NULL);
+      Dir::Guard guard(shard->dirs, ref);
+      Dir* const d = ref->value;
+      assert(d != NULL);
+      DirLock dl(d);
+      s = ProbeDir(d);
+      if (s.ok()) {
+        for (size_t i = 0; i < n; i++) {
+          int srv_id = d->index.HashToServer(hashes[i]);
+          if (srv_id != srv_id_) {
+            Slice encoding = d->index.Encode();
+            Redirect re(encoding.data(), encoding.size());
+            throw re;
+          }
+        }
+      }
+      if (s.ok()) {
+        int num_inserted = 0;
+        uint64_t my_time = NowMicros();
+        for (size_t i = 0; i < n; i++) {
+          Dir::Writer* const w = new Dir::Writer(&shard->mutex);
+          opts[i].dir_id = dir_id;
+          opts[i].name_hash = hashes[i];
+          opts[i].name = names[i];
+          w->options = &opts[i];
+          w->flags = options.flags;
+          w->mode = options.mode;
+          w->uid = options.uid;
+          w->gid = options.gid;
+          w->is_dir = false;
+          w->stat = &ret->stats[i];
+          w->created = false;
+          w->ino = NextIno();
+          writers.push_back(w);
+        }
+        shard->mutex.Unlock();
+
+        tx = new Dir::Tx(mdb_);
+        tx->Ref();
+        assert(d->tx.Acquire_Load() == NULL);
+        d->tx.Release_Store(tx);
+        MDB::Tx* mdb_tx = tx->rep();
+
+        std::map<std::string, Dir::Writer*> inserted;
+        for (size_t i = 0; i < n; i++) {
+          Status st =
+              GroupInsert(dir_id, writers[i], my_time, &inserted, mdb_tx);
+          if (!st.ok()) {
+            ret->errs[i] = st.err_code();
+          } else if (writers[i]->created) {
+            num_inserted++;
+          }
+        }
+
+        if (num_inserted != 0) {
+          DirInfo dir_info;
+          dir_info.mtime = my_time;
+          dir_info.size = num_inserted + d->size;
+          s = mdb_->SetInfo(dir_id, dir_info, mdb_tx);
+          if (s.ok()) {
+            s = mdb_->Commit(mdb_tx);
+          }
+        }
+
+        shard->mutex.Lock();
+        if (s.ok() && num_inserted != 0) {
+          d->size = num_inserted + d->size;
+          assert(my_time >= d->mtime);
+          d->mtime = my_time;
+        }
+        for (size_t i = n; i != 0; i--) {
+          if (!s.ok() || !writers[i - 1]->created) {
+            TryReuseIno(writers[i - 1]->ino);
+          }
+        }
+        assert(d->tx.NoBarrier_Load() == tx);
+        d->tx.NoBarrier_Store(NULL);
+        assert(tx != NULL);
+        bool last_ref = tx->Unref();
+        if (!last_ref) {
+          tx = NULL;
+        }
+        if (s.ok() && num_inserted != 0 && NeedSplit(d)) {
+          SplitDir(shard, dir_id, d);  // Errors are logged and ignored
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < writers.size(); i++) {
+    delete writers[i];
+  }
+  if (tx != NULL) {
+    tx->Dispose(mdb_);
+  }
+  return s;
+}
+
+// Read the stats of a batch of names under a parent directory using a single
+// consistent view of the directory. Return OK on success, in which case the
+// outcome of each name is reported separately. Like regular read operations,
+// this operation never blocks concurrent writes and reads from the snapshot
+// of any on-going write operation.
+//
+// All names must be stored by the current server according to the latest
+// GIGA+ index of the parent directory, or the entire batch is redirected.
+Status MDS::SRV::Bulkstat(const BulkstatOptions& options, BulkstatRet* ret) {
+  Status s;
+  Dir::Tx* tx = NULL;
+  Dir::Ref* ref;
+  const DirId& dir_id = options.dir_id;
+  std::vector<Slice> names;
+  std::vector<std::string> hashes;
+  if (!DecodeNames(options.names, &names, &hashes)) {
+    s = Status::InvalidArgument("bad names");
+  }
+
+  const size_t n = names.size();
+  ret->stats.resize(n);
+  ret->errs.assign(n, 0);
+
+  if (s.ok()) {
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
+    if (s.ok()) {
+      assert(ref != NULL);
+      Dir::Guard guard(shard->dirs, ref);
+      const Dir* const d = ref->value;
+      assert(d != NULL);
+      s = ProbeDir(d);
+      if (s.ok()) {
+        for (size_t i = 0; i < n; i++) {
+          int srv_id = d->index.HashToServer(hashes[i]);
+          if (srv_id != srv_id_) {
+            Slice encoding = d->index.Encode();
+            Redirect re(encoding.data(), encoding.size());
+            throw re;
+          }
+        }
+      }
+      if (s.ok()) {
+        shard->mutex.Unlock();
+
+        MDB::Tx* mdb_tx = NULL;
+        tx = reinterpret_cast<Dir::Tx*>(d->tx.Acquire_Load());
+        if (tx != NULL) {
+          mdb_tx = tx->rep();
+          tx->Ref();
+        }
+
+        for (size_t i = 0; i < n; i++) {
+          Slice name;
+          Status st =
+              mdb_->GetNode(dir_id, hashes[i], &ret->stats[i], &name, mdb_tx);
+          if (st.ok() && paranoid_checks_) {
+            if (name != names[i]) {
+              st = Status::Corruption("name and hash don't match");
+
+              Error(__LOG_ARGS__, "%s/%s: %s", dir_id.DebugString().c_str(),
+                    name.ToString().c_str(), st.ToString().c_str());
+            }
+          }
+          if (!st.ok()) {
+            ret->errs[i] = st.err_code();
+          }
+        }
+
+        shard->mutex.Lock();
+        if (tx != NULL) {
+          bool last_ref = tx->Unref();
+          if (!last_ref) {
+            tx = NULL;
+          }
+        }
+      }
+    }
+  }
+
+  if (tx != NULL) {
+    tx->Dispose(mdb_);
+  }
+  return s;
+}
+
 // Remove an existing file from a parent directory. Return OK on success.
 // Updates generated by this operations are not guaranteed to reach disk. Must
 // do a db sync to ensure durability.
@@ -430,11 +1256,12 @@ Status MDS::SRV::Unlink(const UnlinkOptions& options, UnlinkRet* ret) {
   }
 
   if (s.ok()) {
-    MutexLock ml(&mutex_);
-    s = FetchDir(dir_id, &ref);
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
     if (s.ok()) {
       assert(ref != NULL);
-      Dir::Guard guard(dirs_, ref);
+      Dir::Guard guard(shard->dirs, ref);
       Dir* const d = ref->value;
       assert(d != NULL);
       DirLock dl(d);
@@ -450,7 +1277,7 @@ Status MDS::SRV::Unlink(const UnlinkOptions& options, UnlinkRet* ret) {
       if (s.ok()) {
         bool entry_exists = false;
         uint64_t my_time = NowMicros();
-        mutex_.Unlock();
+        shard->mutex.Unlock();
 
         tx = new Dir::Tx(mdb_);
         tx->Ref();
@@ -510,7 +1337,7 @@ Status MDS::SRV::Unlink(const UnlinkOptions& options, UnlinkRet* ret) {
           }
         }
 
-        mutex_.Lock();
+        shard->mutex.Lock();
         if (s.ok() && entry_exists) {
           assert(d->size > 1);
           d->size = -1 + d->size;
@@ -564,12 +1391,30 @@ Status MDS::SRV::Mkdir(const MkdirOptions& options, MkdirRet* ret) {
     }
   }
 
+  if (s.ok() && group_commit_) {
+    Dir::Writer w(&PickShard(options.dir_id)->mutex);
+    w.options = &options;
+    w.flags = options.flags;
+    w.mode = options.mode;
+    w.uid = options.uid;
+    w.gid = options.gid;
+    w.is_dir = true;
+    w.stat = &ret->stat;
+    w.created = false;
+    s = GroupCommit(&w);
+    if (s.ok()) {
+      ret->stat.AssertAllSet();
+    }
+    return s;
+  }
+
   if (s.ok()) {
-    MutexLock ml(&mutex_);
-    s = FetchDir(dir_id, &ref);
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
     if (s.ok()) {
       assert(ref != NULL);
-      Dir::Guard guard(dirs_, ref);
+      Dir::Guard guard(shard->dirs, ref);
       Dir* const d = ref->value;
       assert(d != NULL);
       DirLock dl(d);
@@ -587,7 +1432,7 @@ Status MDS::SRV::Mkdir(const MkdirOptions& options, MkdirRet* ret) {
         uint64_t my_time = NowMicros();
         uint64_t my_ino = NextIno();
         DirId my_id(reg_id_, snap_id_, my_ino);
-        mutex_.Unlock();
+        shard->mutex.Unlock();
 
         tx = new Dir::Tx(mdb_);
         tx->Ref();
@@ -651,11 +1496,12 @@ Status MDS::SRV::Mkdir(const MkdirOptions& options, MkdirRet* ret) {
           }
         }
 
-        mutex_.Lock();
+        shard->mutex.Lock();
         if (s.ok() && !entry_exists) {
           d->size = 1 + d->size;
           assert(my_time >= d->mtime);
           d->mtime = my_time;
+          RevokeNegativeLease(shard, dir_id, d, name_hash);
         } else {
           TryReuseIno(my_ino);
         }
@@ -666,6 +1512,9 @@ Status MDS::SRV::Mkdir(const MkdirOptions& options, MkdirRet* ret) {
         if (!last_ref) {
           tx = NULL;
         }
+        if (s.ok() && !entry_exists && NeedSplit(d)) {
+          SplitDir(shard, dir_id, d);  // Errors are logged and ignored
+        }
       }
     }
   }
@@ -704,11 +1553,12 @@ Status MDS::SRV::Utime(const UtimeOptions& options, UtimeRet* ret) {
   }
 
   if (s.ok()) {
-    MutexLock ml(&mutex_);
-    s = FetchDir(dir_id, &ref);
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
     if (s.ok()) {
       assert(ref != NULL);
-      Dir::Guard guard(dirs_, ref);
+      Dir::Guard guard(shard->dirs, ref);
       Dir* const d = ref->value;
       assert(d != NULL);
       DirLock dl(d);
@@ -723,7 +1573,7 @@ Status MDS::SRV::Utime(const UtimeOptions& options, UtimeRet* ret) {
       }
       if (s.ok()) {
         uint64_t my_time = NowMicros();
-        mutex_.Unlock();
+        shard->mutex.Unlock();
 
         tx = new Dir::Tx(mdb_);
         tx->Ref();
@@ -745,7 +1595,7 @@ Status MDS::SRV::Utime(const UtimeOptions& options, UtimeRet* ret) {
           s = mdb_->Commit(mdb_tx);
         }
 
-        mutex_.Lock();
+        shard->mutex.Lock();
         assert(d->tx.NoBarrier_Load() == tx);
         d->tx.NoBarrier_Store(NULL);
         assert(tx != NULL);
@@ -791,11 +1641,12 @@ Status MDS::SRV::Trunc(const TruncOptions& options, TruncRet* ret) {
   }
 
   if (s.ok()) {
-    MutexLock ml(&mutex_);
-    s = FetchDir(dir_id, &ref);
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
     if (s.ok()) {
       assert(ref != NULL);
-      Dir::Guard guard(dirs_, ref);
+      Dir::Guard guard(shard->dirs, ref);
       Dir* const d = ref->value;
       assert(d != NULL);
       DirLock dl(d);
@@ -810,7 +1661,7 @@ Status MDS::SRV::Trunc(const TruncOptions& options, TruncRet* ret) {
       }
       if (s.ok()) {
         uint64_t my_time = NowMicros();
-        mutex_.Unlock();
+        shard->mutex.Unlock();
 
         tx = new Dir::Tx(mdb_);
         tx->Ref();
@@ -837,7 +1688,7 @@ Status MDS::SRV::Trunc(const TruncOptions& options, TruncRet* ret) {
           s = mdb_->Commit(mdb_tx);
         }
 
-        mutex_.Lock();
+        shard->mutex.Lock();
         assert(d->tx.NoBarrier_Load() == tx);
         d->tx.NoBarrier_Store(NULL);
         assert(tx != NULL);
@@ -913,6 +1764,20 @@ Status MDS::SRV::Trunc(const TruncOptions& options, TruncRet* ret) {
 //   lease. Also, if the lease table is full at the moment, the
 //   lookup operation also returns with no lease.
 //
+// Negative leases
+// ---------------
+//
+//   If asked by the caller, a lease is also issued when the name does not
+//   exist, so the caller may cache the absence of the name until the lease
+//   due. Such a lease shares the same lease table entry as the directory
+//   that may later be created under the name. Creating the directory bumps
+//   the parent's sequence number and waits until the lease expires.
+//   A negative result is not leased if the parent's sequence number has
+//   changed during the lookup. Creating regular files does not revoke
+//   negative leases, so a cached negative entry may report a missing name
+//   for a name that has since become a regular file, which is an error
+//   either way.
+//
 // Errors may occur when the entry in question does not exist or is not a
 // directory, when the current server is not the right one for the entry,
 // when the data being read from DB is corrupted, and when other internal
@@ -921,6 +1786,7 @@ Status MDS::SRV::Lookup(const LookupOptions& options, LookupRet* ret) {
   Status s;
   Dir::Tx* tx = NULL;
   Dir::Ref* ref;
+  std::string redirect;
   const DirId& dir_id = options.dir_id;
   const Slice& name_hash = options.name_hash;
   if (name_hash.empty()) {
@@ -934,11 +1800,12 @@ Status MDS::SRV::Lookup(const LookupOptions& options, LookupRet* ret) {
   }
 
   if (s.ok()) {
-    MutexLock ml(&mutex_);
-    s = FetchDir(dir_id, &ref);
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
     if (s.ok()) {
       assert(ref != NULL);
-      Dir::Guard guard(dirs_, ref);
+      Dir::Guard guard(shard->dirs, ref);
       const Dir* const d = ref->value;
       assert(d != NULL);
       s = ProbeDir(d);
@@ -953,7 +1820,8 @@ Status MDS::SRV::Lookup(const LookupOptions& options, LookupRet* ret) {
       if (s.ok()) {
         uint64_t my_start = NowMicros();
         uint64_t my_seq = d->seq;
-        mutex_.Unlock();
+        uint64_t my_split_seq = d->split_seq;
+        shard->mutex.Unlock();
 
         MDB::Tx* mdb_tx = NULL;
         tx = reinterpret_cast<Dir::Tx*>(d->tx.Acquire_Load());
@@ -978,11 +1846,27 @@ Status MDS::SRV::Lookup(const LookupOptions& options, LookupRet* ret) {
           ret->stat.CopyFrom(stat);
         }
 
-        mutex_.Lock();
+        shard->mutex.Lock();
         uint64_t my_end = NowMicros();
-        // No lease either we timeout or have a negative result, otherwise...
-        if (s.ok() && (my_end - my_start) < (lease_duration_ - 10)) {
-          Lease::Ref* lref = leases_->Lookup(dir_id, name_hash);
+        if (d->index.HashToServer(name_hash) != srv_id_) {
+          // The name has moved to another server by a concurrent split
+          // and may no longer be in our DB
+          Slice encoding = d->index.Encode();
+          redirect.assign(encoding.data(), encoding.size());
+        }
+        // No lease if a split has overlapped with us since the child's
+        // server won't wait for our leases
+        const bool no_split =
+            redirect.empty() && d->split_seq == my_split_seq &&
+            (my_split_seq & 1) == 0;
+        // A negative result is only leased when the caller asks for it and
+        // no sub-directory has been created since we started
+        const bool negative =
+            s.IsNotFound() && options.negative_lease && d->seq == my_seq;
+        // No lease either we timeout or have an error, otherwise...
+        if ((s.ok() || negative) && no_split &&
+            (my_end - my_start) < (lease_duration_ - 10)) {
+          Lease::Ref* lref = shard->leases->Lookup(dir_id, name_hash);
           if (lref == NULL) {
             Lease* new_lease = new Lease;
             new_lease->state = kLeaseFree;
@@ -990,7 +1874,7 @@ Status MDS::SRV::Lookup(const LookupOptions& options, LookupRet* ret) {
             new_lease->due = 0;
             new_lease->seq = 0;
             try {
-              lref = leases_->Insert(dir_id, name_hash, new_lease);
+              lref = shard->leases->Insert(dir_id, name_hash, new_lease);
             } catch (int err) {
               // Not expecting errors other than ENOBUFS
               assert(err == ENOBUFS);
@@ -1006,7 +1890,7 @@ Status MDS::SRV::Lookup(const LookupOptions& options, LookupRet* ret) {
           }
           // No lease will be issued if the lease table is full, otherwise...
           if (lref != NULL) {
-            Lease::Guard lguard(leases_, lref);
+            Lease::Guard lguard(shard->leases, lref);
             Lease* const lease = lref->value;
             assert(lease != NULL);
             // No lease if the data is possibly stale, otherwise...
@@ -1021,6 +1905,9 @@ Status MDS::SRV::Lookup(const LookupOptions& options, LookupRet* ret) {
                 // able to extend the lease nor change its state
               }
               ret->stat.SetLeaseDue(lease->due);
+              if (negative) {
+                d->neg_due = std::max(d->neg_due, lease->due);
+              }
             }
           }
         }
@@ -1034,11 +1921,68 @@ Status MDS::SRV::Lookup(const LookupOptions& options, LookupRet* ret) {
     }
   }
 
+  if (tx != NULL) {
+    tx->Dispose(mdb_);
+  }
+  if (!redirect.empty()) {
+    Redirect re(redirect);
+    throw re;
+  }
   if (s.ok()) {
     ret->stat.AssertAllSet();
   }
-  if (tx != NULL) {
-    tx->Dispose(mdb_);
+  return s;
+}
+
+// Look up a chain of directories with a single request. Each name is looked
+// up under the directory resolved by the previous one, with the first name
+// looked up under the parent directory given by the caller. Return OK if at
+// least one name is resolved. The lookup state of each resolved name is
+// returned in order and is subject to the same lease control as a regular
+// lookup operation.
+//
+// The chain stops early when the next name is stored by a different
+// server, or when it cannot be resolved for whatever reason. In such cases
+// the caller receives a partial result and is expected to resolve the
+// remaining names using separate lookup operations, which will then report
+// the actual error or redirect the caller to the right server.
+//
+// Errors may occur when the first name cannot be resolved. A redirect is
+// raised when the current server is not the right one for the first name.
+Status MDS::SRV::Resolvepath(const ResolvepathOptions& options,
+                             ResolvepathRet* ret) {
+  Status s;
+  LookupOptions lopts;
+  *static_cast<BaseOptions*>(&lopts) = options;
+  char tmp[DELTAFS_NAME_HASH_BUFSIZE];
+  Slice input = options.names;
+  Slice name;
+  while (GetLengthPrefixedSlice(&input, &name)) {
+    LookupRet lret;
+    lopts.name = name;
+    if (ret->stats.empty()) {
+      lopts.name_hash = options.name_hash;
+      s = Lookup(lopts, &lret);
+      if (!s.ok()) {
+        break;
+      }
+    } else {
+      lopts.name_hash = DirIndex::Hash(name, tmp);
+      try {
+        if (!Lookup(lopts, &lret).ok()) {
+          break;
+        }
+      } catch (Redirect& re) {
+        break;
+      }
+    }
+
+    ret->stats.push_back(lret.stat);
+    lopts.dir_id = DirId(lret.stat);
+  }
+
+  if (s.ok() && ret->stats.empty()) {
+    s = Status::InvalidArgument(Slice());
   }
   return s;
 }
@@ -1076,11 +2020,12 @@ Status MDS::SRV::Uperm(const UpermOptions& options, UpermRet* ret) {
   }
 
   if (s.ok()) {
-    MutexLock ml(&mutex_);
-    s = FetchDir(dir_id, &ref);
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
     if (s.ok()) {
       assert(ref != NULL);
-      Dir::Guard guard(dirs_, ref);
+      Dir::Guard guard(shard->dirs, ref);
       Dir* const d = ref->value;
       assert(d != NULL);
       DirLock dl(d);
@@ -1095,7 +2040,7 @@ Status MDS::SRV::Uperm(const UpermOptions& options, UpermRet* ret) {
       }
       if (s.ok()) {
         uint64_t my_start = NowMicros();
-        mutex_.Unlock();
+        shard->mutex.Unlock();
 
         tx = new Dir::Tx(mdb_);
         tx->Ref();
@@ -1144,11 +2089,11 @@ Status MDS::SRV::Uperm(const UpermOptions& options, UpermRet* ret) {
           s = mdb_->Commit(mdb_tx);
         }
 
-        mutex_.Lock();
+        shard->mutex.Lock();
         uint64_t my_end = NowMicros();
         // Wait until lease expiration if the target is a directory
         if (s.ok() && S_ISDIR(stat->FileMode())) {
-          Lease::Ref* lease_ref = leases_->Lookup(dir_id, name_hash);
+          Lease::Ref* lease_ref = shard->leases->Lookup(dir_id, name_hash);
           if (lease_ref == NULL) {
             Lease* new_lease = new Lease;
             new_lease->state = kLeaseFree;
@@ -1157,7 +2102,7 @@ Status MDS::SRV::Uperm(const UpermOptions& options, UpermRet* ret) {
             new_lease->seq = 0;
             while (lease_ref == NULL) {
               try {
-                lease_ref = leases_->Insert(dir_id, name_hash, new_lease);
+                lease_ref = shard->leases->Insert(dir_id, name_hash, new_lease);
               } catch (int err) {
                 // Not expecting errors other than ENOBUFS
                 assert(err == ENOBUFS);
@@ -1168,25 +2113,25 @@ Status MDS::SRV::Uperm(const UpermOptions& options, UpermRet* ret) {
                 // TODO: a possible alternative is too force injecting a
                 // lease entry even when the lease table is full
                 lease_ref = NULL;
-                mutex_.Unlock();
+                shard->mutex.Unlock();
                 SleepForMicroseconds(lease_duration_ + 10);
-                mutex_.Lock();
+                shard->mutex.Lock();
                 my_end = NowMicros();
               }
             }
             d->num_leases++;
           }
           assert(lease_ref != NULL);
-          Lease::Guard lguard(leases_, lease_ref);
+          Lease::Guard lguard(shard->leases, lease_ref);
           Lease* const lease = lease_ref->value;
           assert(lease != NULL && lease->state != kLeaseLocked);
           while (lease->state == kLeaseShared && lease->due > my_end) {
             lease->state = kLeaseLocked;
             uint64_t diff = lease->due - my_end + 10;
-            mutex_.Unlock();
+            shard->mutex.Unlock();
             // Wait past lease due
             SleepForMicroseconds(diff);
-            mutex_.Lock();
+            shard->mutex.Lock();
             my_end = NowMicros();
           }
           assert(lease->parent == d);
@@ -1220,26 +2165,42 @@ Status MDS::SRV::Uperm(const UpermOptions& options, UpermRet* ret) {
   return s;
 }
 
-// Fetch the entries under a parent directory. Return OK on success.
+// Fetch a page of the entries under a parent directory. Return OK on success.
 // Directory listing does not have to return a serializable view of
 // the file system. So all list operations will go without synchronizing
 // with other concurrent read or write operations.
-// Errors are mostly masked so an empty list is returned in worst case.
+// Entries that cannot be decoded are skipped. Read errors fail the
+// call so a short page is never mistaken for the end of the directory.
+// Pages are bounded both in entries and in bytes so that a page always
+// fits in a single RPC reply.
 Status MDS::SRV::Listdir(const ListdirOptions& options, ListdirRet* ret) {
-  static const size_t kSizeLimit = 1000;
-  mdb_->List(options.dir_id, NULL, ret->names, NULL, kSizeLimit);
-  return Status::OK();
+  static const size_t kMaxPageEntries = 1000;
+  static const size_t kMaxPageBytes = 32 << 10;
+  // A cursor must either be empty or be a name hash
+  if (!options.start_hash.empty() && options.start_hash.size() != 8) {
+    return Status::InvalidArgument("bad listdir cursor");
+  }
+  size_t limit = options.limit;
+  if (limit == 0 || limit > kMaxPageEntries) {
+    limit = kMaxPageEntries;
+  }
+  std::vector<Stat>* const stats = options.with_stats ? ret->stats : NULL;
+  ret->last_hash = options.start_hash.ToString();
+  return mdb_->List(options.dir_id, options.start_hash, stats, ret->names,
+                    &ret->last_hash, &ret->has_more, NULL, limit,
+                    kMaxPageBytes);
 }
 
 // Return the index encoding of a parent directory. Return OK on success
 Status MDS::SRV::Readidx(const ReadidxOptions& options, ReadidxRet* ret) {
   Status s;
   Dir::Ref* ref;
-  MutexLock ml(&mutex_);
-  s = FetchDir(options.dir_id, &ref);
+  Shard* const shard = PickShard(options.dir_id);
+  MutexLock ml(&shard->mutex);
+  s = FetchDir(shard, options.dir_id, &ref);
   if (s.ok()) {
     assert(ref != NULL);
-    Dir::Guard guard(dirs_, ref);
+    Dir::Guard guard(shard->dirs, ref);
     const Dir* const d = ref->value;
     assert(d != NULL);
     s = ProbeDir(d);
@@ -1252,6 +2213,97 @@ Status MDS::SRV::Readidx(const ReadidxOptions& options, ReadidxRet* ret) {
   return s;
 }
 
+// Install a partition migrated from another server that has just split one of
+// its partitions. Directory entries of the new partition are inserted and the
+// index of the directory is updated through a single DB write.
+// Return OK on success, or a non-OK status on errors. To prevent two
+// servers splitting a same directory from waiting on each other, return
+// TryAgain if the directory is currently locked by another write operation.
+Status MDS::SRV::Migrate(const MigrateOptions& options, MigrateRet* ret) {
+  Status s;
+  Dir::Ref* ref;
+  const DirId& dir_id = options.dir_id;
+  DirIndex idx(&giga_);
+  if (!idx.Update(options.idx)) {
+    s = Status::InvalidArgument("bad dir index");
+  } else if (!idx.IsSet(options.index) ||
+             idx.GetServerForIndex(options.index) != srv_id_) {
+    s = Status::InvalidArgument("partition not assigned to us");
+  }
+
+  if (s.ok()) {
+    Shard* const shard = PickShard(dir_id);
+    MutexLock ml(&shard->mutex);
+    s = FetchDir(shard, dir_id, &ref);
+    if (s.ok()) {
+      assert(ref != NULL);
+      Dir::Guard guard(shard->dirs, ref);
+      Dir* const d = ref->value;
+      assert(d != NULL);
+      s = ProbeDir(d);
+      if (s.ok()) {
+        if (d->index.ZerothServer() != idx.ZerothServer()) {
+          s = Status::Corruption("dir index mismatch");
+        } else if (d->locked) {
+          s = Status::TryAgain("dir busy");
+        } else if (d->index.IsSet(options.index)) {
+          // Already installed by an earlier attempt whose reply was lost.
+          // Our copy may have changed since then so it is kept and no
+          // entry is counted twice.
+          return s;
+        }
+      }
+      if (s.ok()) {
+        DirLock dl(d);
+        int num_entries = 0;
+        uint64_t my_time = NowMicros();
+        idx.Update(d->index);
+        shard->mutex.Unlock();
+
+        MDB::Tx* mdb_tx = mdb_->CreateTx();
+        Slice input = options.entries;
+        Slice name_hash;
+        Slice name;
+        Stat stat;
+        while (s.ok() && !input.empty()) {
+          if (!GetLengthPrefixedSlice(&input, &name_hash) ||
+              !GetLengthPrefixedSlice(&input, &name) ||
+              !stat.DecodeFrom(&input)) {
+            s = Status::InvalidArgument("bad dir entries");
+          } else {
+            s = mdb_->SetNode(dir_id, name_hash, stat, name, mdb_tx);
+            num_entries++;
+          }
+        }
+
+        if (s.ok()) {
+          s = mdb_->SetIdx(dir_id, idx, mdb_tx);
+        }
+        if (s.ok()) {
+          DirInfo dir_info;
+          dir_info.mtime = my_time;
+          dir_info.size = num_entries + d->size;
+          s = mdb_->SetInfo(dir_id, dir_info, mdb_tx);
+        }
+        if (s.ok()) {
+          s = mdb_->Commit(mdb_tx);
+        }
+        mdb_->Release(mdb_tx);
+
+        shard->mutex.Lock();
+        if (s.ok()) {
+          d->index.Update(idx);
+          d->size = num_entries + d->size;
+          assert(my_time >= d->mtime);
+          d->mtime = my_time;
+        }
+      }
+    }
+  }
+
+  return s;
+}
+
 // Assign an unique session id to a connecting client. Also informs the
 // client of the env we are running on so the client knowns where
 // to access file data and file system metadata.
@@ -1262,9 +2314,7 @@ Status MDS::SRV::Opensession(const OpensessionOptions&, OpensessionRet* ret) {
   ret->env_conf = mds_env_->env_conf;
   ret->fio_name = mds_env_->fio_name;
   ret->fio_conf = mds_env_->fio_conf;
-  mutex_.Lock();
   ret->session_id = NextSession();
-  mutex_.Unlock();
   return s;
 }
 
@@ -16,6 +16,15 @@
 #include "pdlfs-common/lease.h"
 #include "pdlfs-common/port.h"
 
+#include <map>
+#include <string>
+#include <vector>
+
+// If c++11 or newer, directly use c++ std atomic counters.
+#if __cplusplus >= 201103L
+#include <atomic>
+#endif
+
 namespace pdlfs {
 
 class MDS::SRV : public MDS {
@@ -27,6 +36,8 @@ class MDS::SRV : public MDS {
 
   DEC_OP(Fstat)
   DEC_OP(Fcreat)
+  DEC_OP(Bulkcreat)
+  DEC_OP(Bulkstat)
   DEC_OP(Mkdir)
   DEC_OP(Chmod)
   DEC_OP(Chown)
@@ -35,8 +46,10 @@ class MDS::SRV : public MDS {
   DEC_OP(Trunc)
   DEC_OP(Unlink)
   DEC_OP(Lookup)
+  DEC_OP(Resolvepath)
   DEC_OP(Listdir)
   DEC_OP(Readidx)
+  DEC_OP(Migrate)
   DEC_OP(Opensession)
   DEC_OP(Getinput)
   DEC_OP(Getoutput)
@@ -44,9 +57,33 @@ class MDS::SRV : public MDS {
 #undef DEC_OP
 
  private:
+  // Directory states and leases are partitioned by parent directory id
+  // into a set of shards. Each shard has its own lock so that operations
+  // against directories in different shards never contend with each other.
+  struct Shard {
+    Shard(const LeaseOptions& lease_options, size_t dir_table_size);
+    ~Shard();
+
+    // State below is protected by mutex
+    port::Mutex mutex;
+    LeaseTable* leases;
+    HashSet loading_dirs;  // A set of dirs being loaded into a memory cache
+    port::CondVar loading_cv;
+    DirTable* dirs;
+  };
+  Shard* PickShard(const DirId& id);
   Status LoadDir(const DirId& id, DirInfo* info, DirIndex* index);
-  Status FetchDir(const DirId& id, Dir::Ref** ref);
+  Status FetchDir(Shard* shard, const DirId& id, Dir::Ref** ref);
   Status ProbeDir(const Dir* dir);
+  Status GroupCommit(Dir::Writer* w);
+  bool CanSplit(const DirIndex& idx, int index);
+  bool NeedSplit(const Dir* d);
+  Status SplitDir(Shard* shard, const DirId& id, Dir* d);
+  void RevokeNegativeLease(Shard* shard, const DirId& id, Dir* d,
+                           const Slice& name_hash);
+  Status GroupInsert(const DirId& dir_id, Dir::Writer* w, uint64_t my_time,
+                     std::map<std::string, Dir::Writer*>* inserted,
+                     MDB::Tx* mdb_tx);
 
   // Constant after construction
   MDSEnv* mds_env_;
@@ -58,23 +95,30 @@ class MDS::SRV : public MDS {
   typedef DirIndexOptions GIGA;
   GIGA giga_;
   bool paranoid_checks_;
+  bool group_commit_;
+  size_t split_threshold_;
+  MDSFactory* peers_;
   uint64_t lease_duration_;
   uint64_t snap_id_;
   uint64_t reg_id_;
   int srv_id_;
 
-  // State below is protected by mutex_
-  port::Mutex mutex_;
-  LeaseTable* leases_;
-  HashSet loading_dirs_;  // A set of dirs being loaded into a memory cache
-  port::CondVar loading_cv_;
-  DirTable* dirs_;
+  std::vector<Shard*> shards_;
+
+  // Session ids and inode numbers are allocated without taking any shard
+  // locks. A server-wide error is set when inode numbers are exhausted.
   uint32_t NextSession();
-  uint32_t session_;  // The last session id we allocated
   void TryReuseIno(uint64_t ino);
   uint64_t NextIno();
-  uint64_t ino_;  // The last ino num we allocated
-  Status status_;
+  port::AtomicPointer no_more_inos_;
+#if __cplusplus >= 201103L
+  std::atomic<uint32_t> session_;  // The last session id we allocated
+  std::atomic<uint64_t> ino_;      // The last ino num we allocated
+#else
+  port::Mutex id_mutex_;  // Protects session_ and ino_
+  uint32_t session_;
+  uint64_t ino_;
+#endif
 
   friend class MDS;
   // No copying allowed
@@ -82,6 +126,28 @@ class MDS::SRV : public MDS {
   SRV(const SRV&);
 };
 
+// A file or directory creation waiting to be group committed with other
+// creations against the same parent directory.
+struct Dir::Writer {
+  explicit Writer(port::Mutex* mu) : redirected(false), cv(mu), done(false) {}
+  const MDS::BaseOptions* options;
+  uint32_t flags;
+  uint32_t mode;
+  uint32_t uid;
+  uint32_t gid;
+  bool is_dir;
+  // Results
+  Stat* stat;
+  bool created;
+  Status status;
+
+  uint64_t ino;  // Assigned by the leader of the group
+  // Set by the leader if the name no longer belongs to this server
+  bool redirected;
+  port::CondVar cv;
+  bool done;
+};
+
 inline Status MDS::SRV::Chmod(const ChmodOptions& options, ChmodRet* ret) {
   UpermRet uperm_ret;
   UpermOptions uperm_options;
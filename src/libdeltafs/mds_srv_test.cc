@@ -8,18 +8,27 @@
  */
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
+#include <map>
+#include <set>
+#include <vector>
+
+#include "mds_cli.h"
 #include "mds_srv.h"
+#include "pdlfs-common/coding.h"
+#include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 
 namespace pdlfs {
 
 class ServerTest {
- private:
+ protected:
   std::string dbname_;
   MDSEnv mds_env_;
   MDS* mds_;
@@ -27,7 +36,7 @@ class ServerTest {
   DB* db_;
 
  public:
-  ServerTest() {
+  explicit ServerTest(bool group_commit = false) {
     Env* env = Env::Default();
     dbname_ = test::PrepareTmpDir("mds_srv_test", env);
     DBOptions dbopts;
@@ -42,6 +51,7 @@ class ServerTest {
     MDSOptions mdsopts;
     mdsopts.mds_env = &mds_env_;
     mdsopts.mdb = mdb_;
+    mdsopts.group_commit = group_commit;
     mds_ = MDS::Open(mdsopts);
   }
 
@@ -118,6 +128,151 @@ class ServerTest {
     }
   }
 
+  // Create files from multiple threads at the same time. Thread i creates
+  // files [i * n, i * n + n) as well as a set of files shared by all threads.
+  // Files are inserted into directory 0 unless a parent directory is
+  // given for each thread. Return the number of shared files successfully
+  // created.
+  struct CreateState {
+    ServerTest* test;
+    std::vector<int> dirs;
+    int n;
+    int num_shared;
+    int next_thread;
+    int num_running;
+    int shared_created;
+    std::vector<int> inos;
+    port::Mutex mu;
+    port::CondVar cv;
+    CreateState() : cv(&mu) {}
+  };
+
+  static void CreateFiles(void* arg) {
+    CreateState* state = reinterpret_cast<CreateState*>(arg);
+    state->mu.Lock();
+    const int t = state->next_thread++;
+    const int dir = state->dirs.empty() ? 0 : state->dirs[t];
+    state->mu.Unlock();
+    std::vector<int> inos;
+    int shared_created = 0;
+    for (int i = 0; i < state->n; i++) {
+      if (i < state->num_shared) {
+        if (state->test->Mknod(dir, -1 - i) > 0) {
+          shared_created++;
+        }
+      }
+      inos.push_back(state->test->Mknod(dir, t * state->n + i));
+    }
+    MutexLock ml(&state->mu);
+    state->inos.insert(state->inos.end(), inos.begin(), inos.end());
+    state->shared_created += shared_created;
+    state->num_running--;
+    state->cv.SignalAll();
+  }
+
+  int ConcurrentCreates(int num_threads, int n, int num_shared,
+                        std::vector<int>* inos,
+                        const std::vector<int>* dirs = NULL) {
+    CreateState state;
+    state.test = this;
+    if (dirs != NULL) {
+      state.dirs = *dirs;
+    }
+    state.n = n;
+    state.num_shared = num_shared;
+    state.next_thread = 0;
+    state.num_running = num_threads;
+    state.shared_created = 0;
+    for (int i = 0; i < num_threads; i++) {
+      Env::Default()->StartThread(CreateFiles, &state);
+    }
+    MutexLock ml(&state.mu);
+    while (state.num_running != 0) {
+      state.cv.Wait();
+    }
+    inos->swap(state.inos);
+    return state.shared_created;
+  }
+
+  static std::string EncodeNames(int from, int to) {
+    std::string names;
+    for (int i = from; i < to; i++) {
+      PutLengthPrefixedSlice(&names, NodeName(i));
+    }
+    return names;
+  }
+
+  // Create files [from, to) with a single bulk operation and store
+  // the outcome of each file. Return "-err_code" on errors.
+  int Bulkcreat(int dir_ino, int from, int to, std::vector<int>* errs) {
+    MDS::BulkcreatOptions options;
+    options.dir_id = DirId(0, 0, dir_ino);
+    options.flags = O_EXCL;
+    options.mode = ACCESSPERMS;
+    options.uid = 0;
+    options.gid = 0;
+    std::string names = EncodeNames(from, to);
+    options.names = names;
+    MDS::BulkcreatRet ret;
+    Status s = mds_->Bulkcreat(options, &ret);
+    if (s.ok()) {
+      *errs = ret.errs;
+      return 0;
+    } else {
+      return -1 * s.err_code();
+    }
+  }
+
+  // Read the stats of files [from, to) with a single bulk operation and
+  // store the ino, or "-err_code", of each file.
+  int Bulkstat(int dir_ino, int from, int to, std::vector<int>* inos) {
+    MDS::BulkstatOptions options;
+    options.dir_id = DirId(0, 0, dir_ino);
+    std::string names = EncodeNames(from, to);
+    options.names = names;
+    MDS::BulkstatRet ret;
+    Status s = mds_->Bulkstat(options, &ret);
+    if (s.ok()) {
+      for (size_t i = 0; i < ret.errs.size(); i++) {
+        if (ret.errs[i] != 0) {
+          inos->push_back(-1 * ret.errs[i]);
+        } else {
+          inos->push_back(static_cast<int>(ret.stats[i].InodeNo()));
+        }
+      }
+      return 0;
+    } else {
+      return -1 * s.err_code();
+    }
+  }
+
+  // Resolve a chain of directories starting from the given parent directory
+  // and store the inos of all directories resolved. Return the number of
+  // directories resolved, or "-err_code" on errors.
+  int Resolvepath(int dir_ino, const std::vector<int>& nod_nos,
+                  std::vector<int>* inos) {
+    MDS::ResolvepathOptions options;
+    options.dir_id = DirId(0, 0, dir_ino);
+    std::string names;
+    for (size_t i = 0; i < nod_nos.size(); i++) {
+      PutLengthPrefixedSlice(&names, NodeName(nod_nos[i]));
+    }
+    options.names = names;
+    std::string name_hash;
+    DirIndex::PutHash(&name_hash, NodeName(nod_nos[0]));
+    options.name_hash = name_hash;
+    MDS::ResolvepathRet ret;
+    Status s = mds_->Resolvepath(options, &ret);
+    if (s.ok()) {
+      for (size_t i = 0; i < ret.stats.size(); i++) {
+        inos->push_back(static_cast<int>(ret.stats[i].InodeNo()));
+      }
+      return ret.stats.size();
+    } else {
+      return -1 * s.err_code();
+    }
+  }
+
   int Listdir(int dir_ino) {
     MDS::ListdirOptions options;
     options.dir_id = DirId(0, 0, dir_ino);
@@ -173,8 +328,1077 @@ TEST(ServerTest, Scan) {
   ASSERT_TRUE(r == 9);
 }
 
+TEST(ServerTest, ListPages) {
+  const int n = 250;
+  for (int i = 0; i < n; i++) {
+    ASSERT_TRUE(Mknod(0, i) > 0);
+  }
+  MDS::ListdirOptions options;
+  options.dir_id = DirId(0, 0, 0);
+  options.limit = 100;
+  options.with_stats = true;
+  std::vector<std::string> names;
+  std::vector<Stat> stats;
+  MDS::ListdirRet ret;
+  ret.names = &names;
+  ret.stats = &stats;
+  std::set<std::string> listed;
+  std::string cursor;
+  int pages = 0;
+  do {
+    names.clear();
+    stats.clear();
+    options.start_hash = cursor;
+    ASSERT_OK(mds_->Listdir(options, &ret));
+    ASSERT_TRUE(names.size() <= options.limit);
+    ASSERT_EQ(stats.size(), names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+      ASSERT_TRUE(S_ISREG(stats[i].FileMode()));
+      ASSERT_TRUE(listed.insert(names[i]).second);
+    }
+    cursor = ret.last_hash;
+    pages++;
+  } while (ret.has_more);
+  ASSERT_EQ(listed.size(), n);
+  ASSERT_EQ(pages, 3);
+  options.start_hash = "x";
+  ASSERT_TRUE(mds_->Listdir(options, &ret).IsInvalidArgument());
+}
+
+TEST(ServerTest, Subdirs) {
+  std::vector<int> dirs;
+  for (int i = 0; i < 8; i++) {
+    int r = Mkdir(0, i);
+    ASSERT_TRUE(r > 0);
+    dirs.push_back(r);
+  }
+  std::vector<int> inos;
+  // Threads create files in their own directories, which are likely
+  // to reside in different shards of the server
+  ConcurrentCreates(dirs.size(), 100, 0, &inos, &dirs);
+  std::set<int> uniq(dirs.begin(), dirs.end());
+  for (size_t i = 0; i < inos.size(); i++) {
+    ASSERT_TRUE(inos[i] > 0);
+    uniq.insert(inos[i]);
+  }
+  ASSERT_EQ(uniq.size(), inos.size() + dirs.size());
+  for (size_t i = 0; i < dirs.size(); i++) {
+    ASSERT_EQ(Listdir(dirs[i]), 100);
+    ASSERT_TRUE(Fstat(dirs[i], i * 100) > 0);
+    ASSERT_TRUE(Fstat(dirs[i], (i + 1) * 100) == -1 * Status::kNotFound);
+  }
+}
+
+TEST(ServerTest, Resolvepath) {
+  std::vector<int> dirs;
+  int parent = 0;
+  for (int i = 1; i <= 4; i++) {
+    int r = Mkdir(parent, i);
+    ASSERT_TRUE(r > 0);
+    dirs.push_back(r);
+    parent = r;
+  }
+  Mknod(parent, 5);
+  std::vector<int> path;
+  path.push_back(1);
+  path.push_back(2);
+  path.push_back(3);
+  path.push_back(4);
+  std::vector<int> inos;
+  ASSERT_EQ(Resolvepath(0, path, &inos), 4);
+  ASSERT_TRUE(inos == dirs);
+  // Partial results are returned on missing or non-directory names
+  path[2] = 9;
+  inos.clear();
+  ASSERT_EQ(Resolvepath(0, path, &inos), 2);
+  ASSERT_EQ(inos[1], dirs[1]);
+  path[2] = 3;
+  path.push_back(5);
+  inos.clear();
+  ASSERT_EQ(Resolvepath(0, path, &inos), 4);
+  // Errors are only reported for the first name
+  path[0] = 9;
+  ASSERT_TRUE(Resolvepath(0, path, &inos) == -1 * Status::kNotFound);
+}
+
+TEST(ServerTest, BulkOps) {
+  std::vector<int> errs;
+  ASSERT_EQ(Bulkcreat(0, 0, 100, &errs), 0);
+  ASSERT_EQ(errs.size(), 100);
+  for (size_t i = 0; i < errs.size(); i++) {
+    ASSERT_EQ(errs[i], 0);
+  }
+  ASSERT_EQ(Listdir(0), 100);
+  // Existing files are reported individually
+  ASSERT_EQ(Bulkcreat(0, 90, 110, &errs), 0);
+  for (size_t i = 0; i < errs.size(); i++) {
+    ASSERT_EQ(errs[i], i < 10 ? Status::kAlreadyExists : 0);
+  }
+  ASSERT_EQ(Listdir(0), 110);
+  std::vector<int> inos;
+  ASSERT_EQ(Bulkstat(0, 100, 120, &inos), 0);
+  for (size_t i = 0; i < inos.size(); i++) {
+    if (i < 10) {
+      ASSERT_EQ(inos[i], Fstat(0, 100 + i));
+    } else {
+      ASSERT_EQ(inos[i], -1 * Status::kNotFound);
+    }
+  }
+  std::set<int> uniq;
+  inos.clear();
+  ASSERT_EQ(Bulkstat(0, 0, 110, &inos), 0);
+  for (size_t i = 0; i < inos.size(); i++) {
+    ASSERT_TRUE(inos[i] > 0);
+    uniq.insert(inos[i]);
+  }
+  ASSERT_EQ(uniq.size(), 110);
+}
+
+// A metadata client talking to an in-process metadata server.
+class ClientTest : public ServerTest, public MDSFactory {
+ public:
+  ClientTest() : monitor_(mds_) {
+    MDSCliOptions options;
+    options.env = Env::Default();
+    options.factory = this;
+    options.batched_path_resolution = true;
+    cli_ = MDS::CLI::Open(options);
+  }
+
+  virtual ~ClientTest() { delete cli_; }
+
+  virtual MDS* Get(size_t srv_id) { return &monitor_; }
+
+  SimpleMDSMonitor monitor_;
+  MDS::CLI* cli_;
+};
+
+TEST(ClientTest, BatchedPathResolution) {
+  std::string path;
+  std::vector<uint64_t> inos;
+  Fentry ent;
+  for (int i = 0; i < 8; i++) {
+    path += "/" + NodeName(i);
+    ASSERT_OK(cli_->Mkdir(path, ACCESSPERMS, &ent));
+    inos.push_back(ent.stat.InodeNo());
+  }
+  ASSERT_OK(cli_->Fcreat(path + "/x", ACCESSPERMS, &ent));
+  const uint64_t ino = ent.stat.InodeNo();
+  // Start over with an empty lookup cache
+  delete cli_;
+  MDSCliOptions options;
+  options.env = Env::Default();
+  options.factory = this;
+  options.batched_path_resolution = true;
+  cli_ = MDS::CLI::Open(options);
+  monitor_.Reset();
+  ASSERT_OK(cli_->Fstat(path + "/x", &ent));
+  ASSERT_EQ(ent.stat.InodeNo(), ino);
+  // All parent directories are resolved with a single request
+  ASSERT_EQ(monitor_.Get_Resolvepath_count(), 1);
+  ASSERT_EQ(monitor_.Get_Lookup_count(), 0);
+  ASSERT_OK(cli_->Fstat(path + "/../" + NodeName(7), &ent));
+  ASSERT_EQ(ent.stat.InodeNo(), inos[7]);
+  ASSERT_OK(cli_->Fstat("/node0/./node1//node2/node3", &ent));
+  ASSERT_EQ(ent.stat.InodeNo(), inos[3]);
+  ASSERT_TRUE(cli_->Fstat("/node0/node1/nodeX/node3/x", &ent).IsNotFound());
+  ASSERT_TRUE(cli_->Fstat(path + "/x/y", &ent).IsDirExpected());
+}
+
+TEST(ClientTest, BulkFiles) {
+  ASSERT_OK(cli_->Mkdir("/a", ACCESSPERMS));
+  std::vector<std::string> strs;
+  for (int i = 0; i < 3000; i++) {
+    strs.push_back(NodeName(i));
+  }
+  strs.push_back("node0");  // Duplicate names
+  strs.push_back("x/y");    // Bad names
+  std::vector<Slice> names(strs.begin(), strs.end());
+  std::vector<Status> results;
+  monitor_.Reset();
+  ASSERT_OK(cli_->Bulkcreat("/a", names, ACCESSPERMS, &results));
+  // Names are sent in batches
+  ASSERT_EQ(monitor_.Get_Bulkcreat_count(), 3);
+  ASSERT_EQ(monitor_.Get_Fcreat_count(), 0);
+  ASSERT_EQ(results.size(), names.size());
+  for (int i = 0; i < 3000; i++) {
+    ASSERT_OK(results[i]);
+  }
+  ASSERT_TRUE(results[3000].IsAlreadyExists());
+  ASSERT_TRUE(results[3001].IsInvalidArgument());
+  std::vector<Stat> stats;
+  ASSERT_OK(cli_->Bulkstat("/a", names, &stats, &results));
+  Fentry ent;
+  for (int i = 0; i < 3000; i += 7) {
+    ASSERT_OK(results[i]);
+    ASSERT_OK(cli_->Fstat("/a/" + strs[i], &ent));
+    ASSERT_EQ(stats[i].InodeNo(), ent.stat.InodeNo());
+  }
+  ASSERT_TRUE(cli_->Bulkstat("/b", names, &stats, &results).IsNotFound());
+}
+
+TEST(ClientTest, NegativeLookups) {
+  delete cli_;
+  MDSCliOptions options;
+  options.env = Env::Default();
+  options.factory = this;
+  options.negative_lookups = true;
+  cli_ = MDS::CLI::Open(options);
+  ASSERT_OK(cli_->Mkdir("/z", ACCESSPERMS));
+  Fentry ent;
+  ASSERT_TRUE(cli_->Fstat("/a/x", &ent).IsNotFound());
+  ASSERT_TRUE(cli_->Fstat("/a/y", &ent).IsNotFound());
+  // The absence of "/a" is cached
+  LookupCache::Stats stats;
+  IndexCache::Stats idx_stats;
+  cli_->GetCacheStats(&stats, &idx_stats);
+  ASSERT_EQ(stats.negative_hits, 1);
+  ASSERT_EQ(stats.misses, 1);
+  // Creating "/a" waits out the negative lease
+  const uint64_t start = Env::Default()->NowMicros();
+  ASSERT_OK(cli_->Mkdir("/a", ACCESSPERMS));
+  ASSERT_GT(Env::Default()->NowMicros() - start, 100 * 1000);
+  ASSERT_OK(cli_->Fcreat("/a/x", ACCESSPERMS, &ent));
+  ASSERT_OK(cli_->Fstat("/a/x", &ent));
+  // Missing parents are not leased when they are to be created
+  ASSERT_OK(cli_->Mkdir("/b/c", ACCESSPERMS, NULL, true));
+}
+
+TEST(ClientTest, LeaseRenewal) {
+  delete cli_;
+  MDSCliOptions options;
+  options.env = Env::Default();
+  options.factory = this;
+  options.negative_lookups = true;
+  // Longer than the lease duration so every cache hit renews
+  options.lease_renewal_window = 2 * 1000 * 1000;
+  cli_ = MDS::CLI::Open(options);
+  ASSERT_OK(cli_->Mkdir("/a", ACCESSPERMS));
+  Fentry ent;
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(cli_->Fstat("/a/x", &ent).IsNotFound());
+    ASSERT_TRUE(cli_->Fstat("/b/x", &ent).IsNotFound());
+  }
+  LookupCache::Stats stats;
+  IndexCache::Stats idx_stats;
+  for (int i = 0; i < 500; i++) {
+    cli_->GetCacheStats(&stats, &idx_stats);
+    if (stats.renewals >= 2) break;
+    Env::Default()->SleepForMicroseconds(10 * 1000);
+  }
+  // Both the positive and the negative entry are renewed
+  ASSERT_GE(stats.renewals, 2);
+  ASSERT_EQ(stats.misses, 2);
+  ASSERT_EQ(stats.hits + stats.negative_hits, 4);
+  ASSERT_GE(idx_stats.hits, 1);
+}
+
+namespace {
+struct PageCounter {
+  PageCounter()
+      : pages(0), entries(0), max_pages(-1), caller(pthread_self()) {}
+  int pages;
+  int entries;
+  int max_pages;     // Stop after this many pages unless negative
+  pthread_t caller;  // Thread expected to receive all pages
+
+  static bool Count(const std::vector<std::string>& names,
+                    const std::vector<Stat>* stats, void* arg) {
+    PageCounter* c = reinterpret_cast<PageCounter*>(arg);
+    ASSERT_TRUE(pthread_equal(pthread_self(), c->caller));
+    if (stats != NULL) {
+      ASSERT_EQ(stats->size(), names.size());
+    }
+    c->pages++;
+    c->entries += names.size();
+    return c->max_pages < 0 || c->pages < c->max_pages;
+  }
+};
+}  // namespace
+
+TEST(ClientTest, StreamingListdir) {
+  delete cli_;
+  MDSCliOptions options;
+  options.env = Env::Default();
+  options.factory = this;
+  options.listdir_page_size = 16;
+  cli_ = MDS::CLI::Open(options);
+  ASSERT_OK(cli_->Mkdir("/a", ACCESSPERMS));
+  const int n = 100;
+  for (int i = 0; i < n; i++) {
+    ASSERT_OK(cli_->Fcreat("/a/" + NodeName(i), ACCESSPERMS));
+  }
+  PageCounter c1;
+  ASSERT_OK(cli_->Listdir("/a", PageCounter::Count, &c1, true));
+  ASSERT_EQ(c1.entries, n);
+  ASSERT_EQ(c1.pages, (n + 15) / 16);
+  // Listing stops once the callback asks to
+  PageCounter c2;
+  c2.max_pages = 2;
+  ASSERT_OK(cli_->Listdir("/a", PageCounter::Count, &c2));
+  ASSERT_EQ(c2.pages, 2);
+  ASSERT_EQ(c2.entries, 32);
+  std::vector<std::string> names;
+  ASSERT_OK(cli_->Listdir("/a", &names));
+  ASSERT_EQ(names.size(), n);
+}
+
+class GroupCommitTest : public ServerTest {
+ public:
+  GroupCommitTest() : ServerTest(true) {}
+};
+
+TEST(GroupCommitTest, GroupFiles) {
+  int r1 = Fstat(0, 1);
+  ASSERT_TRUE(r1 == -1 * Status::kNotFound);
+  int r2 = Mknod(0, 1);
+  ASSERT_TRUE(r2 > 0);
+  int r3 = Fstat(0, 1);
+  ASSERT_TRUE(r3 == r2);
+  int r4 = Mknod(0, 1);
+  ASSERT_TRUE(r4 == -1 * Status::kAlreadyExists);
+  int r5 = Mkdir(0, 1);
+  ASSERT_TRUE(r5 == -1 * Status::kAlreadyExists);
+}
+
+TEST(GroupCommitTest, GroupDirs) {
+  int r1 = Mkdir(0, 1);
+  ASSERT_TRUE(r1 > 0);
+  int r2 = Fstat(0, 1);
+  ASSERT_TRUE(r2 == r1);
+  int r3 = Mkdir(0, 1);
+  ASSERT_TRUE(r3 == -1 * Status::kAlreadyExists);
+  int r4 = Mknod(0, 2);
+  ASSERT_TRUE(r4 > 0);
+  ASSERT_TRUE(Listdir(0) == 2);
+}
+
+TEST(GroupCommitTest, ConcurrentCreates) {
+  const int num_threads = 8;
+  const int n = 100;  // Keep the directory within a single Listdir() reply
+  const int num_shared = 20;
+  std::vector<int> inos;
+  int shared_created = ConcurrentCreates(num_threads, n, num_shared, &inos);
+  // Each shared file is created by exactly one thread
+  ASSERT_EQ(shared_created, num_shared);
+  ASSERT_EQ(inos.size(), num_threads * n);
+  std::set<int> uniq;
+  for (size_t i = 0; i < inos.size(); i++) {
+    ASSERT_TRUE(inos[i] > 0);
+    uniq.insert(inos[i]);
+  }
+  ASSERT_EQ(uniq.size(), inos.size());
+  ASSERT_EQ(Listdir(0), num_threads * n + num_shared);
+  for (int i = 0; i < num_threads * n; i += 97) {
+    ASSERT_TRUE(Fstat(0, i) > 0);
+  }
+}
+
+// A log file that takes a while to append to, allowing more writers to queue
+// up behind a group commit.
+class SlowLogFile : public WritableFile {
+ public:
+  explicit SlowLogFile(WritableFile* base) : base_(base) {}
+  virtual ~SlowLogFile() { delete base_; }
+
+  virtual Status Append(const Slice& data) {
+    Env::Default()->SleepForMicroseconds(1000);
+    return base_->Append(data);
+  }
+
+  virtual Status Close() { return base_->Close(); }
+  virtual Status Flush() { return base_->Flush(); }
+  virtual Status Sync() { return base_->Sync(); }
+
+ private:
+  WritableFile* const base_;
+};
+
+class SlowLogEnv : public EnvWrapper {
+ public:
+  SlowLogEnv() : EnvWrapper(Env::Default()) {}
+
+  virtual Status NewWritableFile(const char* f, WritableFile** r) {
+    Status s = target()->NewWritableFile(f, r);
+    if (s.ok() && Slice(f).ends_with(".log")) {
+      *r = new SlowLogFile(*r);
+    }
+    return s;
+  }
+};
+
+// Multiple in-process metadata servers whose directories start on a single
+// server and split to other servers as they grow.
+class SplitTest : public MDSFactory {
+ public:
+  enum { kNumServers = 4, kNumVirServers = 8, kSplitThreshold = 64 };
+
+  explicit SplitTest(bool group_commit = false, Env* db_env = NULL) {
+    Env* env = Env::Default();
+    giga_.num_servers = kNumServers;
+    giga_.num_virtual_servers = kNumVirServers;
+    mds_env_.env = env;
+    for (int i = 0; i < kNumServers; i++) {
+      char tmp[30];
+      snprintf(tmp, sizeof(tmp), "mds_split_test_%d", i);
+      std::string dbname = test::PrepareTmpDir(tmp, env);
+      DBOptions dbopts;
+      dbopts.env = env;
+      DestroyDB(dbname, dbopts);
+      dbopts.create_if_missing = true;
+      if (db_env != NULL) {
+        dbopts.env = db_env;
+      }
+      DB* db;
+      ASSERT_OK(DB::Open(dbopts, dbname, &db));
+      dbs_.push_back(db);
+      MDBOptions mdbopts;
+      mdbopts.db = db;
+      mdbs_.push_back(new MDB(mdbopts));
+      MDSOptions mdsopts;
+      mdsopts.mds_env = &mds_env_;
+      mdsopts.mdb = mdbs_[i];
+      mdsopts.num_servers = kNumServers;
+      mdsopts.num_virtual_servers = kNumVirServers;
+      mdsopts.split_threshold = kSplitThreshold;
+      mdsopts.group_commit = group_commit;
+      mdsopts.peers = this;
+      mdsopts.srv_id = i;
+      srvs_.push_back(MDS::Open(mdsopts));
+    }
+  }
+
+  virtual ~SplitTest() {
+    for (int i = 0; i < kNumServers; i++) {
+      delete srvs_[i];
+      delete mdbs_[i];
+      delete dbs_[i];
+    }
+    std::map<int, DirIndex*>::iterator it = idxs_.begin();
+    for (; it != idxs_.end(); ++it) {
+      delete it->second;
+    }
+  }
+
+  virtual MDS* Get(size_t srv_id) { return srvs_[srv_id]; }
+
+  // Pick a server for a name according to our cached index of the parent
+  // directory. Redirects from servers will update that index.
+  int Route(int dir_ino, const Slice& name_hash) {
+    MutexLock ml(&mu_);
+    std::map<int, DirIndex*>::iterator it = idxs_.find(dir_ino);
+    if (it == idxs_.end()) {
+      return 0;
+    } else {
+      return it->second->HashToServer(name_hash);
+    }
+  }
+
+  void Redirected(int dir_ino, const MDS::Redirect& re) {
+    MutexLock ml(&mu_);
+    DirIndex*& idx = idxs_[dir_ino];
+    if (idx == NULL) idx = new DirIndex(&giga_);
+    ASSERT_TRUE(idx->Update(re));
+  }
+
+  // Return the ino of the newly created file, or "-err_code" on errors.
+  int Mknod(int dir_ino, int nod_no) {
+    MDS::FcreatOptions options;
+    options.dir_id = DirId(0, 0, dir_ino);
+    options.flags = O_EXCL;
+    options.mode = ACCESSPERMS;
+    options.uid = 0;
+    options.gid = 0;
+    std::string name = ServerTest::NodeName(nod_no);
+    options.name = name;
+    std::string name_hash;
+    DirIndex::PutHash(&name_hash, name);
+    options.name_hash = name_hash;
+    MDS::FcreatRet ret;
+    Status s;
+    for (int i = 0; i < 10; i++) {
+      try {
+        s = srvs_[Route(dir_ino, name_hash)]->Fcreat(options, &ret);
+        break;
+      } catch (MDS::Redirect& re) {
+        Redirected(dir_ino, re);
+        s = Status::TryAgain(Slice());
+      }
+    }
+    if (s.ok()) {
+      return static_cast<int>(ret.stat.InodeNo());
+    } else {
+      return -1 * s.err_code();
+    }
+  }
+
+  // Return the error code of looking up a file.
+  int Fstat(int dir_ino, int nod_no) {
+    MDS::FstatOptions options;
+    options.dir_id = DirId(0, 0, dir_ino);
+    std::string name = ServerTest::NodeName(nod_no);
+    options.name = name;
+    std::string name_hash;
+    DirIndex::PutHash(&name_hash, name);
+    options.name_hash = name_hash;
+    MDS::FstatRet ret;
+    Status s;
+    for (int i = 0; i < 10; i++) {
+      try {
+        s = srvs_[Route(dir_ino, name_hash)]->Fstat(options, &ret);
+        break;
+      } catch (MDS::Redirect& re) {
+        Redirected(dir_ino, re);
+        s = Status::TryAgain(Slice());
+      }
+    }
+    return s.err_code();
+  }
+
+  // Create files [from, to) with bulk operations, routing each name by our
+  // cached index. Return the number of files created.
+  int Bulkcreat(int dir_ino, int from, int to) {
+    std::vector<int> todo;
+    for (int i = from; i < to; i++) {
+      todo.push_back(i);
+    }
+    int created = 0;
+    for (int round = 0; round < 10 && !todo.empty(); round++) {
+      std::map<int, std::vector<int> > parts;
+      for (size_t i = 0; i < todo.size(); i++) {
+        std::string name_hash;
+        DirIndex::PutHash(&name_hash, ServerTest::NodeName(todo[i]));
+        parts[Route(dir_ino, name_hash)].push_back(todo[i]);
+      }
+      todo.clear();
+      std::map<int, std::vector<int> >::iterator it = parts.begin();
+      for (; it != parts.end(); ++it) {
+        MDS::BulkcreatOptions options;
+        options.dir_id = DirId(0, 0, dir_ino);
+        options.flags = O_EXCL;
+        options.mode = ACCESSPERMS;
+        options.uid = 0;
+        options.gid = 0;
+        std::string names;
+        for (size_t i = 0; i < it->second.size(); i++) {
+          PutLengthPrefixedSlice(&names, ServerTest::NodeName(it->second[i]));
+        }
+        options.names = names;
+        MDS::BulkcreatRet ret;
+        try {
+          ASSERT_OK(srvs_[it->first]->Bulkcreat(options, &ret));
+          for (size_t i = 0; i < ret.errs.size(); i++) {
+            if (ret.errs[i] == 0) created++;
+          }
+        } catch (MDS::Redirect& re) {
+          Redirected(dir_ino, re);
+          todo.insert(todo.end(), it->second.begin(), it->second.end());
+        }
+      }
+    }
+    return created;
+  }
+
+  // Return the number of entries stored at a given server.
+  int Listdir(int srv_id, int dir_ino) {
+    MDS::ListdirOptions options;
+    options.dir_id = DirId(0, 0, dir_ino);
+    std::vector<std::string> names;
+    MDS::ListdirRet ret;
+    ret.names = &names;
+    ASSERT_OK(srvs_[srv_id]->Listdir(options, &ret));
+    return names.size();
+  }
+
+  DirIndexOptions giga_;
+  MDSEnv mds_env_;
+  std::vector<DB*> dbs_;
+  std::vector<MDB*> mdbs_;
+  std::vector<MDS*> srvs_;
+  port::Mutex mu_;  // Protects idxs_
+  std::map<int, DirIndex*> idxs_;
+};
+
+TEST(SplitTest, SmallDir) {
+  for (int i = 0; i < kSplitThreshold; i++) {
+    ASSERT_TRUE(Mknod(1, i) > 0);
+  }
+  int num_servers_used = 0;
+  for (int i = 0; i < kNumServers; i++) {
+    int n = Listdir(i, 1);
+    if (n != 0) {
+      ASSERT_EQ(n, kSplitThreshold);
+      num_servers_used++;
+    }
+  }
+  ASSERT_EQ(num_servers_used, 1);
+}
+
+TEST(SplitTest, LargeDir) {
+  const int n = 800;
+  for (int i = 0; i < n; i++) {
+    ASSERT_TRUE(Mknod(1, i) > 0);
+  }
+  int total = 0;
+  int num_servers_used = 0;
+  for (int i = 0; i < kNumServers; i++) {
+    int r = Listdir(i, 1);
+    if (r != 0) {
+      num_servers_used++;
+    }
+    total += r;
+  }
+  ASSERT_EQ(total, n);
+  ASSERT_EQ(num_servers_used, kNumServers);
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(Fstat(1, i), 0);
+    ASSERT_EQ(Mknod(1, i), -1 * Status::kAlreadyExists);
+  }
+  ASSERT_EQ(Fstat(1, n), Status::kNotFound);
+}
+
+TEST(SplitTest, BulkCreates) {
+  const int n = 800;
+  for (int i = 0; i < n; i += 100) {
+    ASSERT_EQ(Bulkcreat(1, i, i + 100), 100);
+  }
+  int total = 0;
+  int num_servers_used = 0;
+  for (int i = 0; i < kNumServers; i++) {
+    int r = Listdir(i, 1);
+    if (r != 0) {
+      num_servers_used++;
+    }
+    total += r;
+  }
+  ASSERT_EQ(total, n);
+  ASSERT_EQ(num_servers_used, kNumServers);
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(Fstat(1, i), 0);
+  }
+  ASSERT_EQ(Bulkcreat(1, 0, n), 0);
+}
+
+// Splits must not start when the entries to move cannot be fully listed
+TEST(SplitTest, BadEntry) {
+  ASSERT_TRUE(Mknod(1, 0) > 0);
+  int zserver = 0;
+  while (Listdir(zserver, 1) == 0) {
+    zserver++;
+  }
+  Key key(0, 0, 1, kDirEntType);
+  key.SetHash(std::string(8, 0));
+  ASSERT_OK(dbs_[zserver]->Put(WriteOptions(), key.Encode(), "bad"));
+  const int n = 2 * kSplitThreshold;
+  for (int i = 1; i < n; i++) {
+    ASSERT_TRUE(Mknod(1, i) > 0);
+  }
+  for (int i = 0; i < kNumServers; i++) {
+    ASSERT_EQ(Listdir(i, 1), i == zserver ? n : 0);
+  }
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(Fstat(1, i), 0);
+  }
+}
+
+class GroupSplitTest : public SplitTest {
+ public:
+  GroupSplitTest() : SplitTest(true, &slow_env_) {}
+
+  struct CreateState {
+    GroupSplitTest* test;
+    int n;
+    int num_threads;
+    int next_thread;
+    int num_running;
+    int num_created;
+    port::Mutex mu;
+    port::CondVar cv;
+    CreateState() : cv(&mu) {}
+  };
+
+  // Create files [0, n) round-robin with all other threads.
+  static void CreateFiles(void* arg) {
+    CreateState* state = reinterpret_cast<CreateState*>(arg);
+    state->mu.Lock();
+    const int t = state->next_thread++;
+    state->mu.Unlock();
+    int num_created = 0;
+    for (int i = t; i < state->n; i += state->num_threads) {
+      if (state->test->Mknod(1, i) > 0) {
+        num_created++;
+      }
+    }
+    MutexLock ml(&state->mu);
+    state->num_created += num_created;
+    state->num_running--;
+    state->cv.SignalAll();
+  }
+
+  static SlowLogEnv slow_env_;
+};
+
+SlowLogEnv GroupSplitTest::slow_env_;
+
+// Writers queued for a group commit while their directory splits must be
+// redirected instead of being inserted at a server that no longer owns
+// their names.
+TEST(GroupSplitTest, SplitWithQueuedWriters) {
+  CreateState state;
+  state.test = this;
+  state.n = 800;
+  state.num_threads = 8;
+  state.next_thread = 0;
+  state.num_running = state.num_threads;
+  state.num_created = 0;
+  for (int i = 0; i < state.num_threads; i++) {
+    Env::Default()->StartThread(CreateFiles, &state);
+  }
+  {
+    MutexLock ml(&state.mu);
+    while (state.num_running != 0) {
+      state.cv.Wait();
+    }
+  }
+  ASSERT_EQ(state.num_created, state.n);
+  int total = 0;
+  for (int i = 0; i < kNumServers; i++) {
+    total += Listdir(i, 1);
+  }
+  ASSERT_EQ(total, state.n);
+  for (int i = 0; i < state.n; i++) {
+    ASSERT_EQ(Fstat(1, i), 0);
+  }
+}
+
+// Splits whose Migrate calls first look up a name on the splitting server.
+// The lookup runs after the split has checked the leases below the
+// directory and before it publishes the new index.
+class LookupSplitTest : public SplitTest {
+ public:
+  LookupSplitTest() : zserver_(-1), lease_due_(0), num_hooks_(0) {}
+
+  class Hook : public MDSWrapper {
+   public:
+    Hook(LookupSplitTest* t, MDS* base) : MDSWrapper(base), t_(t) {}
+
+    virtual Status Migrate(const MigrateOptions& options, MigrateRet* ret) {
+      if (t_->num_hooks_++ == 0) {
+        DirIndex idx(&t_->giga_);
+        ASSERT_TRUE(idx.Update(options.idx));
+        // Pick a missing name that is about to move
+        std::string name_hash;
+        for (int i = 1000000; name_hash.empty(); i++) {
+          t_->name_ = ServerTest::NodeName(i);
+          DirIndex::PutHash(&name_hash, t_->name_);
+          if (idx.HashToIndex(name_hash) != options.index) {
+            name_hash.clear();
+          }
+        }
+        t_->lease_due_ = t_->Lookup();
+      }
+      return MDSWrapper::Migrate(options, ret);
+    }
+
+   private:
+    LookupSplitTest* t_;
+  };
+
+  virtual ~LookupSplitTest() {
+    for (size_t i = 0; i < hooks_.size(); i++) {
+      delete hooks_[i];
+    }
+  }
+
+  virtual MDS* Get(size_t srv_id) {
+    MutexLock ml(&mu_);
+    if (hooks_.empty()) {
+      for (size_t i = 0; i < srvs_.size(); i++) {
+        hooks_.push_back(new Hook(this, srvs_[i]));
+      }
+    }
+    return hooks_[srv_id];
+  }
+
+  // Look up name_ at the zeroth server asking for a negative lease.
+  // Return the lease due, or -1 if redirected.
+  int64_t Lookup() {
+    MDS::LookupOptions options;
+    options.dir_id = DirId(0, 0, 1);
+    options.name = name_;
+    std::string name_hash;
+    DirIndex::PutHash(&name_hash, name_);
+    options.name_hash = name_hash;
+    options.negative_lease = true;
+    MDS::LookupRet ret;
+    try {
+      Status s = srvs_[zserver_]->Lookup(options, &ret);
+      ASSERT_TRUE(s.IsNotFound());
+      return static_cast<int64_t>(ret.stat.LeaseDue());
+    } catch (MDS::Redirect& re) {
+      return -1;
+    }
+  }
+
+  std::vector<Hook*> hooks_;
+  int zserver_;
+  std::string name_;
+  int64_t lease_due_;
+  int num_hooks_;
+};
+
+// A split does not wait for leases issued after it has started, so lookups
+// overlapping with it must not be granted any
+TEST(LookupSplitTest, NoLeaseDuringSplit) {
+  ASSERT_TRUE(Mknod(1, 0) > 0);
+  zserver_ = 0;
+  while (Listdir(zserver_, 1) == 0) {
+    zserver_++;
+  }
+  const int n = 2 * kSplitThreshold;
+  for (int i = 1; i < n; i++) {
+    ASSERT_TRUE(Mknod(1, i) > 0);
+  }
+  ASSERT_TRUE(num_hooks_ > 0);
+  ASSERT_EQ(lease_due_, 0);
+  // The name has moved and is now redirected
+  ASSERT_EQ(Lookup(), -1);
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(Fstat(1, i), 0);
+  }
+}
+
+class LostReplySplitTest : public SplitTest {
+ public:
+  LostReplySplitTest() : target_(-1) {}
+
+  // Apply the first migration twice and then report a lost reply.
+  class Hook : public MDSWrapper {
+   public:
+    Hook(LostReplySplitTest* t, int srv_id, MDS* base)
+        : MDSWrapper(base), t_(t), srv_id_(srv_id) {}
+
+    virtual Status Migrate(const MigrateOptions& options, MigrateRet* ret) {
+      Status s = MDSWrapper::Migrate(options, ret);
+      if (s.ok() && t_->target_ == -1) {
+        t_->target_ = srv_id_;
+        MDB* const mdb = t_->mdbs_[srv_id_];
+        ASSERT_OK(mdb->GetInfo(options.dir_id, &t_->info_, NULL));
+        ASSERT_OK(MDSWrapper::Migrate(options, ret));
+        s = Status::IOError("lost reply");
+      }
+      return s;
+    }
+
+   private:
+    LostReplySplitTest* t_;
+    int srv_id_;
+  };
+
+  virtual ~LostReplySplitTest() {
+    for (size_t i = 0; i < hooks_.size(); i++) {
+      delete hooks_[i];
+    }
+  }
+
+  virtual MDS* Get(size_t srv_id) {
+    MutexLock ml(&mu_);
+    if (hooks_.empty()) {
+      for (size_t i = 0; i < srvs_.size(); i++) {
+        hooks_.push_back(new Hook(this, static_cast<int>(i), srvs_[i]));
+      }
+    }
+    return hooks_[srv_id];
+  }
+
+  std::vector<Hook*> hooks_;
+  int target_;
+  DirInfo info_;
+};
+
+// A migration replayed after its reply is lost is not applied twice, and
+// the parent partition stops serving once it cannot tell whether it went
+// through.
+TEST(LostReplySplitTest, FenceAndReplay) {
+  int n = 0;
+  for (; n < 2 * kSplitThreshold && target_ == -1; n++) {
+    ASSERT_TRUE(Mknod(1, n) > 0);
+  }
+  ASSERT_TRUE(target_ != -1);
+  DirInfo info;
+  ASSERT_OK(mdbs_[target_]->GetInfo(DirId(0, 0, 1), &info, NULL));
+  ASSERT_EQ(info.size, info_.size);
+  ASSERT_EQ(Listdir(target_, 1), info.size);
+  // The new index is never published and the parent refuses all names
+  for (int i = 0; i < n; i++) {
+    ASSERT_TRUE(Fstat(1, i) != 0);
+  }
+}
+
+namespace {
+// A listdir callback that, while holding up the listing at its first
+// page, waits for a task scheduled on the default Env to run.
+struct PoolProbe {
+  PoolProbe() : ran(false), checked(false), ran_in_time(false) {}
+  port::Mutex mu;
+  bool ran;
+  bool checked;
+  bool ran_in_time;  // Whether the task ran while the listing was held up
+
+  // Wait for the scheduled task so it never outlives the probe.
+  void WaitForTask() {
+    while (true) {
+      {
+        MutexLock ml(&mu);
+        if (ran) break;
+      }
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+  }
+
+  static void Run(void* arg) {
+    PoolProbe* p = reinterpret_cast<PoolProbe*>(arg);
+    MutexLock ml(&p->mu);
+    p->ran = true;
+  }
+
+  static bool Check(const std::vector<std::string>& names,
+                    const std::vector<Stat>* stats, void* arg) {
+    PoolProbe* p = reinterpret_cast<PoolProbe*>(arg);
+    if (!p->checked) {
+      p->checked = true;
+      Env::Default()->Schedule(Run, p);
+      for (int i = 0; i < 1000; i++) {
+        {
+          MutexLock ml(&p->mu);
+          p->ran_in_time = p->ran;
+        }
+        if (p->ran_in_time) break;
+        Env::Default()->SleepForMicroseconds(10 * 1000);
+      }
+    }
+    return true;
+  }
+};
+}  // namespace
+
+// Directories spread over all servers are listed page by page in parallel.
+TEST(SplitTest, ParallelListdir) {
+  // Clients expect the root directory to start at server 0
+  DirIndex root(0, &giga_);
+  for (int i = 0; i < kNumServers; i++) {
+    ASSERT_OK(mdbs_[i]->SetIdx(DirId(0, 0, 0), root, NULL));
+  }
+  MDSCliOptions options;
+  options.env = Env::Default();
+  options.factory = this;
+  options.num_servers = kNumServers;
+  options.num_virtual_servers = kNumVirServers;
+  options.listdir_page_size = 50;
+  MDS::CLI* cli = MDS::CLI::Open(options);
+  Fentry ent;
+  ASSERT_OK(cli->Mkdir("/d", ACCESSPERMS, &ent));
+  const int n = 800;
+  for (int i = 0; i < n; i++) {
+    ASSERT_OK(cli->Fcreat("/d/" + ServerTest::NodeName(i), ACCESSPERMS));
+  }
+  const int ino = static_cast<int>(ent.stat.InodeNo());
+  for (int i = 0; i < kNumServers; i++) {
+    ASSERT_TRUE(Listdir(i, ino) > 0);
+  }
+  PageCounter c;
+  ASSERT_OK(cli->Listdir("/d", PageCounter::Count, &c, true));
+  ASSERT_EQ(c.entries, n);
+  ASSERT_TRUE(c.pages >= n / 50);
+  std::vector<std::string> names;
+  ASSERT_OK(cli->Listdir("/d", &names));
+  ASSERT_EQ(names.size(), n);
+  std::set<std::string> unique(names.begin(), names.end());
+  ASSERT_EQ(unique.size(), n);
+  // Background helpers must not hold on to the shared Env pool while the
+  // page queue is full, so other background work still gets to run
+  PoolProbe probe;
+  ASSERT_OK(cli->Listdir("/d", PoolProbe::Check, &probe));
+  probe.WaitForTask();
+  ASSERT_TRUE(probe.ran_in_time);
+  delete cli;
+}
+
+// Measure the create throughput of many threads inserting files into a
+// single large directory.
+class LargeDirBench {
+ public:
+  static int GetOption(const char* key, int def) {
+    const char* env = getenv(key);
+    if (env == NULL || env[0] == 0) {
+      return def;
+    } else {
+      return atoi(env);
+    }
+  }
+
+  LargeDirBench()
+      : num_threads_(GetOption("LD_THREADS", 8)),
+        num_files_(GetOption("LD_FILES", 10000)) {}
+
+  void Run(bool group_commit) {
+    ServerTest t(group_commit);
+    std::vector<int> inos;
+    const uint64_t start = Env::Default()->NowMicros();
+    t.ConcurrentCreates(num_threads_, num_files_, 0, &inos);
+    const uint64_t dura = Env::Default()->NowMicros() - start;
+    int errors = 0;
+    for (size_t i = 0; i < inos.size(); i++) {
+      if (inos[i] <= 0) errors++;
+    }
+    fprintf(stderr, "group_commit=%d: %d threads, %d files, %.3f s\n",
+            int(group_commit), num_threads_, int(inos.size()), 1e-6 * dura);
+    fprintf(stderr, "  %.0f creates/s, %d errors\n",
+            1e6 * inos.size() / (dura ? dura : 1), errors);
+  }
+
+  void LogAndApply() {
+    Run(false);
+    Run(true);
+  }
+
+ private:
+  int num_threads_;
+  int num_files_;  // Per thread
+};
+
 }  // namespace pdlfs
 
+static void BM_Usage() {
+  fprintf(stderr, "Use --bench=large_dir to run benchmark.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options (via env vars):\n");
+  fprintf(stderr, "  LD_THREADS  number of creating threads (8)\n");
+  fprintf(stderr, "  LD_FILES    files created per thread (10000)\n");
+}
+
+static void BM_Main(int* argc, char*** argv) {
+  pdlfs::Slice bench_name;
+  if (*argc > 1) {
+    bench_name = pdlfs::Slice((*argv)[*argc - 1]);
+  }
+  if (bench_name == "--bench=large_dir") {
+    pdlfs::LargeDirBench bench;
+    bench.LogAndApply();
+  } else {
+    BM_Usage();
+  }
+}
+
 int main(int argc, char* argv[]) {
-  return ::pdlfs::test::RunAllTests(&argc, &argv);
+  pdlfs::Slice token;
+  if (argc > 1) {
+    token = pdlfs::Slice(argv[argc - 1]);
+  }
+  if (!token.starts_with("--bench")) {
+    return ::pdlfs::test::RunAllTests(&argc, &argv);
+  } else {
+    BM_Main(&argc, &argv);
+    return 0;
+  }
 }
@@ -31,6 +31,23 @@ DirOutputStats::DirOutputStats()
       value_size(0),
       key_size(0) {}
 
+void DirOutputStats::Merge(const DirOutputStats& other) {
+  total_num_keys_ += other.total_num_keys_;
+  total_num_dropped_keys_ += other.total_num_dropped_keys_;
+  total_num_blocks_ += other.total_num_blocks_;
+  total_num_tables_ += other.total_num_tables_;
+  final_data_size += other.final_data_size;
+  data_size += other.data_size;
+  final_meta_index_size += other.final_meta_index_size;
+  meta_index_size += other.meta_index_size;
+  final_index_size += other.final_index_size;
+  index_size += other.index_size;
+  final_filter_size += other.final_filter_size;
+  filter_size += other.filter_size;
+  value_size += other.value_size;
+  key_size += other.key_size;
+}
+
 DirBuilder::DirBuilder(const DirOptions& options, DirOutputStats* stats)
     : options_(options),
       compac_stats_(stats),
@@ -221,126 +238,60 @@ Iterator* ArrayBlock::NewIterator(const Comparator* comparator) {
 }
 
 template <typename T>
-SeqDirBuilder<T>::SeqDirBuilder(const DirOptions& options,
-                                DirOutputStats* stats, LogSink* data,
-                                LogSink* indx)
-    : DirBuilder(options, stats),
+DirTableBuilder<T>::DirTableBuilder(const DirOptions& options,
+                                    DirOutputStats* stats, LogSink* data,
+                                    size_t batch_size)
+    : options_(options),
+      compac_stats_(stats),
+      num_entries_(0),
       num_uncommitted_indx_(0),
       num_uncommitted_data_(0),
       pending_restart_(false),
       pending_commit_(false),
+      batch_size_(batch_size),
       data_block_(new T(options)),
       indx_block_(1),
-      epok_block_(1),
-      root_block_(1),
       pending_indx_entry_(false),
-      pending_meta_entry_(false),
-      pending_root_entry_(false),
-      pending_data_flush_(0),
-      pending_indx_flush_(0),
       data_sink_(data),
       data_offset_(0),
-      indx_writter_(new LogWriter(options, indx)),
-      indx_sink_(indx),
       finished_(false) {
-  // Sanity checks
-  assert(indx_sink_ != NULL && data_sink_ != NULL);
-
-  indx_sink_->Ref();
+  assert(data_sink_ != NULL);
   data_sink_->Ref();
 
   // Allocate memory
   const size_t estimated_index_size_per_table = 4 << 10;
   indx_block_.Reserve(estimated_index_size_per_table);
-  const size_t estimated_meta_index_size_per_epoch = 4 << 10;
-  epok_block_.Reserve(estimated_meta_index_size_per_epoch);
-  const size_t estimated_root_index = 4 << 10;
-  root_block_.Reserve(estimated_root_index);
 
   block_threshold_ =
       static_cast<size_t>(floor(options_.block_size * options_.block_util));
   uncommitted_indexes_.reserve(1 << 10);
-  if (options_.block_batch_size != 0)
-    data_block_->buffer_store()->reserve(options_.block_batch_size);
+  if (batch_size_ != 0) data_block_->buffer_store()->reserve(batch_size_);
   data_block_->buffer_store()->clear();
   pending_restart_ = true;
 }
 
 template <typename T>
-SeqDirBuilder<T>::~SeqDirBuilder() {
-  indx_sink_->Unref();
+DirTableBuilder<T>::~DirTableBuilder() {
   data_sink_->Unref();
-  delete indx_writter_;
   delete data_block_;
 }
 
 template <typename T>
-void SeqDirBuilder<T>::FinishEpoch(uint32_t ep_seq) {
-  assert(!finished_);  // Finish() has not been called
-  // Skip epochs already finished
-  if (ep_seq < num_eps_) return;
-  EndTable(Slice(), static_cast<ChunkType>(0) /*Invalid*/);
-  if (!ok()) return;
-  if (num_tabls_ == 0) {  // Empty epoch
-    // Empty epochs are skipped. But we need to remember their existence.
-    num_eps_ = ep_seq + 1;
-    return;
-  }
-  EpochStone stone;
-
-  BlockHandle epok_block_handle;
-  Slice epok_index_contents = epok_block_.Finish();
-  status_ =
-      indx_writter_->Write(kMetaChunk, epok_index_contents, &epok_block_handle);
-  if (!ok()) {
-    return;
-  }
-
-  const uint64_t meta_index_size = epok_index_contents.size();
-  const uint64_t final_meta_index_size =
-      epok_block_handle.size() + kBlockTrailerSize;
-  compac_stats_->final_meta_index_size += final_meta_index_size;
-  compac_stats_->meta_index_size += meta_index_size;
-
-  epok_block_.Reset();
-  last_epok_info_.set_index_offset(epok_block_handle.offset());
-  last_epok_info_.set_index_size(epok_block_handle.size());
-  last_epok_info_.set_num_tables(num_tabls_);
-  last_epok_info_.set_num_ents(num_entries_);
-  assert(!pending_root_entry_);
-  pending_root_entry_ = true;
-
-  std::string handle_encoding;
-  last_epok_info_.EncodeTo(&handle_encoding);
-  root_block_.Add(EpochKey(num_eps_), handle_encoding);
-  pending_root_entry_ = false;
-
-  stone.set_handle(epok_block_handle);
-  stone.set_id(num_eps_);
-  std::string epoch_stone;
-  stone.EncodeTo(&epoch_stone);
-  status_ = indx_writter_->SealEpoch(epoch_stone);
-  if (!ok()) {
-    return;
-  }
-
-  pending_indx_flush_ = indx_sink_->Ltell();
-  pending_data_flush_ = data_offset_;
-
-  if (ok()) {
-    num_eps_ = ep_seq + 1;  // Flush up-to the requested epoch seq
+void DirTableBuilder<T>::Reset(bool new_epoch) {
 #ifndef NDEBUG
-    // Keys are only required to be unique within an epoch
-    keys_.clear();
+  // Keys are only required to be unique within an epoch
+  if (new_epoch) keys_.clear();
 #endif
-    num_entries_ = 0;
-    num_tabls_ = 0;
-  }
+  indx_block_.Reset();
+  smallest_key_.clear();
+  largest_key_.clear();
+  last_key_.clear();
+  num_entries_ = 0;
+  finished_ = false;
 }
 
 template <typename T>
-void SeqDirBuilder<T>::EndTable(const Slice& filter_contents,
-                                ChunkType filter_type) {
+void DirTableBuilder<T>::Finish() {
   assert(!finished_);  // Finish() has not been called
 
   EndBlock();
@@ -357,66 +308,14 @@ void SeqDirBuilder<T>::EndTable(const Slice& filter_contents,
   Commit();
   if (!ok()) {
     return;
-  } else if (indx_block_.empty()) {
-    return;  // Empty table
   }
 
-  BlockHandle index_block_handle;
-  Slice index_contents = indx_block_.Finish();
-  status_ =
-      indx_writter_->Write(kIdxChunk, index_contents, &index_block_handle);
-  if (!ok()) {
-    return;
-  }
-
-  const uint64_t index_size = index_contents.size();
-  const uint64_t final_index_size =
-      index_block_handle.size() + kBlockTrailerSize;
-  compac_stats_->final_index_size += final_index_size;
-  compac_stats_->index_size += index_size;
-
-  BlockHandle filter_handle;
-  if (!filter_contents.empty()) {
-    status_ =
-        indx_writter_->Write(filter_type, filter_contents, &filter_handle);
-    if (!ok()) {
-      return;
-    }
-
-    const uint64_t filter_size = filter_contents.size();
-    const uint64_t final_filter_size = filter_handle.size() + kBlockTrailerSize;
-    compac_stats_->final_filter_size += final_filter_size;
-    compac_stats_->filter_size += filter_size;
-  } else {
-    filter_handle.set_offset(0);  // No filter installed
-    filter_handle.set_size(0);
-  }
-
-  indx_block_.Reset();
-  last_tabl_info_.set_filter_offset(filter_handle.offset());
-  last_tabl_info_.set_filter_size(filter_handle.size());
-  last_tabl_info_.set_index_offset(index_block_handle.offset());
-  last_tabl_info_.set_index_size(index_block_handle.size());
-  assert(!pending_meta_entry_);
-  pending_meta_entry_ = true;
-
-  last_tabl_info_.set_smallest_key(smallest_key_);
   BytewiseComparator()->FindShortSuccessor(&largest_key_);
-  last_tabl_info_.set_largest_key(largest_key_);
-  std::string handle_encoding;
-  last_tabl_info_.EncodeTo(&handle_encoding);
-  epok_block_.Add(EpochTableKey(num_eps_, num_tabls_), handle_encoding);
-  pending_meta_entry_ = false;
-
-  compac_stats_->total_num_tables_++;
-  num_tabls_++;  // Num of tables within an epoch
-  smallest_key_.clear();
-  largest_key_.clear();
-  last_key_.clear();
+  finished_ = true;
 }
 
 template <typename T>
-void SeqDirBuilder<T>::Commit() {
+void DirTableBuilder<T>::Commit() {
   assert(!finished_);  // Finish() has not been called
   // Skip empty commit
   if (data_block_->buffer_store()->empty()) return;
@@ -479,7 +378,7 @@ void SeqDirBuilder<T>::Commit() {
 }
 
 template <typename T>
-void SeqDirBuilder<T>::EndBlock() {
+void DirTableBuilder<T>::EndBlock() {
   assert(!finished_);                // Finish() has not been called
   if (pending_restart_) return;      // Empty block
   if (data_block_->empty()) return;  // Empty block
@@ -524,7 +423,7 @@ void SeqDirBuilder<T>::EndBlock() {
 }
 
 template <typename T>
-void SeqDirBuilder<T>::Add(const Slice& key, const Slice& value) {
+void DirTableBuilder<T>::Add(const Slice& key, const Slice& value) {
   assert(!finished_);       // Finish() has not been called
   assert(key.size() != 0);  // Keys cannot be empty
   if (!ok()) return;        // Abort
@@ -593,7 +492,7 @@ void SeqDirBuilder<T>::Add(const Slice& key, const Slice& value) {
 
   data_block_->Add(key, value);
   compac_stats_->total_num_keys_++;
-  num_entries_++;  // Num key-value entries within an epoch
+  num_entries_++;  // Num key-value entries within the table
   if (IsKeyUnOrdered(options_.mode)) {
     return;  // Force one block per table
   }
@@ -603,12 +502,250 @@ void SeqDirBuilder<T>::Add(const Slice& key, const Slice& value) {
     EndBlock();
     // Schedule buffer commit if it is about to full
     if (data_block_->buffer_store()->size() + options_.block_size >
-        options_.block_batch_size) {
+        batch_size_) {
       pending_commit_ = true;
     }
   }
 }
 
+template <typename T>
+size_t DirTableBuilder<T>::memory_usage() const {
+  size_t result = data_block_->memory_usage();
+  result += indx_block_.memory_usage();
+  return result;
+}
+
+template <typename T>
+SeqDirBuilder<T>::SeqDirBuilder(const DirOptions& options,
+                                DirOutputStats* stats, LogSink* data,
+                                LogSink* indx)
+    : DirBuilder(options, stats),
+      tb_(new TableBuilder(options, stats, data, options.block_batch_size)),
+      epok_block_(1),
+      root_block_(1),
+      pending_meta_entry_(false),
+      pending_root_entry_(false),
+      pending_indx_flush_(0),
+      data_sink_(data),
+      indx_writter_(new LogWriter(options, indx)),
+      indx_sink_(indx),
+      finished_(false) {
+  // Sanity checks
+  assert(indx_sink_ != NULL && data_sink_ != NULL);
+
+  indx_sink_->Ref();
+  data_sink_->Ref();
+
+  // Allocate memory
+  const size_t estimated_meta_index_size_per_epoch = 4 << 10;
+  epok_block_.Reserve(estimated_meta_index_size_per_epoch);
+  const size_t estimated_root_index = 4 << 10;
+  root_block_.Reserve(estimated_root_index);
+}
+
+template <typename T>
+SeqDirBuilder<T>::~SeqDirBuilder() {
+  indx_sink_->Unref();
+  data_sink_->Unref();
+  delete indx_writter_;
+  delete tb_;
+}
+
+template <typename T>
+void SeqDirBuilder<T>::FinishEpoch(uint32_t ep_seq) {
+  FinishEpoch(ep_seq, Slice(), static_cast<ChunkType>(0) /*Invalid*/);
+}
+
+template <typename T>
+void SeqDirBuilder<T>::FinishEpoch(uint32_t ep_seq,
+                                   const Slice& filter_contents,
+                                   ChunkType filter_type) {
+  assert(!finished_);  // Finish() has not been called
+  // Skip epochs already finished
+  if (ep_seq < num_eps_) return;
+  EndTable(Slice(), static_cast<ChunkType>(0) /*Invalid*/);
+  if (!ok()) return;
+  if (num_tabls_ == 0) {  // Empty epoch
+    // Empty epochs are skipped. But we need to remember their existence.
+    num_eps_ = ep_seq + 1;
+    return;
+  }
+  EpochStone stone;
+
+  if (!filter_contents.empty()) {
+    BlockHandle filter_handle;
+    status_ =
+        indx_writter_->Write(filter_type, filter_contents, &filter_handle);
+    if (!ok()) {
+      return;
+    }
+
+    const uint64_t filter_size = filter_contents.size();
+    const uint64_t final_filter_size = filter_handle.size() + kBlockTrailerSize;
+    compac_stats_->final_filter_size += final_filter_size;
+    compac_stats_->filter_size += filter_size;
+
+    std::string handle_encoding;
+    filter_handle.EncodeTo(&handle_encoding);
+    // Sorts after all tables of the epoch
+    epok_block_.Add(EpochFilterKey(num_eps_), handle_encoding);
+  }
+
+  BlockHandle epok_block_handle;
+  Slice epok_index_contents = epok_block_.Finish();
+  status_ =
+      indx_writter_->Write(kMetaChunk, epok_index_contents, &epok_block_handle);
+  if (!ok()) {
+    return;
+  }
+
+  const uint64_t meta_index_size = epok_index_contents.size();
+  const uint64_t final_meta_index_size =
+      epok_block_handle.size() + kBlockTrailerSize;
+  compac_stats_->final_meta_index_size += final_meta_index_size;
+  compac_stats_->meta_index_size += meta_index_size;
+
+  epok_block_.Reset();
+  last_epok_info_.set_index_offset(epok_block_handle.offset());
+  last_epok_info_.set_index_size(epok_block_handle.size());
+  last_epok_info_.set_num_tables(num_tabls_);
+  last_epok_info_.set_num_ents(num_entries_);
+  assert(!pending_root_entry_);
+  pending_root_entry_ = true;
+
+  std::string handle_encoding;
+  last_epok_info_.EncodeTo(&handle_encoding);
+  root_block_.Add(EpochKey(num_eps_), handle_encoding);
+  pending_root_entry_ = false;
+
+  stone.set_handle(epok_block_handle);
+  stone.set_id(num_eps_);
+  std::string epoch_stone;
+  stone.EncodeTo(&epoch_stone);
+  status_ = indx_writter_->SealEpoch(epoch_stone);
+  if (!ok()) {
+    return;
+  }
+
+  pending_indx_flush_ = indx_sink_->Ltell();
+
+  if (ok()) {
+    num_eps_ = ep_seq + 1;  // Flush up-to the requested epoch seq
+    tb_->Reset(true);
+    num_entries_ = 0;
+    num_tabls_ = 0;
+  }
+}
+
+template <typename T>
+void SeqDirBuilder<T>::EndTable(const Slice& filter_contents,
+                                ChunkType filter_type) {
+  assert(!finished_);  // Finish() has not been called
+
+  tb_->Finish();
+  status_ = tb_->status();
+  if (!ok()) {
+    return;
+  }
+
+  InstallTable(tb_, filter_contents, filter_type);
+  if (!ok()) {
+    return;
+  }
+
+  tb_->Reset(false);
+}
+
+template <typename T>
+typename SeqDirBuilder<T>::TableBuilder* SeqDirBuilder<T>::NewTableBuilder(
+    DirOutputStats* stats, size_t batch_size) {
+  return new TableBuilder(options_, stats, data_sink_, batch_size);
+}
+
+template <typename T>
+void SeqDirBuilder<T>::AddTable(TableBuilder* tb, const Slice& filter_contents,
+                                ChunkType filter_type) {
+  assert(!finished_);  // Finish() has not been called
+  // End the current table so tables remain ordered
+  EndTable(Slice(), static_cast<ChunkType>(0) /*Invalid*/);
+  if (!ok()) {
+    return;
+  }
+
+  status_ = tb->status();
+  if (!ok()) {
+    return;
+  }
+
+  InstallTable(tb, filter_contents, filter_type);
+}
+
+template <typename T>
+void SeqDirBuilder<T>::InstallTable(TableBuilder* tb,
+                                    const Slice& filter_contents,
+                                    ChunkType filter_type) {
+  if (tb->empty()) {
+    return;  // Empty table
+  }
+
+  BlockHandle index_block_handle;
+  Slice index_contents = tb->index_contents();
+  status_ =
+      indx_writter_->Write(kIdxChunk, index_contents, &index_block_handle);
+  if (!ok()) {
+    return;
+  }
+
+  const uint64_t index_size = index_contents.size();
+  const uint64_t final_index_size =
+      index_block_handle.size() + kBlockTrailerSize;
+  compac_stats_->final_index_size += final_index_size;
+  compac_stats_->index_size += index_size;
+
+  BlockHandle filter_handle;
+  if (!filter_contents.empty()) {
+    status_ =
+        indx_writter_->Write(filter_type, filter_contents, &filter_handle);
+    if (!ok()) {
+      return;
+    }
+
+    const uint64_t filter_size = filter_contents.size();
+    const uint64_t final_filter_size = filter_handle.size() + kBlockTrailerSize;
+    compac_stats_->final_filter_size += final_filter_size;
+    compac_stats_->filter_size += filter_size;
+  } else {
+    filter_handle.set_offset(0);  // No filter installed
+    filter_handle.set_size(0);
+  }
+
+  last_tabl_info_.set_filter_offset(filter_handle.offset());
+  last_tabl_info_.set_filter_size(filter_handle.size());
+  last_tabl_info_.set_index_offset(index_block_handle.offset());
+  last_tabl_info_.set_index_size(index_block_handle.size());
+  assert(!pending_meta_entry_);
+  pending_meta_entry_ = true;
+
+  last_tabl_info_.set_smallest_key(tb->smallest_key());
+  last_tabl_info_.set_largest_key(tb->largest_key());
+  std::string handle_encoding;
+  last_tabl_info_.EncodeTo(&handle_encoding);
+  epok_block_.Add(EpochTableKey(num_eps_, num_tabls_), handle_encoding);
+  pending_meta_entry_ = false;
+
+  compac_stats_->total_num_tables_++;
+  num_entries_ += tb->num_entries();  // Num of entries within an epoch
+  num_tabls_++;                       // Num of tables within an epoch
+}
+
+template <typename T>
+void SeqDirBuilder<T>::Add(const Slice& key, const Slice& value) {
+  assert(!finished_);  // Finish() has not been called
+  if (!ok()) return;   // Abort
+  tb_->Add(key, value);
+  status_ = tb_->status();
+}
+
 template <typename T>
 void SeqDirBuilder<T>::Finish(uint32_t ep_seq) {
   assert(!finished_);  // Finish() has not been called
@@ -623,7 +760,6 @@ void SeqDirBuilder<T>::Finish(uint32_t ep_seq) {
 
   std::string footer_buf;
   Footer footer = Mkfoot(options_);
-  assert(!pending_indx_entry_);
   assert(!pending_meta_entry_);
   assert(!pending_root_entry_);
 
@@ -649,14 +785,18 @@ void SeqDirBuilder<T>::Finish(uint32_t ep_seq) {
 
 template <typename T>
 size_t SeqDirBuilder<T>::memory_usage() const {
-  size_t result = data_block_->memory_usage();
+  size_t result = tb_->memory_usage();
   result += root_block_.memory_usage();
   result += epok_block_.memory_usage();
-  result += indx_block_.memory_usage();
   // XXX: Add index log's LogWriter's memory usage as well
   return result;
 }
 
+template class DirTableBuilder<SortedStringBlockBuilder>;
+template class DirTableBuilder<ArrayBlockBuilder>;
+template class SeqDirBuilder<SortedStringBlockBuilder>;
+template class SeqDirBuilder<ArrayBlockBuilder>;
+
 // Use options to determine block formats.
 // Directly return the builder instance. This call won't fail.
 DirBuilder* DirBuilder::Open(const DirOptions& options, DirOutputStats* stats,
@@ -149,6 +149,9 @@ struct DirOutputStats {  // All final sizes include padding and block trailers
   // Total size of user data compacted
   size_t value_size;
   size_t key_size;
+
+  // Accumulate stats from another compaction output.
+  void Merge(const DirOutputStats& other);
 };
 
 // Directory builder interface.
@@ -204,6 +207,88 @@ class SortedStringBlockBuilder;
 class ArrayBlockBuilder;
 class LogWriter;
 
+// Format key-value pairs into data blocks of a single table. Data blocks are
+// accumulated in memory and are periodically committed to the data log. Table
+// indexes are kept in memory until the table is finalized and installed in a
+// directory by a DirBuilder. Instances are not thread-safe but multiple
+// instances may build different tables concurrently.
+template <typename T = SortedStringBlockBuilder>
+class DirTableBuilder {
+ public:
+  // Each table builder buffers at most "batch_size" bytes of data blocks.
+  DirTableBuilder(const DirOptions& options, DirOutputStats* stats,
+                  LogSink* data, size_t batch_size);
+  ~DirTableBuilder();
+
+  // REQUIRES: Finish() has not been called since the previous Reset().
+  void Add(const Slice& key, const Slice& value);
+
+  // Commit all buffered data blocks and finalize the table index.
+  // REQUIRES: Finish() has not been called since the previous Reset().
+  void Finish();
+
+  // Return true iff no data has been added to the table.
+  // REQUIRES: Finish() has been called.
+  bool empty() const { return indx_block_.empty(); }
+
+  // Return the contents of the table index.
+  // REQUIRES: Finish() has been called and the table is not empty.
+  Slice index_contents() { return indx_block_.Finish(); }
+
+  // Return the smallest and a successor of the largest key of the table.
+  const std::string& smallest_key() const { return smallest_key_; }
+  const std::string& largest_key() const { return largest_key_; }
+
+  // Return the number of keys inserted since the previous Reset().
+  uint32_t num_entries() const { return num_entries_; }
+  Status status() const { return status_; }
+
+  // Start a new table. Keys are only checked to be unique within an epoch so
+  // the caller specifies if a new epoch is also being started.
+  void Reset(bool new_epoch);
+
+  // Report memory usage.
+  size_t memory_usage() const;
+
+ private:
+  // End the current block and force the start of a new data block.
+  void EndBlock();
+
+  // Flush buffered data blocks and finalize their indexes.
+  void Commit();
+#ifndef NDEBUG
+  // Used to verify the uniqueness of all input keys
+  std::set<std::string> keys_;
+#endif
+
+  // No copying allowed
+  void operator=(const DirTableBuilder&);
+  DirTableBuilder(const DirTableBuilder&);
+
+  bool ok() const { return status_.ok(); }
+  const DirOptions& options_;
+  DirOutputStats* const compac_stats_;
+  Status status_;
+  std::string smallest_key_;
+  std::string largest_key_;
+  std::string last_key_;
+  uint32_t num_entries_;
+  uint32_t num_uncommitted_indx_;  // Number of uncommitted index entries
+  uint32_t num_uncommitted_data_;  // Number of uncommitted data blocks
+  bool pending_restart_;           // Request to restart the data block buffer
+  bool pending_commit_;  // Request to commit buffered data and indexes
+  size_t block_threshold_;
+  size_t batch_size_;
+  T* data_block_;
+  BlockBuilder indx_block_;  // Locate the data blocks within a table
+  bool pending_indx_entry_;
+  BlockHandle last_data_info_;
+  std::string uncommitted_indexes_;
+  LogSink* data_sink_;
+  uint64_t data_offset_;  // Latest data offset
+  bool finished_;
+};
+
 // Write directory contents into an index log and a data log object. Directory
 // contents are divided into epochs. Epoch id starts with 0, and increments
 // sequentially. Data written into the directory is put into the current epoch
@@ -226,6 +311,12 @@ class SeqDirBuilder : public DirBuilder {
   // REQUIRES: Finish() has not been called.
   virtual void FinishEpoch(uint32_t ep_seq);
 
+  // Force the start of a new epoch. Optionally, a filter can be specified
+  // that indexes all tables of the epoch being finished.
+  // REQUIRES: Finish() has not been called.
+  void FinishEpoch(uint32_t ep_seq, const Slice& filter_contents,
+                   ChunkType filter_type);
+
   // Finalize table contents.
   // No further writes.
   virtual void Finish(uint32_t ep_seq);
@@ -233,42 +324,34 @@ class SeqDirBuilder : public DirBuilder {
   // Report memory usage.
   virtual size_t memory_usage() const;
 
- private:
-  // End the current block and force the start of a new data block.
-  // REQUIRES: Finish() has not been called.
-  void EndBlock();
+  typedef DirTableBuilder<T> TableBuilder;
 
-  // Flush buffered data blocks and finalize their indexes.
+  // Return a new table builder writing to the same data log. Tables built
+  // by it can be added to the current epoch through AddTable().
+  // The result should be deleted when it is no longer needed.
+  TableBuilder* NewTableBuilder(DirOutputStats* stats, size_t batch_size);
+
+  // Add a finished table to the current epoch. Tables are ordered within an
+  // epoch by the order they are added. The current table is ended first.
   // REQUIRES: Finish() has not been called.
-  void Commit();
-#ifndef NDEBUG
-  // Used to verify the uniqueness of all input keys
-  std::set<std::string> keys_;
-#endif
+  void AddTable(TableBuilder* tb, const Slice& filter_contents,
+                ChunkType filter_type);
 
-  std::string smallest_key_;
-  std::string largest_key_;
-  std::string last_key_;
-  uint32_t num_uncommitted_indx_;  // Number of uncommitted index entries
-  uint32_t num_uncommitted_data_;  // Number of uncommitted data blocks
-  bool pending_restart_;           // Request to restart the data block buffer
-  bool pending_commit_;  // Request to commit buffered data and indexes
-  size_t block_threshold_;
-  T* data_block_;
-  BlockBuilder indx_block_;  // Locate the data blocks within a table
+ private:
+  // Write the index and the filter of a finished table and insert the table
+  // into the current epoch.
+  void InstallTable(TableBuilder* tb, const Slice& filter_contents,
+                    ChunkType filter_type);
+
+  TableBuilder* tb_;         // Current table
   BlockBuilder epok_block_;  // Locate the tables within an epoch
   BlockBuilder root_block_;  // Locate each epoch
-  bool pending_indx_entry_;
-  BlockHandle last_data_info_;
   bool pending_meta_entry_;
   TableHandle last_tabl_info_;
   bool pending_root_entry_;
   EpochHandle last_epok_info_;
-  std::string uncommitted_indexes_;
-  uint64_t pending_data_flush_;  // Offset of the data pending flush
   uint64_t pending_indx_flush_;  // Offset of the index pending flush
   LogSink* data_sink_;
-  uint64_t data_offset_;  // Latest data offset
   LogWriter* indx_writter_;
   LogSink* indx_sink_;
   bool finished_;
@@ -8,9 +8,11 @@
  */
 
 #include "deltafs_plfsio_cuckoo.h"
+#include "deltafs_plfsio_format.h"
 #include "deltafs_plfsio_types.h"
 
 #include <math.h>
+#include <algorithm>
 #include <map>
 
 namespace pdlfs {
@@ -193,16 +195,14 @@ void CuckooBlock<k, v>::Reset(uint32_t num_keys) {
   }
   morereps_.resize(0);
   rep_->Reset(num_keys);
-  key_sizes_.resize(0);
+  hashes_.resize(0);
   values_.resize(0);
-  keys_.resize(0);
   finished_ = false;
 }
 
 template <size_t k, size_t v>
 void CuckooBlock<k, v>::MaybeBuildMoreTables() {
-  const uint32_t limit = static_cast<uint32_t>(key_sizes_.size());
-  const char* start = &keys_[0];
+  const uint32_t limit = static_cast<uint32_t>(hashes_.size());
 
   uint32_t i = 0;
   while (i != limit) {
@@ -210,9 +210,8 @@ void CuckooBlock<k, v>::MaybeBuildMoreTables() {
     r->Resize(limit - i);
 
     for (; i < limit; i++) {
-      uint64_t ha = CuckooHash(Slice(start, key_sizes_[i]));
+      uint64_t ha = hashes_[i];
       uint32_t fp = CuckooFingerprint(ha, k);
-      start += key_sizes_[i];
 
       if (v != 0) {  // Skip values when v is disabled
         AddTo(ha, fp, values_[i], r);
@@ -263,9 +262,8 @@ std::string CuckooBlock<k, v>::TEST_Finish() {
 }
 
 template <size_t k, size_t v>
-void CuckooBlock<k, v>::AddMore(const Slice& key, uint32_t value) {
-  key_sizes_.push_back(static_cast<uint32_t>(key.size()));
-  keys_.append(key.data(), key.size());
+void CuckooBlock<k, v>::AddMore(uint64_t ha, uint32_t value) {
+  hashes_.push_back(ha);
   if (v != 0) {  // Ignore data when v is disabled
     values_.push_back(value);
   }
@@ -281,12 +279,16 @@ bool CuckooBlock<k, v>::TEST_AddKey(const Slice& key, uint32_t value) {
 
 template <size_t k, size_t v>
 void CuckooBlock<k, v>::AddKey(const Slice& key, uint32_t value) {
+  AddHash(CuckooHash(key), value);
+}
+
+template <size_t k, size_t v>
+void CuckooBlock<k, v>::AddHash(uint64_t ha, uint32_t value) {
   assert(!finished_);
-  uint64_t ha = CuckooHash(key);
   uint32_t fp = CuckooFingerprint(ha, k);
   // If the main table is full, stage the key at an overflow space
   if (rep_->full_) {
-    AddMore(key, value);
+    AddMore(ha, value);
     return;
   }
 
@@ -367,7 +369,18 @@ void CuckooBlock<k, v>::AddTo(uint64_t ha, uint32_t fp, uint32_t data, Rep* r) {
 
 template <size_t k, size_t v>
 size_t CuckooBlock<k, v>::num_victims() const {
-  return key_sizes_.size();
+  return hashes_.size();
+}
+
+template <size_t k, size_t v>
+size_t CuckooBlock<k, v>::memory_usage() const {
+  size_t result = rep_->space_.capacity();
+  for (size_t i = 0; i < morereps_.size(); i++) {
+    result += morereps_[i]->space_.capacity();
+  }
+  result += sizeof(uint64_t) * hashes_.capacity();
+  result += sizeof(uint32_t) * values_.capacity();
+  return result;
 }
 
 template <size_t k, size_t v>
@@ -598,5 +611,79 @@ bool CuckooValues(const Slice& key, const Slice& input,
   }
 }
 
+EpochCuckooBlock::EpochCuckooBlock(const DirOptions& options,
+                                   size_t bytes_to_reserve)
+    : num_keys_(0), last_num_keys_(0), cuckoo_(options, bytes_to_reserve) {}
+
+EpochCuckooBlock::~EpochCuckooBlock() {}
+
+int EpochCuckooBlock::chunk_type() { return static_cast<int>(kCkfChunk); }
+
+void EpochCuckooBlock::Reset(uint32_t num_keys) {
+  table_hashes_.resize(0);
+  table_hashes_.reserve(num_keys);
+}
+
+void EpochCuckooBlock::AddKey(const Slice& key) {
+  table_hashes_.push_back(CuckooHash(key));
+}
+
+void EpochCuckooBlock::AddTable(EpochCuckooBlock* src, uint32_t table) {
+  const std::vector<uint64_t>& hashes = src->table_hashes_;
+  if (hashes.empty()) {
+    return;
+  }
+  if (num_keys_ == 0) {  // First table of the epoch
+    const uint32_t n = static_cast<uint32_t>(hashes.size());
+    cuckoo_.Reset(std::max(n, last_num_keys_));
+  }
+  for (size_t i = 0; i < hashes.size(); i++) {
+    cuckoo_.AddHash(hashes[i], table);
+  }
+  num_keys_ += static_cast<uint32_t>(hashes.size());
+  src->table_hashes_.resize(0);
+}
+
+Slice EpochCuckooBlock::FinishEpoch() {
+  if (num_keys_ == 0) {
+    return Slice();
+  }
+  last_num_keys_ = num_keys_;
+  num_keys_ = 0;
+  return cuckoo_.Finish();
+}
+
+size_t EpochCuckooBlock::memory_usage() const {
+  size_t result = sizeof(uint64_t) * table_hashes_.capacity();
+  result += cuckoo_.memory_usage();
+  return result;
+}
+
+bool EpochCuckooTables(const Slice& key, const Slice& input,
+                       uint32_t num_tables, std::vector<uint32_t>* tables) {
+  std::vector<uint32_t> values;
+  tables->clear();
+  if (!CuckooValues(key, input, &values)) {
+    return false;
+  }
+  const uint32_t mask = (1u << EpochCuckooBlock::kValueBits) - 1;
+  if (values.empty()) {  // Filter unusable, consider all tables to match
+    for (uint32_t table = 0; table < num_tables; table++) {
+      tables->push_back(table);
+    }
+    return true;
+  }
+  for (size_t i = 0; i < values.size(); i++) {
+    // Only the lower bits of a table number are stored
+    uint32_t table = values[i] & mask;
+    for (; table < num_tables; table += mask + 1) {
+      tables->push_back(table);
+    }
+  }
+  std::sort(tables->begin(), tables->end());
+  tables->erase(std::unique(tables->begin(), tables->end()), tables->end());
+  return true;
+}
+
 }  // namespace plfsio
 }  // namespace pdlfs
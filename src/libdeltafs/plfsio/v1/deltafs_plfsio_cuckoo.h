@@ -17,6 +17,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <string>
 #include <vector>
 
 namespace pdlfs {
@@ -64,6 +65,11 @@ class CuckooBlock {
   // REQUIRES: Finish() has NOT been called.
   void AddKey(const Slice& key, uint32_t value = 0);
 
+  // Insert a key using its CuckooHash(). Same as AddKey().
+  // REQUIRES: Reset(num_keys) has been called.
+  // REQUIRES: Finish() has NOT been called.
+  void AddHash(uint64_t ha, uint32_t value = 0);
+
   // Insert a key into the cuckoo filter. Keys are only inserted to the main
   // table. Auxiliary tables are ignored.
   // Return true if the insertion is success, or false otherwise.
@@ -78,21 +84,21 @@ class CuckooBlock {
   std::string TEST_Finish();
 
   size_t num_victims() const;  // #keys not inserted to the main table
+  size_t memory_usage() const;
 
   size_t TEST_BytesPerCuckooBucket() const;
   size_t TEST_NumCuckooTables() const;
   size_t TEST_NumBuckets() const;
 
  private:
-  std::vector<uint32_t> key_sizes_;  // The size of each overflow key
+  std::vector<uint64_t> hashes_;  // The hash of each overflow key
   std::vector<uint32_t> values_;
-  std::string keys_;
   const int max_cuckoo_moves_;
   bool finished_;  // If Finish() has been called
   Random rnd_;
 
   void MaybeBuildMoreTables();
-  void AddMore(const Slice& key, uint32_t value);
+  void AddMore(uint64_t ha, uint32_t value);
   typedef CuckooTable<k, v> Rep;
   void operator=(const CuckooBlock& cuckoo);  // No copying allowed
   CuckooBlock(const CuckooBlock&);
@@ -103,5 +109,74 @@ class CuckooBlock {
   Rep* rep_;
 };
 
+// A directory filter that indexes all tables of an epoch using a single
+// cuckoo filter. Each key is stored along with the number of the table
+// holding it, allowing readers to go directly to that table instead of
+// probing every table of the epoch. Only the lower kValueBits bits of a table
+// number are stored, so a lookup may return tables that do not hold the key
+// but never misses a table that does.
+//
+// Like other filter blocks, it is fed keys one table at a time through
+// Reset(), AddKey(), and Finish(). Finish() returns an empty per-table
+// filter. Only the hashes of the current table's keys are buffered. They
+// are inserted into the epoch filter once the table is assigned a table
+// number through AddTable(), so no more than the filter itself is kept for
+// the rest of the epoch. The filter is sized using the number of keys of the
+// previous epoch. Keys beyond that go to auxiliary tables.
+class EpochCuckooBlock {
+ public:
+  enum { kKeyBits = 16, kValueBits = 12 };
+  EpochCuckooBlock(const DirOptions& options, size_t bytes_to_reserve);
+  ~EpochCuckooBlock();
+
+  // Start a new table. Keys not yet added to the epoch are discarded.
+  void Reset(uint32_t num_keys);
+
+  // Insert a key into the current table.
+  // REQUIRES: Reset(num_keys) has been called.
+  void AddKey(const Slice& key);
+
+  // Finish the current table. Always returns an empty filter since all
+  // table keys are indexed by the epoch filter instead.
+  Slice Finish() { return Slice(); }
+
+  // Add all keys of a finished table to the epoch, using "table" as their
+  // location. The table's keys may come from a different filter instance,
+  // such as one used by a concurrent compaction shard. This is allowed as
+  // long as "src" is not concurrently accessed.
+  void AddTable(EpochCuckooBlock* src, uint32_t table);
+
+  // Finish the epoch filter and return its contents, or an empty slice if
+  // no keys have been added. Resets epoch state for the next epoch. The
+  // returned contents remain valid until keys are next added through
+  // AddTable().
+  Slice FinishEpoch();
+
+  size_t memory_usage() const;
+  static int chunk_type();  // Return the corresponding chunk type
+  size_t num_victims() const { return cuckoo_.num_victims(); }
+
+ private:
+  // No copying allowed
+  void operator=(const EpochCuckooBlock&);
+  EpochCuckooBlock(const EpochCuckooBlock&);
+
+  // Key hashes of the current table
+  std::vector<uint64_t> table_hashes_;
+  // Number of keys added to the current epoch
+  uint32_t num_keys_;
+  // Number of keys of the previous epoch
+  uint32_t last_num_keys_;
+
+  CuckooBlock<kKeyBits, kValueBits> cuckoo_;
+};
+
+// Obtain the numbers of all tables of an epoch that may contain a given key
+// according to a given epoch cuckoo filter. Table numbers are returned in
+// ascending order. Return false iff the key must not exist in the epoch.
+extern bool EpochCuckooTables(const Slice& key, const Slice& input,
+                              uint32_t num_tables,
+                              std::vector<uint32_t>* tables);
+
 }  // namespace plfsio
 }  // namespace pdlfs
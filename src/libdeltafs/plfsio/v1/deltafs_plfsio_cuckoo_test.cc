@@ -14,6 +14,7 @@
 #include "pdlfs-common/testharness.h"
 #include "pdlfs-common/testutil.h"
 
+#include <algorithm>
 #include <set>
 
 namespace pdlfs {
@@ -305,6 +306,43 @@ TEST(CuckooKvAuxTest, KvAuxiliaryTables) {
   }
 }
 
+class EpochCuckooTest : public CuckooTest {};
+
+TEST(EpochCuckooTest, LongKeys) {
+  EpochCuckooBlock ft(options_, 0);
+  const uint32_t num_tables = 8;
+  const uint32_t keys_per_table = 1024;
+  char tmp[20];
+  for (int epoch = 0; epoch < 2; epoch++) {
+    for (uint32_t t = 0; t < num_tables; t++) {
+      ft.Reset(keys_per_table);
+      for (uint32_t i = 0; i < keys_per_table; i++) {
+        snprintf(tmp, sizeof(tmp), "%u-%u", t, i);
+        std::string key(tmp);
+        key.resize(1024, 'x');
+        ft.AddKey(key);
+      }
+      ft.Finish();
+      ft.AddTable(&ft, t);
+      // Memory must not grow with key size
+      ASSERT_TRUE(ft.memory_usage() < 32 * keys_per_table * num_tables);
+    }
+    data_ = ft.FinishEpoch().ToString();
+    std::vector<uint32_t> tables;
+    for (uint32_t t = 0; t < num_tables; t++) {
+      for (uint32_t i = 0; i < keys_per_table; i++) {
+        snprintf(tmp, sizeof(tmp), "%u-%u", t, i);
+        std::string key(tmp);
+        key.resize(1024, 'x');
+        ASSERT_TRUE(EpochCuckooTables(key, data_, num_tables, &tables));
+        ASSERT_TRUE(std::find(tables.begin(), tables.end(), t) !=
+                    tables.end());
+        ASSERT_TRUE(tables.back() < num_tables);
+      }
+    }
+  }
+}
+
 // Evaluate false positive rate under different filter configurations.
 class PlfsFalsePositiveBench {
  protected:
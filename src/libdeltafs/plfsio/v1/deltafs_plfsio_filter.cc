@@ -11,7 +11,10 @@
 #include "deltafs_plfsio_format.h"
 #include "deltafs_plfsio_types.h"
 
+#include "pdlfs-common/coding.h"
+
 #include <assert.h>
+#include <string.h>
 #include <algorithm>
 
 #include <typeinfo>  // For operator typeid
@@ -145,6 +148,139 @@ bool BloomKeyMayMatch(const Slice& key, const Slice& input) {
   return true;
 }
 
+// Blocked bloom filters use 64-byte blocks made of 16 32-bit words. The
+// i-th probe of a key sets one bit in either word i or word i + 8 of its
+// block. The bit and the word are chosen by multiplying the upper half of the
+// key's hash with per-probe odd constants.
+namespace {
+const size_t kBbfBlockSize = 64;
+const uint32_t kBbfProbes = 8;
+
+const uint32_t kBbfBitSalts[kBbfProbes] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+const uint32_t kBbfWordSalts[kBbfProbes] = {
+    0x9e3779b1U, 0x85ebca77U, 0xc2b2ae3dU, 0x27d4eb2fU,
+    0x165667b1U, 0xd3a2646dU, 0xfd7046c5U, 0xb55a4f09U};
+
+// Map a hash value to a block in [0, n) without using a division.
+inline uint32_t BbfBlockIndex(uint32_t h, uint32_t n) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(h) * n) >> 32);
+}
+
+// Return the word (0-15) and the bit within that word (0-31)
+// of the i-th probe.
+inline void BbfProbe(uint32_t h, uint32_t i, uint32_t* word, uint32_t* bit) {
+  *bit = (h * kBbfBitSalts[i]) >> 27;
+  *word = i + 8 * ((h * kBbfWordSalts[i]) >> 31);
+}
+
+#if defined(DELTAFS_AVX2)
+// The AVX2 code is only used when the host cpu supports it. Otherwise we
+// fall back to the portable code below.
+bool BbfCpuHasAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}
+
+const bool kBbfUseAVX2 = BbfCpuHasAVX2();
+#endif
+
+bool BbfBlockMayMatch(uint32_t h, const char* block) {
+#if defined(DELTAFS_AVX2)
+  if (kBbfUseAVX2) {
+    return BlockedBloomBlockMayMatchAVX2(h, block, kBbfBitSalts,
+                                         kBbfWordSalts);
+  }
+#endif
+  for (uint32_t i = 0; i < kBbfProbes; i++) {
+    uint32_t word, bit;
+    BbfProbe(h, i, &word, &bit);
+    if ((DecodeFixed32(block + 4 * word) & (1u << bit)) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+BlockedBloomBlock::BlockedBloomBlock(const DirOptions& options,
+                                     size_t bytes_to_reserve)
+    : bits_per_key_(options.bf_bits_per_key) {
+  // Reserve an extra byte for storing the number of probes
+  if (bytes_to_reserve != 0) {
+    space_.reserve(bytes_to_reserve + 1);
+  }
+  finished_ = true;  // Pending further initialization
+  num_blocks_ = 0;
+}
+
+BlockedBloomBlock::~BlockedBloomBlock() {}
+
+int BlockedBloomBlock::chunk_type() {
+  return static_cast<int>(kBbfChunk);  // Blocked bloom filter
+}
+
+void BlockedBloomBlock::Reset(uint32_t num_keys) {
+  const uint64_t bits = static_cast<uint64_t>(num_keys) * bits_per_key_;
+  num_blocks_ = static_cast<uint32_t>((bits + kBbfBlockSize * 8 - 1) /
+                                      (kBbfBlockSize * 8));
+  // Always use at least one block
+  if (num_blocks_ == 0) {
+    num_blocks_ = 1;
+  }
+  finished_ = false;
+  space_.clear();
+  space_.resize(num_blocks_ * kBbfBlockSize, 0);
+  // Remember # of probes in filter
+  space_.push_back(static_cast<char>(kBbfProbes));
+}
+
+void BlockedBloomBlock::AddKey(const Slice& key) {
+  assert(!finished_);  // Finish() has not been called
+  const uint64_t hx = BloomHash(key);
+  const uint32_t h = static_cast<uint32_t>(hx >> 32);
+  char* const block =
+      &space_[0] + kBbfBlockSize * BbfBlockIndex(uint32_t(hx), num_blocks_);
+  for (uint32_t i = 0; i < kBbfProbes; i++) {
+    uint32_t word, bit;
+    BbfProbe(h, i, &word, &bit);
+    // Words are stored in little-endian
+    block[4 * word + bit / 8] |= static_cast<char>(1 << (bit % 8));
+  }
+}
+
+std::string BlockedBloomBlock::TEST_Finish() {
+  Finish();
+  return space_;
+}
+
+Slice BlockedBloomBlock::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  return space_;
+}
+
+bool BlockedBloomKeyMayMatch(const Slice& key, const Slice& input) {
+  const size_t len = input.size();
+  if (len < kBbfBlockSize + 1 || (len - 1) % kBbfBlockSize != 0) {
+    return true;  // Consider it a match
+  }
+  const char* array = input.data();
+  const uint32_t k = static_cast<unsigned char>(array[len - 1]);
+  if (k != kBbfProbes) {
+    // Reserved for potentially new encodings.
+    // Consider it a match.
+    return true;
+  }
+  const uint32_t num_blocks = static_cast<uint32_t>(len / kBbfBlockSize);
+  const uint64_t hx = BloomHash(key);
+  const char* const block =
+      array + kBbfBlockSize * BbfBlockIndex(uint32_t(hx), num_blocks);
+  return BbfBlockMayMatch(static_cast<uint32_t>(hx >> 32), block);
+}
+
 // Encoding a bitmap as-is, uncompressed. Used for debugging only.
 // Not intended for production.
 class UncompressedFormat {
@@ -1095,6 +1231,7 @@ template int BitmapFormatFromType<BitmapBlock<PfDeltaFormat> >();
 template int BitmapFormatFromType<BitmapBlock<RoaringFormat> >();
 template int BitmapFormatFromType<EmptyFilterBlock>();
 template int BitmapFormatFromType<BloomBlock>();
+template int BitmapFormatFromType<BlockedBloomBlock>();
 
 int EmptyFilterBlock::chunk_type() {
   return static_cast<int>(kUnknown);  // Dummy block type
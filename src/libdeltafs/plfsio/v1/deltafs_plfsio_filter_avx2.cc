@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2017-2019 Carnegie Mellon University and
+ *         Los Alamos National Laboratory.
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+// This file is compiled with -mavx2 when DELTAFS_AVX2 is set. Keep it free
+// of anything other than the vector code itself so the compiler cannot
+// place AVX2 instructions on paths taken by hosts without AVX2.
+#include "deltafs_plfsio_filter.h"
+
+#include <immintrin.h>
+
+namespace pdlfs {
+namespace plfsio {
+
+bool BlockedBloomBlockMayMatchAVX2(uint32_t h, const char* block,
+                                   const uint32_t* bit_salts,
+                                   const uint32_t* word_salts) {
+  const __m256i hv = _mm256_set1_epi32(static_cast<int>(h));
+  const __m256i bs =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bit_salts));
+  const __m256i ws =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(word_salts));
+  const __m256i bits = _mm256_srli_epi32(_mm256_mullo_epi32(hv, bs), 27);
+  const __m256i masks = _mm256_sllv_epi32(_mm256_set1_epi32(1), bits);
+  // All ones for probes that go to the upper half of the block
+  const __m256i upper = _mm256_srai_epi32(_mm256_mullo_epi32(hv, ws), 31);
+  const __m256i lo =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+  const __m256i hi =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+  return _mm256_testc_si256(lo, _mm256_andnot_si256(upper, masks)) &&
+         _mm256_testc_si256(hi, _mm256_and_si256(upper, masks));
+}
+
+}  // namespace plfsio
+}  // namespace pdlfs
@@ -144,6 +144,38 @@ TEST(BloomFilterTest, BloomFormat) {
   }
 }
 
+typedef FilterTest<BlockedBloomBlock, BlockedBloomKeyMayMatch>
+    BlockedBloomFilterTest;
+
+TEST(BlockedBloomFilterTest, BlockedBloomFormat) {
+  Random rnd(301);
+  uint32_t num_keys = 0;
+  while (num_keys <= (64 << 10)) {
+    TEST_LogAndApply(this, &rnd, num_keys, false);
+    if (num_keys == 0) {
+      num_keys = 1;
+    } else {
+      num_keys *= 4;
+    }
+  }
+}
+
+TEST(BlockedBloomFilterTest, FalsePositives) {
+  const uint32_t num_keys = 16 << 10;
+  Reset(num_keys);
+  for (uint32_t i = 0; i < num_keys; i++) {
+    AddKey(i);
+  }
+  Finish();
+  ASSERT_EQ((data_.size() - 1) % 64, 0);
+  uint32_t fp = 0;
+  for (uint32_t i = num_keys; i < 2 * num_keys; i++) {
+    if (KeyMayMatch(i)) fp++;
+  }
+  // 10 bits per key should give about 1% false positives
+  ASSERT_LT(fp, num_keys / 40);
+}
+
 typedef FilterTest<BitmapBlock<UncompressedFormat>, BitmapKeyMustMatch>
     UncompressedBitmapFilterTest;
 TEST(UncompressedBitmapFilterTest, UncompressedFormat) {
@@ -379,9 +411,11 @@ class PlfsFilterQueryBench : public PlfsFilterBench<T> {
   explicit PlfsFilterQueryBench(size_t key_bits = 24)
       : PlfsFilterBench<T>(key_bits) {}
 
-  void RunQueries(size_t num_keys, std::vector<uint32_t>::iterator& it,
-                  const Slice& filter) {
-    const size_t ckpt = num_keys / 100;
+  // Return the number of keys that match the filter.
+  size_t RunQueries(size_t num_keys, std::vector<uint32_t>::iterator& it,
+                    const Slice& filter) {
+    const size_t ckpt = std::max(num_keys / 100, size_t(1));
+    size_t matches = 0;
     char tmp[4];
     Slice key(tmp, sizeof(tmp));
     for (size_t i = 0; i < num_keys; i++) {
@@ -389,10 +423,11 @@ class PlfsFilterQueryBench : public PlfsFilterBench<T> {
         fprintf(stderr, "\r%d/%d", int(i), int(num_keys));
       }
       EncodeFixed32(tmp, *it);
-      tester(key, filter);
+      if (tester(key, filter)) matches++;
       ++it;
     }
     fprintf(stderr, "\r%d/%d\n", int(num_keys), int(num_keys));
+    return matches;
   }
 
   void LogAndApply() {
@@ -407,13 +442,31 @@ class PlfsFilterQueryBench : public PlfsFilterBench<T> {
     fprintf(stderr, "Testing ...\n");
     const uint64_t start = Env::Default()->NowMicros();
     it = this->keys_.begin();
-    RunQueries(num_keys, it, contents);
+    size_t matches = RunQueries(num_keys, it, contents);
     fprintf(stderr, "Done!\n");
     uint64_t dura = Env::Default()->NowMicros() - start;
+    // Keys following the inserted ones were never inserted
+    const size_t num_non_keys =
+        std::min(num_keys, size_t(this->keys_.end() - it));
+    fprintf(stderr, "Testing non-existent keys ...\n");
+    const uint64_t non_start = Env::Default()->NowMicros();
+    const size_t fps = RunQueries(num_non_keys, it, contents);
+    fprintf(stderr, "Done!\n");
+    uint64_t non_dura = Env::Default()->NowMicros() - non_start;
     fprintf(stderr, "----------------------------------------\n");
     fprintf(stderr, "             Total Time: %.3f s\n", dura / k / k);
-    fprintf(stderr, " Avg. Latency Per Query: %.3f us\n",
-            double(dura) / num_keys);
+    fprintf(stderr, " Avg. Latency Per Query: %.3f us (%.1f ns)\n",
+            double(dura) / num_keys, k * dura / num_keys);
+    fprintf(stderr, "     Matched Keys: %d/%d\n", int(matches),
+            int(num_keys));
+    if (num_non_keys != 0) {
+      fprintf(stderr, " Avg. Latency Per Miss: %.1f ns\n",
+              k * non_dura / num_non_keys);
+      fprintf(stderr, "  False Positive Rate: %.4f%% (%d/%d)\n",
+              100.0 * fps / num_non_keys, int(fps), int(num_non_keys));
+    }
+    fprintf(stderr, "      Filter Size: %.2f (bits per key)\n",
+            8.0 * contents.size() / num_keys);
   }
 };
 
@@ -432,6 +485,7 @@ static void BM_Usage() {
           "Use --bench=ft,<fmt> or --bench=fq,<fmt> to run benchmark.\n\n");
   fprintf(stderr, "== valid fmt are:\n\n");
   fprintf(stderr, " bf     (bloom filter)\n");
+  fprintf(stderr, " bbf    (cache-line blocked bloom filter)\n");
   fprintf(stderr, " bmp    (bitmap, uncompressed)\n");
   fprintf(stderr, " vb     (bitmap, varint)\n");
   fprintf(stderr, " vbp    (bitmap, modified varint)\n");
@@ -470,6 +524,9 @@ static void BM_Parse(const char* bench, const char* fmt) {
   } else if (strcmp(fmt + 1, "bf") == 0) {
     BM_LogAndApply<pdlfs::plfsio::BloomBlock, pdlfs::plfsio::BloomKeyMayMatch>(
         bench);
+  } else if (strcmp(fmt + 1, "bbf") == 0) {
+    BM_LogAndApply<pdlfs::plfsio::BlockedBloomBlock,
+                   pdlfs::plfsio::BlockedBloomKeyMayMatch>(bench);
   } else if (strcmp(fmt + 1, "bmp") == 0) {
     BM_Bmp<pdlfs::plfsio::UncompressedFormat>(bench);
   } else if (strcmp(fmt + 1, "r") == 0) {
@@ -57,6 +57,13 @@ std::string EpochTableKey(uint32_t epoch, uint32_t table) {
   return tmp;
 }
 
+std::string EpochFilterKey(uint32_t epoch) {
+  assert(epoch <= kMaxEpochNo);
+  char tmp[12];
+  snprintf(tmp, sizeof(tmp), "%04d-filter", int(epoch));
+  return tmp;
+}
+
 std::string EpochKey(uint32_t epoch) {
   assert(epoch <= kMaxEpochNo);
   char tmp[5];
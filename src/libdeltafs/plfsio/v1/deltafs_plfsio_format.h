@@ -31,6 +31,8 @@ static const uint32_t kMaxEpochNo = 9999;
 // Formats used by keys in the meta index blocks.
 extern std::string EpochKey(uint32_t epoch);
 extern std::string EpochTableKey(uint32_t epoch, uint32_t table);
+// Sorts after all table keys of the epoch.
+extern std::string EpochFilterKey(uint32_t epoch);
 extern Status ParseEpochKey(const Slice& input, uint32_t* epoch,
                             uint32_t* table);
 
@@ -42,6 +44,8 @@ enum ChunkType {
   kIdxChunk = 0x01,  // Standard SST indexes
   kSbfChunk = 0x02,  // Standard bloom filters
   kBmpChunk = 0x03,  // Bitmap filters (w/ different compression fmts)
+  kBbfChunk = 0x04,  // Cache-line blocked bloom filters
+  kCkfChunk = 0x05,  // Per-epoch cuckoo filters with table locations
 
   // Meta indexing block types
   kMetaChunk = 0x71,  // Meta indexes for each epoch
@@ -8,6 +8,7 @@
  */
 
 #include "deltafs_plfsio_internal.h"
+#include "deltafs_plfsio_cuckoo.h"
 #include "deltafs_plfsio_events.h"
 #include "deltafs_plfsio_filter.h"
 
@@ -17,6 +18,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 #include <algorithm>
 
 namespace pdlfs {
@@ -86,6 +88,7 @@ WriteBuffer::WriteBuffer(const DirOptions& options)
       static_cast<size_t>(
           VarintLength(options.value_size)) +  // For value lengths
       entry_size;
+  prefix_is_key_ = options.fixed_kv_length && options.key_size <= 8;
 }
 
 class WriteBuffer::Iter : public Iterator {
@@ -96,6 +99,12 @@ class WriteBuffer::Iter : public Iterator {
         num_entries_(write_buffer->num_entries_),
         cursor_(num_entries_) {}
 
+  Iter(const WriteBuffer* write_buffer, uint32_t begin, uint32_t end)
+      : buffer_(write_buffer->buffer_),
+        offsets_(&write_buffer->offsets_[0] + begin),
+        num_entries_(end - begin),
+        cursor_(num_entries_) {}
+
   virtual void Next() {
     assert(Valid());
     cursor_++;
@@ -165,6 +174,12 @@ Iterator* WriteBuffer::NewIterator() const {
   return new Iter(this);
 }
 
+Iterator* WriteBuffer::NewIterator(uint32_t begin, uint32_t end) const {
+  assert(finished_);
+  assert(begin <= end && end <= num_entries_);
+  return new Iter(this, begin, end);
+}
+
 struct WriteBuffer::STLLessThan {
   Slice buffer_;
 
@@ -190,15 +205,196 @@ struct WriteBuffer::STLLessThan {
   }
 };
 
+// A fixed-width key prefix extracted from an entry's key. Prefixes are
+// encoded as big-endian integers, and zero-padded if keys are shorter than 8
+// bytes, so comparing two prefixes as integers gives the same result as
+// comparing the corresponding key prefixes using memcmp().
+struct WriteBuffer::KeyPrefix {
+  uint64_t prefix;
+  uint32_t offset;  // Starting offset of the entry
+};
+
+namespace {
+// Number of entries below which we sort using std::sort() directly.
+const size_t kMinRadixSortEntries = 256;
+
+// Minimum number of entries in a write buffer shard. Smaller write buffers
+// are compacted serially.
+const uint32_t kMinShardEntries = 4096;
+
+inline uint64_t DecodePrefix(const Slice& key) {
+  unsigned char tmp[8];
+  memset(tmp, 0, sizeof(tmp));
+  memcpy(tmp, key.data(), std::min(key.size(), sizeof(tmp)));
+  uint64_t result = 0;
+  for (size_t i = 0; i < sizeof(tmp); i++) {
+    result = (result << 8) | tmp[i];
+  }
+  return result;
+}
+}  // namespace
+
+// Sort entries within [begin, end) by extracting an 8-byte key prefix from
+// each of them and radix sorting the resulting (prefix, offset) array. Each
+// radix pass handles one byte and passes that do not move any entries are
+// skipped. Entries with identical prefixes are further sorted using full key
+// comparisons unless keys are known to be no longer than a prefix.
+void WriteBuffer::RadixSort(uint32_t begin, uint32_t end) {
+  const size_t n = end - begin;
+  std::vector<KeyPrefix> src(n);
+  std::vector<KeyPrefix> dst(n);
+  size_t counts[8][256];
+  memset(counts, 0, sizeof(counts));
+  STLLessThan cmp(buffer_);
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t offset = offsets_[begin + i];
+    const uint64_t prefix = DecodePrefix(cmp.GetKey(offset));
+    src[i].prefix = prefix;
+    src[i].offset = offset;
+    for (int j = 0; j < 8; j++) {
+      counts[j][(prefix >> (8 * j)) & 0xFF]++;
+    }
+  }
+
+  for (int j = 0; j < 8; j++) {
+    size_t* const c = counts[j];
+    const size_t first = (src[0].prefix >> (8 * j)) & 0xFF;
+    if (c[first] == n) {
+      continue;  // All entries share this byte
+    }
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+      const size_t tmp = c[b];
+      c[b] = sum;
+      sum += tmp;
+    }
+    for (size_t i = 0; i < n; i++) {
+      dst[c[(src[i].prefix >> (8 * j)) & 0xFF]++] = src[i];
+    }
+    src.swap(dst);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    offsets_[begin + i] = src[i].offset;
+  }
+  if (prefix_is_key_) {
+    return;
+  }
+  // Resolve ties
+  std::vector<uint32_t>::iterator base = offsets_.begin() + begin;
+  size_t i = 0;
+  while (i < n) {
+    size_t j = i + 1;
+    while (j < n && src[j].prefix == src[i].prefix) {
+      j++;
+    }
+    if (j - i > 1) {
+      std::sort(base + i, base + j, cmp);
+    }
+    i = j;
+  }
+}
+
+void WriteBuffer::STLSort(uint32_t begin, uint32_t end) {
+  std::vector<uint32_t>::iterator base = offsets_.begin();
+  std::sort(base + begin, base + end, STLLessThan(buffer_));
+}
+
+void WriteBuffer::SortShard(uint32_t begin, uint32_t end) {
+  assert(begin <= end && end <= num_entries_);
+  if (end - begin < kMinRadixSortEntries) {
+    STLSort(begin, end);
+  } else {
+    RadixSort(begin, end);
+  }
+}
+
 void WriteBuffer::Finish(bool skip_sort) {
   assert(!finished_);
   finished_ = true;
   // Sort entries if not skipped
   if (!skip_sort) {
-    std::vector<uint32_t>::iterator begin = offsets_.begin();
-    std::vector<uint32_t>::iterator end = offsets_.end();
-    std::sort(begin, end, STLLessThan(buffer_));
+    SortShard(0, num_entries_);
+  }
+}
+
+void WriteBuffer::TEST_Finish() {
+  assert(!finished_);
+  finished_ = true;
+  STLSort(0, num_entries_);
+}
+
+// Shards are formed according to the most significant byte of the key
+// prefixes that is not shared by all entries. Since all more significant bytes
+// are identical, ordering entries by this byte is consistent with the final
+// key order. Shard boundaries are placed between byte values such that
+// shards hold roughly equal numbers of entries.
+void WriteBuffer::Partition(size_t num_shards, bool by_key,
+                            std::vector<uint32_t>* bounds) {
+  assert(!finished_);
+  finished_ = true;
+  const uint32_t n = num_entries_;
+  bounds->clear();
+  bounds->push_back(0);
+  if (num_shards <= 1 || n < num_shards) {
+    bounds->push_back(n);
+    return;
+  } else if (!by_key) {
+    for (size_t i = 1; i < num_shards; i++) {
+      bounds->push_back(static_cast<uint32_t>(uint64_t(n) * i / num_shards));
+    }
+    bounds->push_back(n);
+    return;
+  }
+
+  num_shards = std::min<size_t>(num_shards, 256);
+  std::vector<uint64_t> prefixes(n);
+  size_t counts[8][256];
+  memset(counts, 0, sizeof(counts));
+  STLLessThan cmp(buffer_);
+  for (uint32_t i = 0; i < n; i++) {
+    const uint64_t prefix = DecodePrefix(cmp.GetKey(offsets_[i]));
+    prefixes[i] = prefix;
+    for (int j = 0; j < 8; j++) {
+      counts[j][(prefix >> (8 * j)) & 0xFF]++;
+    }
+  }
+  int j = 7;
+  for (; j >= 0; j--) {
+    if (counts[j][(prefixes[0] >> (8 * j)) & 0xFF] != n) {
+      break;
+    }
   }
+  if (j < 0) {  // All prefixes are identical
+    bounds->push_back(n);
+    return;
+  }
+
+  // Map each byte value to a shard
+  size_t* const c = counts[j];
+  unsigned char shard_of[256];
+  size_t shard = 0;
+  size_t sum = 0;
+  for (int b = 0; b < 256; b++) {
+    // Start a new shard once the current one is non-empty and has
+    // reached its share of entries
+    if (shard + 1 < num_shards && sum > bounds->back() &&
+        sum >= uint64_t(n) * (shard + 1) / num_shards) {
+      bounds->push_back(static_cast<uint32_t>(sum));
+      shard++;
+    }
+    shard_of[b] = static_cast<unsigned char>(shard);
+    sum += c[b];
+  }
+  bounds->push_back(n);
+
+  // Scatter entries to their shards
+  std::vector<uint32_t> pos(bounds->begin(), bounds->end() - 1);
+  std::vector<uint32_t> tmp(n);
+  for (uint32_t i = 0; i < n; i++) {
+    tmp[pos[shard_of[(prefixes[i] >> (8 * j)) & 0xFF]]++] = offsets_[i];
+  }
+  std::copy(tmp.begin(), tmp.end(), offsets_.begin());
 }
 
 void WriteBuffer::Reset() {
@@ -250,6 +446,28 @@ Status DirCompactor::Finish(uint32_t ep_seq) {
   return bu_->status_;
 }
 
+// Filters are normally written along with the table they index. A filter
+// indexing an entire epoch must instead be told the number of each table it
+// covers, and is written when the epoch ends.
+template <typename T>
+static inline void AddToEpochFilter(T* epoch_ft, T* table_ft, uint32_t table) {
+}
+
+static inline void AddToEpochFilter(EpochCuckooBlock* epoch_ft,
+                                    EpochCuckooBlock* table_ft,
+                                    uint32_t table) {
+  epoch_ft->AddTable(table_ft, table);
+}
+
+template <typename T>
+static inline Slice FinishEpochFilter(T* epoch_ft) {
+  return Slice();
+}
+
+static inline Slice FinishEpochFilter(EpochCuckooBlock* epoch_ft) {
+  return epoch_ft->FinishEpoch();
+}
+
 template <typename T, typename U>
 class FilteredDirCompactor : public DirCompactor {
  public:
@@ -259,6 +477,8 @@ class FilteredDirCompactor : public DirCompactor {
 
   virtual void Compact(WriteBuffer* buf);
 
+  virtual void ParallelCompact(WriteBuffer* buf, bool skip_sort);
+
   virtual Status FinishEpoch(uint32_t ep_seq);
 
   virtual Status Finish(uint32_t ep_seq);
@@ -266,6 +486,35 @@ class FilteredDirCompactor : public DirCompactor {
   virtual size_t memory_usage() const;
 
  private:
+  typedef typename U::TableBuilder TableBuilder;
+  struct Shard {
+    uint32_t begin;
+    uint32_t end;
+    T* filter;  // NULL if filters are disabled
+    Slice filter_contents;
+    TableBuilder* tb;
+    DirOutputStats stats;
+  };
+
+  // State shared by all shards of a parallel compaction. Deleted by whoever
+  // drops the last reference.
+  struct ShardedCompaction {
+    ShardedCompaction() : cv(&mu), next(0), num_done(0), refs(1) {}
+    port::Mutex mu;
+    port::CondVar cv;
+    WriteBuffer* buf;
+    bool skip_sort;
+    std::vector<Shard> shards;
+    size_t next;      // Next shard to be claimed
+    size_t num_done;  // Number of shards compacted
+    int refs;
+  };
+
+  static void CompactShard(WriteBuffer* buf, bool skip_sort, Shard* s);
+  // Claim and compact shards until no shard is left.
+  static void RunShards(ShardedCompaction* c);
+  static void Unref(ShardedCompaction* c);
+  static void BGWork(void*);
   T* filter_;
 };
 
@@ -276,11 +525,33 @@ FilteredDirCompactor<T, U>::~FilteredDirCompactor() {
 
 template <typename T, typename U>
 Status FilteredDirCompactor<T, U>::FinishEpoch(uint32_t ep_seq) {
+  // Epoch filters are only built when the epoch is actually finished
+  if (filter_ != NULL && ep_seq >= num_epochs()) {
+    Slice filter_contents = FinishEpochFilter(filter_);
+    if (!filter_contents.empty()) {
+      U* const bu = static_cast<U*>(bu_);
+      const ChunkType filter_type = static_cast<ChunkType>(T::chunk_type());
+      bu->U::FinishEpoch(ep_seq, filter_contents, filter_type);
+      return status();
+    }
+  }
   return DirCompactor::FinishEpoch(ep_seq);
 }
 
 template <typename T, typename U>
 Status FilteredDirCompactor<T, U>::Finish(uint32_t ep_seq) {
+  if (filter_ != NULL) {
+    Slice filter_contents = FinishEpochFilter(filter_);
+    if (!filter_contents.empty()) {  // Finish the last epoch with its filter
+      U* const bu = static_cast<U*>(bu_);
+      const ChunkType filter_type = static_cast<ChunkType>(T::chunk_type());
+      bu->U::FinishEpoch(std::max(ep_seq, num_epochs()), filter_contents,
+                         filter_type);
+      if (!ok()) {
+        return status();
+      }
+    }
+  }
   return DirCompactor::Finish(ep_seq);
 }
 
@@ -321,8 +592,154 @@ void FilteredDirCompactor<T, U>::Compact(WriteBuffer* buf) {
     filter_contents = ft->Finish();
   }
   const ChunkType filter_type = static_cast<ChunkType>(T::chunk_type());
+  const uint32_t n = num_tables();
   bu->U::EndTable(filter_contents, filter_type);
+  if (ft != NULL && num_tables() > n) {
+    AddToEpochFilter(ft, ft, num_tables() - 1);
+  }
+  delete iter;
+}
+
+template <typename T, typename U>
+void FilteredDirCompactor<T, U>::CompactShard(WriteBuffer* buf, bool skip_sort,
+                                              Shard* s) {
+  if (!skip_sort) {
+    buf->SortShard(s->begin, s->end);
+  }
+  IterType* const iter =
+      static_cast<IterType*>(buf->NewIterator(s->begin, s->end));
+  TableBuilder* const tb = s->tb;
+  T* const ft = s->filter;
+  iter->IterType::SeekToFirst();
+  if (ft != NULL) {
+    ft->Reset(s->end - s->begin);
+  }
+  for (; iter->IterType::Valid(); iter->IterType::Next()) {
+    Slice key(iter->IterType::key());
+    if (ft != NULL) {
+      ft->AddKey(key);
+    }
+    tb->Add(key, iter->IterType::value());
+    if (!tb->status().ok()) {
+      break;
+    }
+  }
   delete iter;
+  if (!tb->status().ok()) {
+    return;
+  }
+
+  tb->Finish();
+  if (ft != NULL) {
+    s->filter_contents = ft->Finish();
+  }
+}
+
+template <typename T, typename U>
+void FilteredDirCompactor<T, U>::RunShards(ShardedCompaction* c) {
+  MutexLock ml(&c->mu);
+  while (c->next < c->shards.size()) {
+    Shard* const s = &c->shards[c->next++];
+    c->mu.Unlock();
+    CompactShard(c->buf, c->skip_sort, s);
+    c->mu.Lock();
+    c->num_done++;
+    if (c->num_done == c->shards.size()) {
+      c->cv.SignalAll();
+    }
+  }
+}
+
+template <typename T, typename U>
+void FilteredDirCompactor<T, U>::Unref(ShardedCompaction* c) {
+  c->mu.Lock();
+  assert(c->refs > 0);
+  c->refs--;
+  const bool del = c->refs == 0;
+  c->mu.Unlock();
+  if (del) {
+    delete c;
+  }
+}
+
+template <typename T, typename U>
+void FilteredDirCompactor<T, U>::BGWork(void* arg) {
+  ShardedCompaction* const c = reinterpret_cast<ShardedCompaction*>(arg);
+  RunShards(c);
+  Unref(c);
+}
+
+// The calling thread compacts shards along with any background threads it
+// schedules, so a compaction always makes progress even when all threads of
+// the compaction pool are busy. Shards are sorted, formatted, and filtered
+// independently. Their tables are then added to the current epoch in key order.
+template <typename T, typename U>
+void FilteredDirCompactor<T, U>::ParallelCompact(WriteBuffer* buf,
+                                                 bool skip_sort) {
+  U* const bu = static_cast<U*>(bu_);
+  std::vector<uint32_t> bounds;
+  // Keys of an unordered directory are not sorted so we split them by position
+  const bool by_key = !skip_sort;
+  const size_t max_shards = std::min<size_t>(
+      options_.compaction_shards, buf->NumEntries() / kMinShardEntries);
+  buf->Partition(max_shards, by_key, &bounds);
+  const size_t n = bounds.size() - 1;
+  const size_t batch_size =
+      std::max(options_.block_batch_size / n, options_.block_size);
+  ShardedCompaction* const c = new ShardedCompaction;
+  c->buf = buf;
+  c->skip_sort = skip_sort;
+  c->shards.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    Shard* const s = &c->shards[i];
+    s->begin = bounds[i];
+    s->end = bounds[i + 1];
+    s->filter = NULL;
+    if (filter_ != NULL) {
+      s->filter = i == 0 ? filter_ : new T(options_, 0);
+    }
+    s->tb = bu->U::NewTableBuilder(&s->stats, batch_size);
+  }
+
+  for (size_t i = 1; i < n; i++) {
+    if (options_.compaction_pool != NULL) {
+      c->mu.Lock();
+      c->refs++;
+      c->mu.Unlock();
+      options_.compaction_pool->Schedule(BGWork, c);
+    } else if (options_.allow_env_threads) {
+      c->mu.Lock();
+      c->refs++;
+      c->mu.Unlock();
+      Env::Default()->Schedule(BGWork, c);
+    }
+  }
+
+  RunShards(c);
+  c->mu.Lock();
+  while (c->num_done < n) {
+    c->cv.Wait();
+  }
+  c->mu.Unlock();
+
+  const ChunkType filter_type = static_cast<ChunkType>(T::chunk_type());
+  for (size_t i = 0; i < n; i++) {
+    Shard* const s = &c->shards[i];
+    compac_stats()->Merge(s->stats);
+    if (ok()) {
+      const uint32_t n = num_tables();
+      bu->U::AddTable(s->tb, s->filter_contents, filter_type);
+      if (s->filter != NULL && num_tables() > n) {
+        AddToEpochFilter(filter_, s->filter, num_tables() - 1);
+      }
+    }
+    if (s->filter != filter_) {
+      delete s->filter;
+    }
+    delete s->tb;
+  }
+
+  Unref(c);
 }
 
 DirIndexer::DirIndexer(const DirOptions& options, size_t part, port::Mutex* mu,
@@ -434,6 +851,8 @@ DirCompactor* DirIndexer::OpenCompactor(DirBuilder* bu) {
 #define T1 FilteredDirCompactor
 #define T2 BloomBlock
 #define T3 EmptyFilterBlock
+#define T4 BlockedBloomBlock
+#define T5 EpochCuckooBlock
 #define OPEN0(T, t, a1, a2) new T1<T, U>(a1, a2, t)
 #define OPEN1(T, t) OPEN0(T, t, options_, bu)
 #ifndef NDEBUG
@@ -449,12 +868,23 @@ DirCompactor* DirIndexer::OpenCompactor(DirBuilder* bu) {
       return OPEN1(T2, bf);
       break;
     }
+    case kFtBlockedBloom: {
+      T4* bbf = NULL;
+      if (options_.bf_bits_per_key != 0) bbf = new T4(options_, ft_bytes_);
+      return OPEN1(T4, bbf);
+      break;
+    }
+    case kFtCuckoo:
+      return OPEN1(T5, new T5(options_, 0));
+      break;
     default:
       return OPEN1(T3, NULL);
       break;
   }
 #undef OPEN1
 #undef OPEN0
+#undef T5
+#undef T4
 #undef T3
 #undef T2
 #undef T1
@@ -572,6 +1002,29 @@ Status DirIndexer::Add(Epoch* epoch, const Slice& key, const Slice& value) {
   return status;
 }
 
+Status DirIndexer::AddBatch(Epoch* epoch, const Slice* keys,
+                            const Slice* values, size_t n) {
+  mu_->AssertHeld();
+  assert(opened_);
+  Status status;
+  size_t i = 0;
+  while (status.ok() && i < n) {
+    status = Prepare(epoch);
+    // Fill the current write buffer until it asks for a compaction
+    while (status.ok() && i < n) {
+      if (!mem_buf_->Add(keys[i], values[i])) {
+        break;  // Implementation may reject a key-value insertion
+      }
+      i++;
+      if (mem_buf_->NeedCompaction() ||
+          mem_buf_->CurrentBufferSize() >= buf_threshold_) {
+        break;
+      }
+    }
+  }
+  return status;
+}
+
 Status DirIndexer::Prepare(Epoch* epoch, bool force, bool epoch_flush,
                            bool finalize) {
   mu_->AssertHeld();
@@ -696,8 +1149,13 @@ void DirIndexer::CompactMemtable() {
   if (options_.skip_sort) {
     skip_sort = true;  // Forced by user
   }
-  buffer->Finish(skip_sort);
-  dir->Compact(buffer);
+  if (options_.compaction_shards > 1 &&
+      buffer->NumEntries() >= 2 * kMinShardEntries) {
+    dir->ParallelCompact(buffer, skip_sort);
+  } else {
+    buffer->Finish(skip_sort);
+    dir->Compact(buffer);
+  }
   if (dir->ok()) {
 #if VERBOSE >= 3
 #ifndef NDEBUG
@@ -763,6 +1221,47 @@ size_t DirIndexer::memory_usage() const {
   }
 }
 
+// Verify and decompress a block whose contents, including the block trailer,
+// have been read into memory. On success, result->data either points into
+// "contents" or to a heap-allocated buffer storing the uncompressed block.
+static Status DecodeBlock(const DirOptions& options, const Slice& contents,
+                          BlockContents* result) {
+  result->data = Slice();
+  result->heap_allocated = false;
+  result->cachable = false;
+
+  assert(contents.size() >= kBlockTrailerSize);
+  const size_t n = contents.size() - kBlockTrailerSize;
+  const char* data = contents.data();
+  // CRC checks
+  if (!options.skip_checksums && options.verify_checksums) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
+    const uint32_t actual = crc32c::Value(data, n + 1);
+    if (actual != crc) {
+      return Status::Corruption("Block checksum mismatch");
+    }
+  }
+
+  if (data[n] == kSnappyCompression) {
+    size_t ulen = 0;
+    if (!port::Snappy_GetUncompressedLength(data, n, &ulen)) {
+      return Status::Corruption("Cannot compress");
+    }
+    char* ubuf = new char[ulen];
+    if (!port::Snappy_Uncompress(data, n, ubuf)) {
+      delete[] ubuf;
+      return Status::Corruption("Cannot compress");
+    }
+    result->data = Slice(ubuf, ulen);
+    result->heap_allocated = true;
+    result->cachable = true;
+  } else {
+    result->data = Slice(data, n);
+  }
+
+  return Status::OK();
+}
+
 static Status ReadBlock(LogSource* source, const DirOptions& options,
                         const BlockHandle& handle, BlockContents* result,
                         bool cached = false, uint32_t file_index = 0,
@@ -787,55 +1286,28 @@ static Status ReadBlock(LogSource* source, const DirOptions& options,
       status = Status::Corruption("Truncated block read");
     }
   }
+  if (status.ok()) {
+    status = DecodeBlock(options, contents, result);
+  }
   if (!status.ok()) {
     if (buf != tmp) delete[] buf;
     return status;
   }
 
-  // CRC checks
-  const char* data = contents.data();  // Pointer to where read put the data
-  if (!options.skip_checksums && options.verify_checksums) {
-    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
-    const uint32_t actual = crc32c::Value(data, n + 1);
-    if (actual != crc) {
-      if (buf != tmp) delete[] buf;
-      status = Status::Corruption("Block checksum mismatch");
-      return status;
-    }
-  }
-
-  if (data[n] == kSnappyCompression) {
-    size_t ulen = 0;
-    if (!port::Snappy_GetUncompressedLength(data, n, &ulen)) {
-      if (buf != tmp) delete[] buf;
-      status = Status::Corruption("Cannot compress");
-      return status;
-    }
-    char* ubuf = new char[ulen];
-    if (!port::Snappy_Uncompress(data, n, ubuf)) {
-      if (buf != tmp) delete[] buf;
-      delete[] ubuf;
-      status = Status::Corruption("Cannot compress");
-      return status;
-    }
+  if (result->heap_allocated) {
+    // Block has been uncompressed into a new buffer
     if (buf != tmp) {
       delete[] buf;
     }
-    result->data = Slice(ubuf, ulen);
-    result->heap_allocated = true;
-    result->cachable = true;
-  } else if (data != buf) {
+  } else if (contents.data() != buf) {
     // File implementation has given us pointer to some other data.
     // Use it directly under the assumption that it will be live
     // while the file is open.
     if (buf != tmp) {
       delete[] buf;
     }
-    result->data = Slice(data, n);
-    result->heap_allocated = false;
     result->cachable = false;  // Avoid double cache
   } else {
-    result->data = Slice(buf, n);
     result->heap_allocated = (buf != tmp);
     result->cachable = true;
   }
@@ -843,66 +1315,316 @@ static Status ReadBlock(LogSource* source, const DirOptions& options,
   return status;
 }
 
-// Retrieve all keys from a given data block.
-Status Dir::Iter(const IterOptions& opts, Slice* input) {
+static void DeleteCachedIndexBlock(const Slice& key, void* value) {
+  Block* const block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+static void DeleteCachedBlockContents(const Slice& key, void* value) {
+  BlockContents* const contents = reinterpret_cast<BlockContents*>(value);
+  if (contents->heap_allocated) {
+    delete[] contents->data.data();
+  }
+  delete contents;
+}
+
+// Index and filter blocks are cached by their offsets within the index log.
+// Each directory partition has a unique cache id.
+static inline Slice IndexCacheKey(uint64_t cache_id, const BlockHandle& h,
+                                  char* scratch) {
+  EncodeFixed64(scratch, cache_id);
+  EncodeFixed64(scratch + 8, h.offset());
+  return Slice(scratch, 16);
+}
+
+// Load and decode an index block. The block is served from the index cache
+// if possible. Once done, the block must be released using
+// ReleaseIndexBlock(). Return OK on success and a non-OK status on errors.
+Status Dir::ReadIndexBlock(const BlockHandle& h, Block** result,
+                           Cache::Handle** handle) {
   Status status;
-  BlockHandle handle;
-  status = handle.DecodeFrom(input);
-  if (!status.ok()) {
-    return status;
+  *handle = NULL;
+  char tmp[16];
+  Slice key;
+  if (index_cache_ != NULL) {
+    key = IndexCacheKey(cache_id_, h, tmp);
+    *handle = index_cache_->Lookup(key);
+    MutexLock ml(&cache_mu_);
+    if (*handle != NULL) {
+      index_cache_hits_++;
+      *result = reinterpret_cast<Block*>(index_cache_->Value(*handle));
+      return status;
+    } else {
+      index_cache_misses_++;
+    }
   }
+
   BlockContents contents;
-  status = ReadBlock(data_, options_, handle, &contents, false, opts.file_index,
-                     opts.tmp, opts.tmp_length);
+  // We always prefetch and cache all index blocks in memory
+  // so there is no need to allocate an additional
+  // buffer to store the block contents
+  const bool cached = true;
+  status = ReadBlock(indx_, options_, h, &contents, cached);
   if (!status.ok()) {
     return status;
-  } else {
-    opts.stats->seeks++;
   }
 
-  Iterator* const iter = OpenDirBlock(options_, contents);
-  iter->SeekToFirst();
-  for (; iter->Valid(); iter->Next()) {
-    if (opts.saver(opts.arg, iter->key(), iter->value()) == -1) {
-      // User does not want to continue
-      break;
-    }
-    opts.stats->n++;
-  }
-  if (status.ok()) {
-    status = iter->status();
+  *result = new Block(contents);
+  if (index_cache_ != NULL) {
+    *handle = index_cache_->Insert(key, *result, (*result)->size(),
+                                   DeleteCachedIndexBlock);
   }
 
-  delete iter;
   return status;
 }
 
-// Retrieve all keys from a given table and call "opts.saver" to handle the
-// results. Return OK on success and a non-OK status on errors.
-Status Dir::Iter(const IterOptions& opts, const TableHandle& h) {
+void Dir::ReleaseIndexBlock(Block* block, Cache::Handle* handle) {
+  if (handle != NULL) {
+    index_cache_->Release(handle);
+  } else {
+    delete block;
+  }
+}
+
+// Load a filter block. The block is served from the index cache if possible.
+// Once done, the block must be released using ReleaseFilterBlock(). Return OK
+// on success and a non-OK status on errors.
+Status Dir::ReadFilterBlock(const BlockHandle& h, BlockContents* result,
+                            Cache::Handle** handle) {
   Status status;
-  // Load the index block
-  BlockContents index_contents;
-  BlockHandle index_handle;
-  index_handle.set_offset(h.index_offset());
-  index_handle.set_size(h.index_size());
-  // We always prefetch and cache all index blocks in memory
+  *handle = NULL;
+  char tmp[16];
+  Slice key;
+  if (index_cache_ != NULL) {
+    key = IndexCacheKey(cache_id_, h, tmp);
+    *handle = index_cache_->Lookup(key);
+    MutexLock ml(&cache_mu_);
+    if (*handle != NULL) {
+      filter_cache_hits_++;
+      *result =
+          *reinterpret_cast<BlockContents*>(index_cache_->Value(*handle));
+      result->heap_allocated = false;  // Owned by the cache
+      return status;
+    } else {
+      filter_cache_misses_++;
+    }
+  }
+
+  // We always prefetch and cache all filter blocks in memory
   // so there is no need to allocate an additional
   // buffer to store the block contents
   const bool cached = true;
-  status = ReadBlock(indx_, options_, index_handle, &index_contents, cached);
+  status = ReadBlock(indx_, options_, h, result, cached);
   if (!status.ok()) {
     return status;
-  } else {
-    opts.stats->table_seeks++;
   }
 
-  Block* index_block = new Block(index_contents);
-  Iterator* const iter = index_block->NewIterator(BytewiseComparator());
-  iter->SeekToFirst();
+  if (index_cache_ != NULL) {
+    BlockContents* const contents = new BlockContents(*result);
+    *handle = index_cache_->Insert(key, contents, contents->data.size(),
+                                   DeleteCachedBlockContents);
+    result->heap_allocated = false;
+  }
+
+  return status;
+}
+
+void Dir::ReleaseFilterBlock(const BlockContents& contents,
+                             Cache::Handle* handle) {
+  if (handle != NULL) {
+    index_cache_->Release(handle);
+  } else if (contents.heap_allocated) {
+    delete[] contents.data.data();
+  }
+}
+
+// Data blocks are cached by their locations within the data log, which is
+// shared by all directory partitions.
+static inline Slice DataCacheKey(uint32_t file_index, const BlockHandle& h,
+                                 char* scratch) {
+  EncodeFixed32(scratch, file_index);
+  EncodeFixed64(scratch + 4, h.offset());
+  return Slice(scratch, 12);
+}
+
+// Read a data block. The block is served from the data cache or the readahead
+// buffer if possible. Data is read ahead when "ra" is not NULL and the block
+// immediately follows the previous one read using "ra". Blocks read ahead are
+// not inserted into the data cache to avoid flushing it during scans. Return
+// OK on success and a non-OK status on errors.
+Status Dir::ReadDataBlock(const BlockHandle& h, uint32_t file_index, char* tmp,
+                          size_t tmp_length, Readahead* ra,
+                          BlockContents* result, Cache::Handle** handle,
+                          size_t* seeks) {
+  Status status;
+  const uint64_t m = h.size() + kBlockTrailerSize;
+  *handle = LookupDataBlock(h, file_index, result);
+  if (*handle != NULL) {
+    return status;
+  }
+
+  if (ra != NULL) {
+    const uint64_t end = h.offset() + m;
+    const bool sequential = ra->last_end != 0 && h.offset() >= ra->last_end &&
+                            h.offset() - ra->last_end <= options_.block_size;
+    ra->last_end = end;
+    if (h.offset() >= ra->offset && end <= ra->offset + ra->data.size()) {
+      status = DecodeBlock(
+          options_, Slice(ra->data.data() + (h.offset() - ra->offset), m),
+          result);
+      if (status.ok()) {
+        MutexLock ml(&cache_mu_);
+        readahead_hits_++;
+      }
+      return status;
+    } else if (sequential) {
+      ra->window = std::max<size_t>(2 * ra->window, 2 * m);
+      ra->window = std::min(ra->window, options_.readahead_size);
+      if (ra->window > m) {
+        uint64_t n = ra->window;
+        const uint64_t file_size = data_->Size(file_index);
+        if (h.offset() + n > file_size) {
+          n = std::max(file_size - std::min(file_size, h.offset()), m);
+        }
+        ra->space.resize(n);
+        ra->offset = h.offset();
+        status = data_->Read(ra->offset, n, &ra->data, &ra->space[0],
+                             file_index);
+        if (!status.ok()) {
+          ra->data = Slice();
+          return status;
+        } else if (ra->data.size() < m) {
+          ra->data = Slice();
+          return Status::Corruption("Truncated block read");
+        }
+        (*seeks)++;
+        return DecodeBlock(options_, Slice(ra->data.data(), m), result);
+      }
+    } else {
+      ra->window = 0;
+    }
+  }
+
+  status = ReadBlock(data_, options_, h, result, false, file_index, tmp,
+                     tmp_length);
+  if (!status.ok()) {
+    return status;
+  } else {
+    (*seeks)++;
+  }
+
+  *handle = InsertDataBlock(h, file_index, result);
+  return status;
+}
+
+void Dir::ReleaseDataBlock(Cache::Handle* handle) {
+  if (handle != NULL) {
+    data_cache_->Release(handle);
+  }
+}
+
+Cache::Handle* Dir::LookupDataBlock(const BlockHandle& h, uint32_t file_index,
+                                    BlockContents* result) {
+  if (data_cache_ == NULL) {
+    return NULL;
+  }
+  char scratch[12];
+  Cache::Handle* const handle =
+      data_cache_->Lookup(DataCacheKey(file_index, h, scratch));
+  MutexLock ml(&cache_mu_);
+  if (handle != NULL) {
+    data_cache_hits_++;
+    data_cache_bytes_saved_ += h.size() + kBlockTrailerSize;
+    *result = *reinterpret_cast<BlockContents*>(data_cache_->Value(handle));
+    result->heap_allocated = false;  // Owned by the cache
+  } else {
+    data_cache_misses_++;
+  }
+  return handle;
+}
+
+Cache::Handle* Dir::InsertDataBlock(const BlockHandle& h, uint32_t file_index,
+                                    BlockContents* result) {
+  if (data_cache_ == NULL) {
+    return NULL;
+  }
+  BlockContents* const contents = new BlockContents;
+  if (result->heap_allocated) {  // Transfer ownership to the cache
+    contents->data = result->data;
+  } else {
+    char* const buf = new char[result->data.size()];
+    memcpy(buf, result->data.data(), result->data.size());
+    contents->data = Slice(buf, result->data.size());
+  }
+  contents->heap_allocated = true;
+  contents->cachable = false;
+  char scratch[12];
+  Cache::Handle* const handle =
+      data_cache_->Insert(DataCacheKey(file_index, h, scratch), contents,
+                          contents->data.size(), DeleteCachedBlockContents);
+  result->data = contents->data;
+  result->heap_allocated = false;
+  return handle;
+}
+
+// Retrieve all keys from a given data block.
+Status Dir::Iter(const IterOptions& opts, Slice* input, Readahead* ra) {
+  Status status;
+  BlockHandle handle;
+  status = handle.DecodeFrom(input);
+  if (!status.ok()) {
+    return status;
+  }
+  Cache::Handle* cache_handle;
+  BlockContents contents;
+  status = ReadDataBlock(handle, opts.file_index, opts.tmp, opts.tmp_length, ra,
+                         &contents, &cache_handle, &opts.stats->seeks);
+  if (!status.ok()) {
+    return status;
+  }
+
+  Iterator* const iter = OpenDirBlock(options_, contents);
+  iter->SeekToFirst();
+  for (; iter->Valid(); iter->Next()) {
+    if (opts.saver(opts.arg, iter->key(), iter->value()) == -1) {
+      // User does not want to continue
+      break;
+    }
+    opts.stats->n++;
+  }
+  if (status.ok()) {
+    status = iter->status();
+  }
+
+  delete iter;
+  ReleaseDataBlock(cache_handle);
+  return status;
+}
+
+// Retrieve all keys from a given table and call "opts.saver" to handle the
+// results. Return OK on success and a non-OK status on errors.
+Status Dir::Iter(const IterOptions& opts, const TableHandle& h) {
+  Status status;
+  // Load the index block
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
+  Cache::Handle* index_cache_handle;
+  Block* index_block;
+  status = ReadIndexBlock(index_handle, &index_block, &index_cache_handle);
+  if (!status.ok()) {
+    return status;
+  } else {
+    opts.stats->table_seeks++;
+  }
+
+  Readahead readahead;
+  Readahead* const ra = options_.readahead_size != 0 ? &readahead : NULL;
+  Iterator* const iter = index_block->NewIterator(BytewiseComparator());
+  iter->SeekToFirst();
   for (; iter->Valid(); iter->Next()) {
     Slice input = iter->value();
-    status = Iter(opts, &input);
+    status = Iter(opts, &input, ra);
     if (!status.ok()) {
       break;
     }
@@ -912,7 +1634,7 @@ Status Dir::Iter(const IterOptions& opts, const TableHandle& h) {
   }
 
   delete iter;
-  delete index_block;
+  ReleaseIndexBlock(index_block, index_cache_handle);
   return status;
 }
 
@@ -930,13 +1652,12 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key, Slice* input,
   if (!status.ok()) {
     return status;
   }
+  Cache::Handle* cache_handle;
   BlockContents contents;
-  status = ReadBlock(data_, options_, handle, &contents, false, opts.file_index,
-                     opts.tmp, opts.tmp_length);
+  status = ReadDataBlock(handle, opts.file_index, opts.tmp, opts.tmp_length,
+                         NULL, &contents, &cache_handle, &opts.stats->seeks);
   if (!status.ok()) {
     return status;
-  } else {
-    opts.stats->seeks++;
   }
 
   Iterator* const iter = OpenDirBlock(options_, contents);
@@ -993,6 +1714,7 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key, Slice* input,
   }
 
   delete iter;
+  ReleaseDataBlock(cache_handle);
   return status;
 }
 
@@ -1000,39 +1722,71 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key, Slice* input,
 // indexed by the given filter.
 bool Dir::KeyMayMatch(const Slice& key, const BlockHandle& h) {
   Status status;
+  Cache::Handle* handle;
   BlockContents contents;
-  // We always prefetch and cache all filter blocks in memory
-  // so there is no need to allocate an additional
-  // buffer to store the block contents
-  const bool cached = true;
-  status = ReadBlock(indx_, options_, h, &contents, cached);
+  status = ReadFilterBlock(h, &contents, &handle);
   if (status.ok()) {
-    bool r;  // False if key must not match so no need for further access
-    if (options_.filter == kFtBloomFilter) {
-      r = BloomKeyMayMatch(key, contents.data);
-    } else if (options_.filter == kFtBitmap) {
-      r = BitmapKeyMustMatch(key, contents.data);
-    } else {  // Unknown filter type
-      r = true;
-    }
-    if (contents.heap_allocated) {
-      delete[] contents.data.data();
-    }
+    // False if key must not match so no need for further access
+    bool r = KeyMayMatch(key, contents.data);
+    ReleaseFilterBlock(contents, handle);
     return r;
   } else {
     return true;
   }
 }
 
+// Check a key against the contents of a filter block.
+bool Dir::KeyMayMatch(const Slice& key, const Slice& filter) const {
+  if (options_.filter == kFtBloomFilter) {
+    return BloomKeyMayMatch(key, filter);
+  } else if (options_.filter == kFtBlockedBloom) {
+    return BlockedBloomKeyMayMatch(key, filter);
+  } else if (options_.filter == kFtBitmap) {
+    return BitmapKeyMustMatch(key, filter);
+  } else {  // Unknown filter type
+    return true;
+  }
+}
+
+// Load the filter indexing all tables of an epoch. Return false if the epoch
+// has no such filter or the filter cannot be read.
+bool Dir::ReadEpochFilter(uint32_t epoch, Iterator* iter,
+                          BlockContents* contents, Cache::Handle** handle) {
+  const std::string filter_key = EpochFilterKey(epoch);
+  iter->Seek(filter_key);
+  if (!iter->Valid() || iter->key() != filter_key) {
+    return false;  // No epoch filter
+  }
+  BlockHandle filter_handle;
+  Slice input = iter->value();
+  if (!filter_handle.DecodeFrom(&input).ok()) {
+    return false;
+  }
+  Status status = ReadFilterBlock(filter_handle, contents, handle);
+  return status.ok();
+}
+
+bool Dir::EpochFilterTables(const Slice& key, uint32_t epoch,
+                            uint32_t num_tables, Iterator* iter,
+                            std::vector<uint32_t>* tables) {
+  tables->clear();
+  Cache::Handle* handle;
+  BlockContents contents;
+  if (!ReadEpochFilter(epoch, iter, &contents, &handle)) {
+    return true;
+  }
+  bool r = EpochCuckooTables(key, contents.data, num_tables, tables);
+  ReleaseFilterBlock(contents, handle);
+  return r;
+}
+
 // Retrieve value to a specific key from a given table and call "opts.saver"
 // using the value found. Filter will be consulted if available to avoid
 // unnecessary reads. Return OK on success and a non-OK status on errors.
-Status Dir::Fetch(const FetchOptions& opts, const Slice& key,
-                  const TableHandle& h) {
-  Status status;
+bool Dir::TableMayMatch(const Slice& key, const TableHandle& h) {
   // Check table key range and the paired filter
   if (key < h.smallest_key() || key > h.largest_key()) {
-    return status;
+    return false;
   } else if (!options_.ignore_filters) {
     BlockHandle filter_handle;
     filter_handle.set_offset(h.filter_offset());
@@ -1040,28 +1794,43 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key,
     if (filter_handle.size() != 0) {  // Filter detected
       if (!KeyMayMatch(key, filter_handle)) {
         // Assuming no false negatives
-        return status;
+        return false;
       }
     }
   }
+  return true;
+}
+
+Status Dir::Fetch(const FetchOptions& opts, const Slice& key,
+                  const TableHandle& h) {
+  Status status;
+  if (!TableMayMatch(key, h)) {
+    return status;
+  }
 
   // Load the index block
-  BlockContents index_contents;
   BlockHandle index_handle;
   index_handle.set_offset(h.index_offset());
   index_handle.set_size(h.index_size());
-  // We always prefetch and cache all index blocks in memory
-  // so there is no need to allocate an additional
-  // buffer to store the block contents
-  const bool cached = true;
-  status = ReadBlock(indx_, options_, index_handle, &index_contents, cached);
+  Cache::Handle* index_cache_handle;
+  Block* index_block;
+  status = ReadIndexBlock(index_handle, &index_block, &index_cache_handle);
   if (!status.ok()) {
     return status;
   } else {
     opts.stats->table_seeks++;
   }
 
-  Block* index_block = new Block(index_contents);
+  status = Fetch(opts, key, index_block);
+  ReleaseIndexBlock(index_block, index_cache_handle);
+  return status;
+}
+
+// Retrieve value to a specific key from a table whose index block has been
+// loaded and call "opts.saver" using the value found.
+Status Dir::Fetch(const FetchOptions& opts, const Slice& key,
+                  Block* index_block) {
+  Status status;
   Iterator* const iter = index_block->NewIterator(BytewiseComparator());
   if (IsKeyUniqueAndOrdered(options_.mode)) {
     iter->Seek(key);  // Binary search
@@ -1106,7 +1875,6 @@ Status Dir::Fetch(const FetchOptions& opts, const Slice& key,
   }
 
   delete iter;
-  delete index_block;
   return status;
 }
 
@@ -1118,16 +1886,12 @@ Status Dir::DoList(const BlockHandle& h, uint32_t epoch, ListContext* ctx,
                    ListStats* stats) {
   Status status;
   // Load the meta index for the epoch
-  BlockContents meta_index_contents;
-  // We always prefetch and cache all index blocks in memory
-  // so there is no need to allocate an additional
-  // buffer to store the block contents
-  const bool cached = true;
-  status = ReadBlock(indx_, options_, h, &meta_index_contents, cached);
+  Cache::Handle* meta_index_handle;
+  Block* epoch_index_block;
+  status = ReadIndexBlock(h, &epoch_index_block, &meta_index_handle);
   if (!status.ok()) {
     return status;
   }
-  Block* epoch_index_block = new Block(meta_index_contents);
   Iterator* const iter = epoch_index_block->NewIterator(BytewiseComparator());
   iter->SeekToFirst();
   std::string epoch_table_key;
@@ -1170,7 +1934,7 @@ Status Dir::DoList(const BlockHandle& h, uint32_t epoch, ListContext* ctx,
   }
 
   delete iter;
-  delete epoch_index_block;
+  ReleaseIndexBlock(epoch_index_block, meta_index_handle);
   return status;
 }
 
@@ -1210,25 +1974,40 @@ int ParaSaveValue(void* arg, const Slice& key, const Slice& value) {
 // GetContext *ctx may be shared among multiple concurrent getter threads.
 // GetStats *stats is dedicated to the current thread.
 // User callback is expected to be thread-safe.
-Status Dir::DoGet(const Slice& key, const BlockHandle& h, uint32_t epoch,
+Status Dir::DoGet(const Slice& key, const EpochHandle& h, uint32_t epoch,
                   GetContext* ctx, GetStats* stats) {
   Status status;
   // Load the meta index for the epoch
-  BlockContents meta_index_contents;
-  // We always prefetch and cache all index blocks in memory
-  // so there is no need to allocate an additional
-  // buffer to store the block contents
-  const bool cached = true;
-  status = ReadBlock(indx_, options_, h, &meta_index_contents, cached);
+  Cache::Handle* meta_index_handle;
+  Block* epoch_index_block;
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
+  status =
+      ReadIndexBlock(index_handle, &epoch_index_block, &meta_index_handle);
   if (!status.ok()) {
     return status;
   }
-  Block* epoch_index_block = new Block(meta_index_contents);
   Iterator* const iter = epoch_index_block->NewIterator(BytewiseComparator());
+  // Tables to check. All tables are checked if this is empty.
+  std::vector<uint32_t> tables;
+  if (options_.filter == kFtCuckoo && !options_.ignore_filters) {
+    if (!EpochFilterTables(key, epoch, h.num_tables(), iter, &tables)) {
+      delete iter;
+      ReleaseIndexBlock(epoch_index_block, meta_index_handle);
+      return status;  // Key not in epoch
+    }
+  }
   iter->SeekToFirst();
   std::string epoch_table_key;
   uint32_t table = 0;
-  for (; status.ok(); table++) {
+  for (size_t i = 0; status.ok(); i++, table++) {
+    if (!tables.empty()) {
+      if (i == tables.size()) {
+        break;  // All candidate tables checked
+      }
+      table = tables[i];
+    }
     epoch_table_key = EpochTableKey(epoch, table);
     // Try reusing current iterator position if possible
     if (!iter->Valid() || iter->key() != epoch_table_key) {
@@ -1284,7 +2063,262 @@ Status Dir::DoGet(const Slice& key, const BlockHandle& h, uint32_t epoch,
   }
 
   delete iter;
-  delete epoch_index_block;
+  ReleaseIndexBlock(epoch_index_block, meta_index_handle);
+  return status;
+}
+
+namespace {
+struct MultiSaverState {
+  std::string* dst;
+  uint32_t id;
+  bool found;
+};
+
+int MultiSaveValue(void* arg, const Slice& key, const Slice& value) {
+  MultiSaverState* state = reinterpret_cast<MultiSaverState*>(arg);
+  PutVarint32(state->dst, state->id);
+  PutLengthPrefixedSlice(state->dst, value);
+  state->found = true;
+  return 0;
+}
+
+}  // namespace
+
+// Retrieve the values to a subset of keys from a given table. The table's
+// index block is loaded once for all keys. When keys are unique and ordered,
+// keys sharing a data block are looked up using a single block read.
+Status Dir::MultiFetch(const FetchOptions& opts, MultiGetContext* ctx,
+                       const std::vector<uint32_t>& keys, const TableHandle& h,
+                       std::vector<char>* found, std::string* dst) {
+  Status status;
+  // Load the index block
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
+  Cache::Handle* index_cache_handle;
+  Block* index_block;
+  status = ReadIndexBlock(index_handle, &index_block, &index_cache_handle);
+  if (!status.ok()) {
+    return status;
+  } else {
+    opts.stats->table_seeks++;
+  }
+
+  if (!IsKeyUniqueAndOrdered(options_.mode)) {
+    // Keys are non-unique or stored out-of-order and may therefore span
+    // multiple data blocks. Look them up one by one.
+    for (size_t i = 0; i < keys.size() && status.ok(); i++) {
+      const uint32_t k = keys[i];
+      MultiSaverState arg;
+      arg.dst = dst;
+      arg.id = ctx->ids[k];
+      arg.found = false;
+      FetchOptions key_opts = opts;
+      key_opts.saver = MultiSaveValue;
+      key_opts.arg = &arg;
+      status = Fetch(key_opts, ctx->keys[k], index_block);
+      if (arg.found) {
+        (*found)[k] = 1;
+      }
+    }
+    ReleaseIndexBlock(index_block, index_cache_handle);
+    return status;
+  }
+
+  Iterator* const iter = index_block->NewIterator(BytewiseComparator());
+  size_t i = 0;
+  while (i < keys.size()) {
+    iter->Seek(ctx->keys[keys[i]]);  // Binary search
+    if (!iter->Valid()) {
+      break;  // All remaining keys are beyond the last data block
+    }
+    // Keys no greater than the block's separator are all located in
+    // that block
+    size_t j = i + 1;
+    while (j < keys.size() && ctx->keys[keys[j]].compare(iter->key()) <= 0) {
+      j++;
+    }
+    BlockHandle handle;
+    Slice input = iter->value();
+    status = handle.DecodeFrom(&input);
+    if (!status.ok()) {
+      break;
+    }
+    Cache::Handle* cache_handle;
+    BlockContents contents;
+    status = ReadDataBlock(handle, opts.file_index, opts.tmp, opts.tmp_length,
+                           NULL, &contents, &cache_handle, &opts.stats->seeks);
+    if (!status.ok()) {
+      break;
+    }
+    Iterator* const block_iter = OpenDirBlock(options_, contents);
+    for (; i < j; i++) {
+      const uint32_t k = keys[i];
+      block_iter->Seek(ctx->keys[k]);
+      if (block_iter->Valid() && block_iter->key() == ctx->keys[k]) {
+        PutVarint32(dst, ctx->ids[k]);
+        PutLengthPrefixedSlice(dst, block_iter->value());
+        (*found)[k] = 1;
+      }
+    }
+    status = block_iter->status();
+    delete block_iter;
+    ReleaseDataBlock(cache_handle);
+    if (!status.ok()) {
+      break;
+    }
+  }
+
+  if (status.ok()) {
+    status = iter->status();
+  }
+
+  delete iter;
+  ReleaseIndexBlock(index_block, index_cache_handle);
+  return status;
+}
+
+// Obtain the values to a set of sorted keys within a given directory epoch.
+// The epoch's meta index is loaded once and each table is checked against
+// all keys together. Only tables that may contain at least one of the keys
+// are loaded.
+Status Dir::DoMultiGet(const EpochHandle& h, uint32_t epoch,
+                       MultiGetContext* ctx, std::string* dst,
+                       GetStats* stats) {
+  Status status;
+  // Load the meta index for the epoch
+  Cache::Handle* meta_index_handle;
+  Block* epoch_index_block;
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
+  status =
+      ReadIndexBlock(index_handle, &epoch_index_block, &meta_index_handle);
+  if (!status.ok()) {
+    return status;
+  }
+  Iterator* const iter = epoch_index_block->NewIterator(BytewiseComparator());
+  // Candidate (table, key) pairs given by the epoch filter, if any
+  std::vector<std::pair<uint32_t, uint32_t> > candidates;
+  bool has_epoch_filter = false;
+  if (options_.filter == kFtCuckoo && !options_.ignore_filters) {
+    Cache::Handle* handle;
+    BlockContents contents;
+    if (ReadEpochFilter(epoch, iter, &contents, &handle)) {
+      has_epoch_filter = true;
+      std::vector<uint32_t> tables;
+      for (uint32_t k = 0; k < ctx->n; k++) {
+        if (EpochCuckooTables(ctx->keys[k], contents.data, h.num_tables(),
+                              &tables)) {
+          for (size_t i = 0; i < tables.size(); i++) {
+            candidates.push_back(std::make_pair(tables[i], k));
+          }
+        }
+      }
+      // Group keys by table. Keys of each table remain sorted.
+      std::sort(candidates.begin(), candidates.end());
+      ReleaseFilterBlock(contents, handle);
+    }
+  }
+  std::vector<char> found(ctx->n, 0);  // Keys found within the epoch
+  std::vector<uint32_t> keys;
+  std::string epoch_table_key;
+  size_t c = 0;  // Next candidate pair
+  iter->SeekToFirst();
+  for (uint32_t table = 0; status.ok(); table++) {
+    if (has_epoch_filter) {
+      if (c == candidates.size()) {
+        break;  // All candidate tables checked
+      }
+      table = candidates[c].first;
+    }
+    epoch_table_key = EpochTableKey(epoch, table);
+    // Try reusing current iterator position if possible
+    if (!iter->Valid() || iter->key() != epoch_table_key) {
+      iter->Seek(epoch_table_key);
+      if (!iter->Valid()) {
+        break;  // EOF
+      } else if (iter->key() != epoch_table_key) {
+        break;  // No such table
+      }
+    }
+    TableHandle table_handle;
+    Slice input = iter->value();
+    status = table_handle.DecodeFrom(&input);
+    iter->Next();
+    if (!status.ok()) {
+      break;
+    }
+    // Collect keys that may be found in the table
+    keys.clear();
+    const Slice smallest_key = table_handle.smallest_key();
+    const Slice largest_key = table_handle.largest_key();
+    Cache::Handle* filter_cache_handle = NULL;
+    BlockContents filter_contents;
+    bool has_filter = false;
+    if (!has_epoch_filter && !options_.ignore_filters &&
+        table_handle.filter_size() != 0) {
+      BlockHandle filter_handle;
+      filter_handle.set_offset(table_handle.filter_offset());
+      filter_handle.set_size(table_handle.filter_size());
+      has_filter =
+          ReadFilterBlock(filter_handle, &filter_contents, &filter_cache_handle)
+              .ok();
+    }
+    uint32_t k = 0;
+    if (!has_epoch_filter) {  // Skip keys smaller than the table's range
+      k = static_cast<uint32_t>(
+          std::lower_bound(ctx->keys, ctx->keys + ctx->n, smallest_key) -
+          ctx->keys);
+    }
+    while (true) {
+      if (has_epoch_filter) {
+        if (c == candidates.size() || candidates[c].first != table) break;
+        k = candidates[c++].second;
+      } else if (k == ctx->n || ctx->keys[k] > largest_key) {
+        break;
+      }
+      const Slice& key = ctx->keys[k];
+      // Keys are unique so there is no need to look further once found
+      if (found[k] && IsKeyUnique(options_.mode)) {
+        // Skip
+      } else if (key < smallest_key || key > largest_key) {
+        // Skip
+      } else if (has_filter && !KeyMayMatch(key, filter_contents.data)) {
+        // Skip
+      } else if (keys.empty() || keys.back() != k) {
+        keys.push_back(k);
+      }
+      if (!has_epoch_filter) {
+        k++;
+      }
+    }
+    if (has_filter) {
+      ReleaseFilterBlock(filter_contents, filter_cache_handle);
+    }
+    if (keys.empty()) {
+      continue;
+    }
+    FetchOptions opts;
+    if (options_.epoch_log_rotation) {
+      opts.file_index = epoch;
+    } else {
+      opts.file_index = 0;
+    }
+    opts.stats = stats;
+    opts.tmp_length = ctx->tmp_length;
+    opts.tmp = ctx->tmp;
+    opts.saver = NULL;
+    opts.arg = NULL;
+    status = MultiFetch(opts, ctx, keys, table_handle, &found, dst);
+  }
+
+  if (status.ok()) {
+    status = iter->status();
+  }
+
+  delete iter;
+  ReleaseIndexBlock(epoch_index_block, meta_index_handle);
   return status;
 }
 
@@ -1385,7 +2419,7 @@ void Dir::Get(const Slice& key, uint32_t epoch, GetContext* ctx) {
         break;  // No such epoch
       }
     }
-    BlockHandle h;
+    EpochHandle h;
     Slice input = rt_iter->value();
     status = h.DecodeFrom(&input);
     rt_iter->Next();
@@ -1416,6 +2450,66 @@ void Dir::Get(const Slice& key, uint32_t epoch, GetContext* ctx) {
   }
 }
 
+// Obtain the values to a set of keys at a given directory epoch.
+// MultiGetContext *ctx may be shared among multiple concurrent getter threads.
+// Results are appended to *dst, which is dedicated to the epoch.
+void Dir::MultiGet(uint32_t epoch, MultiGetContext* ctx, std::string* dst) {
+  mu_->AssertHeld();
+  if (!ctx->status->ok()) {
+    return;
+  }
+  Iterator* rt_iter = ctx->rt_iter;
+  if (rt_iter == NULL) {
+    rt_iter = NewRtIterator(rt_);
+  }
+  mu_->Unlock();
+  GetStats stats;
+  stats.table_seeks = 0;  // Number of tables touched
+  // Number of data blocks fetched
+  stats.seeks = 0;
+  Status status;
+  for (uint32_t dummy = epoch; dummy == epoch; dummy++) {
+    std::string epoch_key = EpochKey(epoch);
+    // Try reusing current iterator position if possible
+    if (!rt_iter->Valid() || rt_iter->key() != epoch_key) {
+      rt_iter->Seek(epoch_key);
+      if (!rt_iter->Valid()) {
+        break;  // EOF
+      } else if (rt_iter->key() != epoch_key) {
+        break;  // No such epoch
+      }
+    }
+    EpochHandle h;
+    Slice input = rt_iter->value();
+    status = h.DecodeFrom(&input);
+    rt_iter->Next();
+    if (status.ok()) {
+      status = DoMultiGet(h, epoch, ctx, dst, &stats);
+    } else {
+      // Skip the epoch
+    }
+    break;
+  }
+
+  if (status.ok()) {
+    status = rt_iter->status();
+  }
+
+  mu_->Lock();
+  if (rt_iter != ctx->rt_iter) {
+    delete rt_iter;
+  }
+  // Increase the total seek count
+  ctx->num_table_seeks += stats.table_seeks;
+  ctx->num_seeks += stats.seeks;
+  assert(ctx->num_open_reads > 0);
+  ctx->num_open_reads--;
+  bg_cv_->SignalAll();
+  if (ctx->status->ok()) {
+    *ctx->status = status;
+  }
+}
+
 struct Dir::STLLessThan {
   Slice buffer_;
 
@@ -1579,6 +2673,9 @@ Status Dir::Scan(const ScanOptions& opts, ScanStats* stats) {
 Status Dir::Read(const ReadOptions& opts, const Slice& key, std::string* dst,
                  ReadStats* stats) {
   mu_->AssertHeld();
+  if (options_.batched_reads && IsKeyUniqueAndOrdered(options_.mode)) {
+    return BatchedRead(opts, key, dst, stats);
+  }
   Status status;
   assert(rt_ != NULL);
   std::vector<uint32_t> offsets;
@@ -1646,6 +2743,345 @@ Status Dir::Read(const ReadOptions& opts, const Slice& key, std::string* dst,
   return status;
 }
 
+// Obtain the values to a set of sorted keys within a given epoch range.
+// Epochs may be read in parallel. Each has its own result buffer, and buffers
+// are concatenated in epoch order once all reads conclude.
+// Return OK on success, or a non-OK status on errors.
+Status Dir::MultiRead(const ReadOptions& opts, const Slice* keys,
+                      const uint32_t* ids, size_t n, std::string* dst,
+                      ReadStats* stats) {
+  mu_->AssertHeld();
+  Status status;
+  assert(rt_ != NULL);
+
+  MultiGetContext ctx;
+  ctx.num_open_reads = 0;  // Number of outstanding epoch read operations
+  ctx.status = &status;
+  ctx.keys = keys;
+  ctx.ids = ids;
+  ctx.n = n;
+  ctx.num_table_seeks = 0;  // Total number of tables touched
+  // Total number of data blocks fetched
+  ctx.num_seeks = 0;
+  const bool serial = opts.force_serial_reads || !options_.parallel_reads;
+  if (serial) {
+    // Pre-create the root iterator for serial reads
+    ctx.rt_iter = NewRtIterator(rt_);
+    ctx.tmp = opts.tmp;  // User-supplied buffer space
+    ctx.tmp_length = opts.tmp_length;
+  } else {
+    // Block contents may outlive a single key lookup so the temporary
+    // buffer cannot be shared among concurrent getters
+    ctx.rt_iter = NULL;
+    ctx.tmp = NULL;
+    ctx.tmp_length = 0;
+  }
+  std::vector<std::string> results;
+  if (num_eps_ != 0 && n != 0) {
+    uint32_t epoch = opts.epoch_start;
+    uint32_t epoch_end = std::min(num_eps_, opts.epoch_end);
+    if (epoch < epoch_end) {
+      results.resize(epoch_end - epoch);
+    }
+    std::vector<BGMultiGetItem> items(results.size());
+    for (size_t i = 0; epoch < epoch_end; epoch++, i++) {
+      ctx.num_open_reads++;
+      BGMultiGetItem* const item = &items[i];
+      item->epoch = epoch;
+      item->dir = this;
+      item->ctx = &ctx;
+      item->dst = &results[i];
+      if (serial) {
+        MultiGet(item->epoch, item->ctx, item->dst);
+      } else if (options_.reader_pool != NULL) {
+        options_.reader_pool->Schedule(Dir::BGMultiGet, item);
+      } else if (options_.allow_env_threads) {
+        Env::Default()->Schedule(Dir::BGMultiGet, item);
+      } else {
+        MultiGet(item->epoch, item->ctx, item->dst);
+      }
+      if (!status.ok()) {
+        break;
+      }
+    }
+
+    // Wait for all outstanding read operations to conclude
+    while (ctx.num_open_reads > 0) {
+      bg_cv_->Wait();
+    }
+  }
+
+  delete ctx.rt_iter;
+  if (status.ok()) {
+    if (stats != NULL) {
+      stats->total_table_seeks += ctx.num_table_seeks;
+      stats->total_seeks += ctx.num_seeks;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+      dst->append(results[i]);
+    }
+  }
+
+  return status;
+}
+
+// Obtain value to a specific key within a given epoch range. All epochs are
+// first checked against the indexes, which are expected to be cached in
+// memory, to locate the data blocks that may contain the key. All located
+// blocks are then read together so that an Env able to keep multiple reads in
+// flight can serve them concurrently without a reader thread per block.
+// Return OK on success, or a non-OK status on errors.
+Status Dir::BatchedRead(const ReadOptions& opts, const Slice& key,
+                        std::string* dst, ReadStats* stats) {
+  mu_->AssertHeld();
+  Status status;
+  assert(rt_ != NULL);
+  Iterator* const rt_iter = NewRtIterator(rt_);
+  const uint32_t epoch_end = std::min(num_eps_, opts.epoch_end);
+  mu_->Unlock();
+  GetStats get_stats;
+  get_stats.table_seeks = 0;  // Number of tables touched
+  // Number of data blocks fetched
+  get_stats.seeks = 0;
+  std::vector<BlockRef> blocks;
+  std::string epoch_key;
+  for (uint32_t epoch = opts.epoch_start; epoch < epoch_end; epoch++) {
+    epoch_key = EpochKey(epoch);
+    // Try reusing current iterator position if possible
+    if (!rt_iter->Valid() || rt_iter->key() != epoch_key) {
+      rt_iter->Seek(epoch_key);
+      if (!rt_iter->Valid()) {
+        break;  // EOF
+      } else if (rt_iter->key() != epoch_key) {
+        continue;  // No such epoch
+      }
+    }
+    EpochHandle h;
+    Slice input = rt_iter->value();
+    status = h.DecodeFrom(&input);
+    rt_iter->Next();
+    if (status.ok()) {
+      status = LocateBlocks(key, h, epoch, &blocks, &get_stats);
+    }
+    if (!status.ok()) {
+      break;
+    }
+  }
+
+  if (status.ok()) {
+    status = rt_iter->status();
+  }
+  if (status.ok() && !blocks.empty()) {
+    status = FetchBlocks(key, blocks, dst, &get_stats);
+  }
+
+  mu_->Lock();
+  delete rt_iter;
+  if (status.ok()) {
+    if (stats != NULL) {
+      stats->total_table_seeks += get_stats.table_seeks;
+      stats->total_seeks += get_stats.seeks;
+    }
+  }
+
+  return status;
+}
+
+Status Dir::LocateBlocks(const Slice& key, const EpochHandle& h,
+                         uint32_t epoch, std::vector<BlockRef>* blocks,
+                         GetStats* stats) {
+  assert(IsKeyUniqueAndOrdered(options_.mode));
+  Status status;
+  // Load the meta index for the epoch
+  Cache::Handle* meta_index_handle;
+  Block* epoch_index_block;
+  BlockHandle index_handle;
+  index_handle.set_offset(h.index_offset());
+  index_handle.set_size(h.index_size());
+  status =
+      ReadIndexBlock(index_handle, &epoch_index_block, &meta_index_handle);
+  if (!status.ok()) {
+    return status;
+  }
+  Iterator* const iter = epoch_index_block->NewIterator(BytewiseComparator());
+  // Tables to check. All tables are checked if this is empty.
+  std::vector<uint32_t> tables;
+  if (options_.filter == kFtCuckoo && !options_.ignore_filters) {
+    if (!EpochFilterTables(key, epoch, h.num_tables(), iter, &tables)) {
+      delete iter;
+      ReleaseIndexBlock(epoch_index_block, meta_index_handle);
+      return status;  // Key not in epoch
+    }
+  }
+  BlockRef ref;
+  ref.epoch = epoch;
+  if (options_.epoch_log_rotation) {
+    ref.file_index = epoch;
+  } else {
+    ref.file_index = 0;
+  }
+  iter->SeekToFirst();
+  std::string epoch_table_key;
+  uint32_t table = 0;
+  for (size_t i = 0; status.ok(); i++, table++) {
+    if (!tables.empty()) {
+      if (i == tables.size()) {
+        break;  // All candidate tables checked
+      }
+      table = tables[i];
+    }
+    epoch_table_key = EpochTableKey(epoch, table);
+    // Try reusing current iterator position if possible
+    if (!iter->Valid() || iter->key() != epoch_table_key) {
+      iter->Seek(epoch_table_key);
+      if (!iter->Valid()) {
+        break;  // EOF
+      } else if (iter->key() != epoch_table_key) {
+        break;  // No such table
+      }
+    }
+    TableHandle table_handle;
+    Slice input = iter->value();
+    status = table_handle.DecodeFrom(&input);
+    iter->Next();
+    if (!status.ok() || !TableMayMatch(key, table_handle)) {
+      continue;
+    }
+    // Load the index block
+    BlockHandle index_handle;
+    index_handle.set_offset(table_handle.index_offset());
+    index_handle.set_size(table_handle.index_size());
+    Cache::Handle* index_cache_handle;
+    Block* index_block;
+    status = ReadIndexBlock(index_handle, &index_block, &index_cache_handle);
+    if (!status.ok()) {
+      break;
+    } else {
+      stats->table_seeks++;
+    }
+    Iterator* const index_iter =
+        index_block->NewIterator(BytewiseComparator());
+    index_iter->Seek(key);  // Binary search
+    if (index_iter->Valid()) {
+      input = index_iter->value();
+      status = ref.handle.DecodeFrom(&input);
+      if (status.ok()) {
+        blocks->push_back(ref);
+      }
+    } else {
+      status = index_iter->status();
+    }
+    delete index_iter;
+    ReleaseIndexBlock(index_block, index_cache_handle);
+  }
+
+  if (status.ok()) {
+    status = iter->status();
+  }
+
+  delete iter;
+  ReleaseIndexBlock(epoch_index_block, meta_index_handle);
+  return status;
+}
+
+Status Dir::FetchBlocks(const Slice& key, const std::vector<BlockRef>& blocks,
+                        std::string* dst, GetStats* stats) {
+  Status status;
+  const size_t n = blocks.size();
+  std::vector<BlockContents> contents(n);
+  std::vector<Cache::Handle*> handles(n, NULL);
+  std::vector<ReadRequest> reqs;
+  std::vector<size_t> req_blocks;  // Block # of each read request
+  size_t total_size = 0;
+  for (size_t i = 0; i < n; i++) {
+    handles[i] = LookupDataBlock(blocks[i].handle, blocks[i].file_index,
+                                 &contents[i]);
+    if (handles[i] == NULL) {
+      ReadRequest req;
+      req.offset = blocks[i].handle.offset();
+      req.n = blocks[i].handle.size() + kBlockTrailerSize;
+      total_size += req.n;
+      reqs.push_back(req);
+      req_blocks.push_back(i);
+    }
+  }
+
+  std::string space;
+  space.resize(total_size);
+  char* scratch = &space[0];
+  for (size_t i = 0; i < reqs.size(); i++) {
+    reqs[i].scratch = scratch;
+    scratch += reqs[i].n;
+  }
+  // Submit one batch for each data log file
+  for (size_t i = 0; i < reqs.size();) {
+    const uint32_t file_index = blocks[req_blocks[i]].file_index;
+    size_t j = i + 1;
+    while (j < reqs.size() && blocks[req_blocks[j]].file_index == file_index) {
+      j++;
+    }
+    data_->MultiRead(&reqs[i], j - i, file_index);
+    i = j;
+  }
+
+  std::vector<char> decoded(n, 0);
+  for (size_t i = 0; i < reqs.size(); i++) {
+    const size_t b = req_blocks[i];
+    status = reqs[i].status;
+    if (!status.ok()) {
+      break;
+    } else if (reqs[i].result.size() != reqs[i].n) {
+      status = Status::Corruption("Truncated block read");
+      break;
+    }
+    stats->seeks++;
+    status = DecodeBlock(options_, reqs[i].result, &contents[b]);
+    if (!status.ok()) {
+      break;
+    }
+    decoded[b] = 1;
+    handles[b] =
+        InsertDataBlock(blocks[b].handle, blocks[b].file_index, &contents[b]);
+  }
+
+  // Keys are unique within an epoch so we are done with an epoch
+  // once a match is found
+  bool found = false;
+  uint32_t epoch = 0;
+  for (size_t i = 0; status.ok() && i < n; i++) {
+    if (found && blocks[i].epoch == epoch) {
+      continue;
+    }
+    found = false;
+    epoch = blocks[i].epoch;
+    decoded[i] = 0;  // Block contents now owned by the iterator
+    Iterator* const iter = OpenDirBlock(options_, contents[i]);
+    iter->Seek(key);  // Binary search
+    if (iter->Valid() && iter->key() == key) {
+      dst->append(iter->value().data(), iter->value().size());
+      found = true;
+    }
+    status = iter->status();
+    delete iter;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (handles[i] != NULL) {
+      ReleaseDataBlock(handles[i]);
+    } else if (decoded[i] && contents[i].heap_allocated) {
+      delete[] contents[i].data.data();
+    }
+  }
+
+  return status;
+}
+
+void Dir::BGMultiGet(void* arg) {
+  BGMultiGetItem* item = reinterpret_cast<BGMultiGetItem*>(arg);
+  MutexLock ml(item->dir->mu_);
+  item->dir->MultiGet(item->epoch, item->ctx, item->dst);
+}
+
 void Dir::BGList(void* arg) {
   BGListItem* item = reinterpret_cast<BGListItem*>(arg);
   MutexLock ml(item->dir->mu_);
@@ -1685,7 +3121,18 @@ Dir::Dir(const DirOptions& options, port::Mutex* mu, port::CondVar* bg_cv)
       mu_(mu),
       bg_cv_(bg_cv),
       rt_(NULL),
-      refs_(0) {}
+      refs_(0),
+      index_cache_(NULL),
+      cache_id_(0),
+      index_cache_hits_(0),
+      index_cache_misses_(0),
+      filter_cache_hits_(0),
+      filter_cache_misses_(0),
+      data_cache_(NULL),
+      data_cache_hits_(0),
+      data_cache_misses_(0),
+      data_cache_bytes_saved_(0),
+      readahead_hits_(0) {}
 
 Dir::~Dir() {
   mu_->AssertHeld();
@@ -1694,6 +3141,15 @@ Dir::~Dir() {
   delete rt_;
 }
 
+void Dir::InstallIndexCache(Cache* cache) {
+  index_cache_ = cache;
+  if (index_cache_ != NULL) {
+    cache_id_ = index_cache_->NewId();
+  }
+}
+
+void Dir::InstallDataCache(Cache* cache) { data_cache_ = cache; }
+
 void Dir::InstallDataSource(LogSource* data) {
   if (data != data_) {
     if (data_ != NULL) data_->Unref();
@@ -15,6 +15,7 @@
 #include "deltafs_plfsio_recov.h"
 #include "deltafs_plfsio_types.h"
 
+#include "pdlfs-common/cache.h"
 #include "pdlfs-common/env_files.h"
 #include "pdlfs-common/port.h"
 
@@ -130,12 +131,35 @@ class WriteBuffer {
   void Finish(bool skip_sort = false);
   void Reset();
 
+  // Sort entries using the comparison-based sort only.
+  // For benchmarking and testing.
+  void TEST_Finish();
+
+  // Finish the buffer by splitting its entries into at most "num_shards"
+  // key-range shards such that no key in a shard is greater than any key in a
+  // later shard. Shard i spans entries [(*bounds)[i], (*bounds)[i + 1]).
+  // Entries within each shard remain unsorted until SortShard() is called.
+  // If "by_key" is false, entries are split evenly in their insertion order.
+  void Partition(size_t num_shards, bool by_key,
+                 std::vector<uint32_t>* bounds);
+  // Sort the entries of a shard. Different shards may be sorted concurrently.
+  void SortShard(uint32_t begin, uint32_t end);
+  // Return an iterator over the entries of a shard.
+  // REQUIRES: Partition() has been called.
+  Iterator* NewIterator(uint32_t begin, uint32_t end) const;
+
  private:
   friend class DirCompactor;
   struct STLLessThan;
+  struct KeyPrefix;
+  void RadixSort(uint32_t begin, uint32_t end);
+  void STLSort(uint32_t begin, uint32_t end);
   // Estimated memory usage per entry (including overhead due to varint
   // encoding)
   size_t bytes_per_entry_;
+  // True if all keys are known to be no longer than a key prefix so
+  // ties in key prefixes never have to be resolved by full key comparisons
+  bool prefix_is_key_;
 
   // Starting offsets of inserted entries
   std::vector<uint32_t> offsets_;
@@ -156,6 +180,10 @@ class DirCompactor {
   DirCompactor(const DirOptions& options, DirBuilder* bu);
   virtual ~DirCompactor();
   virtual void Compact(WriteBuffer* buf) = 0;
+  // Split a write buffer into multiple key-range shards and compact them
+  // concurrently. Each shard results in a separate table.
+  // REQUIRES: Finish() has not been called on the buffer.
+  virtual void ParallelCompact(WriteBuffer* buf, bool skip_sort) = 0;
   virtual Status FinishEpoch(uint32_t ep_seq) = 0;
   virtual Status Finish(uint32_t ep_seq) = 0;
   virtual size_t memory_usage() const = 0;
@@ -166,6 +194,8 @@ class DirCompactor {
   bool ok() const { return bu_->ok(); }
   Status status() const { return bu_->status_; }
   uint32_t num_epochs() const { return bu_->num_eps_; }
+  uint32_t num_tables() const { return bu_->num_tabls_; }
+  DirOutputStats* compac_stats() const { return bu_->compac_stats_; }
   const DirOptions& options_;
   DirBuilder* bu_;
 
@@ -191,6 +221,10 @@ class DirIndexer {
   Status bg_status();  // Return latest compaction status
   // May trigger a new compaction
   Status Add(Epoch* epoch, const Slice& key, const Slice& value);
+  // Insert n key-value pairs, checking for buffer space only when
+  // the current write buffer may be full. May trigger new compactions.
+  Status AddBatch(Epoch* epoch, const Slice* keys, const Slice* values,
+                  size_t n);
 
   // Force a compaction and maybe wait for it
   struct FlushOptions {
@@ -332,6 +366,17 @@ class Dir {
   Status Read(const ReadOptions& opts, const Slice& key, std::string* dst,
               ReadStats* stats);
 
+  // Obtain the values to a set of keys within a given epoch range. Keys must
+  // be sorted. Each epoch, and each table of an epoch, is visited at most
+  // once, and keys located in the same data block share a single block
+  // read. For each value found, the id of its key, as specified by "ids", is
+  // appended to "dst" as a varint32, followed by the length-prefixed value.
+  // Values are ordered by epoch. Read stats will be accumulated to "*stats".
+  // Return OK on success, or a non-OK status on errors.
+  Status MultiRead(const ReadOptions& opts, const Slice* keys,
+                   const uint32_t* ids, size_t n, std::string* dst,
+                   ReadStats* stats);
+
   // Iterate through all keys within a given epoch range. A caller may
   // optionally provide a temporary buffer for storing fetched block contents.
   // Read stats will be accumulated to "*stats". Return OK on success, or a
@@ -361,6 +406,16 @@ class Dir {
 
   void InstallDataSource(LogSource* data);
 
+  // Use a cache, possibly shared among multiple directory partitions, to
+  // keep decoded index and filter blocks across reads. Must be called
+  // before the directory is used.
+  void InstallIndexCache(Cache* cache);
+
+  // Use a cache, possibly shared among multiple directory partitions, to
+  // keep recently read data blocks. Must be called before the directory is
+  // used.
+  void InstallDataCache(Cache* cache);
+
   void Ref() { refs_++; }
 
   void Unref() {
@@ -394,6 +449,34 @@ class Dir {
     void* arg;
   };
 
+  // State for reading ahead consecutive data blocks of a table.
+  struct Readahead {
+    Readahead() : offset(0), last_end(0), window(0) {}
+    uint64_t offset;  // Data log offset of the buffered range
+    Slice data;  // Buffered range
+    std::string space;
+    uint64_t last_end;  // End offset of the last block read
+    size_t window;  // Current readahead size
+  };
+
+  // Obtain a data block from the data cache, the readahead buffer if "ra" is
+  // not NULL, or the data log. *seeks is incremented for each storage read.
+  // The block must be released using ReleaseDataBlock() once the block's
+  // contents are no longer used.
+  Status ReadDataBlock(const BlockHandle& h, uint32_t file_index, char* tmp,
+                       size_t tmp_length, Readahead* ra,
+                       BlockContents* result, Cache::Handle** handle,
+                       size_t* seeks);
+  void ReleaseDataBlock(Cache::Handle* handle);
+
+  // Look up a data block in the data cache. Return NULL on misses.
+  Cache::Handle* LookupDataBlock(const BlockHandle& h, uint32_t file_index,
+                                 BlockContents* result);
+  // Insert a data block just read from storage into the data cache. The
+  // block's contents will then be owned by the cache.
+  Cache::Handle* InsertDataBlock(const BlockHandle& h, uint32_t file_index,
+                                 BlockContents* result);
+
   // Obtain the value to a specific key from a given table data block.
   // If key is found, "opts.saver" will be called and *found is set to true. In
   // addition, *exhausted is set to true if any key larger than the given one is
@@ -402,8 +485,41 @@ class Dir {
   Status Fetch(const FetchOptions& opts, const Slice& key, Slice* input,
                bool* found, bool* exhausted);
 
+  // Obtain a decoded index block from the index cache or the index log.
+  // The returned block must be released using ReleaseIndexBlock().
+  Status ReadIndexBlock(const BlockHandle& h, Block** result,
+                        Cache::Handle** handle);
+  void ReleaseIndexBlock(Block* block, Cache::Handle* handle);
+
+  // Obtain a filter block from the index cache or the index log.
+  // The returned block must be released using ReleaseFilterBlock().
+  Status ReadFilterBlock(const BlockHandle& h, BlockContents* result,
+                         Cache::Handle** handle);
+  void ReleaseFilterBlock(const BlockContents& contents,
+                          Cache::Handle* handle);
+
   // Return true if the given key matches a specific filter block.
   bool KeyMayMatch(const Slice& key, const BlockHandle& h);
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const;
+
+  // Load the filter indexing all tables of a given epoch. "iter" is
+  // positioned on the epoch's meta index. Return false if there is no such
+  // filter. The filter must be released using ReleaseFilterBlock().
+  bool ReadEpochFilter(uint32_t epoch, Iterator* iter, BlockContents* contents,
+                       Cache::Handle** handle);
+
+  // Obtain the tables of an epoch that may contain a given key using the
+  // epoch's filter, if any. "iter" is positioned on the epoch's meta index.
+  // The epoch has "num_tables" tables. Return false iff the key must not
+  // exist within the epoch. Otherwise, *tables is set to the candidate
+  // tables in ascending order, or cleared if no epoch filter is found and
+  // every table must be checked.
+  bool EpochFilterTables(const Slice& key, uint32_t epoch, uint32_t num_tables,
+                         Iterator* iter, std::vector<uint32_t>* tables);
+
+  // Return false if a given key must not exist in a table according to the
+  // table's key range and filter.
+  bool TableMayMatch(const Slice& key, const TableHandle& h);
 
   // Obtain the value to a specific key from a given table.
   // If key is found, "opts.saver" will be called.
@@ -411,6 +527,7 @@ class Dir {
   // Return OK on success, or a non-OK status on errors.
   Status Fetch(const FetchOptions& opts, const Slice& key,
                const TableHandle& h);
+  Status Fetch(const FetchOptions& opts, const Slice& key, Block* index_block);
 
   // Obtain the value to a specific key within a given directory epoch.
   // GetContext may be shared among multiple concurrent getters.
@@ -438,7 +555,7 @@ class Dir {
     // Total data blocks fetched for a certain epoch
     size_t seeks;
   };
-  Status DoGet(const Slice& key, const BlockHandle& h, uint32_t epoch,
+  Status DoGet(const Slice& key, const EpochHandle& h, uint32_t epoch,
                GetContext* ctx, GetStats* stats);
 
   // Merge results from concurrent getters.
@@ -452,6 +569,63 @@ class Dir {
   };
   static void BGGet(void*);
 
+  // Obtain the values to a set of sorted keys within a given directory epoch.
+  // MultiGetContext may be shared among multiple concurrent getters, each
+  // writing to a dedicated result buffer.
+  struct MultiGetContext {
+    Iterator* rt_iter;  // Only used in serial reads
+    const Slice* keys;
+    const uint32_t* ids;
+    size_t n;
+    int num_open_reads;
+    Status* status;
+    char* tmp;  // Temporary storage for block contents
+    size_t tmp_length;
+    size_t num_table_seeks;  // Total number of tables touched
+    // Total number of data blocks fetched
+    size_t num_seeks;
+  };
+  void MultiGet(uint32_t epoch, MultiGetContext* ctx, std::string* dst);
+
+  Status DoMultiGet(const EpochHandle& h, uint32_t epoch,
+                    MultiGetContext* ctx, std::string* dst, GetStats* stats);
+
+  // Obtain the values to a subset of keys from a given table. "keys"
+  // indexes the keys of the context in ascending order. Keys found are
+  // marked in *found.
+  Status MultiFetch(const FetchOptions& opts, MultiGetContext* ctx,
+                    const std::vector<uint32_t>& keys, const TableHandle& h,
+                    std::vector<char>* found, std::string* dst);
+
+  struct BGMultiGetItem {
+    MultiGetContext* ctx;
+    uint32_t epoch;
+    std::string* dst;
+    Dir* dir;
+  };
+  static void BGMultiGet(void*);
+
+  // Obtain the value to a specific key within a given epoch range by first
+  // locating the candidate data blocks of all epochs and then reading these
+  // blocks in one batch. Only used when keys are unique and ordered.
+  Status BatchedRead(const ReadOptions& opts, const Slice& key,
+                     std::string* dst, ReadStats* stats);
+
+  // A data block that may contain a given key.
+  struct BlockRef {
+    uint32_t epoch;
+    uint32_t file_index;
+    BlockHandle handle;
+  };
+  // Append the data blocks of a given epoch that may contain a key to
+  // *blocks. At most one block per table is located.
+  Status LocateBlocks(const Slice& key, const EpochHandle& h, uint32_t epoch,
+                      std::vector<BlockRef>* blocks, GetStats* stats);
+  // Read a set of located data blocks using a single batch of reads per data
+  // log file and append the values found to *dst in epoch order.
+  Status FetchBlocks(const Slice& key, const std::vector<BlockRef>& blocks,
+                     std::string* dst, GetStats* stats);
+
   struct ListStats;
   struct IterOptions {
     ListStats* stats;
@@ -468,8 +642,9 @@ class Dir {
   };
 
   // Iterate through all keys within a given table data block whose block handle
-  // is encoded as *input. Return OK on success, or a non-OK status on errors.
-  Status Iter(const IterOptions& opts, Slice* input);
+  // is encoded as *input. Data may be read ahead using "ra" if it is not NULL.
+  // Return OK on success, or a non-OK status on errors.
+  Status Iter(const IterOptions& opts, Slice* input, Readahead* ra);
 
   // Iterate through all keys within a given table.
   // For each key obtained, "opts.saver" will be called to save the results.
@@ -524,6 +699,22 @@ class Dir {
   port::CondVar* bg_cv_;
   Block* rt_;
   int refs_;
+
+  Cache* index_cache_;  // May be NULL
+  uint64_t cache_id_;
+  // Index cache stats protected by cache_mu_
+  mutable port::Mutex cache_mu_;
+  uint64_t index_cache_hits_;
+  uint64_t index_cache_misses_;
+  uint64_t filter_cache_hits_;
+  uint64_t filter_cache_misses_;
+
+  Cache* data_cache_;  // May be NULL
+  // Data cache and readahead stats protected by cache_mu_
+  uint64_t data_cache_hits_;
+  uint64_t data_cache_misses_;
+  uint64_t data_cache_bytes_saved_;
+  uint64_t readahead_hits_;
 };
 
 }  // namespace plfsio
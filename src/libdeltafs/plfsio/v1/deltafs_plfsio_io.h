@@ -266,6 +266,20 @@ class LogSource {
     return status;
   }
 
+  // Read a batch of byte ranges from a given file. Depending on the underlying
+  // Env, all reads may be submitted to storage at once.
+  void MultiRead(ReadRequest* reqs, size_t n, size_t index = 0) {
+    if (index < num_files_) {
+      RandomAccessFile* const f = files_[index].first;
+      f->MultiRead(reqs, n);
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        reqs[i].result = Slice();  // Return empty data
+        reqs[i].status = Status::OK();
+      }
+    }
+  }
+
   // Return the size of a given file
   uint64_t Size(size_t index = 0) const {
     if (index < num_files_) {
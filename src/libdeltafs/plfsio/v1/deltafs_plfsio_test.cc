@@ -64,11 +64,28 @@ class WriteBufTest {
   void Add(uint64_t seq) {
     std::string key;
     PutFixed64(&key, seq);
+    Add(key);
+  }
+
+  void Add(const std::string& key) {
     std::string value;
     test::RandomString(&rnd_, value_size, &value);
-    kv_.insert(std::make_pair(key, value));
-    buf_->Add(key, value);
-    num_entries_++;
+    if (kv_.insert(std::make_pair(key, value)).second) {
+      buf_->Add(key, value);
+      num_entries_++;
+    }
+  }
+
+  void CheckAll(Iterator* iter) {
+    std::map<std::string, std::string>::iterator it = kv_.begin();
+    iter->SeekToFirst();
+    for (; it != kv_.end(); ++it) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_TRUE(iter->key() == it->first);
+      ASSERT_TRUE(iter->value() == it->second);
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
   }
 
   void CheckFirst(Iterator* iter) {
@@ -109,6 +126,33 @@ TEST(WriteBufTest<>, FixedSizedValue) {
   delete iter;
 }
 
+TEST(WriteBufTest<>, ManyEntries) {
+  for (int i = 0; i < 10000; i++) {
+    Add(rnd_.Next());
+  }
+
+  Iterator* iter = Flush();
+  CheckAll(iter);
+  delete iter;
+}
+
+TEST(WriteBufTest<>, VariableSizedKeys) {
+  std::string key;
+  for (int i = 0; i < 10000; i++) {
+    key.clear();
+    // Keys share long common prefixes and may contain zeros
+    const int n = 1 + static_cast<int>(rnd_.Uniform(12));
+    for (int j = 0; j < n; j++) {
+      key.push_back(static_cast<char>(rnd_.Uniform(3)));
+    }
+    Add(key);
+  }
+
+  Iterator* iter = Flush();
+  CheckAll(iter);
+  delete iter;
+}
+
 class PlfsIoTest {
  public:
   PlfsIoTest() {
@@ -205,6 +249,40 @@ class PlfsIoTest {
     return tmp;
   }
 
+  static int MultiSaveValue(void* arg, size_t i, const Slice& value) {
+    std::vector<std::string>* const results =
+        reinterpret_cast<std::vector<std::string>*>(arg);
+    (*results)[i].append(value.data(), value.size());
+    return 0;
+  }
+
+  // Read all given keys using a single multi-read. Return the values of each
+  // key concatenated in epoch order.
+  std::vector<std::string> MultiRead(const std::vector<std::string>& keys,
+                                     size_t* table_seeks = NULL) {
+    std::vector<std::string> results(keys.size());
+    std::vector<Slice> fids;
+    for (size_t i = 0; i < keys.size(); i++) {
+      fids.push_back(keys[i]);
+    }
+    DirReader::ReadOp op;
+    op.table_seeks = table_seeks;
+    if (writer_ != NULL) Finish();
+    if (reader_ == NULL) OpenReader();
+    ASSERT_OK(reader_->MultiRead(op, &fids[0], fids.size(), MultiSaveValue,
+                                 &results));
+    return results;
+  }
+
+  // Check a multi-read against individual reads of the same keys.
+  void CheckMultiRead(const std::vector<std::string>& keys) {
+    std::vector<std::string> results = MultiRead(keys);
+    ASSERT_EQ(results.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ(results[i], Read(keys[i])) << keys[i];
+    }
+  }
+
   DirOptions options_;
   std::string dirname_;
   DirWriter* writer_;
@@ -415,6 +493,129 @@ TEST(PlfsIoTest, LargeBatch) {
   ASSERT_TRUE(Read("kx").empty());
 }
 
+TEST(PlfsIoTest, ParallelCompaction) {
+  ThreadPool* const pool = ThreadPool::NewFixed(2);
+  options_.compaction_pool = pool;
+  options_.compaction_shards = 4;
+  options_.total_memtable_budget = 4 << 20;
+  const std::string dummy_val(32, 'x');
+  const int batch_size = 64 << 10;
+  char tmp[10];
+  for (int i = 0; i < batch_size; i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", (i * 7919) % batch_size);
+    Append(Slice(tmp), dummy_val);
+  }
+  MakeEpoch();
+  for (int i = 0; i < batch_size; i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    Append(Slice(tmp), dummy_val);
+  }
+  MakeEpoch();
+  Finish();
+  delete pool;
+  options_.compaction_pool = NULL;
+  for (int i = 0; i < batch_size; i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    ASSERT_EQ(Read(Slice(tmp)).size(), dummy_val.size() * 2) << tmp;
+  }
+  ASSERT_TRUE(Read("kx").empty());
+  ASSERT_EQ(Count(0), batch_size);
+  ASSERT_EQ(Count(1), batch_size);
+}
+
+TEST(PlfsIoTest, BatchedWrites) {
+  options_.total_memtable_budget = 4 << 20;
+  options_.lg_parts = 2;
+  const int batch_size = 16 << 10;
+  std::vector<std::string> keys;
+  for (int i = 0; i < batch_size; i++) {
+    char tmp[10];
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    keys.push_back(tmp);
+  }
+  std::vector<Slice> fids(keys.begin(), keys.end());
+  OpenWriter();
+  ASSERT_OK(writer_->AddBatch(&fids[0], &fids[0], fids.size(), epoch_));
+  MakeEpoch();
+  ASSERT_OK(writer_->AddBatch(&fids[0], &fids[0], fids.size() / 2, epoch_));
+  ASSERT_TRUE(writer_->AddBatch(&fids[0], &fids[0], 1, epoch_ + 1)
+                  .IsAssertionFailed());
+  MakeEpoch();
+  Finish();
+  for (int i = 0; i < batch_size; i++) {
+    std::string expected = keys[i];
+    if (i < batch_size / 2) expected += keys[i];
+    ASSERT_EQ(Read(keys[i]), expected) << keys[i];
+  }
+  ASSERT_EQ(Count(0), batch_size);
+  ASSERT_EQ(Count(1), batch_size / 2);
+}
+
+struct StagedWriterState {
+  StagedWriterState() : cv(&mu), num_running(0) {}
+  port::Mutex mu;
+  port::CondVar cv;
+  DirWriter* writer;
+  int num_running;
+  int epoch;
+  int begin;
+  int end;
+  Status status;
+};
+
+static void StagedWriter(void* arg) {
+  StagedWriterState* st = reinterpret_cast<StagedWriterState*>(arg);
+  st->mu.Lock();
+  const int begin = st->begin;
+  const int end = st->end;
+  st->begin = end;
+  st->end = end + (end - begin);
+  st->mu.Unlock();
+  Status s;
+  char tmp[10];
+  for (int i = begin; i < end && s.ok(); i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    s = st->writer->Add(Slice(tmp), Slice(tmp), st->epoch);
+  }
+  MutexLock ml(&st->mu);
+  if (st->status.ok()) st->status = s;
+  st->num_running--;
+  st->cv.SignalAll();
+}
+
+TEST(PlfsIoTest, StagedWrites) {
+  options_.staging_buffer = 4 << 10;
+  const int num_threads = 4;
+  const int per_thread = 8 << 10;
+  OpenWriter();
+  for (int e = 0; e < 2; e++) {
+    StagedWriterState state;
+    state.writer = writer_;
+    state.epoch = epoch_;
+    state.begin = 0;
+    state.end = per_thread;
+    state.num_running = num_threads;
+    for (int i = 0; i < num_threads; i++) {
+      Env::Default()->StartThread(StagedWriter, &state);
+    }
+    state.mu.Lock();
+    while (state.num_running != 0) {
+      state.cv.Wait();
+    }
+    state.mu.Unlock();
+    ASSERT_OK(state.status);
+    MakeEpoch();
+  }
+  Finish();
+  char tmp[10];
+  for (int i = 0; i < num_threads * per_thread; i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    ASSERT_EQ(Read(Slice(tmp)), std::string(tmp) + tmp) << tmp;
+  }
+  ASSERT_EQ(Count(0), num_threads * per_thread);
+  ASSERT_EQ(Count(1), num_threads * per_thread);
+}
+
 TEST(PlfsIoTest, NoFilter) {
   options_.bf_bits_per_key = 0;
   Append("k1", "v1");
@@ -446,6 +647,244 @@ TEST(PlfsIoTest, NoFilter) {
   ASSERT_EQ(Count(3), 0);
 }
 
+TEST(PlfsIoTest, BlockedBloomFilter) {
+  options_.filter = kFtBlockedBloom;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k3", "v3");
+  Append("k4", "v4");
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), "v1");
+  ASSERT_TRUE(Read("k1.1").empty());
+  ASSERT_EQ(Read("k2"), "v2");
+  ASSERT_TRUE(Read("k2.1").empty());
+  ASSERT_EQ(Read("k3"), "v3");
+  ASSERT_TRUE(Read("k3.1").empty());
+  ASSERT_EQ(Read("k4"), "v4");
+  ASSERT_TRUE(Read("k4.1").empty());
+  ASSERT_EQ(Count(0), 2);
+  ASSERT_EQ(Count(1), 2);
+}
+
+TEST(PlfsIoTest, CuckooFilter) {
+  options_.filter = kFtCuckoo;
+  options_.mode = kDmMultiMap;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  Append("k3", "v4");
+  MakeEpoch();
+  MakeEpoch();
+  Append("k4", "v5");
+  Append("k4", "v6");
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), "v1v3");
+  ASSERT_TRUE(Read("k1.1").empty());
+  ASSERT_EQ(Read("k2"), "v2");
+  ASSERT_TRUE(Read("k2.1").empty());
+  ASSERT_EQ(Read("k3"), "v4");
+  ASSERT_TRUE(Read("k3.1").empty());
+  ASSERT_EQ(Read("k4"), "v5v6");
+  ASSERT_TRUE(Read("k4.1").empty());
+  ASSERT_EQ(Count(0), 2);
+  ASSERT_EQ(Count(1), 2);
+  ASSERT_EQ(Count(2), 0);
+  ASSERT_EQ(Count(3), 2);
+}
+
+TEST(PlfsIoTest, CuckooFilterManyTables) {
+  ThreadPool* const pool = ThreadPool::NewFixed(2);
+  options_.filter = kFtCuckoo;
+  options_.compaction_pool = pool;
+  options_.compaction_shards = 4;
+  options_.total_memtable_budget = 4 << 20;
+  const std::string dummy_val(32, 'x');
+  const int batch_size = 64 << 10;
+  char tmp[10];
+  for (int i = 0; i < batch_size; i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", (i * 7919) % batch_size);
+    Append(Slice(tmp), dummy_val);
+  }
+  MakeEpoch();
+  for (int i = 0; i < batch_size; i += 2) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    Append(Slice(tmp), dummy_val);
+  }
+  MakeEpoch();
+  Finish();
+  delete pool;
+  options_.compaction_pool = NULL;
+  size_t total_table_seeks = 0;
+  size_t expected_table_seeks = 0;
+  for (int i = 0; i < batch_size; i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    const size_t n = i % 2 == 0 ? 2 : 1;
+    ASSERT_EQ(Read(Slice(tmp)).size(), dummy_val.size() * n) << tmp;
+    size_t table_seeks = 0;
+    size_t seeks = 0;
+    DirReader::ReadOp op;
+    op.table_seeks = &table_seeks;
+    op.seeks = &seeks;
+    std::string dst;
+    ASSERT_OK(reader_->Read(op, Slice(tmp), &dst));
+    total_table_seeks += table_seeks;
+    expected_table_seeks += n;
+  }
+  // Only tables holding a key should be visited, barring rare false positives
+  ASSERT_TRUE(total_table_seeks <= expected_table_seeks + batch_size / 100);
+  ASSERT_TRUE(Read("kx").empty());
+  ASSERT_EQ(Count(0), batch_size);
+  ASSERT_EQ(Count(1), batch_size / 2);
+}
+
+TEST(PlfsIoTest, IndexCache) {
+  options_.index_cache_size = 1 << 20;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  Append("k3", "v4");
+  MakeEpoch();
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(Read("k1"), "v1v3");
+    ASSERT_EQ(Read("k2"), "v2");
+    ASSERT_EQ(Read("k3"), "v4");
+    ASSERT_TRUE(Read("k4").empty());
+  }
+  IoStats stats = reader_->TEST_iostats();
+  // One filter per epoch. Each read checks the filters of both epochs.
+  ASSERT_EQ(stats.filter_cache_misses, 2);
+  ASSERT_EQ(stats.filter_cache_hits, 4 * 3 * 2 - 2);
+  ASSERT_TRUE(stats.index_cache_misses <= 4);
+  ASSERT_TRUE(stats.index_cache_hits > stats.index_cache_misses);
+  ASSERT_EQ(Scan(0), "v1v2");
+  ASSERT_EQ(Scan(1), "v3v4");
+}
+
+TEST(PlfsIoTest, IndexCacheWithCuckooFilter) {
+  options_.index_cache_size = 1 << 20;
+  options_.filter = kFtCuckoo;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  Append("k3", "v4");
+  MakeEpoch();
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(Read("k1"), "v1v3");
+    ASSERT_EQ(Read("k2"), "v2");
+    ASSERT_EQ(Read("k3"), "v4");
+    ASSERT_TRUE(Read("k4").empty());
+  }
+  IoStats stats = reader_->TEST_iostats();
+  ASSERT_TRUE(stats.filter_cache_misses <= 2);
+  ASSERT_TRUE(stats.filter_cache_hits > 0);
+}
+
+TEST(PlfsIoTest, DataCache) {
+  options_.data_cache_size = 1 << 20;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  Append("k3", "v4");
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), "v1v3");
+  ASSERT_EQ(Read("k2"), "v2");
+  ASSERT_EQ(Read("k3"), "v4");
+  IoStats stats = reader_->TEST_iostats();
+  ASSERT_EQ(stats.data_cache_misses, 2);
+  ASSERT_EQ(stats.data_cache_hits, 2);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(Read("k1"), "v1v3");
+    ASSERT_EQ(Read("k2"), "v2");
+    ASSERT_EQ(Read("k3"), "v4");
+  }
+  stats = reader_->TEST_iostats();
+  ASSERT_EQ(stats.data_cache_misses, 2);
+  ASSERT_EQ(stats.data_cache_hits, 2 + 2 * 4);
+  ASSERT_TRUE(stats.data_cache_bytes_saved > 0);
+  ASSERT_EQ(Scan(-1), "v1v2v3v4");
+}
+
+TEST(PlfsIoTest, Readahead) {
+  options_.block_size = 4 << 10;
+  options_.block_padding = false;
+  options_.readahead_size = 64 << 10;
+  const std::string dummy_val(32, 'x');
+  const int batch_size = 8 << 10;
+  char tmp[10];
+  for (int i = 0; i < batch_size; i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    Append(Slice(tmp), dummy_val);
+  }
+  MakeEpoch();
+  ASSERT_EQ(Scan(0).size(), dummy_val.size() * batch_size);
+  IoStats stats = reader_->TEST_iostats();
+  ASSERT_TRUE(stats.readahead_hits > 0);
+  size_t seeks = 0;
+  size_t n = 0;
+  std::string dst;
+  SaverState state;
+  state.tmp = &dst;
+  DirReader::ScanOp op;
+  op.SetEpoch(0);
+  op.seeks = &seeks;
+  op.n = &n;
+  ASSERT_OK(reader_->Scan(op, SaveValue, &state));
+  ASSERT_EQ(n, batch_size);
+  const size_t num_blocks = dst.size() / options_.block_size;
+  // Most blocks should be served from readahead buffers
+  ASSERT_TRUE(seeks < num_blocks / 4);
+  ASSERT_EQ(Read("k0000007"), dummy_val);
+  ASSERT_TRUE(Read("k0000007.1").empty());
+}
+
+TEST(PlfsIoTest, BatchedReads) {
+  options_.batched_reads = true;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  MakeEpoch();
+  Append("k2", "v4");
+  MakeEpoch();
+  Append("k1", "v5");
+  Append("k2", "v6");
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), "v1v3v5");
+  ASSERT_EQ(Read("k2"), "v2v4v6");
+  ASSERT_TRUE(Read("k1.1").empty());
+  ASSERT_TRUE(Read("k3").empty());
+  size_t seeks = 0;
+  std::string dst;
+  DirReader::ReadOp op;
+  op.seeks = &seeks;
+  ASSERT_OK(reader_->Read(op, "k1", &dst));
+  ASSERT_EQ(dst, "v1v3v5");
+  ASSERT_EQ(seeks, 3);
+  ASSERT_EQ(Scan(-1), "v1v2v3v4v5v6");
+}
+
+TEST(PlfsIoTest, BatchedReadsWithDataCache) {
+  options_.batched_reads = true;
+  options_.data_cache_size = 1 << 20;
+  options_.epoch_log_rotation = true;
+  Append("k1", "v1");
+  MakeEpoch();
+  Append("k1", "v2");
+  Append("k2", "v3");
+  MakeEpoch();
+  ASSERT_EQ(Read("k1"), "v1v2");
+  ASSERT_EQ(Read("k2"), "v3");
+  ASSERT_EQ(Read("k1"), "v1v2");
+  IoStats stats = reader_->TEST_iostats();
+  ASSERT_EQ(stats.data_cache_misses, 2);
+  ASSERT_EQ(stats.data_cache_hits, 3);
+}
+
 TEST(PlfsIoTest, LogRotation) {
   options_.epoch_log_rotation = true;
   Append("k1", "v1");
@@ -475,6 +914,129 @@ TEST(PlfsIoTest, MultiMap) {
   ASSERT_EQ(Read("k1"), "v1v2v4v5v6v7v9");
 }
 
+TEST(PlfsIoTest, MultiRead) {
+  const std::string dummy_val(32, 'x');
+  const int batch_size = 16 << 10;
+  char tmp[10];
+  for (int e = 0; e < 3; e++) {
+    for (int i = e; i < batch_size; i += 2) {
+      snprintf(tmp, sizeof(tmp), "k%07d", i);
+      Append(Slice(tmp), dummy_val);
+    }
+    MakeEpoch();
+  }
+  std::vector<std::string> keys;
+  for (int i = batch_size + 7; i >= 0; i -= 3) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    keys.push_back(tmp);
+  }
+  keys.push_back("k0000001.1");
+  keys.push_back("k0000002");  // Duplicated keys are reported twice
+  std::vector<std::string> results = MultiRead(keys);
+  for (size_t i = 0; i < keys.size(); i++) {
+    int k = 0;
+    size_t n = 0;
+    if (sscanf(keys[i].c_str(), "k%07d", &k) == 1 &&
+        keys[i].size() == 8 && k < batch_size) {
+      n = k % 2 == 0 ? 2 : 1;
+    }
+    ASSERT_EQ(results[i].size(), dummy_val.size() * n) << keys[i];
+  }
+  CheckMultiRead(keys);
+}
+
+TEST(PlfsIoTest, MultiReadFewerTableSeeks) {
+  const std::string dummy_val(32, 'x');
+  const int batch_size = 64 << 10;
+  char tmp[10];
+  for (int i = 0; i < batch_size; i++) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    Append(Slice(tmp), dummy_val);
+  }
+  MakeEpoch();
+  std::vector<std::string> keys;
+  for (int i = 0; i < batch_size; i += 64) {
+    snprintf(tmp, sizeof(tmp), "k%07d", i);
+    keys.push_back(tmp);
+  }
+  size_t table_seeks = 0;
+  std::vector<std::string> results = MultiRead(keys, &table_seeks);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(results[i], dummy_val) << keys[i];
+  }
+  // Each table should be visited at most once for the entire batch
+  ASSERT_TRUE(table_seeks < keys.size() / 4);
+}
+
+TEST(PlfsIoTest, MultiReadMultiMap) {
+  options_.mode = kDmMultiMap;
+  Append("k1", "v1");
+  Append("k1", "v2");
+  MakeEpoch();
+  Append("k0", "v3");
+  Append("k1", "v4");
+  MakeEpoch();
+  MakeEpoch();
+  Append("k1", "v5");
+  Append("k5", "v6");
+  MakeEpoch();
+  std::vector<std::string> keys;
+  keys.push_back("k5");
+  keys.push_back("k1");
+  keys.push_back("k2");
+  keys.push_back("k0");
+  std::vector<std::string> results = MultiRead(keys);
+  ASSERT_EQ(results[0], "v6");
+  ASSERT_EQ(results[1], "v1v2v4v5");
+  ASSERT_TRUE(results[2].empty());
+  ASSERT_EQ(results[3], "v3");
+}
+
+TEST(PlfsIoTest, MultiReadUnordered) {
+  options_.mode = kDmUniqueUnordered;
+  Append("k3", "v3");
+  Append("k1", "v1");
+  MakeEpoch();
+  Append("k2", "v2");
+  Append("k4", "v4");
+  MakeEpoch();
+  std::vector<std::string> keys;
+  keys.push_back("k4");
+  keys.push_back("k1");
+  keys.push_back("k0");
+  keys.push_back("k3");
+  keys.push_back("k2");
+  CheckMultiRead(keys);
+  ASSERT_EQ(MultiRead(keys)[0], "v4");
+}
+
+TEST(PlfsIoTest, MultiReadCuckooFilter) {
+  options_.filter = kFtCuckoo;
+  options_.mode = kDmMultiMap;
+  Append("k1", "v1");
+  Append("k2", "v2");
+  MakeEpoch();
+  Append("k1", "v3");
+  Append("k3", "v4");
+  MakeEpoch();
+  MakeEpoch();
+  Append("k4", "v5");
+  Append("k4", "v6");
+  MakeEpoch();
+  std::vector<std::string> keys;
+  keys.push_back("k4");
+  keys.push_back("k1.1");
+  keys.push_back("k1");
+  keys.push_back("k3");
+  keys.push_back("k2");
+  std::vector<std::string> results = MultiRead(keys);
+  ASSERT_EQ(results[0], "v5v6");
+  ASSERT_TRUE(results[1].empty());
+  ASSERT_EQ(results[2], "v1v3");
+  ASSERT_EQ(results[3], "v4");
+  ASSERT_EQ(results[4], "v2");
+}
+
 namespace {
 
 class WriteLock {
@@ -612,6 +1174,10 @@ class PlfsIoBench {
       return deffmt;
     } else if (strcmp(env, "bf") == 0) {
       return deffmt;
+    } else if (strcmp(env, "bbf") == 0) {
+      return deffmt;
+    } else if (strcmp(env, "ckf") == 0) {
+      return deffmt;
     } else if (strcmp(env, "bmp") == 0) {
       return kFmtUncompressed;
     } else if (strcmp(env, "r") == 0) {
@@ -640,6 +1206,10 @@ class PlfsIoBench {
       return deftype;
     } else if (strcmp(env, "bf") == 0) {
       return kFtBloomFilter;
+    } else if (strcmp(env, "bbf") == 0) {
+      return kFtBlockedBloom;
+    } else if (strcmp(env, "ckf") == 0) {
+      return kFtCuckoo;
     } else if (strcmp(env, "bmp") == 0) {
       return kFtBitmap;
     } else if (strcmp(env, "r") == 0) {
@@ -746,6 +1316,7 @@ class PlfsIoBench {
     mfiles_ = GetOption("NUM_FILES", 16);  // 16 million per epoch
 
     num_threads_ = GetOption("NUM_THREADS", 4);  // Threads for bg compaction
+    num_producers_ = GetOption("NUM_PRODUCERS", 1);  // Threads for insertion
     // For advanced perf diagnosis
     print_events_ = GetOption("PRINT_EVENTS", false);
     force_fifo_ = GetOption("FORCE_FIFO", false);
@@ -761,6 +1332,10 @@ class PlfsIoBench {
 #endif
     }
     options_.lg_parts = GetOption("LG_PARTS", 2);
+    options_.compaction_shards =
+        static_cast<size_t>(GetOption("COMPACTION_SHARDS", 1));
+    options_.staging_buffer =
+        static_cast<size_t>(GetOption("STAGING_BUFFER", 0) << 10);
     options_.skip_sort = ordered_keys_ != 0;
     options_.leveldb_compatible = GetOption("LEVELDB_FMT", true) != 0;
     options_.fixed_kv_length = GetOption("FIXED_KV", true) != 0;
@@ -963,6 +1538,65 @@ class PlfsIoBench {
   }
 #endif
 
+  struct ProducerState {
+    ProducerState() : cv(&mu), num_running(0), next_rank(0) {}
+    PlfsIoBench* bench;
+    port::Mutex mu;
+    port::CondVar cv;
+    int num_running;
+    int next_rank;
+    int num_files;
+    Status status;
+  };
+
+  // Insert a disjoint range of keys into the directory. Each producer reports
+  // progress for its own range so the output is only an approximation.
+  static void Produce(void* arg) {
+    ProducerState* st = reinterpret_cast<ProducerState*>(arg);
+    PlfsIoBench* const bench = st->bench;
+    st->mu.Lock();
+    const int rank = st->next_rank++;
+    st->mu.Unlock();
+    const int num_producers = bench->num_producers_;
+    const int base = int(int64_t(st->num_files) * rank / num_producers);
+    const int size =
+        int(int64_t(st->num_files) * (rank + 1) / num_producers) - base;
+    BigBatch batch(bench->options_, bench->keys_, base, size);
+    batch.Seek(0);
+    Status s;
+    for (int i = 0; i < size; i++) {
+      if (rank == 0 && (i & 0x7FFFF) == 0) {
+        fprintf(stderr, "\r%.2f%%", 100.0 * i / size);
+      }
+      s = bench->writer_->Add(batch.fid(), batch.data(), 0);
+      if (s.ok()) {
+        batch.Next();
+      } else {
+        break;
+      }
+    }
+    MutexLock ml(&st->mu);
+    if (st->status.ok()) st->status = s;
+    st->num_running--;
+    st->cv.SignalAll();
+  }
+
+  // Insert all keys using multiple concurrent producer threads.
+  Status RunProducers(int num_files) {
+    ProducerState state;
+    state.bench = this;
+    state.num_files = num_files;
+    state.num_running = num_producers_;
+    for (int i = 0; i < num_producers_; i++) {
+      Env::Default()->StartThread(Produce, &state);
+    }
+    MutexLock ml(&state.mu);
+    while (state.num_running != 0) {
+      state.cv.Wait();
+    }
+    return state.status;
+  }
+
   void DoIt() {
     bool owns_pool = false;
     if (num_threads_ != 0) {
@@ -997,18 +1631,22 @@ class PlfsIoBench {
     const uint64_t start = env_->NowMicros();
     fprintf(stderr, "Inserting data...\n");
     const int num_files = (mfiles_ << 20);
-    BigBatch batch(options_, keys_, 0, num_files);
-    batch.Seek(0);
-    for (int i = 0; i < num_files; i++) {
-      // Report progress
-      if ((i & 0x7FFFF) == 0) {
-        fprintf(stderr, "\r%.2f%%", 100.0 * i / num_files);
-      }
-      s = writer_->Add(batch.fid(), batch.data(), 0);
-      if (s.ok()) {
-        batch.Next();
-      } else {
-        break;
+    if (num_producers_ > 1) {
+      s = RunProducers(num_files);
+    } else {
+      BigBatch batch(options_, keys_, 0, num_files);
+      batch.Seek(0);
+      for (int i = 0; i < num_files; i++) {
+        // Report progress
+        if ((i & 0x7FFFF) == 0) {
+          fprintf(stderr, "\r%.2f%%", 100.0 * i / num_files);
+        }
+        s = writer_->Add(batch.fid(), batch.data(), 0);
+        if (s.ok()) {
+          batch.Next();
+        } else {
+          break;
+        }
       }
     }
     ASSERT_OK(s) << "Cannot write";
@@ -1056,6 +1694,10 @@ class PlfsIoBench {
     switch (type) {
       case kFtBloomFilter:
         return "BF (std bloom filter)";
+      case kFtBlockedBloom:
+        return "BBF (blocked bloom filter)";
+      case kFtCuckoo:
+        return "CKF (per-epoch cuckoo filter)";
       case kFtBitmap:
         return "BM (bitmap)";
       default:
@@ -1129,7 +1771,8 @@ class PlfsIoBench {
     fprintf(stderr, "                FT Type: %s\n", ToString(options_.filter));
     fprintf(stderr, "          FT Mem Budget: %d (bits per key)\n",
             int(options_.filter_bits_per_key));
-    if (options_.filter == kFtBloomFilter) {
+    if (options_.filter == kFtBloomFilter ||
+        options_.filter == kFtBlockedBloom) {
       fprintf(stderr, "              BF Budget: %d (bits per key)\n",
               int(options_.bf_bits_per_key));
     } else if (options_.filter == kFtBitmap) {
@@ -1151,6 +1794,13 @@ class PlfsIoBench {
             int(options_.block_size) >> 10, options_.block_util * 100);
     fprintf(stderr, "Num MemTable Partitions: %d\n", 1 << options_.lg_parts);
     fprintf(stderr, "         Num Bg Threads: %d\n", num_threads_);
+    fprintf(stderr, "  Num Compaction Shards: %d\n",
+            int(options_.compaction_shards));
+    fprintf(stderr, "          Num Producers: %d\n", num_producers_);
+    fprintf(stderr, "         Staging Buffer: %d KiB (per producer)\n",
+            int(options_.staging_buffer) >> 10);
+    fprintf(stderr, "        Insertion Speed: %.3f Mop/s\n",
+            1.0 * (mfiles_ << 20) / dura);
     if (owns_env) {
       fprintf(stderr, "    Emulated Link Speed: %d MiB/s (per log)\n", mbps_);
     } else {
@@ -1226,10 +1876,11 @@ class PlfsIoBench {
 
   int mbps_;  // Link speed to emulate (in MBps)
   int ordered_keys_;
-  int mfiles_;        // Number of files to insert (in Millions)
-  int num_threads_;   // Number of bg compaction threads
-  int force_fifo_;    // Force real-time FIFO scheduling
-  int print_events_;  // Dump background events
+  int mfiles_;         // Number of files to insert (in Millions)
+  int num_threads_;    // Number of bg compaction threads
+  int num_producers_;  // Number of foreground insertion threads
+  int force_fifo_;     // Force real-time FIFO scheduling
+  int print_events_;   // Dump background events
   EventPrinter printer_;
   std::vector<uint32_t> keys_;
   const std::string home_;
@@ -1421,6 +2072,11 @@ class PlfsQuBench : protected PlfsIoBench {
     mbps_ = 0;
 
     force_negative_lookups_ = GetOption("FALSE_KEYS", false);
+    multiget_batch_ = GetOption("MULTIGET_BATCH", 0);
+    options_.index_cache_size =
+        static_cast<size_t>(GetOption("INDEX_CACHE_SIZE", 0) << 20);
+    options_.data_cache_size =
+        static_cast<size_t>(GetOption("DATA_CACHE_SIZE", 0) << 20);
     num_empty_reads_ = 0;
     num_reads_ = 0;
 
@@ -1475,6 +2131,19 @@ class PlfsQuBench : protected PlfsIoBench {
         memcpy(tmp, &h2, 8);
         k = Slice(tmp, options_.key_size);
       }
+      if (multiget_batch_ != 0) {
+        multiget_keys_.append(k.data(), k.size());
+        multiget_sizes_.push_back(k.size());
+        batch.Next();
+        if (multiget_sizes_.size() == size_t(multiget_batch_) ||
+            !batch.Valid()) {
+          s = MultiGet();
+          if (!s.ok()) {
+            break;
+          }
+        }
+        continue;
+      }
       DirReader::ReadOp op;
       s = reader_->Read(op, k, &dummy_buf);
       if (!s.ok()) {
@@ -1501,6 +2170,37 @@ class PlfsQuBench : protected PlfsIoBench {
     reader_ = NULL;
   }
 
+  static int CountValue(void* arg, size_t i, const Slice& value) {
+    std::vector<char>* const found = reinterpret_cast<std::vector<char>*>(arg);
+    (*found)[i] = 1;
+    return 0;
+  }
+
+  // Look up all pending keys using a single multi-read.
+  Status MultiGet() {
+    const size_t n = multiget_sizes_.size();
+    std::vector<Slice> keys;
+    const char* p = multiget_keys_.data();
+    for (size_t i = 0; i < n; i++) {
+      keys.push_back(Slice(p, multiget_sizes_[i]));
+      p += multiget_sizes_[i];
+    }
+    std::vector<char> found(n, 0);
+    DirReader::ReadOp op;
+    Status s = reader_->MultiRead(op, &keys[0], n, CountValue, &found);
+    if (s.ok()) {
+      for (size_t i = 0; i < n; i++) {
+        if (!found[i]) {
+          num_empty_reads_++;
+        }
+      }
+      num_reads_ += n;
+    }
+    multiget_keys_.resize(0);
+    multiget_sizes_.resize(0);
+    return s;
+  }
+
   void Report(uint64_t dura) {
     const double k = 1000.0, ki = 1024.0;
     fprintf(stderr, "----------------------------------------\n");
@@ -1528,9 +2228,25 @@ class PlfsQuBench : protected PlfsIoBench {
             1.0 * stats.data_bytes / ki / ki / ki);
     fprintf(stderr, "           Avg I/O size: %.3f KB\n",
             1.0 * stats.data_bytes / stats.data_ops / ki);
+    fprintf(stderr, "   Index Cache Hit Rate: %.2f%% (%llu misses)\n",
+            100.0 * stats.index_cache_hits /
+                (stats.index_cache_hits + stats.index_cache_misses + 1),
+            static_cast<unsigned long long>(stats.index_cache_misses));
+    fprintf(stderr, "  Filter Cache Hit Rate: %.2f%% (%llu misses)\n",
+            100.0 * stats.filter_cache_hits /
+                (stats.filter_cache_hits + stats.filter_cache_misses + 1),
+            static_cast<unsigned long long>(stats.filter_cache_misses));
+    fprintf(stderr, "    Data Cache Hit Rate: %.2f%% (%.3f MB saved)\n",
+            100.0 * stats.data_cache_hits /
+                (stats.data_cache_hits + stats.data_cache_misses + 1),
+            1.0 * stats.data_cache_bytes_saved / ki / ki);
   }
 
   int force_negative_lookups_;
+  // Keys looked up together by a multi-read, or 0 to read keys one by one
+  int multiget_batch_;
+  std::string multiget_keys_;
+  std::vector<size_t> multiget_sizes_;
   DirReader* reader_;
 
   uint64_t num_empty_reads_;
@@ -1538,6 +2254,57 @@ class PlfsQuBench : protected PlfsIoBench {
   Histo seeks_;
 };
 
+// Compare the radix sort used by write buffers against the
+// comparison-based sort it replaces.
+class WriteBufBench {
+ public:
+  WriteBufBench() {
+    mfiles_ = PlfsIoBench::GetOption("NUM_FILES", 16);
+    options_.key_size =
+        static_cast<size_t>(PlfsIoBench::GetOption("KEY_SIZE", 8));
+    options_.value_size =
+        static_cast<size_t>(PlfsIoBench::GetOption("VALUE_SIZE", 40));
+    options_.fixed_kv_length = PlfsIoBench::GetOption("FIXED_KV", true) != 0;
+  }
+
+  void LogAndApply() {
+    fprintf(stderr, "Num Entries,STL Sort (ms),Radix Sort (ms)\n");
+    for (int m = 1; m <= mfiles_; m *= 2) {
+      const uint64_t t1 = RunSort(m << 20, false);
+      const uint64_t t2 = RunSort(m << 20, true);
+      fprintf(stderr, "%dM,%.3f,%.3f\n", m, t1 / 1000.0, t2 / 1000.0);
+    }
+  }
+
+ private:
+  // Return the time in micros spent on sorting.
+  uint64_t RunSort(int num_entries, bool radix_sort) {
+    WriteBuffer buf(options_);
+    buf.Reserve((options_.key_size + options_.value_size + 2) * num_entries);
+    std::string dummy_val(options_.value_size, 'x');
+    char tmp[64];
+    ASSERT_TRUE(options_.key_size <= sizeof(tmp));
+    memset(tmp, 0, sizeof(tmp));
+    for (int i = 0; i < num_entries; i++) {
+      uint64_t h = xxhash64(&i, sizeof(i), 0);
+      for (size_t j = 0; j < options_.key_size; j += 8) {
+        memcpy(tmp + j, &h, std::min<size_t>(8, options_.key_size - j));
+      }
+      buf.Add(Slice(tmp, options_.key_size), dummy_val);
+    }
+    const uint64_t start = Env::Default()->NowMicros();
+    if (radix_sort) {
+      buf.Finish();
+    } else {
+      buf.TEST_Finish();
+    }
+    return Env::Default()->NowMicros() - start;
+  }
+
+  int mfiles_;  // Max number of entries to sort (in Millions)
+  DirOptions options_;
+};
+
 }  // namespace plfsio
 }  // namespace pdlfs
 
@@ -1549,7 +2316,9 @@ class PlfsQuBench : protected PlfsIoBench {
 #endif
 
 static void BM_Usage() {
-  fprintf(stderr, "Use --bench=io or --bench=qu to select a benchmark.\n");
+  fprintf(stderr,
+          "Use --bench=io, --bench=qu, or --bench=sort to select a "
+          "benchmark.\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "== workload confs\n");
   fprintf(stderr, "LINK_SPEED\n");
@@ -1569,6 +2338,9 @@ static void BM_Usage() {
   fprintf(stderr, "MIN_INDEX_BUFFER\n");
   fprintf(stderr, "INDEX_BUFFER\n");
   fprintf(stderr, "NUM_THREADS\n");
+  fprintf(stderr, "COMPACTION_SHARDS\n");
+  fprintf(stderr, "NUM_PRODUCERS\n");
+  fprintf(stderr, "STAGING_BUFFER\n");
   fprintf(stderr, "MEMTABLE_SIZE\n");
   fprintf(stderr, "BLOCK_BATCH_SIZE\n");
   fprintf(stderr, "BLOCK_SIZE\n");
@@ -1577,7 +2349,7 @@ static void BM_Usage() {
   fprintf(stderr, "SNAPPY\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "== plfsdir filter options\n");
-  fprintf(stderr, "FT_TYPE (bf, bmp, r, fvbp, fpfd)\n");
+  fprintf(stderr, "FT_TYPE (bf, bbf, ckf, bmp, r, fvbp, fpfd)\n");
   fprintf(stderr, "FT_BITS\n");
   fprintf(stderr, "BM_KEY_BITS\n");
   fprintf(stderr, "BF_BITS\n");
@@ -1585,6 +2357,9 @@ static void BM_Usage() {
   fprintf(stderr, "== adv. options\n");
   fprintf(stderr, "FORCE_FIFO\n");
   fprintf(stderr, "FALSE_KEYS\n");
+  fprintf(stderr, "MULTIGET_BATCH\n");
+  fprintf(stderr, "INDEX_CACHE_SIZE\n");
+  fprintf(stderr, "DATA_CACHE_SIZE\n");
   fprintf(stderr, "\n");
 }
 
@@ -1595,6 +2370,9 @@ static void BM_LogAndApply(const char* bm) {
   } else if (strcmp(bm, "qu") == 0) {
     pdlfs::plfsio::PlfsQuBench bench;
     bench.LogAndApply();
+  } else if (strcmp(bm, "sort") == 0) {
+    pdlfs::plfsio::WriteBufBench bench;
+    bench.LogAndApply();
   } else {
     BM_Usage();
   }
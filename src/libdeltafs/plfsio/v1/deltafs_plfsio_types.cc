@@ -18,12 +18,25 @@
 namespace pdlfs {
 namespace plfsio {
 
-IoStats::IoStats() : index_bytes(0), index_ops(0), data_bytes(0), data_ops(0) {}
+IoStats::IoStats()
+    : index_bytes(0),
+      index_ops(0),
+      data_bytes(0),
+      data_ops(0),
+      index_cache_hits(0),
+      index_cache_misses(0),
+      filter_cache_hits(0),
+      filter_cache_misses(0),
+      data_cache_hits(0),
+      data_cache_misses(0),
+      data_cache_bytes_saved(0),
+      readahead_hits(0) {}
 
 DirOptions::DirOptions()
     : total_memtable_budget(4 << 20),
       memtable_util(0.97),
       memtable_reserv(1.00),
+      staging_buffer(0),
       leveldb_compatible(true),
       skip_sort(false),
       fixed_kv_length(false),
@@ -48,9 +61,14 @@ DirOptions::DirOptions()
       epoch_log_rotation(false),
       tail_padding(false),
       compaction_pool(NULL),
+      compaction_shards(1),
       reader_pool(NULL),
       read_size(8 << 20),
+      index_cache_size(0),
+      data_cache_size(0),
+      readahead_size(0),
       parallel_reads(false),
+      batched_reads(false),
       paranoid_checks(false),
       ignore_filters(false),
       compression(kNoCompression),
@@ -125,9 +143,15 @@ bool ParseFilterType(const Slice& key, const Slice& value, FilterType* result) {
   if (value.starts_with("bloom")) {
     *result = kFtBloomFilter;
     return true;
+  } else if (value.starts_with("blocked-bloom")) {
+    *result = kFtBlockedBloom;
+    return true;
   } else if (value.starts_with("bitmap")) {
     *result = kFtBitmap;
     return true;
+  } else if (value.starts_with("cuckoo")) {
+    *result = kFtCuckoo;
+    return true;
   } else {
     Warn(__LOG_ARGS__, "Unknown filter type: %s=%s, option ignored",
          key.c_str(), value.c_str());
@@ -190,10 +214,18 @@ DirOptions ParseDirOptions(const char* input) {
       if (ParseInteger(conf_key, conf_value, &num)) {
         result.total_memtable_budget = num;
       }
+    } else if (conf_key == "staging_buffer") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.staging_buffer = num;
+      }
     } else if (conf_key == "compaction_buffer") {
       if (ParseInteger(conf_key, conf_value, &num)) {
         result.block_batch_size = num;
       }
+    } else if (conf_key == "compaction_shards") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.compaction_shards = num;
+      }
     } else if (conf_key == "data_buffer") {
       if (ParseInteger(conf_key, conf_value, &num)) {
         result.data_buffer = num;
@@ -234,10 +266,26 @@ DirOptions ParseDirOptions(const char* input) {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.skip_sort = flag;
       }
+    } else if (conf_key == "index_cache_size") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.index_cache_size = num;
+      }
+    } else if (conf_key == "data_cache_size") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.data_cache_size = num;
+      }
+    } else if (conf_key == "readahead_size") {
+      if (ParseInteger(conf_key, conf_value, &num)) {
+        result.readahead_size = num;
+      }
     } else if (conf_key == "parallel_reads") {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.parallel_reads = flag;
       }
+    } else if (conf_key == "batched_reads") {
+      if (ParseBool(conf_key, conf_value, &flag)) {
+        result.batched_reads = flag;
+      }
     } else if (conf_key == "paranoid_checks") {
       if (ParseBool(conf_key, conf_value, &flag)) {
         result.paranoid_checks = flag;
@@ -34,6 +34,22 @@ struct IoStats {
   uint64_t data_bytes;
   // Total number of I/O operations for reading or writing data
   uint64_t data_ops;
+  // Total number of index block lookups served by the index cache
+  uint64_t index_cache_hits;
+  // Total number of index block lookups missing the index cache
+  uint64_t index_cache_misses;
+  // Total number of filter block lookups served by the index cache
+  uint64_t filter_cache_hits;
+  // Total number of filter block lookups missing the index cache
+  uint64_t filter_cache_misses;
+  // Total number of data block reads served by the data cache
+  uint64_t data_cache_hits;
+  // Total number of data block reads missing the data cache
+  uint64_t data_cache_misses;
+  // Total bytes not read from storage due to data cache hits
+  uint64_t data_cache_bytes_saved;
+  // Total number of data blocks served from readahead buffers
+  uint64_t readahead_hits;
 };
 
 // Directory semantics
@@ -60,7 +76,11 @@ enum FilterType {
   // Use bloom filters
   kFtBloomFilter = 0x01,
   // Use bitmap filters
-  kFtBitmap = 0x02
+  kFtBitmap = 0x02,
+  // Use cache-line blocked bloom filters
+  kFtBlockedBloom = 0x03,
+  // Use one cuckoo filter per epoch mapping keys to tables
+  kFtCuckoo = 0x04
 };
 
 // Bitmap compression format.
@@ -99,6 +119,15 @@ struct DirOptions {
   // Default: 1.00 (100%)
   double memtable_reserv;
 
+  // Per-thread buffer space for staging writes before they are inserted into
+  // the memtable. When set, each writer thread accumulates its writes in a
+  // private buffer and hands them to the memtable in bulk once the buffer is
+  // full or when an epoch is flushed, paying for the directory lock once per
+  // batch rather than once per write. Staged writes are not counted
+  // against total_memtable_budget. Set to 0 to disable staging.
+  // Default: 0
+  size_t staging_buffer;
+
   // Always use LevelDb compatible block formats.
   // Default: true
   bool leveldb_compatible;
@@ -135,7 +164,8 @@ struct DirOptions {
   size_t filter_bits_per_key;
 
   // Bloom filter bits per key.
-  // This option is only used when bloom filter is enabled.
+  // This option is only used when bloom filter or blocked bloom
+  // filter is enabled.
   // Set to 0 to disable bloom filters.
   // Default: 8 bits
   size_t bf_bits_per_key;
@@ -226,6 +256,15 @@ struct DirOptions {
   // Default: NULL
   ThreadPool* compaction_pool;
 
+  // Number of key-range shards to split each memtable compaction into.
+  // Shards are sorted, formatted, and filtered concurrently using the
+  // compaction pool (or the env if allowed) and each shard is written as a
+  // separate table within the current epoch. This allows a single memtable
+  // partition to use more than one thread during compaction. Set to 1 to
+  // compact each memtable using a single thread.
+  // Default: 1
+  size_t compaction_shards;
+
   // Thread pool used to run concurrent background reads.
   // If set to NULL, Env::Default() may be used to schedule reads if permitted.
   // Otherwise, the caller's thread context will be used directly.
@@ -238,11 +277,37 @@ struct DirOptions {
   // Default: 8MB
   size_t read_size;
 
+  // Capacity of a cache holding decoded index and filter blocks. The cache
+  // is shared by all directory partitions and saves re-verifying and
+  // re-decoding the same blocks on each read. Set to 0 to disable.
+  // Default: 0
+  size_t index_cache_size;
+
+  // Capacity of a cache holding recently read data blocks. The cache is
+  // shared by all directory partitions. Set to 0 to disable.
+  // Default: 0
+  size_t data_cache_size;
+
+  // Max number of bytes to read ahead when scanning consecutive data blocks.
+  // Once sequential access is detected, data is read ahead two blocks at a
+  // time and the amount doubles on each subsequent readahead until reaching
+  // this size. Set to 0 to disable.
+  // Default: 0
+  size_t readahead_size;
+
   // Set to true to enable parallel reading across different epochs.
   // Otherwise, reads progress serially over all epochs.
   // Default: false
   bool parallel_reads;
 
+  // Set to true to have point queries first locate the candidate data blocks
+  // of all epochs and then read these blocks using a single batch of reads.
+  // This avoids dedicating a thread to each outstanding read, and works best
+  // with an Env able to keep many reads in flight such as the io_uring env.
+  // Only used when keys are unique and ordered.
+  // Default: false
+  bool batched_reads;
+
   // Perform aggressive checking of the data so we stop early on errors.
   // Default: false
   bool paranoid_checks;
@@ -12,18 +12,32 @@
 #include "deltafs_plfsio_internal.h"
 #include "deltafs_plfsio_types.h"
 
+#include "pdlfs-common/coding.h"
 #include "pdlfs-common/env_files.h"
 #include "pdlfs-common/hash.h"
 #include "pdlfs-common/logging.h"
 #include "pdlfs-common/mutexlock.h"
 #include "pdlfs-common/strutil.h"
 
+#include <pthread.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
 namespace pdlfs {
 namespace plfsio {
 
+// Private write buffer owned by a single writer thread. Writes are
+// accumulated here without touching the directory lock and are later
+// moved into the memtable in bulk.
+struct WriteStage {
+  WriteStage() : seq(0), num_entries(0) {}
+  port::Mutex mu;     // Almost always uncontended
+  std::string buf;    // Length-prefixed (fid, data) pairs
+  uint32_t seq;       // Epoch of all staged writes
+  uint32_t num_entries;
+};
+
 struct DirWriter::Rep {
  public:
   Rep(const DirOptions& opts, const std::string& dirname);
@@ -35,6 +49,14 @@ struct DirWriter::Rep {
   Status MaybeRotateLogs(Epoch*);
   Status TryFlush(Epoch*, bool ef = false, bool fi = false);
   Status TryAdd(Epoch*, const Slice& fid, const Slice& data);
+  Status TryAddBatch(Epoch*, const Slice* fids, const Slice* data, size_t n);
+  Status AddBatch(const Slice* fids, const Slice* data, size_t n, int epoch);
+  Status TryStage(const Slice& fid, const Slice& data, int epoch, bool* staged);
+  Status DrainStage(WriteStage* stage);
+  Status DrainStages();
+  WriteStage* GetStage();
+  void OpenEpoch(Epoch*);
+  void CloseEpoch();
   Status EnsureDataPadding(LogSink* sink, size_t footer_size);
   Status InstallDirInfo(const std::string& footer);
   Status Finalize();
@@ -55,6 +77,13 @@ struct DirWriter::Rep {
   DirIndexer** idxers_;
   LogSink* data_;
   Env* env_;
+
+  // Write staging. Only used when options_.staging_buffer > 0.
+  std::vector<WriteStage*> stages_;  // All stages ever created
+  pthread_key_t stage_key_;          // Stage of the calling thread
+  // Seq + 1 of the current epoch if it accepts staged writes, or NULL
+  // if the current epoch is being committed. Readable without mutex_.
+  port::AtomicPointer open_epoch_;
 };
 
 DirWriter::Rep::Rep(const DirOptions& o, const std::string& d)
@@ -69,9 +98,15 @@ DirWriter::Rep::Rep(const DirOptions& o, const std::string& d)
       compac_stats_(NULL),
       idxers_(NULL),
       data_(NULL),
-      env_(options_.env) {
+      env_(options_.env),
+      open_epoch_(NULL) {
   epoch_ = new Epoch(0, &mutex_);
   epoch_->Ref();
+  if (options_.staging_buffer != 0) {
+    port::PthreadCall("pthread_key_create",
+                      pthread_key_create(&stage_key_, NULL));
+    open_epoch_.NoBarrier_Store(reinterpret_cast<void*>(1));  // Epoch 0
+  }
 }
 
 DirWriter::Rep::~Rep() {
@@ -87,6 +122,12 @@ DirWriter::Rep::~Rep() {
   if (data_ != NULL) {
     data_->Unref();
   }
+  if (options_.staging_buffer != 0) {
+    pthread_key_delete(stage_key_);
+    for (size_t i = 0; i < stages_.size(); i++) {
+      delete stages_[i];
+    }
+  }
 }
 
 Status DirWriter::Rep::EnsureDataPadding(LogSink* sink, size_t footer_size) {
@@ -261,6 +302,195 @@ Status DirWriter::Rep::TryAdd(Epoch* ep, const Slice& fid, const Slice& data) {
   return status;
 }
 
+// Insert a batch of data into their directory partitions. The batch is
+// first grouped by partition so each partition receives its share of the
+// batch in a single call. May be blocked due to potential lack of buffer
+// space. Return OK on success, or a non-OK status on errors.
+Status DirWriter::Rep::TryAddBatch(Epoch* ep, const Slice* fids,
+                                   const Slice* data, size_t n) {
+  mutex_.AssertHeld();
+  assert(ep->num_ongoing_ops_ != 0);
+  Status status;
+  std::vector<uint32_t> parts(n);
+  std::vector<size_t> starts(num_parts_ + 1, 0);
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t hash = Hash(fids[i].data(), fids[i].size(), 0);
+    parts[i] = hash & part_mask_;
+    assert(parts[i] < num_parts_);
+    starts[parts[i] + 1]++;
+  }
+  for (size_t i = 0; i < num_parts_; i++) {
+    starts[i + 1] += starts[i];
+  }
+  std::vector<Slice> keys(n);
+  std::vector<Slice> values(n);
+  std::vector<size_t> next(starts.begin(), starts.end() - 1);
+  for (size_t i = 0; i < n; i++) {
+    const size_t j = next[parts[i]]++;
+    keys[j] = fids[i];
+    values[j] = data[i];
+  }
+  for (size_t i = 0; i < num_parts_ && status.ok(); i++) {
+    const size_t m = starts[i + 1] - starts[i];
+    if (m != 0) {
+      status = idxers_[i]->AddBatch(ep, &keys[starts[i]], &values[starts[i]],
+                                    m);
+    }
+  }
+  return status;
+}
+
+// Validate the target epoch and insert a batch of data into it.
+// REQUIRES: mutex_ has *NOT* been locked.
+Status DirWriter::Rep::AddBatch(const Slice* fids, const Slice* data,
+                                size_t n, int epoch) {
+  Status status;
+  MutexLock ml(&mutex_);
+  while (true) {
+    if (finished_) {
+      status = Status::AssertionFailed("Plfsdir already finished");
+      break;
+    }
+    Epoch* const cur = epoch_;
+    assert(cur != NULL);
+    if (epoch == -1 && cur->committing_) {
+      cv_.Wait();
+    } else if (epoch != -1 && epoch != int(cur->seq_)) {
+      status = Status::AssertionFailed("Bad epoch num");
+      break;
+    } else if (cur->committing_) {
+      status = Status::AssertionFailed("Epoch is being flushed");
+      break;
+    } else {
+      cur->num_ongoing_ops_++;
+      status = TryAddBatch(cur, fids, data, n);
+      assert(cur->num_ongoing_ops_ != 0);
+      cur->num_ongoing_ops_--;
+      if (cur->committing_ && cur->num_ongoing_ops_ == 0) {
+        cur->cv_.SignalAll();
+      }
+      break;
+    }
+  }
+  return status;
+}
+
+// Publish an epoch as open for staged writes.
+// REQUIRES: mutex_ has been locked.
+void DirWriter::Rep::OpenEpoch(Epoch* ep) {
+  mutex_.AssertHeld();
+  if (options_.staging_buffer != 0) {
+    const uintptr_t seq = ep->seq_;
+    open_epoch_.Release_Store(reinterpret_cast<void*>(seq + 1));
+  }
+}
+
+// Stop accepting staged writes for the current epoch. Writes staged before
+// this call are still inserted into the current epoch by the next
+// DrainStages(). REQUIRES: mutex_ has been locked.
+void DirWriter::Rep::CloseEpoch() {
+  mutex_.AssertHeld();
+  if (options_.staging_buffer != 0) {
+    open_epoch_.Release_Store(NULL);
+  }
+}
+
+// Return the stage of the calling thread, creating one if necessary.
+// Stages are owned by the directory and outlive their threads so writes
+// staged by an exited thread are still flushed with their epoch.
+WriteStage* DirWriter::Rep::GetStage() {
+  WriteStage* stage =
+      reinterpret_cast<WriteStage*>(pthread_getspecific(stage_key_));
+  if (stage == NULL) {
+    stage = new WriteStage;
+    stage->buf.reserve(options_.staging_buffer);
+    port::PthreadCall("pthread_setspecific",
+                      pthread_setspecific(stage_key_, stage));
+    MutexLock ml(&mutex_);
+    stages_.push_back(stage);
+  }
+  return stage;
+}
+
+// Append a write to the calling thread's stage if the target epoch is
+// open, moving the stage into the memtable once it becomes full. Set *staged
+// to false, without staging anything, if the caller should fall back
+// to the regular write path.
+// REQUIRES: mutex_ has *NOT* been locked.
+Status DirWriter::Rep::TryStage(const Slice& fid, const Slice& data, int epoch,
+                                bool* staged) {
+  Status status;
+  WriteStage* const stage = GetStage();
+  MutexLock ml(&stage->mu);
+  // Checking the epoch while holding the stage lock ensures that a concurrent
+  // epoch flush either sees this write or makes us fall back.
+  const uintptr_t open =
+      reinterpret_cast<uintptr_t>(open_epoch_.Acquire_Load());
+  if (open == 0 || (epoch != -1 && uintptr_t(epoch) + 1 != open)) {
+    *staged = false;
+    return status;
+  }
+  assert(stage->num_entries == 0 || stage->seq + 1 == open);
+  stage->seq = static_cast<uint32_t>(open - 1);
+  PutLengthPrefixedSlice(&stage->buf, fid);
+  PutLengthPrefixedSlice(&stage->buf, data);
+  stage->num_entries++;
+  *staged = true;
+  if (stage->buf.size() >= options_.staging_buffer) {
+    status = DrainStage(stage);
+  }
+  return status;
+}
+
+// Insert all writes of a stage into the memtable of its epoch, acquiring
+// mutex_ only once for the entire batch. Staged writes are always drained
+// before their epoch is allowed to end so the epoch is still current here
+// even if it is being committed.
+// REQUIRES: stage->mu has been locked, mutex_ has *NOT* been locked.
+Status DirWriter::Rep::DrainStage(WriteStage* stage) {
+  stage->mu.AssertHeld();
+  Status status;
+  if (stage->num_entries == 0) return status;
+  MutexLock ml(&mutex_);
+  Epoch* const cur = epoch_;
+  assert(cur != NULL && cur->seq_ == stage->seq);
+  cur->num_ongoing_ops_++;
+  Slice input = stage->buf;
+  Slice fid;
+  Slice data;
+  while (status.ok() && GetLengthPrefixedSlice(&input, &fid) &&
+         GetLengthPrefixedSlice(&input, &data)) {
+    status = TryAdd(cur, fid, data);
+  }
+  assert(cur->num_ongoing_ops_ != 0);
+  cur->num_ongoing_ops_--;
+  if (cur->committing_ && cur->num_ongoing_ops_ == 0) {
+    cur->cv_.SignalAll();
+  }
+  stage->buf.clear();
+  stage->num_entries = 0;
+  return status;
+}
+
+// Drain the stages of all writer threads. May temporarily unlock mutex_.
+// REQUIRES: mutex_ has been locked.
+Status DirWriter::Rep::DrainStages() {
+  mutex_.AssertHeld();
+  Status status;
+  if (options_.staging_buffer == 0) return status;
+  std::vector<WriteStage*> stages = stages_;
+  mutex_.Unlock();  // Stage locks must be acquired before mutex_
+  for (size_t i = 0; i < stages.size(); i++) {
+    MutexLock ml(&stages[i]->mu);
+    Status s = DrainStage(stages[i]);
+    if (status.ok()) {
+      status = s;
+    }
+  }
+  mutex_.Lock();
+  return status;
+}
+
 // Attempt to schedule a minor compaction on all directory partitions
 // simultaneously. If a compaction cannot be scheduled immediately due to a lack
 // of buffer space, it will be added to a waiting list so it can be reattempted
@@ -332,10 +562,13 @@ Status DirWriter::Finish() {
       r->cv_.Wait();
     } else {
       cur->committing_ = true;
+      r->CloseEpoch();
+      status = r->DrainStages();  // May temporarily unlock
       while (cur->num_ongoing_ops_ != 0) {
         cur->cv_.Wait();
       }
-      status = r->TryFlush(cur, true /*epoch flush*/, true /*finalize*/);
+      if (status.ok())
+        status = r->TryFlush(cur, true /*epoch flush*/, true /*finalize*/);
       if (status.ok()) status = r->WaitForCompaction();
       if (status.ok()) status = r->Finalize();
       r->finish_status_ = status;
@@ -376,15 +609,18 @@ Status DirWriter::EpochFlush(int epoch) {
       break;
     } else {
       cur->committing_ = true;  // No more writing
+      r->CloseEpoch();
+      status = r->DrainStages();  // May temporarily unlock
       while (cur->num_ongoing_ops_ != 0) {
         cur->cv_.Wait();
       }
-      status = r->TryFlush(cur, true /*epoch flush*/);
+      if (status.ok()) status = r->TryFlush(cur, true /*epoch flush*/);
       if (status.ok())
         status = r->MaybeRotateLogs(cur);  // May temporarily unlock
       Epoch* const nxt = new Epoch(1 + cur->seq_, &r->mutex_);
       assert(r->epoch_ == cur);
       r->epoch_ = nxt;
+      r->OpenEpoch(nxt);
       r->cv_.SignalAll();
       cur->Unref();
       nxt->Ref();
@@ -403,6 +639,10 @@ Status DirWriter::Flush(int epoch) {
   Status status;
   Rep* const r = rep_;
   MutexLock ml(&r->mutex_);
+  status = r->DrainStages();  // May temporarily unlock
+  if (!status.ok()) {
+    return status;
+  }
   while (true) {
     if (r->finished_) {
       status = Status::AssertionFailed("Plfsdir already finished");
@@ -435,6 +675,13 @@ Status DirWriter::Flush(int epoch) {
 Status DirWriter::Add(const Slice& fid, const Slice& data, int epoch) {
   Status status;
   Rep* const r = rep_;
+  if (r->options_.staging_buffer != 0) {
+    bool staged = false;
+    status = r->TryStage(fid, data, epoch, &staged);
+    if (staged || !status.ok()) {
+      return status;
+    }
+  }
   MutexLock ml(&r->mutex_);
   while (true) {
     if (r->finished_) {
@@ -465,6 +712,35 @@ Status DirWriter::Add(const Slice& fid, const Slice& data, int epoch) {
   return status;
 }
 
+Status DirWriter::AddBatch(const Slice* fids, const Slice* data, size_t n,
+                           int epoch) {
+  return rep_->AddBatch(fids, data, n, epoch);
+}
+
+Status DirWriter::AddPacked(const Slice& records, int epoch) {
+  const DirOptions& options = rep_->options_;
+  if (!options.fixed_kv_length) {
+    return Status::AssertionFailed("Plfsdir not in fixed kv mode");
+  }
+  const size_t record_size = options.key_size + options.value_size;
+  if (records.size() % record_size != 0) {
+    return Status::InvalidArgument("Bad record size");
+  }
+  const size_t n = records.size() / record_size;
+  if (n == 0) {
+    return Status::OK();
+  }
+  std::vector<Slice> fids(n);
+  std::vector<Slice> data(n);
+  const char* p = records.data();
+  for (size_t i = 0; i < n; i++) {
+    fids[i] = Slice(p, options.key_size);
+    data[i] = Slice(p + options.key_size, options.value_size);
+    p += record_size;
+  }
+  return rep_->AddBatch(&fids[0], &data[0], n, epoch);
+}
+
 // Wait for all on-going compactions to finish.
 // Return OK on success, or a non-OK status on errors.
 Status DirWriter::Wait() {
@@ -656,6 +932,7 @@ static DirOptions SanitizeWriteOptions(const DirOptions& options) {
   ClipToRange(&result.block_size, 1 << 10, 1 << 20);
   ClipToRange(&result.block_util, 0.5, 1.0);
   ClipToRange(&result.lg_parts, 0, 8);
+  ClipToRange(&result.compaction_shards, 1, 256);
   if (result.index_buffer < result.min_index_buffer) {
     result.index_buffer = result.min_index_buffer;
   }
@@ -719,6 +996,14 @@ std::string FilterOptions(const DirOptions& options) {
       snprintf(tmp, sizeof(tmp), "BF (bits_per_key=%d)",
                int(options.bf_bits_per_key));
       return tmp;
+    case kFtBlockedBloom:
+      snprintf(tmp, sizeof(tmp), "BBF (bits_per_key=%d)",
+               int(options.bf_bits_per_key));
+      return tmp;
+    case kFtCuckoo:
+      snprintf(tmp, sizeof(tmp), "CKF (per epoch, frac=%.2f)",
+               options.cuckoo_frac);
+      return tmp;
     case kFtNoFilter:
       return "Dis";
     default:
@@ -822,6 +1107,8 @@ Status DirWriter::Open(const DirOptions& _opts, const std::string& dirname,
           100 * options.memtable_util);
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.memtable_reserv -> %.2f%%",
           100 * options.memtable_reserv);
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.staging_buffer -> %s",
+          PrettySize(options.staging_buffer).c_str());
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.leveldb_compatible -> %s",
           int(options.leveldb_compatible) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.skip_sort -> %s",
@@ -858,6 +1145,8 @@ Status DirWriter::Open(const DirOptions& _opts, const std::string& dirname,
           options.compaction_pool != NULL
               ? options.compaction_pool->ToDebugString().c_str()
               : "None");
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.compaction_shards -> %d",
+          int(options.compaction_shards));
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.compression -> %s",
           options.compression == kSnappyCompression ? "Snappy" : "None");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.index_compression -> %s",
@@ -899,6 +1188,8 @@ class DirReaderImpl : public DirReader {
 
   virtual Status Count(const CountOp& op, size_t* result);
   virtual Status Read(const ReadOp& op, const Slice& fid, std::string* dst);
+  virtual Status MultiRead(const ReadOp& op, const Slice* fids, size_t n,
+                           MultiReadSaver saver, void* arg);
   virtual Status Scan(const ScanOp& op, ScanSaver, void*);
 
   virtual IoStats TEST_iostats() const;
@@ -918,6 +1209,10 @@ class DirReaderImpl : public DirReader {
   // Lazily initialized directory partitions
   Dir** dirs_;
   LogSource* data_;
+  // Decoded index and filter blocks shared by all partitions. May be NULL.
+  Cache* index_cache_;
+  // Data blocks shared by all partitions. May be NULL.
+  Cache* data_cache_;
 };
 
 DirReaderImpl::DirReaderImpl(const DirOptions& opts, const std::string& name)
@@ -927,7 +1222,16 @@ DirReaderImpl::DirReaderImpl(const DirOptions& opts, const std::string& name)
       part_mask_(~static_cast<uint32_t>(0)),
       cond_cv_(&mutex_),
       dirs_(NULL),
-      data_(NULL) {}
+      data_(NULL),
+      index_cache_(NULL),
+      data_cache_(NULL) {
+  if (options_.index_cache_size != 0) {
+    index_cache_ = NewLRUCache(options_.index_cache_size);
+  }
+  if (options_.data_cache_size != 0) {
+    data_cache_ = NewLRUCache(options_.data_cache_size);
+  }
+}
 
 DirReaderImpl::~DirReaderImpl() {
   MutexLock ml(&mutex_);
@@ -940,6 +1244,8 @@ DirReaderImpl::~DirReaderImpl() {
   if (data_ != NULL) {
     data_->Unref();
   }
+  delete index_cache_;
+  delete data_cache_;
 }
 
 // Open a directory partition if it has not been opened before.
@@ -953,6 +1259,8 @@ Status DirReaderImpl::OpenDir(size_t part) {
     mutex_.Unlock();  // Unlock when reading dir indexes
     LogSource* indx = NULL;
     Dir* dir = new Dir(options_, &mutex_, &cond_cv_);
+    dir->InstallIndexCache(index_cache_);
+    dir->InstallDataCache(data_cache_);
     dir->Ref();
     LogSource::LogOptions idx_opts;
     idx_opts.type = kIdxIoType;
@@ -1105,6 +1413,96 @@ Status DirReaderImpl::Read(const ReadOp& op, const Slice& fid,
   return status;
 }
 
+namespace {
+struct MultiReadKeyLessThan {
+  const Slice* fids;
+
+  explicit MultiReadKeyLessThan(const Slice* f) : fids(f) {}
+
+  bool operator()(uint32_t a, uint32_t b) const { return fids[a] < fids[b]; }
+};
+}  // namespace
+
+// Perform a read operation for a set of keys. Keys are grouped by partition
+// and sorted so that each partition is read once for all its keys.
+// Return OK on success, or a non-OK status on errors.
+Status DirReaderImpl::MultiRead(const ReadOp& op, const Slice* fids, size_t n,
+                                MultiReadSaver saver, void* arg) {
+  Status status;
+  // Key indexes grouped by partition
+  std::vector<std::vector<uint32_t> > parts(num_parts_);
+  for (size_t i = 0; i < n; i++) {
+    uint32_t hash = Hash(fids[i].data(), fids[i].size(), 0);
+    parts[hash & part_mask_].push_back(static_cast<uint32_t>(i));
+  }
+  MutexLock ml(&mutex_);
+  Dir::ReadStats stats;
+  stats.total_table_seeks = 0;
+  stats.total_seeks = 0;
+
+  std::vector<Slice> keys;
+  std::string results;
+  bool stopped = false;
+  for (uint32_t part = 0; part < num_parts_ && !stopped; part++) {
+    std::vector<uint32_t>* const ids = &parts[part];
+    if (ids->empty()) {
+      continue;
+    }
+    std::sort(ids->begin(), ids->end(), MultiReadKeyLessThan(fids));
+    keys.resize(0);
+    for (size_t i = 0; i < ids->size(); i++) {
+      keys.push_back(fids[(*ids)[i]]);
+    }
+    status = OpenDir(part);
+    if (status.ok()) {
+      assert(dirs_[part] != NULL);
+      Dir* const dir = dirs_[part];
+      dir->Ref();
+      Dir::ReadOptions opts;
+      opts.epoch_start = op.epoch_start;
+      opts.epoch_end = op.epoch_end;
+      opts.force_serial_reads = op.no_parallel_reads;
+      char tmp[256];  // Temporary buffer space for the read operation
+      opts.tmp_length = sizeof(tmp);
+      opts.tmp = tmp;
+
+      results.resize(0);
+      status =
+          dir->MultiRead(opts, &keys[0], &(*ids)[0], keys.size(), &results,
+                         &stats);
+      dir->Unref();
+    }
+
+    if (!status.ok()) {
+      break;
+    }
+
+    // Report results without holding the lock
+    mutex_.Unlock();
+    Slice input = results;
+    uint32_t i;
+    Slice value;
+    while (GetVarint32(&input, &i) && GetLengthPrefixedSlice(&input, &value)) {
+      if (saver(arg, i, value) == -1) {
+        stopped = true;
+        break;
+      }
+    }
+    mutex_.Lock();
+  }
+
+  if (status.ok()) {
+    if (op.table_seeks != NULL) {
+      *op.table_seeks = stats.total_table_seeks;
+    }
+    if (op.seeks != NULL) {
+      *op.seeks = stats.total_seeks;
+    }
+  }
+
+  return status;
+}
+
 IoStats DirReaderImpl::TEST_iostats() const {
   MutexLock ml(&mutex_);
   IoStats result;
@@ -1112,6 +1510,15 @@ IoStats DirReaderImpl::TEST_iostats() const {
     if (dirs_[i] != NULL) {
       result.index_bytes += dirs_[i]->io_stats_.TotalBytes();
       result.index_ops += dirs_[i]->io_stats_.TotalOps();
+      MutexLock cl(&dirs_[i]->cache_mu_);
+      result.index_cache_hits += dirs_[i]->index_cache_hits_;
+      result.index_cache_misses += dirs_[i]->index_cache_misses_;
+      result.filter_cache_hits += dirs_[i]->filter_cache_hits_;
+      result.filter_cache_misses += dirs_[i]->filter_cache_misses_;
+      result.data_cache_hits += dirs_[i]->data_cache_hits_;
+      result.data_cache_misses += dirs_[i]->data_cache_misses_;
+      result.data_cache_bytes_saved += dirs_[i]->data_cache_bytes_saved_;
+      result.readahead_hits += dirs_[i]->readahead_hits_;
     }
   }
   result.data_bytes = io_stats_.TotalBytes();
@@ -1170,8 +1577,12 @@ static std::string FilterName(FilterType type) {
       return "Dis";
     case kFtBloomFilter:
       return "Bloom filter";
+    case kFtBlockedBloom:
+      return "Blocked bloom filter";
     case kFtBitmap:
       return "Bitmap";
+    case kFtCuckoo:
+      return "Cuckoo filter";
     default:
       return "Unk";
   }
@@ -1248,8 +1659,16 @@ Status DirReader::Open(const DirOptions& _opts, const std::string& dirname,
               : "None");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.read_size -> %s",
           PrettySize(options.read_size).c_str());
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.index_cache_size -> %s",
+          PrettySize(options.index_cache_size).c_str());
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.data_cache_size -> %s",
+          PrettySize(options.data_cache_size).c_str());
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.readahead_size -> %s",
+          PrettySize(options.readahead_size).c_str());
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.parallel_reads -> %s",
           int(options.parallel_reads) ? "Yes" : "No");
+  Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.batched_reads -> %s",
+          int(options.batched_reads) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.paranoid_checks -> %s",
           int(options.paranoid_checks) ? "Yes" : "No");
   Verbose(__LOG_ARGS__, 2, "Dfs.plfsdir.ignore_filters -> %s",
@@ -71,9 +71,29 @@ class DirWriter {
 
   // Append a piece of data to a specific file under the directory.
   // Set epoch to -1 to disable epoch validation.
+  // If options.staging_buffer is set, the data may be staged in a per-thread
+  // buffer and inserted later. Staged data is always inserted before the
+  // epoch it was written in is flushed, and errors encountered while
+  // inserting it are reported by a later call.
   // REQUIRES: Finish() has not been called.
   Status Add(const Slice& fid, const Slice& data, int epoch = -1);
 
+  // Append n pieces of data to their files under the directory. The batch
+  // is partitioned once and inserted into each memtable partition in bulk.
+  // Either all data is accepted or a non-OK status is returned, in which
+  // case a prefix of the batch may have been inserted.
+  // Set epoch to -1 to disable epoch validation.
+  // REQUIRES: Finish() has not been called.
+  Status AddBatch(const Slice* fids, const Slice* data, size_t n,
+                  int epoch = -1);
+
+  // Same as AddBatch() but takes records packed back-to-back in a
+  // single buffer, each consisting of a key_size-byte fid immediately
+  // followed by value_size bytes of data.
+  // REQUIRES: options.fixed_kv_length is true.
+  // REQUIRES: Finish() has not been called.
+  Status AddPacked(const Slice& records, int epoch = -1);
+
   // Force a memtable compaction.
   // Set epoch to -1 to disable epoch validation.
   // REQUIRES: Finish() has not been called.
@@ -144,6 +164,18 @@ class DirReader {
   // Return OK on success, or a non-OK status on errors.
   virtual Status Read(const ReadOp& op, const Slice& fid, std::string* dst) = 0;
 
+  typedef int (*MultiReadSaver)(void* arg, size_t i, const Slice& value);
+  // Obtain the values to n keys stored in a given epoch range. Keys are
+  // sorted and looked up together so that each epoch and each table is
+  // visited at most once, and keys sharing a data block are served by a
+  // single block read. For each value found, "saver" is called with the
+  // index of the key in "fids" and the value. Values of a key are reported in
+  // epoch order. Values of different keys may be interleaved. Reporting stops
+  // if "saver" returns -1. Report operation stats in *table_seeks and *seeks.
+  // Return OK on success, or a non-OK status on errors.
+  virtual Status MultiRead(const ReadOp& op, const Slice* fids, size_t n,
+                           MultiReadSaver saver, void* arg) = 0;
+
   // Default: scan all epochs and allow parallel reads
   struct ScanOp {
     ScanOp();
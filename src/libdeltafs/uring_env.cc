@@ -0,0 +1,579 @@
+/*
+ * Copyright (c) 2015-2017 Carnegie Mellon University.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#include "uring_env.h"
+
+#include "pdlfs-common/mutexlock.h"
+#include "pdlfs-common/port.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+namespace pdlfs {
+namespace uring {
+
+static Status IoUringError(const Slice& err_context, int err_number) {
+  if (err_number == ENOENT) {
+    return Status::NotFound(err_context);
+  } else if (err_number == EEXIST) {
+    return Status::AlreadyExists(err_context);
+  } else {
+    return Status::IOError(err_context, strerror(err_number));
+  }
+}
+
+// A minimal io_uring instance driven directly through system calls.
+// Not thread-safe. External synchronization is needed.
+class IoUring {
+ public:
+  IoUring()
+      : fd_(-1),
+        sq_ptr_(MAP_FAILED),
+        sq_size_(0),
+        cq_ptr_(MAP_FAILED),
+        cq_size_(0),
+        sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+        sqes_size_(0),
+        sqe_tail_(0),
+        to_submit_(0) {}
+
+  ~IoUring() { Close(); }
+
+  // Tear down the ring. The kernel cancels all requests still in flight.
+  // The ring may be opened again afterwards.
+  void Close() {
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+    sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    if (cq_ptr_ != MAP_FAILED) munmap(cq_ptr_, cq_size_);
+    cq_ptr_ = MAP_FAILED;
+    if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_size_);
+    sq_ptr_ = MAP_FAILED;
+    if (fd_ != -1) {
+      close(fd_);
+      fd_ = -1;
+    }
+    sqe_tail_ = 0;
+    to_submit_ = 0;
+  }
+
+  // Return true iff the ring has been successfully opened.
+  bool ok() const { return sqes_ != MAP_FAILED; }
+
+  // Set up the ring with at least "entries" submission queue entries.
+  Status Open(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd < 0) {
+      return IoUringError("io_uring_setup", errno);
+    }
+    fd_ = fd;
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    sq_ptr_ = mmap(NULL, sq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+      return IoUringError("mmap sq ring", errno);
+    }
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    cq_ptr_ = mmap(NULL, cq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED) {
+      return IoUringError("mmap cq ring", errno);
+    }
+    sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(
+        mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      return IoUringError("mmap sqes", errno);
+    }
+    char* const sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    char* const cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+    sq_entries_ = p.sq_entries;
+    sqe_tail_ = *sq_tail_;
+    return Status::OK();
+  }
+
+  // Return the number of submission queue entries.
+  unsigned capacity() const { return sq_entries_; }
+
+  // Return a cleared submission queue entry, or NULL if the submission
+  // queue is currently full.
+  struct io_uring_sqe* NextSqe() {
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= sq_entries_) {
+      return NULL;
+    }
+    const unsigned idx = sqe_tail_ & sq_mask_;
+    struct io_uring_sqe* const sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    sqe_tail_++;
+    to_submit_++;
+    return sqe;
+  }
+
+  // Submit all queued entries and wait for at least "wait_nr" completions.
+  // Return 0 on success, or -errno on errors.
+  int Enter(unsigned wait_nr) {
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    const unsigned flags = wait_nr != 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true) {
+      long r = syscall(__NR_io_uring_enter, fd_, to_submit_, wait_nr, flags,
+                       NULL, 0);
+      if (r >= 0) {
+        to_submit_ -= static_cast<unsigned>(r);
+        return 0;
+      } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        return -errno;
+      }
+    }
+  }
+
+  // Withdraw all entries that have been queued but not yet consumed by the
+  // kernel so that they are never submitted. Withdrawn entries are always the
+  // most recently queued ones. Return the number of entries withdrawn.
+  unsigned DiscardUnsubmitted() {
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    const unsigned n = sqe_tail_ - head;
+    sqe_tail_ = head;
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    to_submit_ = 0;
+    return n;
+  }
+
+  // Retrieve the next completion. Return false if there is none.
+  bool PopCqe(uint64_t* user_data, int* res) {
+    const unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      return false;
+    }
+    const struct io_uring_cqe* const cqe = &cqes_[head & cq_mask_];
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  int fd_;
+  void* sq_ptr_;
+  size_t sq_size_;
+  void* cq_ptr_;
+  size_t cq_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_array_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+  unsigned sqe_tail_;  // Tail of entries queued but not yet published
+  unsigned to_submit_;
+
+  // No copying allowed
+  void operator=(const IoUring&);
+  IoUring(const IoUring&);
+};
+
+// Random access file that batches the reads of a MultiRead() call into a
+// single io_uring submission. Individual reads are served by pread(2)
+// since a ring brings no benefit to them.
+class IoUringRandomAccessFile : public RandomAccessFile {
+ private:
+  std::string filename_;
+  int fd_;
+  unsigned queue_depth_;
+  mutable port::Mutex mu_;
+  mutable IoUring ring_;
+
+ public:
+  IoUringRandomAccessFile(const char* fname, int fd)
+      : filename_(fname), fd_(fd), queue_depth_(0) {}
+
+  virtual ~IoUringRandomAccessFile() { close(fd_); }
+
+  Status OpenRing(unsigned queue_depth) {
+    queue_depth_ = queue_depth;
+    return ring_.Open(queue_depth);
+  }
+
+  virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                      char* scratch) const {
+    Status s;
+    ssize_t r = pread(fd_, scratch, n, static_cast<off_t>(offset));
+    *result = Slice(scratch, static_cast<size_t>(r < 0 ? 0 : r));
+    if (r < 0) {
+      // An error: return a non-ok status
+      s = IoUringError(filename_, errno);
+    }
+    return s;
+  }
+
+  virtual void MultiRead(ReadRequest* reqs, size_t n) const {
+    MutexLock ml(&mu_);
+    std::vector<char> done(n, 0);
+    size_t next = 0;  // Next request to submit
+    size_t inflight = 0;
+    int r = ring_.ok() ? 0 : -EBADF;
+    while (r == 0 && (next < n || inflight != 0)) {
+      struct io_uring_sqe* sqe;
+      // Never keep more reads in flight than the completion queue can hold
+      while (next < n && inflight < ring_.capacity() &&
+             (sqe = ring_.NextSqe()) != NULL) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uintptr_t>(reqs[next].scratch);
+        sqe->len = static_cast<uint32_t>(reqs[next].n);
+        sqe->off = reqs[next].offset;
+        sqe->user_data = next;
+        next++;
+        inflight++;
+      }
+      r = ring_.Enter(1);
+      if (r < 0) {
+        // Take back the reads the kernel has not consumed so that the next
+        // call never submits them against buffers we no longer own. These
+        // are always the most recently queued requests.
+        const unsigned k = ring_.DiscardUnsubmitted();
+        assert(k <= inflight);
+        next -= k;
+        inflight -= k;
+      }
+      Reap(reqs, &done[0], &inflight);
+    }
+    if (r < 0) {
+      // Reads already submitted still target the callers' buffers, so they
+      // must all complete before we return
+      while (inflight != 0) {
+        if (ring_.Enter(1) < 0) {
+          // Closing the ring cancels the remaining reads. Reopen it for the
+          // calls that follow, which fall back to pread(2) if this fails.
+          ring_.Close();
+          if (!ring_.Open(queue_depth_).ok()) {
+            ring_.Close();
+          }
+          inflight = 0;
+          break;
+        }
+        Reap(reqs, &done[0], &inflight);
+      }
+      // Serve all requests never submitted synchronously and fail those
+      // whose reads were lost
+      for (; next < n; next++) {
+        reqs[next].status = Read(reqs[next].offset, reqs[next].n,
+                                 &reqs[next].result, reqs[next].scratch);
+        done[next] = 1;
+      }
+      for (size_t i = 0; i < n; i++) {
+        if (!done[i]) {
+          reqs[i].result = Slice();
+          reqs[i].status = IoUringError(filename_, -r);
+        }
+      }
+    }
+  }
+
+ private:
+  // Process all available completions.
+  void Reap(ReadRequest* reqs, char* done, size_t* inflight) const {
+    uint64_t id;
+    int res;
+    while (ring_.PopCqe(&id, &res)) {
+      ReadRequest* const req = &reqs[id];
+      done[id] = 1;
+      if (res == -EINVAL || res == -EOPNOTSUPP) {
+        // The kernel does not support the read opcode
+        req->status = Read(req->offset, req->n, &req->result, req->scratch);
+      } else if (res < 0) {
+        req->result = Slice();
+        req->status = IoUringError(filename_, -res);
+      } else if (res != 0 && static_cast<size_t>(res) < req->n) {
+        // Short read: fetch the remainder synchronously
+        Slice rest;
+        req->status =
+            Read(req->offset + res, req->n - res, &rest, req->scratch + res);
+        req->result = Slice(req->scratch, res + rest.size());
+      } else {
+        req->result = Slice(req->scratch, res);
+        req->status = Status::OK();
+      }
+      assert(*inflight != 0);
+      (*inflight)--;
+    }
+  }
+};
+
+// Append-only file that submits each flushed buffer as an asynchronous write
+// at an explicit file offset. At most "queue_depth" writes are in flight at
+// any time. Errors reported by asynchronous writes are sticky and are
+// returned by the next Append(), Flush(), Sync(), or Close().
+// Not thread-safe. External synchronization is needed.
+class IoUringWritableFile : public WritableFile {
+ private:
+  // Data appended since the last flush will be submitted as soon as it
+  // reaches this size.
+  static const size_t kMaxBufferedBytes = 1 << 20;
+
+  std::string filename_;
+  int fd_;
+  uint64_t offset_;  // File offset of the next write
+  std::string buf_;  // Data appended but not yet submitted
+  // Data and file offsets of writes submitted but not yet completed,
+  // indexed by slot #
+  std::vector<std::string> bufs_;
+  std::vector<uint64_t> offs_;
+  std::vector<size_t> free_slots_;
+  size_t num_inflight_;
+  Status status_;
+  IoUring ring_;
+
+  // Complete the write at a given slot.
+  void Finish(size_t slot, int res) {
+    std::string* const buf = &bufs_[slot];
+    if (res < 0) {
+      if (status_.ok()) {
+        status_ = IoUringError(filename_, -res);
+      }
+    } else if (static_cast<size_t>(res) < buf->size()) {
+      // Short write: write the remainder synchronously
+      const char* p = buf->data() + res;
+      size_t left = buf->size() - res;
+      uint64_t off = offs_[slot] + res;
+      while (left != 0 && status_.ok()) {
+        ssize_t nw = pwrite(fd_, p, left, static_cast<off_t>(off));
+        if (nw < 0) {
+          if (errno != EINTR) status_ = IoUringError(filename_, errno);
+        } else {
+          p += nw;
+          off += nw;
+          left -= nw;
+        }
+      }
+    }
+    buf->clear();
+    free_slots_.push_back(slot);
+    assert(num_inflight_ != 0);
+    num_inflight_--;
+  }
+
+  // Reap completions, waiting until at least "min" writes have completed
+  // or no more writes are in flight.
+  Status Reap(size_t min) {
+    size_t reaped = 0;
+    while (true) {
+      uint64_t id;
+      int res;
+      while (ring_.PopCqe(&id, &res)) {
+        Finish(static_cast<size_t>(id), res);
+        reaped++;
+      }
+      if (reaped >= min || num_inflight_ == 0) {
+        break;
+      }
+      int r = ring_.Enter(1);
+      if (r < 0) {
+        return IoUringError(filename_, -r);
+      }
+    }
+    return status_;
+  }
+
+  // Submit buffered data as an asynchronous write.
+  Status Submit() {
+    Status s = status_;
+    if (!s.ok() || buf_.empty()) {
+      return s;
+    }
+    while (s.ok() && free_slots_.empty()) {
+      s = Reap(1);
+    }
+    struct io_uring_sqe* sqe = NULL;
+    while (s.ok() && (sqe = ring_.NextSqe()) == NULL) {
+      s = Reap(1);
+    }
+    if (s.ok()) {
+      const size_t slot = free_slots_.back();
+      free_slots_.pop_back();
+      bufs_[slot].swap(buf_);
+      offs_[slot] = offset_;
+      sqe->opcode = IORING_OP_WRITE;
+      sqe->fd = fd_;
+      sqe->addr = reinterpret_cast<uintptr_t>(bufs_[slot].data());
+      sqe->len = static_cast<uint32_t>(bufs_[slot].size());
+      sqe->off = offset_;
+      sqe->user_data = slot;
+      offset_ += bufs_[slot].size();
+      num_inflight_++;
+      int r = ring_.Enter(0);
+      if (r < 0) {
+        s = IoUringError(filename_, -r);
+      } else {
+        s = Reap(0);
+      }
+    }
+    return s;
+  }
+
+ public:
+  IoUringWritableFile(const char* fname, int fd, unsigned queue_depth)
+      : filename_(fname),
+        fd_(fd),
+        offset_(0),
+        bufs_(queue_depth),
+        offs_(queue_depth),
+        num_inflight_(0) {
+    for (size_t i = 0; i < queue_depth; i++) {
+      free_slots_.push_back(queue_depth - 1 - i);
+    }
+  }
+
+  virtual ~IoUringWritableFile() {
+    if (fd_ != -1) {
+      Close();  // Ignoring any potential errors
+    }
+    // The kernel may still be reading from bufs_ and writing to fd_. Neither
+    // they nor the ring may be released before all writes complete. If the
+    // ring can no longer be waited on, tear it down so that the kernel
+    // cancels whatever is still in flight.
+    while (num_inflight_ != 0) {
+      if (!Reap(num_inflight_).ok() && num_inflight_ != 0) {
+        ring_.Close();
+        num_inflight_ = 0;
+      }
+    }
+    if (fd_ != -1) {
+      close(fd_);
+    }
+  }
+
+  Status OpenRing(unsigned queue_depth) { return ring_.Open(queue_depth); }
+
+  virtual Status Append(const Slice& data) {
+    if (!status_.ok()) {
+      return status_;
+    }
+    buf_.append(data.data(), data.size());
+    if (buf_.size() >= kMaxBufferedBytes) {
+      return Submit();
+    } else {
+      return Status::OK();
+    }
+  }
+
+  virtual Status Flush() { return Submit(); }
+
+  virtual Status Sync() {
+    Status s = Submit();
+    if (s.ok()) {
+      s = Reap(num_inflight_);
+    }
+    if (s.ok()) {
+      if (fdatasync(fd_) != 0) {
+        s = IoUringError(filename_, errno);
+      }
+    }
+    return s;
+  }
+
+  virtual Status Close() {
+    Status s = Submit();
+    Status r = Reap(num_inflight_);
+    if (s.ok()) s = r;
+    if (num_inflight_ == 0) {  // Never close a file with writes in flight
+      close(fd_);
+      fd_ = -1;
+    }
+    return s;
+  }
+};
+
+class IoUringEnv : public EnvWrapper {
+ private:
+  unsigned queue_depth_;
+
+ public:
+  IoUringEnv(Env* base, unsigned queue_depth)
+      : EnvWrapper(base), queue_depth_(queue_depth) {}
+
+  virtual ~IoUringEnv() {}
+
+  virtual Status NewRandomAccessFile(const char* fname, RandomAccessFile** r) {
+    *r = NULL;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+      return IoUringError(fname, errno);
+    }
+    IoUringRandomAccessFile* f = new IoUringRandomAccessFile(fname, fd);
+    Status s = f->OpenRing(queue_depth_);
+    if (s.ok()) {
+      *r = f;
+    } else {
+      delete f;
+    }
+    return s;
+  }
+
+  virtual Status NewWritableFile(const char* fname, WritableFile** r) {
+    *r = NULL;
+    int fd = open(fname, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+      return IoUringError(fname, errno);
+    }
+    IoUringWritableFile* f = new IoUringWritableFile(fname, fd, queue_depth_);
+    Status s = f->OpenRing(queue_depth_);
+    if (s.ok()) {
+      *r = f;
+    } else {
+      delete f;
+    }
+    return s;
+  }
+};
+
+Status IoUringInit(Env** result, Env* base, unsigned queue_depth) {
+  *result = NULL;
+  if (queue_depth == 0) {
+    queue_depth = 64;
+  }
+  // Fail early if io_uring is not available on this system
+  IoUring probe;
+  Status s = probe.Open(queue_depth);
+  if (!s.ok()) {
+    return Status::NotSupported("io_uring", s.ToString());
+  }
+  *result = new IoUringEnv(base, queue_depth);
+  return s;
+}
+
+}  // namespace uring
+}  // namespace pdlfs
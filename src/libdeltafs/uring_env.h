@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2015-2017 Carnegie Mellon University.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#pragma once
+
+#include "pdlfs-common/env.h"
+#include "pdlfs-common/status.h"
+
+namespace pdlfs {
+namespace uring {
+
+// Factory method
+
+// Create a new Env that performs file I/O through Linux io_uring. Writable
+// files submit each flushed buffer as an asynchronous write and only wait for
+// completions when the queue is full or on Sync() and Close(). Random access
+// files submit all reads of a MultiRead() call with a single system call and
+// reap their completions together. All other operations are forwarded to
+// "base", which must remain alive for as long as the new Env is in use.
+// "queue_depth" bounds the number of outstanding I/O requests per file.
+// The result should be deleted when it is no longer needed.
+extern Status IoUringInit(Env** result, Env* base, unsigned queue_depth);
+
+}  // namespace uring
+}  // namespace pdlfs
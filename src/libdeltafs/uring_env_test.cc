@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2015-2017 Carnegie Mellon University.
+ *
+ * All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. See the AUTHORS file for names of contributors.
+ */
+
+#include "uring_env.h"
+
+#include "plfsio/v1/deltafs_plfsio_types.h"
+#include "plfsio/v1/deltafs_plfsio_v1.h"
+
+#include "pdlfs-common/testharness.h"
+#include "pdlfs-common/testutil.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace pdlfs {
+namespace uring {
+
+class IoUringEnvTest {
+ public:
+  IoUringEnvTest() {
+    dirname_ = test::TmpDir() + "/uring_env_test";
+    Env::Default()->CreateDir(dirname_.c_str());
+    ASSERT_OK(IoUringInit(&env_, Env::Default(), 8));
+  }
+
+  ~IoUringEnvTest() { delete env_; }
+
+  std::string dirname_;
+  Env* env_;
+};
+
+TEST(IoUringEnvTest, AppendAndRead) {
+  const std::string fname = dirname_ + "/a";
+  WritableFile* file;
+  ASSERT_OK(env_->NewWritableFile(fname.c_str(), &file));
+  std::string expected;
+  char tmp[20];
+  // Issue more flushes than the queue can hold
+  for (int i = 0; i < 100; i++) {
+    snprintf(tmp, sizeof(tmp), "%08d", i);
+    ASSERT_OK(file->Append(tmp));
+    ASSERT_OK(file->Append(tmp));
+    ASSERT_OK(file->Flush());
+    expected += tmp;
+    expected += tmp;
+  }
+  ASSERT_OK(file->Sync());
+  ASSERT_OK(file->Close());
+  delete file;
+  std::string contents;
+  ASSERT_OK(ReadFileToString(Env::Default(), fname.c_str(), &contents));
+  ASSERT_EQ(contents, expected);
+}
+
+TEST(IoUringEnvTest, MultiRead) {
+  const std::string fname = dirname_ + "/b";
+  std::string data;
+  for (int i = 0; i < 4096; i++) {
+    data.push_back(static_cast<char>('a' + i % 26));
+  }
+  ASSERT_OK(WriteStringToFile(Env::Default(), data, fname.c_str()));
+  RandomAccessFile* file;
+  ASSERT_OK(env_->NewRandomAccessFile(fname.c_str(), &file));
+  // Issue more reads than the queue can hold
+  const size_t n = 50;
+  std::vector<ReadRequest> reqs(n);
+  std::string space(n * 100, 0);
+  for (size_t i = 0; i < n; i++) {
+    reqs[i].offset = (i * 997) % data.size();
+    reqs[i].n = 100;
+    reqs[i].scratch = &space[i * 100];
+  }
+  file->MultiRead(&reqs[0], n);
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_OK(reqs[i].status);
+    const size_t size = std::min<size_t>(100, data.size() - reqs[i].offset);
+    ASSERT_EQ(reqs[i].result.ToString(), data.substr(reqs[i].offset, size));
+  }
+  // Reads beyond the end of the file return empty results
+  ReadRequest eof;
+  eof.offset = data.size() + 1;
+  eof.n = 10;
+  eof.scratch = &space[0];
+  file->MultiRead(&eof, 1);
+  ASSERT_OK(eof.status);
+  ASSERT_TRUE(eof.result.empty());
+  delete file;
+}
+
+TEST(IoUringEnvTest, PlfsDir) {
+  using namespace plfsio;
+  const std::string dirname = dirname_ + "/plfsdir";
+  DirOptions options;
+  options.env = env_;
+  options.batched_reads = true;
+  options.epoch_log_rotation = true;
+  options.verify_checksums = true;
+  DestroyDir(dirname, options);
+  DirWriter* writer;
+  ASSERT_OK(DirWriter::Open(options, dirname, &writer));
+  char key[20];
+  for (int epoch = 0; epoch < 4; epoch++) {
+    for (int i = 0; i < 1000; i++) {
+      snprintf(key, sizeof(key), "k%06d", i);
+      ASSERT_OK(writer->Add(key, std::string(1, 'a' + epoch), epoch));
+    }
+    ASSERT_OK(writer->EpochFlush(epoch));
+  }
+  ASSERT_OK(writer->Finish());
+  delete writer;
+  DirReader* reader;
+  ASSERT_OK(DirReader::Open(options, dirname, &reader));
+  for (int i = 0; i < 1000; i += 37) {
+    snprintf(key, sizeof(key), "k%06d", i);
+    std::string dst;
+    size_t seeks = 0;
+    DirReader::ReadOp op;
+    op.seeks = &seeks;
+    ASSERT_OK(reader->Read(op, key, &dst));
+    ASSERT_EQ(dst, "abcd");
+    ASSERT_EQ(seeks, 4);
+  }
+  delete reader;
+}
+
+}  // namespace uring
+}  // namespace pdlfs
+
+int main(int argc, char* argv[]) {
+  return pdlfs::test::RunAllTests(&argc, &argv);
+}